@@ -0,0 +1,145 @@
+#include "BakedMesh.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+// The Windows SDK headers stop at OpenGL 1.1, so buffer objects come from glutGetProcAddress
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STATIC_DRAW 0x88E4
+#endif
+
+typedef void (APIENTRY *GenBuffersProc)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRY *DeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+typedef void (APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+
+static GenBuffersProc genBuffers = NULL;
+static DeleteBuffersProc deleteBuffers = NULL;
+static BindBufferProc bindBuffer = NULL;
+static BufferDataProc bufferData = NULL;
+static bool hasBuffers = false;
+
+bool initBufferObjects()
+{
+	// Some drivers hand out pointers for functions they don't support, so check the version too
+	int major = 0, minor = 0;
+	const char* version = (const char*)glGetString(GL_VERSION);
+	if (version == NULL || sscanf(version, "%d.%d", &major, &minor) != 2 || major * 10 + minor < 15)
+	{
+		printf("GL %s has no buffer objects, drawing from client memory\n", version ? version : "?");
+		return false;
+	}
+
+	genBuffers = (GenBuffersProc)glutGetProcAddress("glGenBuffers");
+	deleteBuffers = (DeleteBuffersProc)glutGetProcAddress("glDeleteBuffers");
+	bindBuffer = (BindBufferProc)glutGetProcAddress("glBindBuffer");
+	bufferData = (BufferDataProc)glutGetProcAddress("glBufferData");
+	hasBuffers = genBuffers && deleteBuffers && bindBuffer && bufferData;
+	return hasBuffers;
+}
+
+void initBatch(BakedBatch& batch, GLenum mode, float r, float g, float b)
+{
+	batch.mode = mode;
+	batch.color[0] = r;
+	batch.color[1] = g;
+	batch.color[2] = b;
+	batch.count = 0;
+	batch.vertexBuffer = 0;
+	batch.indexBuffer = 0;
+}
+
+void clearBatch(BakedBatch& batch)
+{
+	batch.vertices.clear();
+	batch.indices.clear();
+	batch.count = 0;
+}
+
+void uploadBatch(BakedBatch& batch)
+{
+	batch.count = (GLsizei)batch.indices.size();
+	if (!hasBuffers)
+	{
+		return;
+	}
+
+	if (batch.vertexBuffer == 0)
+	{
+		genBuffers(1, &batch.vertexBuffer);
+		genBuffers(1, &batch.indexBuffer);
+	}
+	bindBuffer(GL_ARRAY_BUFFER, batch.vertexBuffer);
+	bufferData(GL_ARRAY_BUFFER, batch.vertices.size() * sizeof(GLfloat), batch.vertices.data(), GL_STATIC_DRAW);
+	bindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.indexBuffer);
+	bufferData(GL_ELEMENT_ARRAY_BUFFER, batch.indices.size() * sizeof(GLuint), batch.indices.data(), GL_STATIC_DRAW);
+	bindBuffer(GL_ARRAY_BUFFER, 0);
+	bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	// The GPU has its own copy now
+	std::vector<GLfloat>().swap(batch.vertices);
+	std::vector<GLuint>().swap(batch.indices);
+}
+
+void streamBatch(BakedBatch& batch)
+{
+	batch.count = (GLsizei)batch.indices.size();
+}
+
+void drawBatch(const BakedBatch& batch)
+{
+	GLuint first = 0;
+	drawBatchRanges(batch, &first, &batch.count, 1);
+}
+
+void drawBatchRanges(const BakedBatch& batch, const GLuint* firsts, const GLsizei* counts, int ranges)
+{
+	if (batch.count == 0 || ranges == 0)
+	{
+		return;
+	}
+
+	// With buffers bound the pointers are offsets into them
+	const GLfloat* vertices = batch.vertices.data();
+	const GLuint* indices = batch.indices.data();
+	bool buffered = hasBuffers && batch.vertexBuffer != 0;
+	if (buffered)
+	{
+		bindBuffer(GL_ARRAY_BUFFER, batch.vertexBuffer);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.indexBuffer);
+		vertices = NULL;
+		indices = NULL;
+	}
+
+	glColor3f(batch.color[0], batch.color[1], batch.color[2]);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 6 * sizeof(GLfloat), vertices);
+	glNormalPointer(GL_FLOAT, 6 * sizeof(GLfloat), vertices + 3);
+	for (int i = 0; i < ranges; i++)
+	{
+		glDrawElements(batch.mode, counts[i], GL_UNSIGNED_INT, indices + firsts[i]);
+	}
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+	if (buffered)
+	{
+		bindBuffer(GL_ARRAY_BUFFER, 0);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+}
+
+void deleteBatch(BakedBatch& batch)
+{
+	if (hasBuffers && batch.vertexBuffer != 0)
+	{
+		deleteBuffers(1, &batch.vertexBuffer);
+		deleteBuffers(1, &batch.indexBuffer);
+	}
+	batch.vertexBuffer = 0;
+	batch.indexBuffer = 0;
+	clearBatch(batch);
+}
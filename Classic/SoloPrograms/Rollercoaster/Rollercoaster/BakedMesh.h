@@ -0,0 +1,38 @@
+#ifndef BAKED_MESH_H
+#define BAKED_MESH_H
+
+#include <vector>
+
+#include "GL/freeglut.h"
+
+// Static geometry of one material, transformed to world space once and kept in buffer objects
+struct BakedBatch
+{
+	GLenum mode; // GL_TRIANGLES or GL_LINES
+	float color[3];
+	std::vector<GLfloat> vertices; // Position then normal, 6 floats a vertex
+	std::vector<GLuint> indices;
+	GLsizei count; // Indices drawn, still known once the arrays are freed after upload
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+};
+
+// Loads the GL 1.5 buffer object functions, returns false if the driver lacks them.
+// Batches then stay in client memory and are drawn from plain vertex arrays
+bool initBufferObjects();
+
+void initBatch(BakedBatch& batch, GLenum mode, float r, float g, float b);
+// Empties the batch for a rebake, keeping its buffer objects
+void clearBatch(BakedBatch& batch);
+// Moves the baked arrays into the batch's buffer objects
+void uploadBatch(BakedBatch& batch);
+// Draws the batch from its arrays in client memory, for geometry rebuilt every frame that
+// would only be drawn once from a buffer
+void streamBatch(BakedBatch& batch);
+// Draws the whole batch in one call
+void drawBatch(const BakedBatch& batch);
+// Draws ranges of the batch's indices, each counts[i] long from firsts[i], binding it once
+void drawBatchRanges(const BakedBatch& batch, const GLuint* firsts, const GLsizei* counts, int ranges);
+void deleteBatch(BakedBatch& batch);
+
+#endif
@@ -0,0 +1,243 @@
+#include "CartFleet.h"
+
+#include <math.h>
+
+#define GRAVITY 9.8f
+#define DRAG 0.002f // Slowing per unit of speed squared
+#define DRIVE_ACCELERATION 2.0f // Drive tyres bringing a standing train up to speed
+#define BRAKE_DECELERATION 4.0f
+#define STOP_TOLERANCE 0.001f // Closer than this to a station counts as standing at it
+#define PARALLEL_TRAINS 256 // Fewer trains than this are stepped on the calling thread
+#define JOBS_PER_THREAD 4
+
+#define CART_HALF_WIDTH 0.6f
+#define CART_FLOOR 0.15f // Above the rails
+#define CART_TOP 0.75f
+#define CART_HALF_LENGTH 0.8f
+#define CART_RADIUS 1.2f // Bounding sphere about the cart's origin
+
+CartFleet::CartFleet()
+{
+	drawn = 0;
+	track = NULL;
+	length = 1.0f;
+	trainsPerLine = 1;
+	cartsPerTrain = 1;
+	blockLength = 1.0f;
+	stationStart = 0.0f;
+	stationGap = 0.0f;
+	dwellTime = 0.0f;
+	driveSpeed = 0.0f;
+}
+
+void CartFleet::init(const TrackSpline* track, int lines, int trainsPerLine, int cartsPerTrain, float start,
+	float blockLength, float stationGap, float dwellTime)
+{
+	this->track = track;
+	length = track->length();
+	this->trainsPerLine = trainsPerLine;
+	this->cartsPerTrain = cartsPerTrain;
+	this->blockLength = blockLength;
+	stationStart = start;
+	this->stationGap = stationGap;
+	this->dwellTime = dwellTime;
+
+	int trains = lines * trainsPerLine;
+	fronts.resize(trains);
+	nextFronts.resize(trains);
+	speeds.assign(trains, 0.0f);
+	slopes.resize(trains);
+	dwells.assign(trains, 0.0f);
+	stations.resize(trains);
+	matrices.resize((size_t)trains * cartsPerTrain * 16);
+
+	int stationCount = stationGap > 0.0f ? (int)ceilf((length - start) / stationGap) : 0;
+	for (int train = 0; train < trains; train++)
+	{
+		fronts[train] = wrap(start + (train % trainsPerLine) * length / trainsPerLine);
+
+		// Trains set off straight away, so the first stop is the next station ahead
+		int station = stationGap > 0.0f ? (int)floorf((fronts[train] - start) / stationGap + STOP_TOLERANCE) + 1 : 0;
+		stations[train] = station >= 0 && station < stationCount ? station : 0;
+		placeCarts(train, fronts[train]);
+	}
+}
+
+float CartFleet::wrap(float distance) const
+{
+	distance = fmodf(distance, length);
+	return distance < 0.0f ? distance + length : distance;
+}
+
+float CartFleet::ahead(float a, float b) const
+{
+	return wrap(b - a);
+}
+
+void CartFleet::stepTrain(int train, float dt)
+{
+	float front = fronts[train];
+	if (dwells[train] > 0.0f)
+	{
+		dwells[train] = fmaxf(dwells[train] - dt, 0.0f);
+		speeds[train] = 0.0f;
+		nextFronts[train] = front;
+		return;
+	}
+
+	// Gravity pulls along the track and drag against the motion, while the tyres bring slow
+	// trains up to the drive speed and hold them there up hills
+	float speed = speeds[train] + (-GRAVITY * slopes[train] - DRAG * speeds[train] * speeds[train]) * dt;
+	speed = fmaxf(speed, fminf(driveSpeed, speeds[train] + DRIVE_ACCELERATION * dt));
+
+	// Room to the next station, a lap away when that is the one it stands at, and to the block
+	// holding the last cart of the train ahead as it stood before this step. A train already in
+	// that block has no room at all
+	float toStation = 1e30f;
+	if (stationGap > 0.0f)
+	{
+		toStation = ahead(front, stationStart + stations[train] * stationGap);
+		toStation += toStation < STOP_TOLERANCE ? length : 0.0f;
+	}
+	float room = toStation;
+	if (trainsPerLine > 1)
+	{
+		int first = train - train % trainsPerLine;
+		int next = first + (train - first + 1) % trainsPerLine;
+		float nose = front + 0.5f * CART_SPACING;
+		float tail = wrap(fronts[next] - (cartsPerTrain - 0.5f) * CART_SPACING);
+		float toTail = ahead(nose, tail);
+		float toBlock = ahead(nose, floorf(tail / blockLength) * blockLength);
+		room = fminf(room, toBlock <= toTail ? toBlock : 0.0f);
+	}
+
+	// Brake so as to stop within the room, then arrive at the station if that's where it ends
+	speed = fminf(speed, sqrtf(2.0f * BRAKE_DECELERATION * room));
+	float move = fminf(speed * dt, room);
+	if (toStation - move < STOP_TOLERANCE)
+	{
+		int stationCount = (int)ceilf((length - stationStart) / stationGap);
+		stations[train] = (stations[train] + 1) % stationCount;
+		dwells[train] = dwellTime;
+		speed = 0.0f;
+	}
+	nextFronts[train] = wrap(front + move);
+	speeds[train] = speed;
+}
+
+void CartFleet::placeCarts(int train, float front)
+{
+	TrackFrame frame;
+	for (int cart = 0; cart < cartsPerTrain; cart++)
+	{
+		track->evaluate(wrap(front - cart * CART_SPACING), frame);
+		frameMatrix(frame, &matrices[((size_t)train * cartsPerTrain + cart) * 16]);
+		if (cart == 0)
+		{
+			slopes[train] = frame.tangent[1];
+		}
+	}
+}
+
+void CartFleet::step(float dt, ThreadPool& pool)
+{
+	int count = trainCount();
+	int jobs = count < PARALLEL_TRAINS ? 1 : pool.size() * JOBS_PER_THREAD;
+	auto job = [&](int j)
+	{
+		for (int train = count * j / jobs; train < count * (j + 1) / jobs; train++)
+		{
+			stepTrain(train, dt);
+			placeCarts(train, nextFronts[train]);
+		}
+	};
+	if (jobs == 1)
+	{
+		job(0);
+	}
+	else
+	{
+		pool.parallelFor(jobs, job);
+	}
+	fronts.swap(nextFronts);
+}
+
+void CartFleet::initDrawing(float r, float g, float b)
+{
+	// A box on the rails, with each face's corners counterclockwise from outside
+	static const int FACES[6][4] =
+	{
+		{ 0, 1, 1, 2 }, { 0, -1, 2, 1 },
+		{ 1, 1, 2, 0 }, { 1, -1, 0, 2 },
+		{ 2, 1, 0, 1 }, { 2, -1, 1, 0 }
+	};
+	const float centre[3] = { 0.0f, 0.5f * (CART_FLOOR + CART_TOP), 0.0f };
+	const float half[3] = { CART_HALF_WIDTH, 0.5f * (CART_TOP - CART_FLOOR), CART_HALF_LENGTH };
+
+	meshVertices.clear();
+	meshIndices.clear();
+	for (int face = 0; face < 6; face++)
+	{
+		int axis = FACES[face][0];
+		float sign = (float)FACES[face][1];
+		int u = FACES[face][2];
+		int v = FACES[face][3];
+		for (int corner = 0; corner < 4; corner++)
+		{
+			GLfloat vertex[6] = { centre[0], centre[1], centre[2], 0.0f, 0.0f, 0.0f };
+			vertex[axis] += sign * half[axis];
+			vertex[u] += (corner == 1 || corner == 2) ? half[u] : -half[u];
+			vertex[v] += corner >= 2 ? half[v] : -half[v];
+			vertex[3 + axis] = sign;
+			meshVertices.insert(meshVertices.end(), vertex, vertex + 6);
+		}
+
+		GLuint first = face * 4;
+		const GLuint quad[6] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+		meshIndices.insert(meshIndices.end(), quad, quad + 6);
+	}
+
+	initBatch(batch, GL_TRIANGLES, r, g, b);
+}
+
+void CartFleet::draw(const float* matrices, int count, const Frustum& frustum, int hidden)
+{
+	clearBatch(batch);
+	drawn = 0;
+	for (int cart = 0; cart < count; cart++)
+	{
+		const float* m = &matrices[cart * 16];
+		bool visible = cart != hidden;
+		for (int p = 0; p < 6 && visible; p++)
+		{
+			const float* plane = frustum.planes[p];
+			visible = plane[0] * m[12] + plane[1] * m[13] + plane[2] * m[14] + plane[3] >= -CART_RADIUS;
+		}
+		if (!visible)
+		{
+			continue;
+		}
+
+		// The cart's matrix only turns and moves it, so it turns normals as it is
+		GLuint base = (GLuint)(batch.vertices.size() / 6);
+		for (size_t i = 0; i < meshVertices.size(); i += 6)
+		{
+			const GLfloat* in = &meshVertices[i];
+			GLfloat out[6];
+			for (int k = 0; k < 3; k++)
+			{
+				out[k] = m[k] * in[0] + m[4 + k] * in[1] + m[8 + k] * in[2] + m[12 + k];
+				out[3 + k] = m[k] * in[3] + m[4 + k] * in[4] + m[8 + k] * in[5];
+			}
+			batch.vertices.insert(batch.vertices.end(), out, out + 6);
+		}
+		for (GLuint index : meshIndices)
+		{
+			batch.indices.push_back(base + index);
+		}
+		drawn++;
+	}
+
+	streamBatch(batch);
+	drawBatch(batch);
+}
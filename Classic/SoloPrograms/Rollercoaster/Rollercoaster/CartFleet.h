@@ -0,0 +1,85 @@
+#ifndef CART_FLEET_H
+#define CART_FLEET_H
+
+#include <vector>
+
+#include "BakedMesh.h"
+#include "ChunkBVH.h"
+#include "ThreadPool.h"
+#include "TrackSpline.h"
+
+#define CART_SPACING 2.2f // Between the centres of neighbouring carts in a train
+
+// Trains of carts riding a track as a loop, each line of them on its own copy of the track.
+// Gravity along the track speeds trains up and slows them down, drive tyres keep them at
+// least at the drive speed, and they brake to stop at every station for a dwell and short
+// of any block section still holding the train ahead.
+// State is kept one array per field, per train for the physics and per cart for the matrices
+// they are drawn with. A step reads where every train was and writes where it is now, so the
+// trains can be shared across the pool in chunks and move the same for any number of threads
+class CartFleet
+{
+	public:
+		CartFleet();
+
+		// Spreads trains evenly around each of lines copies of track, with the first train's front
+		// cart at start. Stations stand stationGap apart from start, and blocks are blockLength long
+		void init(const TrackSpline* track, int lines, int trainsPerLine, int cartsPerTrain, float start,
+			float blockLength, float stationGap, float dwellTime);
+		// Speed the drive tyres hold trains to
+		void setDriveSpeed(float speed) { driveSpeed = speed; }
+
+		// Advances every train by dt seconds, then places every cart
+		void step(float dt, ThreadPool& pool);
+
+		int trainCount() const { return (int)fronts.size(); }
+		int cartCount() const { return (int)fronts.size() * cartsPerTrain; }
+		// Distance of a train's front cart along the track
+		float front(int train) const { return fronts[train]; }
+		float speed(int train) const { return speeds[train]; }
+		// Cart i's matrix, column-major, taking the cart's own space to where it is on the track
+		const float* cartMatrix(int cart) const { return &matrices[cart * 16]; }
+
+		// Draws count carts placed by matrices, laid out as cartMatrix() lays them, skipping hidden
+		// and any outside frustum. Carts are copied out of one cart mesh into a single array as
+		// PillarLOD does. Taking the matrices rather than reading the fleet's own lets another
+		// thread step the fleet while carts are drawn where they were
+		void initDrawing(float r, float g, float b);
+		void draw(const float* matrices, int count, const Frustum& frustum, int hidden);
+		int drawn; // Carts drawn last frame
+
+	private:
+		const TrackSpline* track;
+		float length; // Of the loop
+		int trainsPerLine;
+		int cartsPerTrain;
+		float blockLength;
+		float stationStart;
+		float stationGap;
+		float dwellTime;
+		float driveSpeed;
+
+		// Per train
+		std::vector<float> fronts;
+		std::vector<float> nextFronts; // Written by a step, then swapped with fronts
+		std::vector<float> speeds;
+		std::vector<float> slopes; // Rise of the track under the front cart, saved when it is placed
+		std::vector<float> dwells; // Seconds left standing at a station, 0 once running
+		std::vector<int> stations; // Index of the next station to stop at
+
+		// Per cart
+		std::vector<float> matrices; // 16 floats each
+
+		std::vector<GLfloat> meshVertices; // One cart in its own space
+		std::vector<GLuint> meshIndices;
+		BakedBatch batch; // Rebuilt every frame
+
+		// Distance brought into [0, length)
+		float wrap(float distance) const;
+		// Distance from a to b going forward round the loop
+		float ahead(float a, float b) const;
+		void stepTrain(int train, float dt);
+		void placeCarts(int train, float front);
+};
+
+#endif
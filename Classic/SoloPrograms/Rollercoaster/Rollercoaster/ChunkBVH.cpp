@@ -0,0 +1,281 @@
+#include "ChunkBVH.h"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CHUNK_BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+#define LEAF -1
+#define EMPTY -2
+#define PARALLEL_BOXES 1024 // Fewer boxes than this are culled on the calling thread
+#define WORK_PER_THREAD 4 // Subtrees handed to each thread, so uneven ones still balance
+
+void extractFrustum(const float* projection, const float* modelview, Frustum& frustum)
+{
+	// clip = projection * modelview, still column-major
+	float clip[16];
+	for (int column = 0; column < 4; column++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < 4; k++)
+			{
+				sum += projection[k * 4 + row] * modelview[column * 4 + k];
+			}
+			clip[column * 4 + row] = sum;
+		}
+	}
+
+	// Each plane is the w row plus or minus the x, y or z row: left, right, bottom, top, near, far
+	for (int p = 0; p < 6; p++)
+	{
+		int row = p / 2;
+		float sign = p % 2 == 0 ? 1.0f : -1.0f;
+		float* plane = frustum.planes[p];
+		for (int column = 0; column < 4; column++)
+		{
+			plane[column] = clip[column * 4 + 3] + sign * clip[column * 4 + row];
+		}
+
+		float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		for (int k = 0; k < 4; k++)
+		{
+			plane[k] /= length;
+		}
+	}
+}
+
+ChunkBVH::ChunkBVH()
+{
+	boxCount = 0;
+}
+
+void ChunkBVH::build(const float* mins, const float* maxs, int stride, int count)
+{
+	nodes.clear();
+	boxCount = count;
+	if (count > 0)
+	{
+		float min[3], max[3];
+		buildNode(mins, maxs, stride, 0, count, min, max);
+	}
+}
+
+int ChunkBVH::buildNode(const float* mins, const float* maxs, int stride, int first, int count, float* min, float* max)
+{
+	int index = (int)nodes.size();
+	nodes.push_back(Node());
+
+	for (int k = 0; k < 3; k++)
+	{
+		min[k] = 1e30f;
+		max[k] = -1e30f;
+	}
+
+	// Quarter the run, giving the remainder to the first children
+	int start = first;
+	for (int i = 0; i < 4; i++)
+	{
+		int size = count / 4 + (i < count % 4 ? 1 : 0);
+		float childMin[3] = { 0.0f, 0.0f, 0.0f };
+		float childMax[3] = { 0.0f, 0.0f, 0.0f };
+		int child = EMPTY;
+		if (size == 1)
+		{
+			child = LEAF;
+			for (int k = 0; k < 3; k++)
+			{
+				childMin[k] = mins[start * stride + k];
+				childMax[k] = maxs[start * stride + k];
+			}
+		}
+		else if (size > 1)
+		{
+			child = buildNode(mins, maxs, stride, start, size, childMin, childMax);
+		}
+
+		// Building children grows nodes, so only index it afterwards
+		Node& node = nodes[index];
+		node.child[i] = child;
+		node.first[i] = start;
+		node.count[i] = size;
+		float* centre[3] = { node.centreX, node.centreY, node.centreZ };
+		float* extent[3] = { node.extentX, node.extentY, node.extentZ };
+		for (int k = 0; k < 3; k++)
+		{
+			centre[k][i] = (childMin[k] + childMax[k]) * 0.5f;
+			// An empty slot's negative extent puts it outside every plane
+			extent[k][i] = child == EMPTY ? -1e30f : (childMax[k] - childMin[k]) * 0.5f;
+			if (child != EMPTY)
+			{
+				min[k] = fminf(min[k], childMin[k]);
+				max[k] = fmaxf(max[k], childMax[k]);
+			}
+		}
+		start += size;
+	}
+
+	return index;
+}
+
+void ChunkBVH::testNode(const Node& node, const Frustum& frustum, int& outside, int& inside)
+{
+	// A box is outside a plane when its corner furthest along the normal, centre plus
+	// |normal| . extent, is still behind it, and inside when its nearest corner is in front
+#ifdef CHUNK_BVH_SSE
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 centreX = _mm_loadu_ps(node.centreX);
+	__m128 centreY = _mm_loadu_ps(node.centreY);
+	__m128 centreZ = _mm_loadu_ps(node.centreZ);
+	__m128 extentX = _mm_loadu_ps(node.extentX);
+	__m128 extentY = _mm_loadu_ps(node.extentY);
+	__m128 extentZ = _mm_loadu_ps(node.extentZ);
+	__m128 out = _mm_setzero_ps();
+	__m128 crossing = _mm_setzero_ps();
+	for (int p = 0; p < 6; p++)
+	{
+		__m128 a = _mm_set1_ps(frustum.planes[p][0]);
+		__m128 b = _mm_set1_ps(frustum.planes[p][1]);
+		__m128 c = _mm_set1_ps(frustum.planes[p][2]);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(centreX, a), _mm_mul_ps(centreY, b)),
+			_mm_add_ps(_mm_mul_ps(centreZ, c), _mm_set1_ps(frustum.planes[p][3])));
+		__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extentX, _mm_andnot_ps(signMask, a)),
+			_mm_mul_ps(extentY, _mm_andnot_ps(signMask, b))), _mm_mul_ps(extentZ, _mm_andnot_ps(signMask, c)));
+		out = _mm_or_ps(out, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		crossing = _mm_or_ps(crossing, _mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()));
+	}
+	outside = _mm_movemask_ps(out);
+	inside = ~_mm_movemask_ps(crossing) & ~outside & 15;
+#else
+	outside = 0;
+	int crossing = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			const float* plane = frustum.planes[p];
+			float distance = node.centreX[i] * plane[0] + node.centreY[i] * plane[1] + node.centreZ[i] * plane[2] + plane[3];
+			float radius = node.extentX[i] * fabsf(plane[0]) + node.extentY[i] * fabsf(plane[1]) + node.extentZ[i] * fabsf(plane[2]);
+			outside |= distance + radius < 0.0f ? 1 << i : 0;
+			crossing |= distance - radius < 0.0f ? 1 << i : 0;
+		}
+	}
+	inside = ~crossing & ~outside & 15;
+#endif
+}
+
+void ChunkBVH::expand(const Work& item, const Frustum& frustum, std::vector<Work>& work) const
+{
+	if (item.node == LEAF)
+	{
+		work.push_back(item);
+		return;
+	}
+
+	const Node& node = nodes[item.node];
+	int outside, inside;
+	testNode(node, frustum, outside, inside);
+	for (int i = 0; i < 4; i++)
+	{
+		if (outside & (1 << i))
+		{
+			continue;
+		}
+
+		Work child = { LEAF, node.first[i], node.count[i] };
+		if (!(inside & (1 << i)) && node.child[i] != LEAF)
+		{
+			child.node = node.child[i];
+		}
+		work.push_back(child);
+	}
+}
+
+void ChunkBVH::cullNode(int index, const Frustum& frustum, std::vector<int>& visible) const
+{
+	const Node& node = nodes[index];
+	int outside, inside;
+	testNode(node, frustum, outside, inside);
+	for (int i = 0; i < 4; i++)
+	{
+		if (outside & (1 << i))
+		{
+			continue;
+		}
+
+		if ((inside & (1 << i)) || node.child[i] == LEAF)
+		{
+			// Wholly inside, so every box under it is visible without testing further
+			for (int box = node.first[i]; box < node.first[i] + node.count[i]; box++)
+			{
+				visible.push_back(box);
+			}
+		}
+		else
+		{
+			cullNode(node.child[i], frustum, visible);
+		}
+	}
+}
+
+void ChunkBVH::cull(const Frustum& frustum, ThreadPool& pool, std::vector<int>& visible) const
+{
+	visible.clear();
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	if (pool.size() == 1 || boxCount < PARALLEL_BOXES)
+	{
+		cullNode(0, frustum, visible);
+		return;
+	}
+
+	// Open the top of the tree until there are enough subtrees to share out
+	std::vector<Work> work(1);
+	work[0].node = 0;
+	work[0].first = 0;
+	work[0].count = boxCount;
+	std::vector<Work> next;
+	bool opened = true;
+	while (opened && (int)work.size() < pool.size() * WORK_PER_THREAD)
+	{
+		next.clear();
+		for (const Work& item : work)
+		{
+			expand(item, frustum, next);
+		}
+		opened = false;
+		for (const Work& item : next)
+		{
+			opened = opened || item.node != LEAF;
+		}
+		work.swap(next);
+	}
+
+	std::vector<std::vector<int> > results(work.size());
+	pool.parallelFor((int)work.size(), [&](int i)
+	{
+		const Work& item = work[i];
+		if (item.node == LEAF)
+		{
+			for (int box = item.first; box < item.first + item.count; box++)
+			{
+				results[i].push_back(box);
+			}
+		}
+		else
+		{
+			cullNode(item.node, frustum, results[i]);
+		}
+	});
+
+	for (const std::vector<int>& result : results)
+	{
+		visible.insert(visible.end(), result.begin(), result.end());
+	}
+}
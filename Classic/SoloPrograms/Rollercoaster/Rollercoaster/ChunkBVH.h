@@ -0,0 +1,71 @@
+#ifndef CHUNK_BVH_H
+#define CHUNK_BVH_H
+
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Six planes of a view frustum, ax + by + cz + d >= 0 inside, with unit normals
+struct Frustum
+{
+	float planes[6][4];
+};
+
+// Planes of the volume projection * modelview maps into clip space. Both matrices are
+// column-major, as glGetFloatv returns them
+void extractFrustum(const float* projection, const float* modelview, Frustum& frustum);
+
+// Four-wide bounding volume hierarchy over a fixed list of boxes, built once.
+// Every node keeps its four children's bounds as centre and half extent arrays, so one SIMD
+// pass tests all four against a plane. The tree splits runs of consecutive boxes, which suits
+// boxes that arrive in spatial order, such as chunks along a track
+class ChunkBVH
+{
+	public:
+		ChunkBVH();
+
+		// Builds over count boxes. Box i's corners are mins + i * stride and maxs + i * stride,
+		// with stride counted in floats
+		void build(const float* mins, const float* maxs, int stride, int count);
+
+		int size() const { return boxCount; }
+
+		// Replaces visible with the boxes at least partly inside the frustum, in ascending order.
+		// Big trees are split into subtrees culled across the pool
+		void cull(const Frustum& frustum, ThreadPool& pool, std::vector<int>& visible) const;
+
+	private:
+		struct Node
+		{
+			float centreX[4];
+			float centreY[4];
+			float centreZ[4];
+			float extentX[4];
+			float extentY[4];
+			float extentZ[4];
+			int child[4]; // Node index, LEAF or EMPTY
+			int first[4]; // Boxes under each child
+			int count[4];
+		};
+
+		// A subtree to cull, or when node is LEAF a run of boxes already known to be visible
+		struct Work
+		{
+			int node;
+			int first;
+			int count;
+		};
+
+		std::vector<Node> nodes;
+		int boxCount;
+
+		int buildNode(const float* mins, const float* maxs, int stride, int first, int count, float* min, float* max);
+		// Sets bit i of outside for children wholly outside a plane, and of inside for children
+		// wholly inside them all
+		static void testNode(const Node& node, const Frustum& frustum, int& outside, int& inside);
+		// Appends the node's visible children to work, in order
+		void expand(const Work& item, const Frustum& frustum, std::vector<Work>& work) const;
+		void cullNode(int node, const Frustum& frustum, std::vector<int>& visible) const;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "FixedStepThread.h"
+
+#define MAX_CATCH_UP 5 // Steps run back to back before the rest of the missed time is dropped
+
+FixedStepThread::FixedStepThread()
+{
+	stopping = false;
+	interval = 1.0;
+	originTicks = 0;
+	droppedSteps = 0;
+}
+
+void FixedStepThread::start(double interval, const std::function<void(double)>& step)
+{
+	stop();
+	this->interval = interval;
+	this->step = step;
+	stopping = false;
+	droppedSteps = 0;
+	origin = Clock::now();
+	originTicks = origin.time_since_epoch().count();
+	thread = std::thread(&FixedStepThread::run, this);
+}
+
+void FixedStepThread::stop()
+{
+	if (!thread.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+double FixedStepThread::now() const
+{
+	Clock::time_point at = Clock::time_point(Clock::duration(originTicks.load()));
+	return std::chrono::duration<double>(Clock::now() - at).count();
+}
+
+void FixedStepThread::run()
+{
+	auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
+	long long index = 1;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (wake.wait_until(lock, origin + index * period, [this] { return stopping; }))
+			{
+				return;
+			}
+		}
+
+		step(index * interval);
+		index++;
+
+		// Too far behind to catch up, so start counting again from the step just run
+		long long behind = (long long)((Clock::now() - origin) / period) - index;
+		if (behind > MAX_CATCH_UP)
+		{
+			origin += behind * period;
+			originTicks = origin.time_since_epoch().count();
+			droppedSteps += (int)behind;
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef FIXED_STEP_THREAD_H
+#define FIXED_STEP_THREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Calls a step on a thread of its own at a fixed rate, whatever the caller is doing. Steps are
+// timed against when the thread started rather than against each other, so late wake-ups don't
+// add up into drift. A thread that falls behind runs the missed steps back to back, up to
+// MAX_CATCH_UP of them, and drops whatever time is missed beyond that
+class FixedStepThread
+{
+	public:
+		FixedStepThread();
+		~FixedStepThread() { stop(); }
+
+		// Calls step(time) every interval seconds, time being the moment the step stands for in
+		// seconds since start, starting at interval
+		void start(double interval, const std::function<void(double)>& step);
+		// Finishes the running step and joins the thread
+		void stop();
+
+		// Seconds since start on the clock steps keep to, less any time dropped
+		double now() const;
+		int dropped() const { return droppedSteps; } // Steps skipped for falling too far behind
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable wake; // Signals the thread to stop
+		bool stopping;
+		std::function<void(double)> step;
+		double interval;
+		Clock::time_point origin; // Moved on by any time dropped, so only read it on the thread
+		std::atomic<long long> originTicks; // The same, for now() on other threads
+		std::atomic<int> droppedSteps;
+
+		void run();
+};
+
+#endif
@@ -0,0 +1,319 @@
+#include "OcclusionCuller.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLER_SSE
+#include <xmmintrin.h>
+#endif
+
+#define NEAR_W 0.1f // Occluders are clipped here, and boxes reaching nearer are always visible
+#define PARALLEL_TRIANGLES 32 // Fewer occluder triangles than this are rasterized on the calling thread
+#define JOBS_PER_THREAD 4
+
+#define TILE_COLUMNS (OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH)
+#define TILE_ROWS (OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT)
+
+// x, y and w of world point p in clip space
+static void toClip(const float* m, const float* p, float* clip)
+{
+	clip[0] = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+	clip[1] = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+	clip[2] = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+}
+
+OcclusionCuller::OcclusionCuller()
+{
+	for (int k = 0; k < 16; k++)
+	{
+		matrix[k] = k % 5 == 0 ? 1.0f : 0.0f;
+	}
+	depths.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 0.0f);
+	tileDepths.assign(TILE_COLUMNS * TILE_ROWS, 0.0f);
+}
+
+void OcclusionCuller::begin(const float* viewProjection)
+{
+	memcpy(matrix, viewProjection, sizeof(matrix));
+	setups.clear();
+}
+
+void OcclusionCuller::addQuad(const float* corners)
+{
+	float clip[4][3];
+	for (int i = 0; i < 4; i++)
+	{
+		toClip(matrix, &corners[i * 3], clip[i]);
+	}
+	addTriangle(clip[0], clip[1], clip[2]);
+	addTriangle(clip[0], clip[2], clip[3]);
+}
+
+void OcclusionCuller::addTriangle(const float* a, const float* b, const float* c)
+{
+	// Walk the edges keeping what's in front of the near plane, which leaves at most a quad
+	const float* in[3] = { a, b, c };
+	float out[4][3];
+	int count = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		const float* from = in[i];
+		const float* to = in[(i + 1) % 3];
+		bool fromInside = from[2] >= NEAR_W;
+		if (fromInside)
+		{
+			memcpy(out[count++], from, 3 * sizeof(float));
+		}
+		if (fromInside != (to[2] >= NEAR_W))
+		{
+			float t = (NEAR_W - from[2]) / (to[2] - from[2]);
+			for (int k = 0; k < 3; k++)
+			{
+				out[count][k] = from[k] + t * (to[k] - from[k]);
+			}
+			count++;
+		}
+	}
+	for (int i = 1; i + 1 < count; i++)
+	{
+		setupTriangle(out[0], out[i], out[i + 1]);
+	}
+}
+
+void OcclusionCuller::setupTriangle(const float* a, const float* b, const float* c)
+{
+	// Into buffer pixels, with 1/w as depth since it interpolates linearly across the screen
+	double x[3], y[3], z[3];
+	const float* clip[3] = { a, b, c };
+	for (int i = 0; i < 3; i++)
+	{
+		z[i] = 1.0 / clip[i][2];
+		x[i] = (clip[i][0] * z[i] * 0.5 + 0.5) * OCCLUSION_WIDTH;
+		y[i] = (clip[i][1] * z[i] * 0.5 + 0.5) * OCCLUSION_HEIGHT;
+	}
+	double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area < 0.0)
+	{
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(z[1], z[2]);
+		area = -area;
+	}
+	if (area < 1e-6)
+	{
+		return;
+	}
+
+	Setup setup;
+	setup.minX = std::max((int)floor(std::min(std::min(x[0], x[1]), x[2])), 0);
+	setup.maxX = std::min((int)ceil(std::max(std::max(x[0], x[1]), x[2])) - 1, OCCLUSION_WIDTH - 1);
+	setup.minY = std::max((int)floor(std::min(std::min(y[0], y[1]), y[2])), 0);
+	setup.maxY = std::min((int)ceil(std::max(std::max(y[0], y[1]), y[2])) - 1, OCCLUSION_HEIGHT - 1);
+	if (setup.minX > setup.maxX || setup.minY > setup.maxY)
+	{
+		return;
+	}
+
+	// Edge k runs between the two vertices other than k, and is area at vertex k. Edges are
+	// scaled so neither step exceeds one, which keeps them exact enough in floats across the buffer
+	double depthX = 0.0, depthY = 0.0, depthC = 0.0;
+	for (int k = 0; k < 3; k++)
+	{
+		int from = (k + 1) % 3;
+		int to = (k + 2) % 3;
+		double edgeX = y[from] - y[to];
+		double edgeY = x[to] - x[from];
+		double edgeC = x[from] * y[to] - y[from] * x[to];
+		depthX += z[k] * edgeX / area;
+		depthY += z[k] * edgeY / area;
+		depthC += z[k] * edgeC / area;
+
+		double scale = 1.0 / std::max(fabs(edgeX), fabs(edgeY));
+		setup.edgeX[k] = (float)(edgeX * scale);
+		setup.edgeY[k] = (float)(edgeY * scale);
+		setup.edgeC[k] = edgeC * scale;
+		setup.edgeMargin[k] = 0.5f * (fabsf(setup.edgeX[k]) + fabsf(setup.edgeY[k]));
+	}
+	setup.depthX = (float)depthX;
+	setup.depthY = (float)depthY;
+	setup.depthC = depthC;
+	setup.depthMargin = 0.5f * (fabsf(setup.depthX) + fabsf(setup.depthY));
+	setups.push_back(setup);
+}
+
+void OcclusionCuller::rasterizeRows(int firstRow, int lastRow)
+{
+	memset(&depths[firstRow * OCCLUSION_WIDTH], 0, (lastRow - firstRow) * OCCLUSION_WIDTH * sizeof(float));
+
+	for (const Setup& setup : setups)
+	{
+		int top = std::max(setup.minY, firstRow);
+		int bottom = std::min(setup.maxY, lastRow - 1);
+		for (int y = top; y <= bottom; y++)
+		{
+			double centreY = y + 0.5;
+			float rowEdges[3];
+			for (int k = 0; k < 3; k++)
+			{
+				rowEdges[k] = (float)(setup.edgeC[k] + setup.edgeY[k] * centreY);
+			}
+			float rowDepth = (float)(setup.depthC + setup.depthY * centreY) - setup.depthMargin;
+			float* row = &depths[y * OCCLUSION_WIDTH];
+
+#ifdef OCCLUSION_CULLER_SSE
+			// Four pixels at a time from a multiple of four, as pixels left of the triangle fail an edge
+			const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			__m128 edges[3], steps[3], margins[3];
+			for (int k = 0; k < 3; k++)
+			{
+				edges[k] = _mm_set1_ps(rowEdges[k]);
+				steps[k] = _mm_set1_ps(setup.edgeX[k]);
+				margins[k] = _mm_set1_ps(setup.edgeMargin[k]);
+			}
+			__m128 depthRow = _mm_set1_ps(rowDepth);
+			__m128 depthStep = _mm_set1_ps(setup.depthX);
+			for (int x = setup.minX & ~3; x <= setup.maxX; x += 4)
+			{
+				__m128 centreX = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(edges[0], _mm_mul_ps(steps[0], centreX)), margins[0]);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(edges[1], _mm_mul_ps(steps[1], centreX)), margins[1]));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(edges[2], _mm_mul_ps(steps[2], centreX)), margins[2]));
+				if (_mm_movemask_ps(inside) == 0)
+				{
+					continue;
+				}
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_max_ps(old, _mm_add_ps(depthRow, _mm_mul_ps(depthStep, centreX)));
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+			}
+#else
+			for (int x = setup.minX; x <= setup.maxX; x++)
+			{
+				float centreX = x + 0.5f;
+				bool inside = true;
+				for (int k = 0; k < 3 && inside; k++)
+				{
+					inside = rowEdges[k] + setup.edgeX[k] * centreX >= setup.edgeMargin[k];
+				}
+				if (inside)
+				{
+					row[x] = std::max(row[x], rowDepth + setup.depthX * centreX);
+				}
+			}
+#endif
+		}
+	}
+
+	for (int tileRow = firstRow / OCCLUSION_TILE_HEIGHT; tileRow < lastRow / OCCLUSION_TILE_HEIGHT; tileRow++)
+	{
+		for (int tileColumn = 0; tileColumn < TILE_COLUMNS; tileColumn++)
+		{
+			float farthest = 1e30f;
+			for (int y = tileRow * OCCLUSION_TILE_HEIGHT; y < (tileRow + 1) * OCCLUSION_TILE_HEIGHT; y++)
+			{
+				const float* row = &depths[y * OCCLUSION_WIDTH + tileColumn * OCCLUSION_TILE_WIDTH];
+				for (int x = 0; x < OCCLUSION_TILE_WIDTH; x++)
+				{
+					farthest = std::min(farthest, row[x]);
+				}
+			}
+			tileDepths[tileRow * TILE_COLUMNS + tileColumn] = farthest;
+		}
+	}
+}
+
+void OcclusionCuller::rasterize(ThreadPool& pool)
+{
+	int jobs = (int)setups.size() < PARALLEL_TRIANGLES ? 1 : std::min(TILE_ROWS, pool.size() * JOBS_PER_THREAD);
+	auto job = [&](int j)
+	{
+		rasterizeRows(TILE_ROWS * j / jobs * OCCLUSION_TILE_HEIGHT, TILE_ROWS * (j + 1) / jobs * OCCLUSION_TILE_HEIGHT);
+	};
+	if (jobs == 1)
+	{
+		job(0);
+	}
+	else
+	{
+		pool.parallelFor(jobs, job);
+	}
+}
+
+bool OcclusionCuller::visible(const float* min, const float* max) const
+{
+	// Screen rectangle of the corners, and the nearest of them, which is the box's nearest point
+	float left = 1e30f, right = -1e30f, bottom = 1e30f, top = -1e30f;
+	float nearest = 0.0f;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		const float point[3] = { corner & 1 ? max[0] : min[0], corner & 2 ? max[1] : min[1], corner & 4 ? max[2] : min[2] };
+		float clip[3];
+		toClip(matrix, point, clip);
+		if (clip[2] < NEAR_W)
+		{
+			return true;
+		}
+		float inverse = 1.0f / clip[2];
+		float x = (clip[0] * inverse * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		float y = (clip[1] * inverse * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+		left = fminf(left, x);
+		right = fmaxf(right, x);
+		bottom = fminf(bottom, y);
+		top = fmaxf(top, y);
+		nearest = fmaxf(nearest, inverse);
+	}
+
+	// Every pixel the rectangle touches on the buffer
+	int x0 = std::max((int)floorf(left), 0);
+	int x1 = std::min((int)floorf(right), OCCLUSION_WIDTH - 1);
+	int y0 = std::max((int)floorf(bottom), 0);
+	int y1 = std::min((int)floorf(top), OCCLUSION_HEIGHT - 1);
+	if (x0 > x1 || y0 > y1)
+	{
+		return true;
+	}
+
+	for (int tileRow = y0 / OCCLUSION_TILE_HEIGHT; tileRow <= y1 / OCCLUSION_TILE_HEIGHT; tileRow++)
+	{
+		for (int tileColumn = x0 / OCCLUSION_TILE_WIDTH; tileColumn <= x1 / OCCLUSION_TILE_WIDTH; tileColumn++)
+		{
+			// Everything in the tile is nearer than the box, so no pixel there can show it
+			if (tileDepths[tileRow * TILE_COLUMNS + tileColumn] > nearest)
+			{
+				continue;
+			}
+
+			int firstX = std::max(x0, tileColumn * OCCLUSION_TILE_WIDTH);
+			int lastX = std::min(x1, (tileColumn + 1) * OCCLUSION_TILE_WIDTH - 1);
+			int lastY = std::min(y1, (tileRow + 1) * OCCLUSION_TILE_HEIGHT - 1);
+			for (int y = std::max(y0, tileRow * OCCLUSION_TILE_HEIGHT); y <= lastY; y++)
+			{
+				const float* row = &depths[y * OCCLUSION_WIDTH];
+#ifdef OCCLUSION_CULLER_SSE
+				__m128 boxDepth = _mm_set1_ps(nearest);
+				for (int x = firstX & ~3; x <= lastX; x += 4)
+				{
+					int lanes = _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), boxDepth));
+					// Only the lanes inside [firstX, lastX]
+					lanes &= (0xF << std::max(firstX - x, 0)) & (0xF >> std::max(x + 3 - lastX, 0));
+					if (lanes != 0)
+					{
+						return true;
+					}
+				}
+#else
+				for (int x = firstX; x <= lastX; x++)
+				{
+					if (row[x] <= nearest)
+					{
+						return true;
+					}
+				}
+#endif
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,69 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <vector>
+
+#include "ThreadPool.h"
+
+#define OCCLUSION_WIDTH 256 // Depth buffer size in pixels, stretched over the whole view
+#define OCCLUSION_HEIGHT 256
+#define OCCLUSION_TILE_WIDTH 32
+#define OCCLUSION_TILE_HEIGHT 8
+
+// Hides boxes behind a few large occluders, tested on the CPU before anything is sent to GL.
+// Occluders are rasterized into a small depth buffer of 1/w, nearest kept, where a pixel only
+// takes a triangle's depth if the triangle covers all of it, and then at its farthest over the
+// pixel. Every tile of the buffer also keeps its farthest depth, so a box behind that needs no
+// pixel tests there. Rasterizing splits the buffer into bands of tile rows shared across the
+// pool, each band touching only its own pixels.
+// A box is only reported hidden if every pixel it touches is covered by something nearer than
+// its nearest corner, so nothing visible is ever culled
+class OcclusionCuller
+{
+	public:
+		OcclusionCuller();
+
+		// Starts a frame seen through viewProjection, column-major and taking world space to clip
+		// space, with no occluders
+		void begin(const float* viewProjection);
+		// Queues a flat convex quad, corners xyz in order round it, as something that hides what's
+		// behind it. Parts nearer than the near plane are clipped off
+		void addQuad(const float* corners);
+		// Rasterizes the quads queued since begin()
+		void rasterize(ThreadPool& pool);
+
+		// False when the box is hidden behind the occluders wherever it lands on screen. Boxes
+		// reaching behind the eye or off the screen are left to the frustum, so always visible
+		bool visible(const float* min, const float* max) const;
+
+		int triangles() const { return (int)setups.size(); } // Occluder triangles last rasterized
+
+	private:
+		// A triangle ready to rasterize in buffer space, wound counterclockwise. Edge k is inside
+		// where edgeX[k] * x + edgeY[k] * y + edgeC[k] >= edgeMargin[k] at pixel centres, the margin
+		// keeping whole pixels inside, and depth is 1/w the same way, less depthMargin
+		struct Setup
+		{
+			float edgeX[3];
+			float edgeY[3];
+			double edgeC[3]; // Double, as vertices clipped near the eye land far off the buffer
+			float edgeMargin[3];
+			float depthX;
+			float depthY;
+			double depthC;
+			float depthMargin;
+			int minX, maxX, minY, maxY; // Pixels the triangle can cover, inclusive
+		};
+
+		float matrix[16];
+		std::vector<Setup> setups;
+		std::vector<float> depths; // 1/w of the nearest occluder in each pixel, 0 for none
+		std::vector<float> tileDepths; // Farthest of each tile's pixels
+
+		// Clips a triangle in clip space, xyzw each, to the near plane and sets up what remains
+		void addTriangle(const float* a, const float* b, const float* c);
+		void setupTriangle(const float* a, const float* b, const float* c);
+		void rasterizeRows(int firstRow, int lastRow);
+};
+
+#endif
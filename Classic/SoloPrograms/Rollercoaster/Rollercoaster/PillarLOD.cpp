@@ -0,0 +1,259 @@
+#include "PillarLOD.h"
+
+#include <math.h>
+#include <algorithm>
+
+#define TWO_PI 6.2831853f
+#define HYSTERESIS 0.2f // How far past a threshold a pillar must be to change level
+
+static const int LEVEL_SIDES[PILLAR_LEVELS] = { 10, 6, 4 };
+// Narrowest a pillar can look, in pixels across, and still use each cylinder level
+static const float LEVEL_PIXELS[PILLAR_LEVELS] = { 48.0f, 16.0f, 5.0f };
+
+static void putVertex(std::vector<GLfloat>& vertices, float x, float y, float z, float nx, float ny, float nz)
+{
+	GLfloat vertex[6] = { x, y, z, nx, ny, nz };
+	vertices.insert(vertices.end(), vertex, vertex + 6);
+}
+
+// Capped cylinder with its top centre at the origin, hanging PILLAR_HEIGHT down.
+// The scene's specular highlight peaks on normals facing +Z, so a cylinder with a vertex
+// there shines white across whole faces. Those with a multiple of four sides are turned
+// half a side to keep every level as dull as the finest one
+static void buildCylinder(int sides, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+{
+	float phase = sides % 4 == 0 ? 0.5f : 0.0f;
+
+	// Side, one ring at the top and one at the bottom
+	for (int ring = 0; ring < 2; ring++)
+	{
+		for (int side = 0; side < sides; side++)
+		{
+			float angle = TWO_PI * (side + phase) / sides;
+			putVertex(vertices, cosf(angle) * PILLAR_RADIUS, -ring * PILLAR_HEIGHT, sinf(angle) * PILLAR_RADIUS,
+				cosf(angle), 0.0f, sinf(angle));
+		}
+	}
+	for (int side = 0; side < sides; side++)
+	{
+		GLuint a = side;
+		GLuint b = (side + 1) % sides;
+		const GLuint quad[6] = { a, b, b + sides, a, b + sides, a + sides };
+		indices.insert(indices.end(), quad, quad + 6);
+	}
+
+	// Caps as fans around their centres
+	for (int cap = 0; cap < 2; cap++)
+	{
+		float ny = cap == 0 ? 1.0f : -1.0f;
+		float y = -cap * PILLAR_HEIGHT;
+		GLuint first = (GLuint)(vertices.size() / 6);
+		putVertex(vertices, 0.0f, y, 0.0f, 0.0f, ny, 0.0f);
+		for (int side = 0; side < sides; side++)
+		{
+			float angle = TWO_PI * (side + phase) / sides;
+			putVertex(vertices, cosf(angle) * PILLAR_RADIUS, y, sinf(angle) * PILLAR_RADIUS, 0.0f, ny, 0.0f);
+
+			GLuint next = (side + 1) % sides;
+			const GLuint fan[3] =
+			{
+				first,
+				cap == 0 ? first + 1 + next : first + 1 + side,
+				cap == 0 ? first + 1 + side : first + 1 + next
+			};
+			indices.insert(indices.end(), fan, fan + 3);
+		}
+	}
+}
+
+PillarLOD::PillarLOD()
+{
+	enabled = true;
+	triangles = 0;
+	frame = 1;
+	eye[0] = eye[1] = eye[2] = 0.0f;
+	pixelsPerUnit = 1.0f;
+	for (int level = 0; level <= PILLAR_LEVELS; level++)
+	{
+		levelCounts[level] = 0;
+	}
+}
+
+void PillarLOD::init(float r, float g, float b)
+{
+	for (int level = 0; level < PILLAR_LEVELS; level++)
+	{
+		meshVertices[level].clear();
+		meshIndices[level].clear();
+		buildCylinder(LEVEL_SIDES[level], meshVertices[level], meshIndices[level]);
+	}
+	for (int level = 0; level <= PILLAR_LEVELS; level++)
+	{
+		initBatch(batches[level], GL_TRIANGLES, r, g, b);
+	}
+}
+
+void PillarLOD::setPillars(const std::vector<float>& tops)
+{
+	this->tops = tops;
+	levels.assign(tops.size() / 3, PILLAR_IMPOSTOR);
+	lastSeen.assign(tops.size() / 3, 0);
+	frame = 1;
+}
+
+void PillarLOD::shiftPillars(const std::vector<float>& tops, int dropped)
+{
+	this->tops = tops;
+	dropped = std::min(dropped, (int)levels.size());
+	levels.erase(levels.begin(), levels.begin() + dropped);
+	levels.resize(tops.size() / 3, PILLAR_IMPOSTOR);
+	lastSeen.erase(lastSeen.begin(), lastSeen.begin() + dropped);
+	lastSeen.resize(tops.size() / 3, 0);
+}
+
+void PillarLOD::beginFrame(const float* eye, float pixelsPerUnit)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		this->eye[k] = eye[k];
+	}
+	this->pixelsPerUnit = pixelsPerUnit;
+	frame++;
+	for (int level = 0; level <= PILLAR_LEVELS; level++)
+	{
+		queued[level].clear();
+	}
+}
+
+int PillarLOD::chooseLevel(int pillar, float pixels)
+{
+	int level = levels[pillar];
+	if (lastSeen[pillar] + 1 != frame)
+	{
+		// Off screen last frame, so there's nothing to pop from
+		level = PILLAR_IMPOSTOR;
+		while (level > 0 && pixels >= LEVEL_PIXELS[level - 1])
+		{
+			level--;
+		}
+		return level;
+	}
+
+	while (level > 0 && pixels >= LEVEL_PIXELS[level - 1] * (1.0f + HYSTERESIS))
+	{
+		level--;
+	}
+	while (level < PILLAR_IMPOSTOR && pixels < LEVEL_PIXELS[level] * (1.0f - HYSTERESIS))
+	{
+		level++;
+	}
+	return level;
+}
+
+void PillarLOD::addPillars(int first, int count)
+{
+	for (int pillar = first; pillar < first + count; pillar++)
+	{
+		int level = 0;
+		if (enabled)
+		{
+			// Distance to the pillar's middle decides how wide it looks
+			const float* top = &tops[pillar * 3];
+			float dx = top[0] - eye[0];
+			float dy = top[1] - 0.5f * PILLAR_HEIGHT - eye[1];
+			float dz = top[2] - eye[2];
+			float distance = fmaxf(sqrtf(dx * dx + dy * dy + dz * dz), 0.001f);
+			level = chooseLevel(pillar, 2.0f * PILLAR_RADIUS * pixelsPerUnit / distance);
+		}
+		levels[pillar] = (unsigned char)level;
+		lastSeen[pillar] = frame;
+		queued[level].push_back(pillar);
+	}
+}
+
+void PillarLOD::addImpostor(const float* top, BakedBatch& batch)
+{
+	// Turn about the pillar's axis to face the eye. The edges' normals lean halfway out from
+	// the eye, as the cylinder's do between its middle and its silhouette, so the quad takes
+	// its average shade without the highlight a normal facing the eye would catch
+	float toEye[3] = { eye[0] - top[0], 0.0f, eye[2] - top[2] };
+	float length = sqrtf(toEye[0] * toEye[0] + toEye[2] * toEye[2]);
+	if (length > 0.0f)
+	{
+		toEye[0] /= length;
+		toEye[2] /= length;
+	}
+	else
+	{
+		toEye[2] = 1.0f;
+	}
+	float right[3] = { toEye[2], 0.0f, -toEye[0] };
+
+	GLuint base = (GLuint)(batch.vertices.size() / 6);
+	for (int row = 0; row < 2; row++)
+	{
+		float y = top[1] - row * PILLAR_HEIGHT;
+		for (int column = -1; column <= 1; column += 2)
+		{
+			putVertex(batch.vertices,
+				top[0] + right[0] * PILLAR_RADIUS * column, y, top[2] + right[2] * PILLAR_RADIUS * column,
+				(right[0] * column + toEye[0]) * 0.7071068f, 0.0f, (right[2] * column + toEye[2]) * 0.7071068f);
+		}
+	}
+
+	// Top left, top right, bottom left, bottom right
+	const GLuint quad[6] = { base, base + 2, base + 3, base, base + 3, base + 1 };
+	batch.indices.insert(batch.indices.end(), quad, quad + 6);
+}
+
+void PillarLOD::draw()
+{
+	triangles = 0;
+	for (int level = 0; level <= PILLAR_LEVELS; level++)
+	{
+		BakedBatch& batch = batches[level];
+		clearBatch(batch);
+		levelCounts[level] = (int)queued[level].size();
+
+		if (level == PILLAR_IMPOSTOR)
+		{
+			for (int pillar : queued[level])
+			{
+				addImpostor(&tops[pillar * 3], batch);
+			}
+		}
+		else
+		{
+			// Copy the level's mesh to every pillar using it
+			const std::vector<GLfloat>& vertices = meshVertices[level];
+			const std::vector<GLuint>& indices = meshIndices[level];
+			GLuint meshSize = (GLuint)(vertices.size() / 6);
+			batch.vertices.resize(queued[level].size() * vertices.size());
+			batch.indices.resize(queued[level].size() * indices.size());
+			GLfloat* vertex = batch.vertices.data();
+			GLuint* index = batch.indices.data();
+			for (size_t i = 0; i < queued[level].size(); i++)
+			{
+				const float* top = &tops[queued[level][i] * 3];
+				for (size_t v = 0; v < vertices.size(); v += 6, vertex += 6)
+				{
+					vertex[0] = vertices[v + 0] + top[0];
+					vertex[1] = vertices[v + 1] + top[1];
+					vertex[2] = vertices[v + 2] + top[2];
+					vertex[3] = vertices[v + 3];
+					vertex[4] = vertices[v + 4];
+					vertex[5] = vertices[v + 5];
+				}
+				GLuint base = (GLuint)i * meshSize;
+				for (GLuint source : indices)
+				{
+					*index++ = source + base;
+				}
+			}
+		}
+
+		streamBatch(batch);
+		drawBatch(batch);
+		triangles += (int)batch.indices.size() / 3;
+	}
+}
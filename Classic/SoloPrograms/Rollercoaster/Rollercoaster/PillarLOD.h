@@ -0,0 +1,59 @@
+#ifndef PILLAR_LOD_H
+#define PILLAR_LOD_H
+
+#include <vector>
+
+#include "BakedMesh.h"
+
+#define PILLAR_RADIUS 0.5f
+#define PILLAR_HEIGHT 5.0f
+#define PILLAR_LEVELS 3 // Cylinder levels, finest first
+#define PILLAR_IMPOSTOR PILLAR_LEVELS // Level after the cylinders, a quad facing the camera
+
+// Upright pillars drawn in as much detail as their size on screen calls for: capped cylinders
+// with fewer sides as they shrink, then a quad turned to face the camera whose edge normals
+// shade it like the cylinder it stands in for. A pillar only moves to a finer level once it is
+// clearly past the threshold and back once clearly under it, so pillars near one don't flicker.
+// Fixed-function GL has no per-instance attributes, so each frame the pillars at a level are
+// copied out of that level's mesh into one array and drawn with one call
+class PillarLOD
+{
+	public:
+		PillarLOD();
+
+		void init(float r, float g, float b);
+		// Replaces the pillars with ones hanging from tops, xyz each, and forgets their levels
+		void setPillars(const std::vector<float>& tops);
+		// Replaces the pillars with tops that start with the old pillars after the first dropped,
+		// in the same order, so those keep their levels and only the pillars added after them start over
+		void shiftPillars(const std::vector<float>& tops, int dropped);
+
+		// Starts a frame seen from eye, where one unit at distance one covers pixelsPerUnit pixels
+		void beginFrame(const float* eye, float pixelsPerUnit);
+		// Picks levels for pillars [first, first + count) and queues them
+		void addPillars(int first, int count);
+		// Draws the pillars queued since beginFrame, one call per level
+		void draw();
+
+		bool enabled; // Every pillar is drawn at the finest level when false
+		int levelCounts[PILLAR_LEVELS + 1]; // Pillars drawn at each level last frame
+		int triangles; // Drawn last frame
+
+	private:
+		std::vector<GLfloat> meshVertices[PILLAR_LEVELS]; // Each cylinder level with its top at the origin
+		std::vector<GLuint> meshIndices[PILLAR_LEVELS];
+		BakedBatch batches[PILLAR_LEVELS + 1]; // Rebuilt every frame
+		std::vector<int> queued[PILLAR_LEVELS + 1];
+
+		std::vector<float> tops;
+		std::vector<unsigned char> levels; // Level each pillar was last drawn at
+		std::vector<unsigned int> lastSeen; // Frame each pillar was last drawn in
+		unsigned int frame;
+		float eye[3];
+		float pixelsPerUnit;
+
+		int chooseLevel(int pillar, float pixels);
+		void addImpostor(const float* top, BakedBatch& batch);
+};
+
+#endif
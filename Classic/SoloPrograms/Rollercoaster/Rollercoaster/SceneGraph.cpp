@@ -0,0 +1,235 @@
+#include "SceneGraph.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_GRAPH_SSE
+#include <xmmintrin.h>
+#endif
+
+#define PARALLEL_NODES 4096 // Depths with fewer dirty nodes than this are updated on the calling thread
+#define JOBS_PER_THREAD 4
+
+void multiplyMatrices(const float* a, const float* b, float* out)
+{
+	// Each column of out is a's columns weighted by the matching column of b
+#ifdef SCENE_GRAPH_SSE
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+	for (int column = 0; column < 4; column++)
+	{
+		const float* weights = b + column * 4;
+		__m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(weights[0])), _mm_mul_ps(a1, _mm_set1_ps(weights[1]))),
+			_mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(weights[2])), _mm_mul_ps(a3, _mm_set1_ps(weights[3]))));
+		_mm_storeu_ps(out + column * 4, sum);
+	}
+#else
+	for (int column = 0; column < 4; column++)
+	{
+		const float* weights = b + column * 4;
+		for (int row = 0; row < 4; row++)
+		{
+			out[column * 4 + row] = (a[row] * weights[0] + a[4 + row] * weights[1]) + (a[8 + row] * weights[2] + a[12 + row] * weights[3]);
+		}
+	}
+#endif
+}
+
+SceneGraph::SceneGraph()
+{
+	sorted = true;
+	updatedCount = 0;
+}
+
+int SceneGraph::addNode(int parent, const float* local)
+{
+	int handle = (int)slots.size();
+	int slot = (int)parents.size();
+	int parentSlot = parent < 0 ? -1 : slots[parent];
+
+	locals.insert(locals.end(), local, local + 16);
+	worlds.resize(worlds.size() + 16);
+	parents.push_back(parentSlot);
+	depths.push_back(parentSlot < 0 ? 0 : depths[parentSlot] + 1);
+	firstChildren.push_back(0);
+	childCounts.push_back(0);
+	dirty.push_back(1);
+	handles.push_back(handle);
+	slots.push_back(slot);
+	pending.push_back(slot);
+	sorted = false;
+	return handle;
+}
+
+void SceneGraph::setLocal(int node, const float* local)
+{
+	int slot = slots[node];
+	memcpy(&locals[slot * 16], local, 16 * sizeof(float));
+	if (!dirty[slot])
+	{
+		dirty[slot] = 1;
+		pending.push_back(slot);
+	}
+}
+
+void SceneGraph::sort()
+{
+	int count = (int)parents.size();
+
+	// Children of each node, in the order they are stored now
+	std::vector<int> childStarts(count + 1, 0);
+	for (int slot = 0; slot < count; slot++)
+	{
+		if (parents[slot] >= 0)
+		{
+			childStarts[parents[slot] + 1]++;
+		}
+	}
+	for (int slot = 0; slot < count; slot++)
+	{
+		childStarts[slot + 1] += childStarts[slot];
+	}
+	std::vector<int> children(childStarts[count]);
+	std::vector<int> filled(childStarts.begin(), childStarts.end() - 1);
+	for (int slot = 0; slot < count; slot++)
+	{
+		if (parents[slot] >= 0)
+		{
+			children[filled[parents[slot]]++] = slot;
+		}
+	}
+
+	// Breadth first from the roots, so depths come in order and siblings together
+	std::vector<int> order;
+	order.reserve(count);
+	for (int slot = 0; slot < count; slot++)
+	{
+		if (parents[slot] < 0)
+		{
+			order.push_back(slot);
+		}
+	}
+	std::vector<int> newFirstChildren(count), newChildCounts(count);
+	for (int i = 0; i < (int)order.size(); i++)
+	{
+		int slot = order[i];
+		newFirstChildren[i] = (int)order.size();
+		newChildCounts[i] = childStarts[slot + 1] - childStarts[slot];
+		order.insert(order.end(), children.begin() + childStarts[slot], children.begin() + childStarts[slot + 1]);
+	}
+
+	std::vector<int> moved(count);
+	for (int i = 0; i < count; i++)
+	{
+		moved[order[i]] = i;
+	}
+
+	std::vector<float> newLocals(locals.size()), newWorlds(worlds.size());
+	std::vector<int> newParents(count), newDepths(count), newHandles(count);
+	std::vector<unsigned char> newDirty(count);
+	for (int i = 0; i < count; i++)
+	{
+		int slot = order[i];
+		memcpy(&newLocals[i * 16], &locals[slot * 16], 16 * sizeof(float));
+		memcpy(&newWorlds[i * 16], &worlds[slot * 16], 16 * sizeof(float));
+		newParents[i] = parents[slot] < 0 ? -1 : moved[parents[slot]];
+		newDepths[i] = depths[slot];
+		newHandles[i] = handles[slot];
+		newDirty[i] = dirty[slot];
+		slots[handles[slot]] = i;
+	}
+	locals.swap(newLocals);
+	worlds.swap(newWorlds);
+	parents.swap(newParents);
+	depths.swap(newDepths);
+	handles.swap(newHandles);
+	dirty.swap(newDirty);
+	firstChildren.swap(newFirstChildren);
+	childCounts.swap(newChildCounts);
+	for (int& slot : pending)
+	{
+		slot = moved[slot];
+	}
+	sorted = true;
+}
+
+void SceneGraph::update(ThreadPool& pool)
+{
+	if (!sorted)
+	{
+		sort();
+	}
+
+	updatedCount = 0;
+	levels.resize(depths.empty() ? 0 : depths.back() + 1);
+	for (std::vector<int>& level : levels)
+	{
+		level.clear();
+	}
+	for (int slot : pending)
+	{
+		levels[depths[slot]].push_back(slot);
+	}
+	pending.clear();
+
+	// A depth at a time, as every parent must be done before its children
+	for (int depth = 0; depth < (int)levels.size(); depth++)
+	{
+		const std::vector<int>& level = levels[depth];
+		int count = (int)level.size();
+		if (count == 0)
+		{
+			continue;
+		}
+
+		int jobs = count < PARALLEL_NODES ? 1 : pool.size() * JOBS_PER_THREAD;
+		found.resize(jobs);
+		auto job = [&](int j)
+		{
+			std::vector<int>& marked = found[j];
+			marked.clear();
+			for (int i = count * j / jobs; i < count * (j + 1) / jobs; i++)
+			{
+				int slot = level[i];
+				if (parents[slot] < 0)
+				{
+					memcpy(&worlds[slot * 16], &locals[slot * 16], 16 * sizeof(float));
+				}
+				else
+				{
+					multiplyMatrices(&worlds[parents[slot] * 16], &locals[slot * 16], &worlds[slot * 16]);
+				}
+				dirty[slot] = 0;
+
+				// Only this node's job touches its children's flags
+				for (int child = firstChildren[slot]; child < firstChildren[slot] + childCounts[slot]; child++)
+				{
+					if (!dirty[child])
+					{
+						dirty[child] = 1;
+						marked.push_back(child);
+					}
+				}
+			}
+		};
+		if (jobs == 1)
+		{
+			job(0);
+		}
+		else
+		{
+			pool.parallelFor(jobs, job);
+		}
+
+		for (int j = 0; j < jobs; j++)
+		{
+			if (!found[j].empty())
+			{
+				levels[depth + 1].insert(levels[depth + 1].end(), found[j].begin(), found[j].end());
+			}
+		}
+		updatedCount += count;
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Transform hierarchy that keeps world matrices between frames, in place of re-running
+// glPushMatrix/glMultMatrixf/glPopMatrix nesting every frame.
+// Nodes are stored as one array per field, sorted by depth and then by parent, so a parent
+// always comes before its children and each node's children sit next to each other.
+// setLocal only marks a node dirty; update() then recomputes the dirty nodes and everything
+// under them, one depth at a time, and nothing else
+class SceneGraph
+{
+	public:
+		SceneGraph();
+
+		// Adds a node under parent, or a root when parent is -1, and returns its handle.
+		// Matrices are column-major, as glMultMatrixf takes them
+		int addNode(int parent, const float* local);
+		void setLocal(int node, const float* local);
+
+		// Brings every world matrix up to date
+		void update(ThreadPool& pool);
+
+		int size() const { return (int)parents.size(); }
+		const float* world(int node) const { return &worlds[slots[node] * 16]; }
+		// Nodes recomputed by the last update
+		int updated() const { return updatedCount; }
+
+	private:
+		// Per node in storage order
+		std::vector<float> locals; // 16 floats each
+		std::vector<float> worlds;
+		std::vector<int> parents; // Storage index, -1 for roots
+		std::vector<int> depths;
+		std::vector<int> firstChildren;
+		std::vector<int> childCounts;
+		std::vector<unsigned char> dirty;
+		std::vector<int> handles; // Handle of the node at each storage index
+
+		std::vector<int> slots; // Storage index of each handle
+		std::vector<int> pending; // Nodes marked dirty since the last update
+		std::vector<std::vector<int> > levels; // Dirty nodes by depth, while updating
+		std::vector<std::vector<int> > found; // Children each job marked dirty
+		bool sorted;
+		int updatedCount;
+
+		// Restores depth order after nodes were added
+		void sort();
+};
+
+// out = a * b for column-major 4x4 matrices, out apart from both
+void multiplyMatrices(const float* a, const float* b, float* out);
+
+#endif
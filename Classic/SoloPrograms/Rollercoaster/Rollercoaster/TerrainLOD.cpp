@@ -0,0 +1,736 @@
+#include "TerrainLOD.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+#define TILE_SAMPLES (TERRAIN_TILE_CELLS + 1)
+#define NODES_PER_TILE (TERRAIN_TILE_CELLS / TERRAIN_GRID) // Along each side
+#define TOP_LEVEL (TERRAIN_LEVELS - 1)
+#define NODE_RANGE 2.5f // Each level is drawn out to this many of its nodes' widths from the eye
+#define MORPH_START 0.7f // How far through its part of the range a level starts turning into the next
+#define MAX_TILES 64 // Resident at once
+#define TILE_UPLOADS 2 // A frame
+
+#define GROUND_Y -4.75f // Where drawGround() had the top of its cube
+#define BUMPS 0.3f // Height of the ground's roughness around the ride
+#define MOUNTAIN_HEIGHT 90.0f
+#define RIDE_NEAR 30.0f // The fixed ride runs down -Z between these, kept flat
+#define RIDE_FAR -110.0f
+#define HEIGHT_BASE -5.0f // Height at texel value 0
+#define HEIGHT_SPAN 100.0f // From texel value 0 to 65535
+
+// The Windows SDK headers stop at OpenGL 1.1, so shaders come from glutGetProcAddress too
+#ifndef GL_VERTEX_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS 0x8B4C
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+typedef GLuint (APIENTRY *CreateShaderProc)(GLenum type);
+typedef void (APIENTRY *ShaderSourceProc)(GLuint shader, GLsizei count, const char* const* strings, const GLint* lengths);
+typedef void (APIENTRY *CompileShaderProc)(GLuint shader);
+typedef void (APIENTRY *GetShaderivProc)(GLuint shader, GLenum name, GLint* value);
+typedef void (APIENTRY *GetInfoLogProc)(GLuint object, GLsizei size, GLsizei* length, char* log);
+typedef GLuint (APIENTRY *CreateProgramProc)();
+typedef void (APIENTRY *AttachShaderProc)(GLuint program, GLuint shader);
+typedef void (APIENTRY *LinkProgramProc)(GLuint program);
+typedef void (APIENTRY *GetProgramivProc)(GLuint program, GLenum name, GLint* value);
+typedef void (APIENTRY *UseProgramProc)(GLuint program);
+typedef GLint (APIENTRY *GetUniformLocationProc)(GLuint program, const char* name);
+typedef void (APIENTRY *Uniform1iProc)(GLint location, GLint x);
+typedef void (APIENTRY *Uniform2fProc)(GLint location, GLfloat x, GLfloat y);
+typedef void (APIENTRY *Uniform3fProc)(GLint location, GLfloat x, GLfloat y, GLfloat z);
+typedef void (APIENTRY *Uniform4fProc)(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+
+static CreateShaderProc createShader = NULL;
+static ShaderSourceProc shaderSource = NULL;
+static CompileShaderProc compileShader = NULL;
+static GetShaderivProc getShaderiv = NULL;
+static GetInfoLogProc getShaderInfoLog = NULL;
+static CreateProgramProc createProgram = NULL;
+static AttachShaderProc attachShader = NULL;
+static LinkProgramProc linkProgram = NULL;
+static GetProgramivProc getProgramiv = NULL;
+static GetInfoLogProc getProgramInfoLog = NULL;
+static UseProgramProc useProgram = NULL;
+static GetUniformLocationProc getUniformLocation = NULL;
+static Uniform1iProc uniform1i = NULL;
+static Uniform2fProc uniform2f = NULL;
+static Uniform3fProc uniform3f = NULL;
+static Uniform4fProc uniform4f = NULL;
+
+// Places a grid vertex of a node, morphs it towards the next level out and lights it as
+// GL_LIGHT0 would, with the colour standing in for the diffuse material as glColorMaterial does
+static const char* VERTEX_SHADER =
+	"uniform sampler2D heights;\n"
+	"uniform vec4 node; // World x and z of the node's corner, then its cell size\n"
+	"uniform vec4 tile; // World x and z of the tile's first sample, then scale and offset to texture coordinates\n"
+	"uniform vec2 morph; // Distance morphing starts at, then one over the distance it takes\n"
+	"uniform vec3 eye;\n"
+	"uniform vec2 heightRange; // Height at texel value 0, then from 0 to 1\n"
+	"\n"
+	"vec3 fetch(vec2 world)\n"
+	"{\n"
+	"	return texture2DLod(heights, (world - tile.xy) * tile.z + tile.w, 0.0).rgb;\n"
+	"}\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 grid = gl_Vertex.xz;\n"
+	"	vec2 world = node.xy + grid * node.z;\n"
+	"	vec3 texel = fetch(world);\n"
+	"\n"
+	"	// Odd vertices slide onto their even neighbours, leaving the next level's grid\n"
+	"	float k = clamp((distance(eye, vec3(world.x, heightRange.x + texel.r * heightRange.y, world.y)) - morph.x) * morph.y, 0.0, 1.0);\n"
+	"	vec2 target = world - fract(grid * 0.5) * 2.0 * node.z;\n"
+	"	texel = mix(texel, fetch(target), k);\n"
+	"	world = mix(world, target, k);\n"
+	"\n"
+	"	vec4 position = vec4(world.x, heightRange.x + texel.r * heightRange.y, world.y, 1.0);\n"
+	"	vec2 slope = texel.gb * 2.0 - 1.0;\n"
+	"	vec3 normal = normalize(gl_NormalMatrix * vec3(slope.x, sqrt(max(1.0 - dot(slope, slope), 0.0)), slope.y));\n"
+	"	vec3 eyePosition = (gl_ModelViewMatrix * position).xyz;\n"
+	"	vec3 light = normalize(gl_LightSource[0].position.xyz - eyePosition * gl_LightSource[0].position.w);\n"
+	"	float diffuse = max(dot(normal, light), 0.0);\n"
+	"	float specular = diffuse > 0.0 ? pow(max(dot(normal, normalize(light + vec3(0.0, 0.0, 1.0))), 0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+	"	gl_FrontColor = (gl_LightModel.ambient + gl_LightSource[0].ambient) * gl_FrontMaterial.ambient\n"
+	"		+ gl_LightSource[0].diffuse * gl_Color * diffuse + gl_LightSource[0].specular * gl_FrontMaterial.specular * specular;\n"
+	"	gl_FrontColor.a = gl_Color.a;\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * position;\n"
+	"}\n";
+
+static const char* FRAGMENT_SHADER =
+	"void main()\n"
+	"{\n"
+	"	gl_FragColor = gl_Color;\n"
+	"}\n";
+
+// Corner values of the noise lattice, in [0, 1)
+static float lattice(int x, int z)
+{
+	unsigned int h = (unsigned int)x * 73856093u ^ (unsigned int)z * 19349663u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	return (h ^ (h >> 16)) * (1.0f / 4294967296.0f);
+}
+
+static float valueNoise(float x, float z)
+{
+	float cellX = floorf(x), cellZ = floorf(z);
+	int ix = (int)cellX, iz = (int)cellZ;
+	float fx = x - cellX, fz = z - cellZ;
+	fx = fx * fx * (3.0f - 2.0f * fx);
+	fz = fz * fz * (3.0f - 2.0f * fz);
+	float near = lattice(ix, iz) + fx * (lattice(ix + 1, iz) - lattice(ix, iz));
+	float far = lattice(ix, iz + 1) + fx * (lattice(ix + 1, iz + 1) - lattice(ix, iz + 1));
+	return near + fz * (far - near);
+}
+
+// Height of heightmap sample (x, z), the one place the rest of the terrain reads the map from:
+// rough ground round the fixed ride where drawGround() had it, rising into hills away from it
+static float sampleHeight(int x, int z)
+{
+	float worldX = (x - TERRAIN_CELLS / 2) * TERRAIN_SPACING;
+	float worldZ = (z - TERRAIN_CELLS / 2) * TERRAIN_SPACING;
+
+	float hills = 0.0f, amplitude = 0.5f, frequency = 1.0f / 512.0f;
+	for (int octave = 0; octave < 7; octave++)
+	{
+		hills += amplitude * valueNoise(worldX * frequency, worldZ * frequency);
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+
+	float beyond = fmaxf(fmaxf(RIDE_FAR - worldZ, worldZ - RIDE_NEAR), 0.0f);
+	float away = fminf(fmaxf((sqrtf(worldX * worldX + beyond * beyond) - 20.0f) / 130.0f, 0.0f), 1.0f);
+	away = away * away * (3.0f - 2.0f * away);
+	return GROUND_Y + BUMPS * valueNoise(worldX / 6.0f, worldZ / 6.0f) + away * MOUNTAIN_HEIGHT * hills * hills;
+}
+
+static bool boxInFrustum(const Frustum& frustum, const float* min, const float* max)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		const float* plane = frustum.planes[p];
+		float x = plane[0] > 0.0f ? max[0] : min[0];
+		float y = plane[1] > 0.0f ? max[1] : min[1];
+		float z = plane[2] > 0.0f ? max[2] : min[2];
+		if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool sphereTouchesBox(const float* centre, float radius, const float* min, const float* max)
+{
+	float squared = 0.0f;
+	for (int k = 0; k < 3; k++)
+	{
+		float outside = fmaxf(fmaxf(min[k] - centre[k], centre[k] - max[k]), 0.0f);
+		squared += outside * outside;
+	}
+	return squared <= radius * radius;
+}
+
+static GLuint compile(GLenum type, const char* source)
+{
+	GLuint shader = createShader(type);
+	shaderSource(shader, 1, &source, NULL);
+	compileShader(shader);
+	GLint compiled = 0;
+	getShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (!compiled)
+	{
+		char log[1024];
+		getShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("Terrain shader failed to compile:\n%s\n", log);
+		return 0;
+	}
+	return shader;
+}
+
+TerrainLOD::TerrainLOD()
+{
+	nodesDrawn = 0;
+	triangles = 0;
+	coarser = 0;
+	tilesUploaded = 0;
+	ready = false;
+	program = 0;
+	nodeUniform = tileUniform = morphUniform = eyeUniform = heightUniform = -1;
+	frame = 0;
+	generating = -1;
+	generatedCount = 0;
+	stopping = false;
+	for (int level = 0; level < TERRAIN_LEVELS; level++)
+	{
+		ranges[level] = NODE_RANGE * TERRAIN_GRID * (float)(1 << level) * TERRAIN_SPACING;
+	}
+}
+
+int TerrainLOD::tilesAcross(int level)
+{
+	return std::max((TERRAIN_CELLS / TERRAIN_TILE_CELLS) >> level, 1);
+}
+
+long long TerrainLOD::tileKey(int level, int x, int z)
+{
+	return ((long long)level << 40) | ((long long)x << 20) | z;
+}
+
+bool TerrainLOD::init()
+{
+	// As with buffer objects, check the version as well as the pointers
+	int major = 0, minor = 0;
+	const char* version = (const char*)glGetString(GL_VERSION);
+	GLint vertexTextures = 0;
+	if (version != NULL && sscanf(version, "%d.%d", &major, &minor) == 2 && major >= 2)
+	{
+		glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &vertexTextures);
+	}
+	if (vertexTextures == 0)
+	{
+		printf("GL %s can't read textures in vertex shaders, keeping the flat ground\n", version ? version : "?");
+		return false;
+	}
+
+	createShader = (CreateShaderProc)glutGetProcAddress("glCreateShader");
+	shaderSource = (ShaderSourceProc)glutGetProcAddress("glShaderSource");
+	compileShader = (CompileShaderProc)glutGetProcAddress("glCompileShader");
+	getShaderiv = (GetShaderivProc)glutGetProcAddress("glGetShaderiv");
+	getShaderInfoLog = (GetInfoLogProc)glutGetProcAddress("glGetShaderInfoLog");
+	createProgram = (CreateProgramProc)glutGetProcAddress("glCreateProgram");
+	attachShader = (AttachShaderProc)glutGetProcAddress("glAttachShader");
+	linkProgram = (LinkProgramProc)glutGetProcAddress("glLinkProgram");
+	getProgramiv = (GetProgramivProc)glutGetProcAddress("glGetProgramiv");
+	getProgramInfoLog = (GetInfoLogProc)glutGetProcAddress("glGetProgramInfoLog");
+	useProgram = (UseProgramProc)glutGetProcAddress("glUseProgram");
+	getUniformLocation = (GetUniformLocationProc)glutGetProcAddress("glGetUniformLocation");
+	uniform1i = (Uniform1iProc)glutGetProcAddress("glUniform1i");
+	uniform2f = (Uniform2fProc)glutGetProcAddress("glUniform2f");
+	uniform3f = (Uniform3fProc)glutGetProcAddress("glUniform3f");
+	uniform4f = (Uniform4fProc)glutGetProcAddress("glUniform4f");
+	if (!createShader || !shaderSource || !compileShader || !getShaderiv || !getShaderInfoLog || !createProgram
+		|| !attachShader || !linkProgram || !getProgramiv || !getProgramInfoLog || !useProgram || !getUniformLocation
+		|| !uniform1i || !uniform2f || !uniform3f || !uniform4f)
+	{
+		return false;
+	}
+
+	GLuint vertexShader = compile(GL_VERTEX_SHADER, VERTEX_SHADER);
+	GLuint fragmentShader = compile(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+	if (vertexShader == 0 || fragmentShader == 0)
+	{
+		return false;
+	}
+	program = createProgram();
+	attachShader(program, vertexShader);
+	attachShader(program, fragmentShader);
+	linkProgram(program);
+	GLint linked = 0;
+	getProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		char log[1024];
+		getProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("Terrain shader failed to link:\n%s\n", log);
+		return false;
+	}
+	nodeUniform = getUniformLocation(program, "node");
+	tileUniform = getUniformLocation(program, "tile");
+	morphUniform = getUniformLocation(program, "morph");
+	eyeUniform = getUniformLocation(program, "eye");
+	heightUniform = getUniformLocation(program, "heightRange");
+	useProgram(program);
+	uniform1i(getUniformLocation(program, "heights"), 0);
+	useProgram(0);
+
+	// The shared grid, with vertices at whole cell coordinates in x and z and each quarter's
+	// triangles together, so a node can draw only some quarters
+	initBatch(grid, GL_TRIANGLES, 1.0f, 1.0f, 1.0f);
+	for (int z = 0; z <= TERRAIN_GRID; z++)
+	{
+		for (int x = 0; x <= TERRAIN_GRID; x++)
+		{
+			const GLfloat vertex[6] = { (GLfloat)x, 0.0f, (GLfloat)z, 0.0f, 1.0f, 0.0f };
+			grid.vertices.insert(grid.vertices.end(), vertex, vertex + 6);
+		}
+	}
+	const int HALF = TERRAIN_GRID / 2;
+	for (int quarter = 0; quarter < 4; quarter++)
+	{
+		for (int z = (quarter >> 1) * HALF; z < ((quarter >> 1) + 1) * HALF; z++)
+		{
+			for (int x = (quarter & 1) * HALF; x < ((quarter & 1) + 1) * HALF; x++)
+			{
+				// Counterclockwise seen from above
+				GLuint a = z * (TERRAIN_GRID + 1) + x;
+				GLuint b = a + 1;
+				GLuint c = a + TERRAIN_GRID + 2;
+				GLuint d = a + TERRAIN_GRID + 1;
+				const GLuint quad[6] = { a, c, b, a, d, c };
+				grid.indices.insert(grid.indices.end(), quad, quad + 6);
+			}
+		}
+	}
+	uploadBatch(grid);
+
+	for (int level = 0; level < TERRAIN_LEVELS; level++)
+	{
+		tileSlots[level].assign(tilesAcross(level) * tilesAcross(level), -1);
+	}
+
+	// The coarsest tile covers the whole map, so there is always something to draw
+	Tile top;
+	generateTile(TOP_LEVEL, 0, 0, top);
+	upload(top);
+
+	stopping = false;
+	worker = std::thread(&TerrainLOD::generate, this);
+	ready = true;
+	return true;
+}
+
+void TerrainLOD::stop()
+{
+	if (!worker.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+float TerrainLOD::floorHeight() const
+{
+	// One texel value under the ground's lowest, for rounding
+	return GROUND_Y - HEIGHT_SPAN / 65535.0f;
+}
+
+float TerrainLOD::height(float x, float z) const
+{
+	int sampleX = (int)floorf(x / TERRAIN_SPACING + 0.5f) + TERRAIN_CELLS / 2;
+	int sampleZ = (int)floorf(z / TERRAIN_SPACING + 0.5f) + TERRAIN_CELLS / 2;
+	return sampleHeight(std::min(std::max(sampleX, 0), TERRAIN_CELLS), std::min(std::max(sampleZ, 0), TERRAIN_CELLS));
+}
+
+float TerrainLOD::highestAt(float x, float z) const
+{
+	int cellX = (int)floorf(x / TERRAIN_SPACING) + TERRAIN_CELLS / 2;
+	int cellZ = (int)floorf(z / TERRAIN_SPACING) + TERRAIN_CELLS / 2;
+	if (!ready || cellX < 0 || cellZ < 0 || cellX >= TERRAIN_CELLS || cellZ >= TERRAIN_CELLS)
+	{
+		return 1e30f;
+	}
+
+	// Every level is in range at the point itself, so selection went down to the first level
+	// lacking the finer tile
+	int level = TOP_LEVEL;
+	while (level > 0 && tileSlots[level - 1][((cellZ >> (level - 1)) / TERRAIN_TILE_CELLS) * tilesAcross(level - 1)
+		+ (cellX >> (level - 1)) / TERRAIN_TILE_CELLS] >= 0)
+	{
+		level--;
+	}
+	float min[3], max[3];
+	nodeBounds(level, (cellX >> level) / TERRAIN_GRID, (cellZ >> level) / TERRAIN_GRID, min, max);
+	return max[1];
+}
+
+size_t TerrainLOD::residentBytes() const
+{
+	return (size_t)tilesResident() * TILE_SAMPLES * TILE_SAMPLES * 3 * sizeof(unsigned short);
+}
+
+void TerrainLOD::generateTile(int level, int x, int z, Tile& tile)
+{
+	// With a sample of border all round, for the normals. Tiles of the coarsest levels reach
+	// past the map, where its edge samples carry on
+	const int ROW = TILE_SAMPLES + 2;
+	int stride = 1 << level;
+	std::vector<float> heights(ROW * ROW);
+	for (int j = 0; j < ROW; j++)
+	{
+		int sampleZ = std::min(std::max((z * TERRAIN_TILE_CELLS + j - 1) * stride, 0), TERRAIN_CELLS);
+		for (int i = 0; i < ROW; i++)
+		{
+			int sampleX = std::min(std::max((x * TERRAIN_TILE_CELLS + i - 1) * stride, 0), TERRAIN_CELLS);
+			heights[j * ROW + i] = sampleHeight(sampleX, sampleZ);
+		}
+	}
+
+	tile.level = level;
+	tile.x = x;
+	tile.z = z;
+	tile.texture = 0;
+	tile.lastUsed = 0;
+	tile.texels.resize(TILE_SAMPLES * TILE_SAMPLES * 3);
+	std::vector<float> drawn(TILE_SAMPLES * TILE_SAMPLES); // Heights as the shader will decode them
+	for (int j = 0; j < TILE_SAMPLES; j++)
+	{
+		for (int i = 0; i < TILE_SAMPLES; i++)
+		{
+			const float* h = &heights[(j + 1) * ROW + i + 1];
+			float slopeX = (h[-1] - h[1]) / (2.0f * stride * TERRAIN_SPACING);
+			float slopeZ = (h[-ROW] - h[ROW]) / (2.0f * stride * TERRAIN_SPACING);
+			float length = sqrtf(slopeX * slopeX + 1.0f + slopeZ * slopeZ);
+
+			unsigned short* texel = &tile.texels[(j * TILE_SAMPLES + i) * 3];
+			float scaled = fminf(fmaxf((h[0] - HEIGHT_BASE) / HEIGHT_SPAN, 0.0f), 1.0f);
+			texel[0] = (unsigned short)(scaled * 65535.0f + 0.5f);
+			texel[1] = (unsigned short)((slopeX / length * 0.5f + 0.5f) * 65535.0f + 0.5f);
+			texel[2] = (unsigned short)((slopeZ / length * 0.5f + 0.5f) * 65535.0f + 0.5f);
+			drawn[j * TILE_SAMPLES + i] = HEIGHT_BASE + texel[0] / 65535.0f * HEIGHT_SPAN;
+		}
+	}
+
+	tile.nodeMins.resize(NODES_PER_TILE * NODES_PER_TILE);
+	tile.nodeMaxs.resize(NODES_PER_TILE * NODES_PER_TILE);
+	for (int node = 0; node < NODES_PER_TILE * NODES_PER_TILE; node++)
+	{
+		int firstX = node % NODES_PER_TILE * TERRAIN_GRID;
+		int firstZ = node / NODES_PER_TILE * TERRAIN_GRID;
+		float low = 1e30f, high = -1e30f;
+		for (int j = firstZ; j <= firstZ + TERRAIN_GRID; j++)
+		{
+			for (int i = firstX; i <= firstX + TERRAIN_GRID; i++)
+			{
+				low = fminf(low, drawn[j * TILE_SAMPLES + i]);
+				high = fmaxf(high, drawn[j * TILE_SAMPLES + i]);
+			}
+		}
+		tile.nodeMins[node] = low;
+		tile.nodeMaxs[node] = high;
+	}
+}
+
+void TerrainLOD::generate()
+{
+	while (true)
+	{
+		long long key;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !wanted.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+			key = wanted.front();
+			wanted.erase(wanted.begin());
+			generating = key;
+		}
+
+		Tile tile;
+		generateTile((int)(key >> 40), (int)(key >> 20) & 0xFFFFF, (int)key & 0xFFFFF, tile);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.push_back(std::move(tile));
+		generating = -1;
+		generatedCount++;
+	}
+}
+
+bool TerrainLOD::upload(Tile& tile)
+{
+	// A free slot, a new one, or the one least recently used before last frame, never the
+	// coarsest, which selection starts from
+	int slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else if (slots.size() < MAX_TILES)
+	{
+		slot = (int)slots.size();
+		slots.push_back(Tile());
+		slots.back().texture = 0;
+	}
+	else
+	{
+		slot = -1;
+		for (int s = 0; s < (int)slots.size(); s++)
+		{
+			if (slots[s].level < TOP_LEVEL && slots[s].lastUsed + 1 < frame && (slot < 0 || slots[s].lastUsed < slots[slot].lastUsed))
+			{
+				slot = s;
+			}
+		}
+		if (slot < 0)
+		{
+			return false;
+		}
+		const Tile& old = slots[slot];
+		tileSlots[old.level][old.z * tilesAcross(old.level) + old.x] = -1;
+	}
+
+	// Reuse the slot's texture, and free the texels once GL has them
+	GLuint texture = slots[slot].texture;
+	if (texture == 0)
+	{
+		glGenTextures(1, &texture);
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16, TILE_SAMPLES, TILE_SAMPLES, 0, GL_RGB, GL_UNSIGNED_SHORT, tile.texels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	std::vector<unsigned short>().swap(tile.texels);
+
+	slots[slot] = std::move(tile);
+	slots[slot].texture = texture;
+	slots[slot].lastUsed = frame;
+	tileSlots[slots[slot].level][slots[slot].z * tilesAcross(slots[slot].level) + slots[slot].x] = slot;
+	return true;
+}
+
+int TerrainLOD::residentSlot(int level, int x, int z)
+{
+	int slot = tileSlots[level][z * tilesAcross(level) + x];
+	if (slot >= 0)
+	{
+		slots[slot].lastUsed = frame;
+	}
+	return slot;
+}
+
+void TerrainLOD::nodeBounds(int level, int x, int z, float* min, float* max) const
+{
+	const Tile& tile = slots[tileSlots[level][z / NODES_PER_TILE * tilesAcross(level) + x / NODES_PER_TILE]];
+	int node = z % NODES_PER_TILE * NODES_PER_TILE + x % NODES_PER_TILE;
+	float size = TERRAIN_GRID * (float)(1 << level) * TERRAIN_SPACING;
+	min[0] = x * size - TERRAIN_CELLS / 2 * TERRAIN_SPACING;
+	min[1] = tile.nodeMins[node];
+	min[2] = z * size - TERRAIN_CELLS / 2 * TERRAIN_SPACING;
+	max[0] = min[0] + size;
+	max[1] = tile.nodeMaxs[node];
+	max[2] = min[2] + size;
+}
+
+bool TerrainLOD::select(int level, int x, int z, const Frustum& frustum, const float* eye)
+{
+	float min[3], max[3];
+	nodeBounds(level, x, z, min, max);
+	if (level < TOP_LEVEL && !sphereTouchesBox(eye, ranges[level], min, max))
+	{
+		return false;
+	}
+	if (!boxInFrustum(frustum, min, max))
+	{
+		return true;
+	}
+
+	int slot = residentSlot(level, x / NODES_PER_TILE, z / NODES_PER_TILE);
+	Selected node = { level, x, z, 15, slot };
+	if (level == 0 || !sphereTouchesBox(eye, ranges[level - 1], min, max))
+	{
+		selected.push_back(node);
+		return true;
+	}
+
+	// Children share one tile of the finer level, and wait for it at this level
+	int childX = x * 2 / NODES_PER_TILE, childZ = z * 2 / NODES_PER_TILE;
+	if (residentSlot(level - 1, childX, childZ) < 0)
+	{
+		missing.push_back(tileKey(level - 1, childX, childZ));
+		selected.push_back(node);
+		coarser++;
+		return true;
+	}
+
+	// Quarters beyond the finer level's range are drawn at this one
+	node.quarters = 0;
+	for (int quarter = 0; quarter < 4; quarter++)
+	{
+		int cx = x * 2 + (quarter & 1), cz = z * 2 + (quarter >> 1);
+		if (!select(level - 1, cx, cz, frustum, eye))
+		{
+			nodeBounds(level - 1, cx, cz, min, max);
+			node.quarters |= boxInFrustum(frustum, min, max) ? 1 << quarter : 0;
+		}
+	}
+	if (node.quarters != 0)
+	{
+		selected.push_back(node);
+	}
+	return true;
+}
+
+void TerrainLOD::draw(const Frustum& frustum, const float* eye, const float* color)
+{
+	if (!ready)
+	{
+		return;
+	}
+	frame++;
+
+	// Upload what the worker finished, oldest first, before choosing nodes so they can use it
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while (!finished.empty())
+		{
+			pending.push_back(std::move(finished.front()));
+			finished.pop_front();
+		}
+	}
+	tilesUploaded = 0;
+	while (!pending.empty() && tilesUploaded < TILE_UPLOADS && upload(pending.front()))
+	{
+		pending.pop_front();
+		tilesUploaded++;
+	}
+
+	selected.clear();
+	missing.clear();
+	coarser = 0;
+	select(TOP_LEVEL, 0, 0, frustum, eye);
+
+	// Ask for the tiles that were missed, coarsest first as finer ones are only reached through them
+	std::sort(missing.begin(), missing.end(), [](long long a, long long b) { return (a >> 40) != (b >> 40) ? (a >> 40) > (b >> 40) : a < b; });
+	missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wanted.clear();
+		for (long long key : missing)
+		{
+			bool waiting = key == generating;
+			for (size_t i = 0; i < pending.size() && !waiting; i++)
+			{
+				waiting = tileKey(pending[i].level, pending[i].x, pending[i].z) == key;
+			}
+			for (size_t i = 0; i < finished.size() && !waiting; i++)
+			{
+				waiting = tileKey(finished[i].level, finished[i].x, finished[i].z) == key;
+			}
+			if (!waiting)
+			{
+				wanted.push_back(key);
+			}
+		}
+	}
+	wake.notify_one();
+
+	useProgram(program);
+	uniform3f(eyeUniform, eye[0], eye[1], eye[2]);
+	uniform2f(heightUniform, HEIGHT_BASE, HEIGHT_SPAN);
+	grid.color[0] = color[0];
+	grid.color[1] = color[1];
+	grid.color[2] = color[2];
+
+	const GLsizei QUARTER = TERRAIN_GRID * TERRAIN_GRID / 4 * 6;
+	int bound = -1;
+	nodesDrawn = (int)selected.size();
+	triangles = 0;
+	for (const Selected& node : selected)
+	{
+		if (node.slot != bound)
+		{
+			const Tile& tile = slots[node.slot];
+			float stride = (float)(1 << tile.level) * TERRAIN_SPACING;
+			glBindTexture(GL_TEXTURE_2D, tile.texture);
+			uniform4f(tileUniform, tile.x * TERRAIN_TILE_CELLS * stride - TERRAIN_CELLS / 2 * TERRAIN_SPACING,
+				tile.z * TERRAIN_TILE_CELLS * stride - TERRAIN_CELLS / 2 * TERRAIN_SPACING,
+				1.0f / (stride * TILE_SAMPLES), 0.5f / TILE_SAMPLES);
+			bound = node.slot;
+		}
+
+		float cell = (float)(1 << node.level) * TERRAIN_SPACING;
+		uniform4f(nodeUniform, node.x * TERRAIN_GRID * cell - TERRAIN_CELLS / 2 * TERRAIN_SPACING,
+			node.z * TERRAIN_GRID * cell - TERRAIN_CELLS / 2 * TERRAIN_SPACING, cell, 0.0f);
+
+		// Morph over the far part of the level's range, done just short of its end
+		if (node.level == TOP_LEVEL)
+		{
+			uniform2f(morphUniform, 1e30f, 0.0f);
+		}
+		else
+		{
+			float end = ranges[node.level] * 0.99f;
+			float previous = node.level == 0 ? 0.0f : ranges[node.level - 1];
+			float start = previous + MORPH_START * (end - previous);
+			uniform2f(morphUniform, start, 1.0f / (end - start));
+		}
+
+		GLuint firsts[4];
+		GLsizei counts[4];
+		int runs = 0;
+		for (int quarter = 0; quarter < 4; quarter++)
+		{
+			if (!(node.quarters & (1 << quarter)))
+			{
+				continue;
+			}
+			if (runs > 0 && firsts[runs - 1] + counts[runs - 1] == quarter * (GLuint)QUARTER)
+			{
+				counts[runs - 1] += QUARTER;
+			}
+			else
+			{
+				firsts[runs] = quarter * QUARTER;
+				counts[runs] = QUARTER;
+				runs++;
+			}
+			triangles += QUARTER / 3;
+		}
+		drawBatchRanges(grid, firsts, counts, runs);
+	}
+
+	useProgram(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,126 @@
+#ifndef TERRAIN_LOD_H
+#define TERRAIN_LOD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BakedMesh.h"
+#include "ChunkBVH.h"
+
+#define TERRAIN_CELLS 16384 // Heightmap cells along each side, one sample more than this
+#define TERRAIN_SPACING 1.0f // Between samples, with the map centred on the origin
+#define TERRAIN_GRID 32 // Cells along each side of the shared grid mesh
+#define TERRAIN_LEVELS 10 // Levels of detail, the last a single node over the whole map
+#define TERRAIN_TILE_CELLS 256 // Cells along each side of a streamed tile
+
+// A heightmap of TERRAIN_CELLS squared, far too big to keep, drawn as a quadtree with continuous
+// level of detail in the manner of CDLOD. A node at level l covers TERRAIN_GRID cells of that
+// level, each 2^l samples across, and every node is drawn with the one grid mesh, moved, scaled
+// and displaced by a vertex shader. Nodes are chosen finer the nearer the eye they are, and over
+// the far part of each level's range the shader slides every other vertex onto its neighbour,
+// so a node has become its coarser parent by the time the parent takes over, with nothing popping.
+// The heightmap is kept as a pyramid of tiles, tile (l, x, z) holding every 2^l-th sample of its
+// area with a normal alongside, generated by a worker thread as they are asked for, uploaded a
+// few a frame and forgotten least recently used first. Until a level's tile arrives the nodes
+// that need it are drawn a level coarser
+class TerrainLOD
+{
+	public:
+		TerrainLOD();
+		~TerrainLOD() { stop(); }
+
+		// Builds the shader and grid and loads the coarsest tile, then starts the worker. Returns
+		// false, drawing nothing, when GL lacks shaders or textures in vertex shaders
+		bool init();
+		// Joins the worker
+		void stop();
+
+		// Picks the nodes to draw from eye through frustum, then draws them lit by GL_LIGHT0. Call
+		// once a frame, as it also uploads tiles the worker finished and asks for ones it lacked
+		void draw(const Frustum& frustum, const float* eye, const float* color);
+
+		// Lowest the terrain goes anywhere, so nothing under this height can be seen past it
+		float floorHeight() const;
+		// Height at the sample nearest x, z, as drawn at the finest level
+		float height(float x, float z) const;
+		// Highest the terrain drawn last frame can reach over x, z, from the bounds of the node
+		// selection drew there, or beyond any height off the map
+		float highestAt(float x, float z) const;
+
+		int nodesDrawn; // Last frame, whole or in part
+		int triangles; // Last frame
+		int coarser; // Nodes drawn a level coarser last frame, waiting for a tile
+		int tilesUploaded; // Last frame
+		int tilesResident() const { return (int)slots.size() - (int)freeSlots.size(); }
+		size_t residentBytes() const;
+		int tilesGenerated() const { return generatedCount; }
+
+	private:
+		struct Tile
+		{
+			int level;
+			int x;
+			int z;
+			GLuint texture; // Heights and normals as 16 bit RGB
+			unsigned int lastUsed; // Frame
+			std::vector<unsigned short> texels; // Until uploaded
+			std::vector<float> nodeMins; // Lowest and highest sample of each node of its level in the tile
+			std::vector<float> nodeMaxs;
+		};
+
+		// A node, or some of its quarters, to draw this frame
+		struct Selected
+		{
+			int level;
+			int x;
+			int z;
+			int quarters; // Bit per quarter, x then z
+			int slot; // Tile it reads
+		};
+
+		bool ready; // init() succeeded
+		GLuint program;
+		BakedBatch grid;
+		GLint nodeUniform;
+		GLint tileUniform;
+		GLint morphUniform;
+		GLint eyeUniform;
+		GLint heightUniform;
+		float ranges[TERRAIN_LEVELS]; // Distance out to which each level is drawn
+
+		std::vector<Tile> slots;
+		std::vector<int> freeSlots;
+		std::vector<int> tileSlots[TERRAIN_LEVELS]; // Slot of each tile of a level, -1 when not resident
+		std::deque<Tile> pending; // Finished by the worker, waiting for an upload
+		std::vector<Selected> selected;
+		std::vector<long long> missing; // Tiles selection wanted this frame and lacked
+		unsigned int frame;
+
+		// Shared with the worker
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::vector<long long> wanted; // Tiles to generate, most wanted first
+		std::deque<Tile> finished;
+		long long generating; // Tile the worker is on, or -1
+		std::atomic<int> generatedCount; // Read by the render thread without the lock
+		bool stopping;
+
+		static int tilesAcross(int level);
+		static long long tileKey(int level, int x, int z);
+		static void generateTile(int level, int x, int z, Tile& tile);
+		void generate();
+		// Uploads a tile into a free or least recently used slot, false when every slot was used last frame
+		bool upload(Tile& tile);
+		int residentSlot(int level, int x, int z);
+		// Selects node (x, z) of level, or returns false when it is beyond the level's range and
+		// its parent should draw it instead
+		bool select(int level, int x, int z, const Frustum& frustum, const float* eye);
+		void nodeBounds(int level, int x, int z, float* min, float* max) const;
+};
+
+#endif
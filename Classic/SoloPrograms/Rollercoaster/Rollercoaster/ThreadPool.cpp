@@ -0,0 +1,101 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool()
+{
+	job = NULL;
+	count = 0;
+	next = 0;
+	busy = 0;
+	generation = 0;
+	stopping = false;
+}
+
+void ThreadPool::start(int threads)
+{
+	if (threads <= 0)
+	{
+		threads = (int)std::thread::hardware_concurrency();
+		threads = threads > 0 ? threads : 1;
+	}
+
+	stopping = false;
+	for (int i = 1; i < threads; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, generation));
+	}
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+}
+
+void ThreadPool::runJob()
+{
+	for (int i = next++; i < count; i = next++)
+	{
+		(*job)(i);
+	}
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& job)
+{
+	if (workers.empty() || count <= 1)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			job(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->job = &job;
+		this->count = count;
+		next = 0;
+		busy = (int)workers.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	runJob();
+
+	// The job lives on the caller's stack, so wait for every worker to let go of it
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return busy == 0; });
+	this->job = NULL;
+}
+
+void ThreadPool::workerLoop(unsigned int seen)
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+			if (stopping)
+			{
+				return;
+			}
+			seen = generation;
+		}
+
+		runJob();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy--;
+		}
+		done.notify_one();
+	}
+}
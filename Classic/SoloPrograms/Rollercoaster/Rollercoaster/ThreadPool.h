@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads kept alive between jobs, for splitting loops across cores.
+// One job runs at a time, and the thread that submits it works on it too
+class ThreadPool
+{
+	public:
+		ThreadPool();
+		~ThreadPool() { stop(); }
+
+		// Starts threads - 1 workers, or one per core less one when threads is 0
+		void start(int threads = 0);
+		// Finishes the running job and joins the workers
+		void stop();
+
+		// Threads that take part in a job, counting the caller
+		int size() const { return (int)workers.size() + 1; }
+
+		// Calls job(i) for every i in [0, count) across the pool and returns once all are done.
+		// Indices are handed out one at a time, so uneven jobs still balance
+		void parallelFor(int count, const std::function<void(int)>& job);
+
+	private:
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wake; // Signals the workers that a job started or the pool stopped
+		std::condition_variable done; // Signals the caller that a worker left the job
+		const std::function<void(int)>* job;
+		int count;
+		std::atomic<int> next; // Next index to hand out
+		int busy; // Workers still inside the current job
+		unsigned int generation; // Bumped per job, so workers run each job once
+		bool stopping;
+
+		// Runs every job started after generation seen, until the pool stops
+		void workerLoop(unsigned int seen);
+		void runJob();
+};
+
+#endif
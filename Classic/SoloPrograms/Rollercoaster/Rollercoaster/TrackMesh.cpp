@@ -0,0 +1,349 @@
+#include "TrackMesh.h"
+
+#include <math.h>
+
+#include "PillarLOD.h"
+
+#define CHUNK_LENGTH 32.0f // Track meshed by one job
+
+#define RAIL_SIDES 8
+#define RAIL_RADIUS 0.08f
+#define RAIL_OFFSET 0.5f // Rail centres either side of the centre line
+#define MAX_TURN 0.05f // Radians the track may turn between rings
+#define MIN_RING_STEP 0.05f
+#define MAX_RING_STEP 4.0f
+#define CURVATURE_STEP 0.05f // Distance over which the turn rate is measured
+
+#define TIE_HALF_WIDTH 0.6f
+#define TIE_HALF_SIZE 0.1f // Half height and half depth
+
+#define PILLAR_TOP 4.3f // Above the rails
+#define PILLAR_OFFSET 2.0f // Either side of the centre line
+
+#define TWO_PI 6.2831853f
+
+// Vertices and indices each piece adds
+#define RING_VERTICES (2 * RAIL_SIDES)
+#define SEGMENT_INDICES (2 * RAIL_SIDES * 6)
+#define TIE_VERTICES 24
+#define TIE_INDICES 36
+
+namespace
+{
+	// One job's share of the track and where its output goes
+	struct Chunk
+	{
+		float start;
+		float end;
+		std::vector<float> rings; // Distances of the rings this chunk emits
+		int firstTie; // Global index of the chunk's first tie, so tie k sits at k * tieGap
+		int tieCount;
+		int firstPillar; // Pillar pair k stands at 1 + k * pillarGap
+		int pillarCount;
+		GLuint vertexBase; // First vertex of the chunk's rings, then its ties, in the rails batch
+		GLuint indexBase; // First index of the chunk's segments, then its ties
+		int pillarBase; // First pillar in pillarTops
+	};
+
+	float dot(const float* a, const float* b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	// Radians per unit distance the track turns just ahead of distance
+	float turnRate(const TrackSpline& track, float distance)
+	{
+		TrackFrame a, b;
+		track.evaluate(distance, a);
+		track.evaluate(distance + CURVATURE_STEP, b);
+		float cosine = fminf(fmaxf(dot(a.tangent, b.tangent), -1.0f), 1.0f);
+		return acosf(cosine) / CURVATURE_STEP;
+	}
+
+	float ringStep(float rate)
+	{
+		float step = rate > 0.0f ? MAX_TURN / rate : MAX_RING_STEP;
+		return fminf(fmaxf(step, MIN_RING_STEP), MAX_RING_STEP);
+	}
+
+	void putVertex(GLfloat* out, const float* position, const float* normal)
+	{
+		out[0] = position[0];
+		out[1] = position[1];
+		out[2] = position[2];
+		out[3] = normal[0];
+		out[4] = normal[1];
+		out[5] = normal[2];
+	}
+
+	// Both rails' rings at one distance
+	void writeRing(const TrackFrame& frame, GLfloat* out)
+	{
+		for (int rail = 0; rail < 2; rail++)
+		{
+			float offset = rail == 0 ? -RAIL_OFFSET : RAIL_OFFSET;
+			for (int side = 0; side < RAIL_SIDES; side++)
+			{
+				float angle = TWO_PI * side / RAIL_SIDES;
+				float x = cosf(angle);
+				float y = sinf(angle);
+				float normal[3], position[3];
+				for (int k = 0; k < 3; k++)
+				{
+					normal[k] = frame.right[k] * x + frame.up[k] * y;
+					position[k] = frame.position[k] + frame.right[k] * offset + normal[k] * RAIL_RADIUS;
+				}
+				putVertex(out, position, normal);
+				out += 6;
+			}
+		}
+	}
+
+	// Quads joining both rails of the ring whose first vertex is from to those of the ring at to
+	void writeSegment(GLuint from, GLuint to, GLuint* out)
+	{
+		for (int rail = 0; rail < 2; rail++)
+		{
+			for (int side = 0; side < RAIL_SIDES; side++)
+			{
+				GLuint offset = rail * RAIL_SIDES;
+				GLuint next = rail * RAIL_SIDES + (side + 1) % RAIL_SIDES;
+				GLuint a = from + offset + side;
+				GLuint b = from + next;
+				GLuint c = to + next;
+				GLuint d = to + offset + side;
+				out[0] = a;
+				out[1] = c;
+				out[2] = b;
+				out[3] = a;
+				out[4] = d;
+				out[5] = c;
+				out += 6;
+			}
+		}
+	}
+
+	// Box across the rails in the track's frame. Each face lists its axis, then the two axes
+	// spanning it in the order that winds it counterclockwise from outside
+	void writeTie(const TrackFrame& frame, GLuint base, GLfloat* vertices, GLuint* indices)
+	{
+		static const int FACES[6][4] =
+		{
+			{ 0, 1, 1, 2 }, { 0, -1, 2, 1 },
+			{ 1, 1, 2, 0 }, { 1, -1, 0, 2 },
+			{ 2, 1, 0, 1 }, { 2, -1, 1, 0 }
+		};
+		const float half[3] = { TIE_HALF_WIDTH, TIE_HALF_SIZE, TIE_HALF_SIZE };
+		const float back[3] = { -frame.tangent[0], -frame.tangent[1], -frame.tangent[2] };
+		const float* axes[3] = { frame.right, frame.up, back };
+
+		for (int face = 0; face < 6; face++)
+		{
+			int axis = FACES[face][0];
+			float sign = (float)FACES[face][1];
+			const float* u = axes[FACES[face][2]];
+			const float* v = axes[FACES[face][3]];
+			float hu = half[FACES[face][2]];
+			float hv = half[FACES[face][3]];
+
+			float normal[3];
+			for (int k = 0; k < 3; k++)
+			{
+				normal[k] = axes[axis][k] * sign;
+			}
+			for (int corner = 0; corner < 4; corner++)
+			{
+				float a = (corner == 1 || corner == 2) ? hu : -hu;
+				float b = corner >= 2 ? hv : -hv;
+				float position[3];
+				for (int k = 0; k < 3; k++)
+				{
+					position[k] = frame.position[k] + normal[k] * half[axis] + u[k] * a + v[k] * b;
+				}
+				putVertex(vertices, position, normal);
+				vertices += 6;
+			}
+
+			GLuint first = base + face * 4;
+			const GLuint quad[6] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+			for (int i = 0; i < 6; i++)
+			{
+				*indices++ = quad[i];
+			}
+		}
+	}
+
+	void growBounds(const GLfloat* vertices, size_t count, float* min, float* max)
+	{
+		for (size_t i = 0; i < count; i++, vertices += 6)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				min[k] = fminf(min[k], vertices[k]);
+				max[k] = fmaxf(max[k], vertices[k]);
+			}
+		}
+	}
+
+	// First index k of the series offset + k * gap at or past distance
+	int firstAtOrPast(float distance, float offset, float gap)
+	{
+		int k = (int)ceilf((distance - offset) / gap);
+		return k > 0 ? k : 0;
+	}
+}
+
+TrackMeshStats buildTrackMesh(const TrackSpline& track, float tieGap, float pillarGap, ThreadPool& pool,
+	BakedBatch& rails, std::vector<float>& pillarTops, std::vector<TrackChunk>& trackChunks)
+{
+	float length = track.length();
+	int chunkCount = (int)ceilf(length / CHUNK_LENGTH);
+	chunkCount = chunkCount > 0 ? chunkCount : 1;
+	std::vector<Chunk> chunks(chunkCount);
+
+	// Place the rings and count everything, each chunk on its own
+	pool.parallelFor(chunkCount, [&](int c)
+	{
+		Chunk& chunk = chunks[c];
+		chunk.start = c * CHUNK_LENGTH;
+		chunk.end = c + 1 == chunkCount ? length : (c + 1) * CHUNK_LENGTH;
+
+		// Step by however far the track may go before turning MAX_TURN, checked at both ends
+		// of the step so a bend just ahead isn't skipped. The ring at end belongs to the next chunk
+		float distance = chunk.start;
+		while (true)
+		{
+			chunk.rings.push_back(distance);
+			float step = ringStep(turnRate(track, distance));
+			step = fminf(step, ringStep(turnRate(track, distance + step)));
+			distance += step;
+			if (distance > chunk.end - MIN_RING_STEP)
+			{
+				break;
+			}
+		}
+		if (c + 1 == chunkCount)
+		{
+			chunk.rings.push_back(length);
+		}
+
+		chunk.firstTie = firstAtOrPast(chunk.start, 0.0f, tieGap);
+		chunk.tieCount = firstAtOrPast(chunk.end, 0.0f, tieGap) - chunk.firstTie;
+		chunk.firstPillar = firstAtOrPast(chunk.start, 1.0f, pillarGap);
+		chunk.pillarCount = firstAtOrPast(chunk.end, 1.0f, pillarGap) - chunk.firstPillar;
+	});
+
+	// Hand out the output ranges in track order, so each chunk's geometry is one run of indices
+	int rings = 0;
+	int ties = 0;
+	int pillarCount = 0;
+	GLuint vertices = 0;
+	GLuint indices = 0;
+	for (int c = 0; c < chunkCount; c++)
+	{
+		Chunk& chunk = chunks[c];
+		int ringCount = (int)chunk.rings.size();
+		int segmentCount = c + 1 == chunkCount ? ringCount - 1 : ringCount;
+		chunk.vertexBase = vertices;
+		chunk.indexBase = indices;
+		chunk.pillarBase = pillarCount;
+		vertices += ringCount * RING_VERTICES + chunk.tieCount * TIE_VERTICES;
+		indices += segmentCount * SEGMENT_INDICES + chunk.tieCount * TIE_INDICES;
+		rings += ringCount;
+		ties += chunk.tieCount;
+		pillarCount += chunk.pillarCount * 2;
+	}
+
+	clearBatch(rails);
+	rails.vertices.resize((size_t)vertices * 6);
+	rails.indices.resize(indices);
+	pillarTops.resize((size_t)pillarCount * 3);
+	trackChunks.resize(chunkCount);
+
+	// Mesh every chunk into its ranges
+	pool.parallelFor(chunkCount, [&](int c)
+	{
+		const Chunk& chunk = chunks[c];
+		int ringCount = (int)chunk.rings.size();
+		TrackFrame frame;
+
+		GLuint* index = &rails.indices[chunk.indexBase];
+		for (int i = 0; i < ringCount; i++)
+		{
+			GLuint ring = chunk.vertexBase + i * RING_VERTICES;
+			track.evaluate(chunk.rings[i], frame);
+			writeRing(frame, &rails.vertices[(size_t)ring * 6]);
+			if (i + 1 < ringCount)
+			{
+				writeSegment(ring, ring + RING_VERTICES, index);
+				index += SEGMENT_INDICES;
+			}
+			else if (c + 1 < chunkCount)
+			{
+				writeSegment(ring, chunks[c + 1].vertexBase, index);
+				index += SEGMENT_INDICES;
+			}
+		}
+
+		GLuint tieBase = chunk.vertexBase + ringCount * RING_VERTICES;
+		for (int i = 0; i < chunk.tieCount; i++)
+		{
+			GLuint base = tieBase + i * TIE_VERTICES;
+			track.evaluate((chunk.firstTie + i) * tieGap, frame);
+			writeTie(frame, base, &rails.vertices[(size_t)base * 6], index);
+			index += TIE_INDICES;
+		}
+
+		// Bound everything the chunk draws, including the far end of its last segment
+		TrackChunk& out = trackChunks[c];
+		for (int k = 0; k < 3; k++)
+		{
+			out.min[k] = 1e30f;
+			out.max[k] = -1e30f;
+		}
+		size_t railVertices = ringCount * RING_VERTICES + chunk.tieCount * TIE_VERTICES;
+		growBounds(&rails.vertices[(size_t)chunk.vertexBase * 6], railVertices, out.min, out.max);
+
+		for (int i = 0; i < chunk.pillarCount; i++)
+		{
+			track.evaluate(1.0f + (chunk.firstPillar + i) * pillarGap, frame);
+			for (int side = 0; side < 2; side++)
+			{
+				float offset = side == 0 ? -PILLAR_OFFSET : PILLAR_OFFSET;
+				float* top = &pillarTops[(size_t)(chunk.pillarBase + i * 2 + side) * 3];
+				top[0] = frame.position[0] + frame.right[0] * offset;
+				top[1] = frame.position[1] + PILLAR_TOP;
+				top[2] = frame.position[2] + frame.right[2] * offset;
+
+				const float low[3] = { top[0] - PILLAR_RADIUS, top[1] - PILLAR_HEIGHT, top[2] - PILLAR_RADIUS };
+				const float high[3] = { top[0] + PILLAR_RADIUS, top[1], top[2] + PILLAR_RADIUS };
+				for (int k = 0; k < 3; k++)
+				{
+					out.min[k] = fminf(out.min[k], low[k]);
+					out.max[k] = fmaxf(out.max[k], high[k]);
+				}
+			}
+		}
+		if (c + 1 < chunkCount)
+		{
+			GLfloat ring[RING_VERTICES * 6];
+			track.evaluate(chunk.end, frame);
+			writeRing(frame, ring);
+			growBounds(ring, RING_VERTICES, out.min, out.max);
+		}
+
+		out.railFirst = chunk.indexBase;
+		out.railCount = (GLsizei)(index - &rails.indices[chunk.indexBase]);
+		out.firstPillar = chunk.pillarBase;
+		out.pillarCount = chunk.pillarCount * 2;
+	});
+
+	TrackMeshStats stats;
+	stats.chunks = chunkCount;
+	stats.rings = rings;
+	stats.ties = ties;
+	stats.pillars = pillarCount;
+	stats.vertices = (int)(rails.vertices.size() / 6);
+	stats.triangles = (int)(rails.indices.size() / 3);
+	return stats;
+}
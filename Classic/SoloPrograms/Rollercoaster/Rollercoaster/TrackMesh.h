@@ -0,0 +1,42 @@
+#ifndef TRACK_MESH_H
+#define TRACK_MESH_H
+
+#include "BakedMesh.h"
+#include "ThreadPool.h"
+#include "TrackSpline.h"
+
+// What buildTrackMesh produced
+struct TrackMeshStats
+{
+	int chunks;
+	int rings; // Cross-sections swept along the rails
+	int ties;
+	int pillars;
+	int vertices; // In the rails batch
+	int triangles;
+};
+
+// Where one chunk's geometry lies in space, in the rails batch and among the pillars, for
+// culling it as a whole
+struct TrackChunk
+{
+	float min[3];
+	float max[3];
+	GLuint railFirst; // Indices into the rails batch
+	GLsizei railCount;
+	int firstPillar;
+	int pillarCount;
+};
+
+// Sweeps the rail cross-section along the track, with rings closer together where it bends,
+// and adds a bar every tieGap and a pair of pillars every pillarGap. Rails and bars replace what
+// rails held, and pillarTops gets the top centre of each pillar, xyz each, for PillarLOD to draw.
+// The track is cut into fixed-length chunks that are meshed in parallel, each straight into its
+// own range of the preallocated arrays. A chunk stitches its last rails to the first ring of
+// the next chunk instead of repeating it, so joints are welded and the output is the same for
+// any number of threads. Chunks are laid out in track order, each one run of indices and one
+// run of pillars, and described in trackChunks
+TrackMeshStats buildTrackMesh(const TrackSpline& track, float tieGap, float pillarGap, ThreadPool& pool,
+	BakedBatch& rails, std::vector<float>& pillarTops, std::vector<TrackChunk>& trackChunks);
+
+#endif
@@ -0,0 +1,301 @@
+#include "TrackSpline.h"
+
+#include <math.h>
+
+// Samples per segment when measuring arc length, and per table step on long segments
+#define LENGTH_SAMPLES 64
+#define SAMPLES_PER_STEP 4
+
+static float dot(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void normalize(float* v)
+{
+	float length = sqrtf(dot(v, v));
+	if (length > 0.0f)
+	{
+		v[0] /= length;
+		v[1] /= length;
+		v[2] /= length;
+	}
+}
+
+void frameMatrix(const TrackFrame& frame, float* matrix)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		matrix[i] = frame.right[i];
+		matrix[4 + i] = frame.up[i];
+		matrix[8 + i] = -frame.tangent[i];
+		matrix[12 + i] = frame.position[i];
+	}
+	matrix[3] = matrix[7] = matrix[11] = 0.0f;
+	matrix[15] = 1.0f;
+}
+
+TrackSpline::TrackSpline()
+{
+	step = 1.0f;
+	totalLength = 0.0f;
+}
+
+void TrackSpline::build(const float* points, int count, float step)
+{
+	fit(points, count, step, false, NULL);
+}
+
+void TrackSpline::buildPiece(const float* points, int count, float step, const float* startUp)
+{
+	fit(points, count, step, true, startUp);
+}
+
+void TrackSpline::endUp(float* up) const
+{
+	for (int k = 0; k < 3; k++)
+	{
+		up[k] = ups[ups.size() - 3 + k];
+	}
+}
+
+void TrackSpline::fit(const float* points, int count, float step, bool guided, const float* startUp)
+{
+	segments.clear();
+	segmentStarts.clear();
+	parameters.clear();
+	ups.clear();
+	totalLength = 0.0f;
+
+	// Segments run from points[first] to points[last]
+	int first = guided ? 1 : 0;
+	int last = guided ? count - 2 : count - 1;
+	if (last - first < 1)
+	{
+		return;
+	}
+
+	// Hermite form of each segment. Unguided ends get mirrored phantom points, and knot spacing of
+	// sqrt(distance) (the centripetal variant) keeps long straights from overshooting into loops
+	for (int i = first; i < last; i++)
+	{
+		float p0[3], p1[3], p2[3], p3[3];
+		for (int k = 0; k < 3; k++)
+		{
+			p1[k] = points[i * 3 + k];
+			p2[k] = points[(i + 1) * 3 + k];
+			p0[k] = i > 0 ? points[(i - 1) * 3 + k] : 2.0f * p1[k] - p2[k];
+			p3[k] = i + 2 < count ? points[(i + 2) * 3 + k] : 2.0f * p2[k] - p1[k];
+		}
+
+		float d01[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float d12[3] = { p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2] };
+		float d23[3] = { p3[0] - p2[0], p3[1] - p2[1], p3[2] - p2[2] };
+		float t01 = fmaxf(sqrtf(sqrtf(dot(d01, d01))), 1e-4f);
+		float t12 = fmaxf(sqrtf(sqrtf(dot(d12, d12))), 1e-4f);
+		float t23 = fmaxf(sqrtf(sqrtf(dot(d23, d23))), 1e-4f);
+
+		Segment segment;
+		for (int k = 0; k < 3; k++)
+		{
+			float m1 = (d01[k] / t01 - (p2[k] - p0[k]) / (t01 + t12) + d12[k] / t12) * t12;
+			float m2 = (d12[k] / t12 - (p3[k] - p1[k]) / (t12 + t23) + d23[k] / t23) * t12;
+			segment.a[k] = 2.0f * p1[k] - 2.0f * p2[k] + m1 + m2;
+			segment.b[k] = -3.0f * p1[k] + 3.0f * p2[k] - 2.0f * m1 - m2;
+			segment.c[k] = m1;
+			segment.d[k] = p1[k];
+		}
+		segments.push_back(segment);
+	}
+
+	// Measure the spline densely, then resample so entries are exactly step apart in distance
+	std::vector<float> denseParameters;
+	std::vector<float> denseLengths;
+	float previous[3] = { 0.0f, 0.0f, 0.0f };
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		const float* p1 = &points[(first + i) * 3];
+		const float* p2 = &points[(first + i + 1) * 3];
+		float chord[3] = { p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2] };
+		int samples = (int)(sqrtf(dot(chord, chord)) / step) * SAMPLES_PER_STEP;
+		samples = samples > LENGTH_SAMPLES ? samples : LENGTH_SAMPLES;
+
+		segmentStarts.push_back(totalLength);
+		for (int j = (i == 0 ? 0 : 1); j <= samples; j++)
+		{
+			float t = i + (float)j / samples;
+			float point[3], tangent[3];
+			curve(t, point, tangent);
+			if (!denseLengths.empty())
+			{
+				float delta[3] = { point[0] - previous[0], point[1] - previous[1], point[2] - previous[2] };
+				totalLength += sqrtf(dot(delta, delta));
+			}
+			denseParameters.push_back(t);
+			denseLengths.push_back(totalLength);
+			previous[0] = point[0];
+			previous[1] = point[1];
+			previous[2] = point[2];
+		}
+	}
+
+	int intervals = (int)ceilf(totalLength / step);
+	intervals = intervals > 0 ? intervals : 1;
+	this->step = totalLength / intervals;
+	size_t dense = 0;
+	for (int i = 0; i <= intervals; i++)
+	{
+		float distance = i * this->step;
+		while (dense + 2 < denseLengths.size() && denseLengths[dense + 1] < distance)
+		{
+			dense++;
+		}
+		float span = denseLengths[dense + 1] - denseLengths[dense];
+		float fraction = span > 0.0f ? (distance - denseLengths[dense]) / span : 0.0f;
+		fraction = fminf(fmaxf(fraction, 0.0f), 1.0f);
+		parameters.push_back(denseParameters[dense] + fraction * (denseParameters[dense + 1] - denseParameters[dense]));
+	}
+
+	// Rotation minimising frames by double reflection (Wang et al. 2008): each up vector is the
+	// previous one carried along without twisting, starting from the one closest to world up
+	float position[3], tangent[3];
+	curve(parameters[0], position, tangent);
+	float up[3] = { 0.0f, 1.0f, 0.0f };
+	if (startUp != NULL)
+	{
+		up[0] = startUp[0];
+		up[1] = startUp[1];
+		up[2] = startUp[2];
+	}
+	else if (fabsf(tangent[1]) > 0.99f)
+	{
+		up[1] = 0.0f;
+		up[2] = 1.0f;
+	}
+	float along = dot(up, tangent);
+	for (int k = 0; k < 3; k++)
+	{
+		up[k] -= along * tangent[k];
+	}
+	normalize(up);
+	ups.insert(ups.end(), up, up + 3);
+
+	for (int i = 1; i <= intervals; i++)
+	{
+		float nextPosition[3], nextTangent[3];
+		curve(parameters[i], nextPosition, nextTangent);
+
+		float v1[3] = { nextPosition[0] - position[0], nextPosition[1] - position[1], nextPosition[2] - position[2] };
+		float c1 = dot(v1, v1);
+		if (c1 > 0.0f)
+		{
+			float upDot = dot(v1, up) * 2.0f / c1;
+			float tangentDot = dot(v1, tangent) * 2.0f / c1;
+			float reflectedTangent[3];
+			for (int k = 0; k < 3; k++)
+			{
+				up[k] -= upDot * v1[k];
+				reflectedTangent[k] = tangent[k] - tangentDot * v1[k];
+			}
+
+			float v2[3] = { nextTangent[0] - reflectedTangent[0], nextTangent[1] - reflectedTangent[1], nextTangent[2] - reflectedTangent[2] };
+			float c2 = dot(v2, v2);
+			if (c2 > 0.0f)
+			{
+				float secondDot = dot(v2, up) * 2.0f / c2;
+				for (int k = 0; k < 3; k++)
+				{
+					up[k] -= secondDot * v2[k];
+				}
+			}
+		}
+		normalize(up);
+		ups.insert(ups.end(), up, up + 3);
+
+		for (int k = 0; k < 3; k++)
+		{
+			position[k] = nextPosition[k];
+			tangent[k] = nextTangent[k];
+		}
+	}
+}
+
+float TrackSpline::parameterAt(float distance, int& index, float& fraction) const
+{
+	distance = fminf(fmaxf(distance, 0.0f), totalLength);
+	float scaled = distance / step;
+	int last = (int)parameters.size() - 2;
+	index = (int)scaled;
+	index = index < last ? index : last;
+	fraction = scaled - index;
+
+	float from = parameters[index];
+	float to = parameters[index + 1];
+	int boundary = (int)to;
+	if ((int)from == boundary || (float)boundary == to)
+	{
+		return from + fraction * (to - from);
+	}
+
+	// The interval straddles two segments, which can cover ground at very different rates per
+	// unit of t, so interpolate on whichever side of the joint the distance falls
+	float joint = segmentStarts[boundary];
+	float start = index * step;
+	if (distance < joint)
+	{
+		return from + (distance - start) / (joint - start) * (boundary - from);
+	}
+	return boundary + (distance - joint) / (start + step - joint) * (to - boundary);
+}
+
+void TrackSpline::curve(float t, float* position, float* tangent) const
+{
+	int i = (int)t < (int)segments.size() - 1 ? (int)t : (int)segments.size() - 1;
+	float u = t - i;
+	const Segment& s = segments[i];
+	for (int k = 0; k < 3; k++)
+	{
+		position[k] = ((s.a[k] * u + s.b[k]) * u + s.c[k]) * u + s.d[k];
+		tangent[k] = (3.0f * s.a[k] * u + 2.0f * s.b[k]) * u + s.c[k];
+	}
+	normalize(tangent);
+}
+
+void TrackSpline::position(float distance, float* position) const
+{
+	int index;
+	float fraction;
+	float t = parameterAt(distance, index, fraction);
+	int i = (int)t < (int)segments.size() - 1 ? (int)t : (int)segments.size() - 1;
+	float u = t - i;
+	const Segment& s = segments[i];
+	for (int k = 0; k < 3; k++)
+	{
+		position[k] = ((s.a[k] * u + s.b[k]) * u + s.c[k]) * u + s.d[k];
+	}
+}
+
+void TrackSpline::evaluate(float distance, TrackFrame& frame) const
+{
+	int index;
+	float fraction;
+	curve(parameterAt(distance, index, fraction), frame.position, frame.tangent);
+
+	// Interpolated up, made square to the exact tangent again
+	const float* a = &ups[index * 3];
+	const float* b = &ups[(index + 1) * 3];
+	for (int k = 0; k < 3; k++)
+	{
+		frame.up[k] = a[k] + fraction * (b[k] - a[k]);
+	}
+	float along = dot(frame.up, frame.tangent);
+	for (int k = 0; k < 3; k++)
+	{
+		frame.up[k] -= along * frame.tangent[k];
+	}
+	normalize(frame.up);
+
+	frame.right[0] = frame.tangent[1] * frame.up[2] - frame.tangent[2] * frame.up[1];
+	frame.right[1] = frame.tangent[2] * frame.up[0] - frame.tangent[0] * frame.up[2];
+	frame.right[2] = frame.tangent[0] * frame.up[1] - frame.tangent[1] * frame.up[0];
+}
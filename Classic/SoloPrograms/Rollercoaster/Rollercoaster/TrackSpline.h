@@ -0,0 +1,67 @@
+#ifndef TRACK_SPLINE_H
+#define TRACK_SPLINE_H
+
+#include <vector>
+
+// Where a point on the track is and which way it faces
+struct TrackFrame
+{
+	float position[3];
+	float tangent[3]; // Direction of travel
+	float up[3]; // Away from the rails' running surface
+	float right[3];
+};
+
+// Matrix taking (right, up, -tangent) to the frame's axes and the origin to its position,
+// so shapes modelled looking down -Z, as GL does, follow the track
+void frameMatrix(const TrackFrame& frame, float* matrix);
+
+// Centripetal Catmull-Rom spline through a list of points, reparameterised by arc length.
+// build() samples the spline into a table spaced evenly in distance, so evaluate() is O(1):
+// one table lookup, then the segment's cubic for the exact position and tangent
+class TrackSpline
+{
+	public:
+		TrackSpline();
+
+		// Fits the spline through count points, xyz each, with a table entry every step units
+		void build(const float* points, int count, float step);
+		// Fits one piece of a longer track through points[1] to points[count - 2], the outer two
+		// only steering its ends, with its first up vector startUp, or the one closest to world up
+		// when NULL. Pieces fitted over overlapping points, each from the last one's endUp, meet
+		// with no kink or roll
+		void buildPiece(const float* points, int count, float step, const float* startUp);
+
+		float length() const { return totalLength; }
+		void endUp(float* up) const;
+
+		// Frame at distance along the track, clamped to its ends
+		void evaluate(float distance, TrackFrame& frame) const;
+		// Just the position, for callers that don't need the frame
+		void position(float distance, float* position) const;
+
+	private:
+		// p(u) = a u^3 + b u^2 + c u + d for u in [0, 1]
+		struct Segment
+		{
+			float a[3];
+			float b[3];
+			float c[3];
+			float d[3];
+		};
+
+		std::vector<Segment> segments;
+		std::vector<float> segmentStarts; // Distance along the track where each segment begins
+		std::vector<float> parameters; // Segment index plus u at every multiple of step
+		std::vector<float> ups; // Rotation minimising up vector at the same distances, xyz each
+		float step;
+		float totalLength;
+
+		void fit(const float* points, int count, float step, bool guided, const float* startUp);
+		// Spline parameter at a distance, and the table interval it fell in
+		float parameterAt(float distance, int& index, float& fraction) const;
+		// Position and unit tangent at spline parameter t, the segment index plus u
+		void curve(float t, float* position, float* tangent) const;
+};
+
+#endif
@@ -0,0 +1,309 @@
+#include "TrackStream.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+#define SECTION_POINTS 8 // Control points each section runs between
+#define POINT_SPACING 12.0f // Between control points, down -Z
+#define SPLINE_STEP 0.05f // Spacing of each section's arc length table
+#define AHEAD 600.0f // Track kept generated past the cart
+#define BEHIND 64.0f // Track kept drawn behind the cart
+#define UPLOAD_BUDGET (256 * 1024) // Bytes moved into buffer objects a frame
+
+#define GROUND_Y -5.0f
+#define GROUND_HILLS 1.0f // Height of the ground's swells, kept clear of the lowest pillars
+#define GROUND_HALF_WIDTH 160.0f
+#define GROUND_CELL 8.0f
+
+// Control point i of the ride, winding and rolling gently forever down -Z
+static void ridePoint(int i, float* point)
+{
+	point[0] = 40.0f * sinf(0.11f * i) + 6.0f * sinf(0.37f * i);
+	point[1] = -0.3f + 1.5f * sinf(0.23f * i) + 0.5f * sinf(0.71f * i);
+	point[2] = -POINT_SPACING * i;
+}
+
+static float groundHeight(float x, float z)
+{
+	return GROUND_Y + GROUND_HILLS * sinf(0.04f * x) * sinf(0.05f * z);
+}
+
+// Ground between control points first and first + SECTION_POINTS, so neighbouring sections'
+// ground meets along a line of constant z
+static void buildGround(int first, BakedBatch& ground)
+{
+	int columns = (int)(2.0f * GROUND_HALF_WIDTH / GROUND_CELL);
+	int rows = (int)(SECTION_POINTS * POINT_SPACING / GROUND_CELL);
+	float near = -POINT_SPACING * first;
+
+	for (int row = 0; row <= rows; row++)
+	{
+		for (int column = 0; column <= columns; column++)
+		{
+			float x = -GROUND_HALF_WIDTH + column * GROUND_CELL;
+			float z = near - row * GROUND_CELL;
+			float slopeX = GROUND_HILLS * 0.04f * cosf(0.04f * x) * sinf(0.05f * z);
+			float slopeZ = GROUND_HILLS * 0.05f * sinf(0.04f * x) * cosf(0.05f * z);
+			float length = sqrtf(slopeX * slopeX + 1.0f + slopeZ * slopeZ);
+			GLfloat vertex[6] = { x, groundHeight(x, z), z, -slopeX / length, 1.0f / length, -slopeZ / length };
+			ground.vertices.insert(ground.vertices.end(), vertex, vertex + 6);
+		}
+	}
+
+	// Rows run away from the viewer, so each cell winds a, b, c counterclockwise seen from above
+	for (int row = 0; row < rows; row++)
+	{
+		for (int column = 0; column < columns; column++)
+		{
+			GLuint a = row * (columns + 1) + column;
+			GLuint b = a + 1;
+			GLuint c = a + columns + 2;
+			GLuint d = a + columns + 1;
+			const GLuint quad[6] = { a, b, c, a, c, d };
+			ground.indices.insert(ground.indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+TrackStream::TrackStream()
+{
+	drawn = 0;
+	bytes = 0;
+	frameBytes = 0;
+	generatedCount = 0;
+	droppedPillars = 0;
+	wanted = 0.0f;
+	pillarGap = 4.0f;
+	stopping = false;
+	tieGap = 1.0f;
+	railColor[0] = railColor[1] = railColor[2] = 1.0f;
+	nextIndex = 0;
+	nextStart = 0.0f;
+	nextUp[0] = nextUp[2] = 0.0f;
+	nextUp[1] = 1.0f;
+}
+
+void TrackStream::start(float tieGap, float pillarGap, const float* railColor)
+{
+	stop();
+	for (StreamSection& section : sections)
+	{
+		deleteBatch(section.rails);
+		deleteBatch(section.ground);
+	}
+	sections.clear();
+	ready.clear();
+	drawn = 0;
+	bytes = 0;
+	frameBytes = 0;
+	droppedPillars = 0;
+
+	this->tieGap = tieGap;
+	this->pillarGap = pillarGap;
+	for (int k = 0; k < 3; k++)
+	{
+		this->railColor[k] = railColor[k];
+	}
+	wanted = 0.0f;
+	stopping = false;
+
+	sections.push_back(StreamSection());
+	buildSection(0, 0.0f, NULL, pillarGap, sections.back());
+	sections.back().spline.endUp(nextUp);
+	nextIndex = 1;
+	nextStart = sections.back().spline.length();
+	generatedCount = 1;
+
+	worker = std::thread(&TrackStream::generate, this);
+}
+
+void TrackStream::stop()
+{
+	if (!worker.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void TrackStream::setPillarGap(float pillarGap)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->pillarGap = pillarGap;
+}
+
+void TrackStream::buildSection(int index, float start, const float* startUp, float pillarGap, StreamSection& section)
+{
+	// Points either side of the section's own steer its ends as they would a single spline
+	float points[(SECTION_POINTS + 3) * 3];
+	for (int i = 0; i < SECTION_POINTS + 3; i++)
+	{
+		ridePoint(index * SECTION_POINTS - 1 + i, &points[i * 3]);
+	}
+	section.index = index;
+	section.start = start;
+	section.spline.buildPiece(points, SECTION_POINTS + 3, SPLINE_STEP, startUp);
+
+	// The worker is a thread of its own already, so it meshes alone
+	ThreadPool serial;
+	initBatch(section.rails, GL_TRIANGLES, railColor[0], railColor[1], railColor[2]);
+	buildTrackMesh(section.spline, tieGap, pillarGap, serial, section.rails, section.pillarTops, section.chunks);
+	initBatch(section.ground, GL_TRIANGLES, 1.0f, 1.0f, 1.0f);
+	buildGround(index * SECTION_POINTS, section.ground);
+
+	section.uploaded = 0;
+	section.bytes = 0;
+}
+
+void TrackStream::generate()
+{
+	while (true)
+	{
+		float gap;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || nextStart < wanted; });
+			if (stopping)
+			{
+				return;
+			}
+			gap = pillarGap;
+		}
+
+		StreamSection section;
+		buildSection(nextIndex, nextStart, nextUp, gap, section);
+		section.spline.endUp(nextUp);
+		nextIndex++;
+		nextStart += section.spline.length();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		ready.push_back(std::move(section));
+	}
+}
+
+bool TrackStream::update(float distance, std::vector<TrackChunk>& chunks, std::vector<int>& chunkSections,
+	std::vector<float>& pillarTops)
+{
+	bool changed = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wanted = distance + AHEAD;
+		while (!ready.empty())
+		{
+			sections.push_back(std::move(ready.front()));
+			ready.pop_front();
+			generatedCount++;
+		}
+	}
+	wake.notify_one();
+
+	// Upload in track order, always at least one batch a frame so no section is too big to go
+	frameBytes = 0;
+	bool full = false;
+	while (!full && drawn < (int)sections.size())
+	{
+		StreamSection& section = sections[drawn];
+		while (section.uploaded < 2)
+		{
+			BakedBatch& batch = section.uploaded == 0 ? section.rails : section.ground;
+			size_t size = batch.vertices.size() * sizeof(GLfloat) + batch.indices.size() * sizeof(GLuint);
+			if (frameBytes > 0 && frameBytes + size > UPLOAD_BUDGET)
+			{
+				full = true;
+				break;
+			}
+			uploadBatch(batch);
+			frameBytes += size;
+			section.bytes += size;
+			bytes += size;
+			section.uploaded++;
+		}
+		if (section.uploaded == 2)
+		{
+			drawn++;
+			changed = true;
+		}
+	}
+
+	// Drop whole sections the cart is well past
+	while (drawn > 1 && sections[0].start + sections[0].spline.length() < distance - BEHIND)
+	{
+		deleteBatch(sections[0].rails);
+		deleteBatch(sections[0].ground);
+		bytes -= sections[0].bytes;
+		droppedPillars += (int)sections[0].pillarTops.size() / 3;
+		sections.pop_front();
+		drawn--;
+		changed = true;
+	}
+
+	if (changed)
+	{
+		chunks.clear();
+		chunkSections.clear();
+		pillarTops.clear();
+		for (int s = 0; s < drawn; s++)
+		{
+			const StreamSection& section = sections[s];
+			int pillarBase = (int)pillarTops.size() / 3;
+			for (TrackChunk chunk : section.chunks)
+			{
+				chunk.firstPillar += pillarBase;
+				chunks.push_back(chunk);
+				chunkSections.push_back(s);
+			}
+			pillarTops.insert(pillarTops.end(), section.pillarTops.begin(), section.pillarTops.end());
+		}
+	}
+	return changed;
+}
+
+float TrackStream::evaluate(float distance, TrackFrame& frame) const
+{
+	// Only a few sections are ever kept, so look back from the newest
+	int s = (int)sections.size() - 1;
+	while (s > 0 && distance < sections[s].start)
+	{
+		s--;
+	}
+	const StreamSection& section = sections[s];
+	float along = fminf(fmaxf(distance - section.start, 0.0f), section.spline.length());
+	section.spline.evaluate(along, frame);
+	return section.start + along;
+}
+
+void TrackStream::drawGround(const float* color)
+{
+	for (int s = 0; s < drawn; s++)
+	{
+		BakedBatch& ground = sections[s].ground;
+		ground.color[0] = color[0];
+		ground.color[1] = color[1];
+		ground.color[2] = color[2];
+		drawBatch(ground);
+	}
+}
+
+void TrackStream::groundOccluder(float* corners) const
+{
+	float y = GROUND_Y - GROUND_HILLS;
+	float near = -POINT_SPACING * SECTION_POINTS * sections[0].index;
+	float far = -POINT_SPACING * SECTION_POINTS * (sections[std::max(drawn, 1) - 1].index + 1);
+	const float quad[12] =
+	{
+		-GROUND_HALF_WIDTH, y, near, GROUND_HALF_WIDTH, y, near,
+		GROUND_HALF_WIDTH, y, far, -GROUND_HALF_WIDTH, y, far
+	};
+	for (int k = 0; k < 12; k++)
+	{
+		corners[k] = quad[k];
+	}
+}
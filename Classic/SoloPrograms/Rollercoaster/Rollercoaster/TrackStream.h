@@ -0,0 +1,100 @@
+#ifndef TRACK_STREAM_H
+#define TRACK_STREAM_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BakedMesh.h"
+#include "TrackMesh.h"
+#include "TrackSpline.h"
+
+// A stretch of the endless ride and the ground under it, meshed off the GL thread
+struct StreamSection
+{
+	int index; // Of the section along the ride, from 0
+	float start; // Distance along the ride where the section begins
+	TrackSpline spline;
+	BakedBatch rails;
+	BakedBatch ground;
+	std::vector<float> pillarTops;
+	std::vector<TrackChunk> chunks;
+	int uploaded; // Batches moved into buffer objects so far, the section is drawn once both are
+	size_t bytes; // Held by its buffer objects
+};
+
+// Track that never ends. A worker thread fits and meshes sections of a procedural ride ahead of
+// the cart, in order, so each can start from the last one's up vector. Finished sections queue
+// up for the GL thread, which moves at most UPLOAD_BUDGET bytes a frame into buffer objects and
+// deletes sections once the cart is well past them, so memory stays bounded however long it rides
+class TrackStream
+{
+	public:
+		TrackStream();
+		~TrackStream() { stop(); }
+
+		// Generates the first section, so there is track under the cart straight away, and starts
+		// the worker on the rest. Call on the GL thread, as it deletes any earlier ride's buffers
+		void start(float tieGap, float pillarGap, const float* railColor);
+		// Joins the worker
+		void stop();
+		// Applies to sections generated from now on
+		void setPillarGap(float pillarGap);
+
+		// Called once a frame on the GL thread with the cart's distance. Asks for track far enough
+		// ahead, uploads what the budget allows and drops sections behind. Returns true when the
+		// drawn sections changed, after filling chunks and pillarTops with theirs, chunkSections
+		// with each chunk's section and firstPillar offset into the joined pillarTops
+		bool update(float distance, std::vector<TrackChunk>& chunks, std::vector<int>& chunkSections,
+			std::vector<float>& pillarTops);
+
+		// Frame at distance, clamped to the track taken from the worker so far. Returns the distance
+		// it was taken at, short of the one asked for if the cart has outrun the worker
+		float evaluate(float distance, TrackFrame& frame) const;
+		// Distance where the track taken from the worker so far runs out
+		float end() const { return sections.back().start + sections.back().spline.length(); }
+
+		// Sections being drawn, in track order
+		int sectionCount() const { return drawn; }
+		const BakedBatch& rails(int section) const { return sections[section].rails; }
+		void drawGround(const float* color);
+		// Corners of a flat quad under the ground drawn now that the ground never dips below, so
+		// anything it hides the ground hides too
+		void groundOccluder(float* corners) const;
+
+		int generated() const { return generatedCount; } // Sections taken from the worker since start
+		int pillarsDropped() const { return droppedPillars; } // Pillars of the sections dropped since start
+		size_t residentBytes() const { return bytes; } // In buffer objects now
+		size_t uploadedLastFrame() const { return frameBytes; }
+
+	private:
+		std::deque<StreamSection> sections; // Taken from the worker, in order. The first drawn are uploaded
+		int drawn;
+		size_t bytes;
+		size_t frameBytes;
+		int generatedCount;
+		int droppedPillars;
+
+		// Shared with the worker
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<StreamSection> ready; // Finished, waiting for the GL thread
+		float wanted; // Generate until the track reaches this far
+		float pillarGap;
+		bool stopping;
+
+		// Owned by the worker once started
+		float tieGap;
+		float railColor[3];
+		int nextIndex;
+		float nextStart;
+		float nextUp[3];
+
+		void generate();
+		void buildSection(int index, float start, const float* startUp, float pillarGap, StreamSection& section);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Hands the newest of a stream of values from one writer thread to one reader thread without
+// either ever waiting. Of three slots the writer fills one, the reader reads another, and the
+// third sits between them: publishing swaps the writer's slot with it, and the reader swaps its
+// own for it whenever something new has been put there. Values the reader is too slow for are
+// skipped, never queued
+template <typename T>
+class TripleBuffer
+{
+	public:
+		TripleBuffer() : middle(1)
+		{
+			back = 0;
+			front = 2;
+		}
+
+		// The writer's slot, free to fill until publish()
+		T& writeSlot() { return slots[back]; }
+		void publish()
+		{
+			back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+		}
+
+		// Takes the newest value published, returns false when there is nothing new since last time
+		bool update()
+		{
+			if (!(middle.load(std::memory_order_acquire) & FRESH))
+			{
+				return false;
+			}
+			front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+			return true;
+		}
+		// The value update() last took
+		const T& readSlot() const { return slots[front]; }
+
+	private:
+		static const int INDEX = 3;
+		static const int FRESH = 4; // Set on the middle slot's index when the writer put it there
+
+		T slots[3];
+		std::atomic<int> middle;
+		int back; // Only the writer's
+		int front; // Only the reader's
+};
+
+#endif
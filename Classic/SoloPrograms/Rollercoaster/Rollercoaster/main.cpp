@@ -6,11 +6,51 @@ right click on the project and change the Windows 10 SDK to whatever option work
 
 #include <stdio.h> // Change SDK if this is underlined in red
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
 
 #include "GL/freeglut.h"
+#include "BakedMesh.h"
+#include "CartFleet.h"
+#include "ChunkBVH.h"
+#include "FixedStepThread.h"
+#include "OcclusionCuller.h"
+#include "PillarLOD.h"
+#include "SceneGraph.h"
+#include "TerrainLOD.h"
+#include "ThreadPool.h"
+#include "TrackMesh.h"
+#include "TrackSpline.h"
+#include "TrackStream.h"
+#include "TripleBuffer.h"
 
 #define WINDOW_SIZE 500.0
 #define PI 3.141517
+#define TRACK_STEP 0.05f // Spacing of the track's arc length table
+#define CART_START 15.0f // Distance along the track each ride starts from
+#define CAMERA_HEIGHT 1.3f // Eye above the rails
+#define TIE_GAP 2.1f // Distance between bars across the rails
+#define STEP_TIME (1.0f / 60.0f) // Seconds the carts move each simulation step
+#define FRAME_TIME (1.0 / 60.0) // Seconds between the frames the render loop aims for
+#define OCCLUDER_PILLARS 48 // Nearest pillars rasterized as occluders each frame
+#define OCCLUDER_PILLAR_RADIUS (PILLAR_RADIUS * 0.7071f) // Inside the four sided cylinders of the coarsest pillar level
+#define SNAP_DISTANCE 4.0f // Carts that moved further than this in a step jumped, so aren't blended
+#define FLEET_TRAINS 3
+#define CARTS_PER_TRAIN 3
+#define BLOCK_LENGTH 20.0f // Track a train must have to itself
+#define DWELL_TIME 2.0f // Seconds trains stand at the station
+#define CARTS_TARGET_MS 2.0 // Step time --bench-carts aims for with its 100000 carts on 8 cores
 
 // Global variables
 GLfloat aspect;
@@ -18,7 +58,7 @@ double fov = 45.0; // Field of vision of camera
 double eyeCenter[3] = { 0.0, 1.0, 5.0 }; // Coordinates of eyeCenter
 double eyeLooking[2] = { 0.0, 0.0 }; // Camera's pointing camera
 float cameraAngle = 0.0f;
-int SPEED = 1; // Cart movement speed
+std::atomic<int> SPEED(1); // Cart movement speed, read by the simulation thread
 int trackSize = 0; // Length of Track
 float trackRotate = 0.0f; // Track rotation about X-Axis
 int mouseCoord[2] = { 0, 0 }; // Coordinates of mouse
@@ -30,6 +70,93 @@ float deltaX = 0.0f;
 float deltaY = 0.0f;
 int pillarGap = 4; // Gap between pillars
 
+// Centre line of the track at rail height: level, down into a dip, back up and level again.
+// The baked geometry and the cart both follow the spline through these points. Points are
+// spaced closer near the dip so the long straights stay straight
+const float TRACK_POINTS[][3] =
+{
+	{ 0.0f, -0.3f, 20.0f },
+	{ 0.0f, -0.3f, 0.0f },
+	{ 0.0f, -0.3f, -20.0f },
+	{ 0.0f, -0.3f, -32.0f },
+	{ 0.0f, -0.5f, -37.0f },
+	{ 0.0f, -1.5f, -40.5f },
+	{ 0.0f, -2.5f, -43.5f },
+	{ 0.0f, -1.5f, -46.5f },
+	{ 0.0f, -0.5f, -50.0f },
+	{ 0.0f, -0.3f, -55.0f },
+	{ 0.0f, -0.3f, -70.0f },
+	{ 0.0f, -0.3f, -100.0f }
+};
+TrackSpline track;
+TrackFrame cart; // Track frame under the camera
+float cartDistance = CART_START; // Distance along the track
+
+// Static track geometry, baked once per pillarGap into one batch per material
+BakedBatch trackBatch; // Rails and bars
+std::vector<float> pillarTops;
+PillarLOD pillars;
+int bakedGap = 0; // pillarGap the batches were baked with, 0 before the first bake
+ThreadPool pool; // Shares out track meshing and culling
+std::vector<TrackChunk> trackChunks; // Bounds and index ranges of each piece of the baked track
+ChunkBVH trackBVH; // Over trackChunks
+bool cullTrack = true;
+std::vector<int> visibleChunks;
+std::vector<GLuint> railFirsts; // Runs of visible rails drawn this frame
+std::vector<GLsizei> railCounts;
+int shownVisible = -1; // Visible chunk count in the window title
+
+// The ground and the nearest pillars hide much of what's behind them, so chunks and pillars
+// they hide are culled before drawing
+OcclusionCuller occlusion;
+bool cullOccluded = true;
+std::vector<int> occluderPillars;
+std::vector<int> visiblePillars; // Of visibleChunks and not hidden, when culling occluded pillars
+int chunksOccluded = 0; // Of visibleChunks last frame
+int pillarsTested = 0;
+int pillarsOccluded = 0;
+double occlusionMs = 0.0; // Spent rasterizing occluders and testing against them last frame
+
+// Endless ride, streamed in ahead of the cart in place of the fixed track and ground
+bool endless = false;
+TrackStream stream;
+const float RAIL_COLOR[3] = { 0.9f, 0.4f, 0.0f };
+std::vector<int> chunkSections; // Stream section of each of trackChunks
+
+// Heightmapped ground under the fixed ride, drawn with drawGround() when GL can't
+TerrainLOD terrain;
+bool terrainReady = false;
+
+// Trains riding the fixed track as a loop. The camera rides the first cart of the first train
+CartFleet fleet;
+std::vector<float> cartMatrices; // Where the carts are drawn this frame
+
+// The ride as the simulation thread left it after a step
+struct RideState
+{
+	double time; // Seconds since the simulation started that the step stands for
+	float distance; // Of the cart the camera rides
+	std::vector<float> carts; // Matrices of every cart in the fleet
+};
+
+// Once the ride starts, the simulation thread alone steps the fleet and the cart's distance, at
+// a fixed rate whatever the frame rate, and publishes each step. The render side draws between
+// the last two states it took, a step behind, so the motion stays smooth between steps.
+// The thread is declared after what its steps touch, so it is destroyed, and joined, first
+ThreadPool simulationPool; // The fleet's own, as only one thread may hand jobs to a pool
+TripleBuffer<RideState> rideStates;
+float rideDistance = CART_START; // The simulation's own copy of the cart's distance
+std::atomic<float> trackEnd(0.0f); // Where the endless track runs out, as the render side last saw
+FixedStepThread simulation;
+RideState shownFrom; // The two states drawn between
+RideState shownTo;
+std::chrono::steady_clock::time_point nextFrame; // When the render loop next draws
+
+// What rides the track: the cart follows it and the camera sits above the cart
+SceneGraph scene;
+int cartNode = -1;
+int cameraNode = -1;
+
 // Variables for ground color
 const float GREEN[3] = { 0.7f, 0.8f, 0.5f };
 const float BROWN[3] = { 0.8f, 0.7f, 0.5f };
@@ -72,6 +199,7 @@ void changeGap(int num)
 		case 2: pillarGap = 10;
 			break;
 	}
+	stream.setPillarGap((float)pillarGap);
 
 	glutPostRedisplay();
 }
@@ -170,165 +298,258 @@ void drawGround()
 	glPopMatrix();
 }
 
-// Draw pillars beside track
-void drawPillars(int isRight, int zInc)
+// Mesh every static piece of track along the spline in world space and upload it
+void bakeTracks()
 {
-	// Draw pillar
-	glPushMatrix();
-		glColor3f(1.0f, 0.6f, 0.6f);
-		glTranslatef(-2.0f * isRight, 4.0f, -1.0f - pillarGap * zInc);
-		glRotatef(90.0f, 1.0f, 0.0f, 0.0f);
-		glutSolidCylinder(0.5, 5.0, 10, 10);
-	glPopMatrix();
+	buildTrackMesh(track, TIE_GAP, (float)pillarGap, pool, trackBatch, pillarTops, trackChunks);
+	trackBVH.build(trackChunks[0].min, trackChunks[0].max, (int)(sizeof(TrackChunk) / sizeof(float)), (int)trackChunks.size());
+
+	uploadBatch(trackBatch);
+	pillars.setPillars(pillarTops);
+	bakedGap = pillarGap;
 }
 
-// Draw an arc of a circle with center at (x, y, z) and an arc angle
-void drawCurveTrack(float centerX, float centerY, float centerZ, float radius, float angle, int segments)
+// Add a run of indices to draw, joining it onto the last run when they meet
+void addRange(std::vector<GLuint>& firsts, std::vector<GLsizei>& counts, GLuint first, GLsizei count)
 {
-	angle = PI / 3.5f;
+	if (count == 0)
+	{
+		return;
+	}
 
-	glPushMatrix();
-		glColor3f(1.0f, 0.0f, 0.0f);
-		glBegin(GL_LINE_STRIP);
-			glVertex3f(centerX, centerY, centerZ);
-			for (int i = 0; i <= segments; i++) 
-			{
-				float currentAngle = angle * i / segments;
-				glVertex3f(centerX + cos(currentAngle) * centerX, centerY, -1 * (centerZ + sin(currentAngle) * centerZ));
-			}
-		glEnd();
-	glPopMatrix();
+	if (!firsts.empty() && firsts.back() + counts.back() == first)
+	{
+		counts.back() += count;
+	}
+	else
+	{
+		firsts.push_back(first);
+		counts.push_back(count);
+	}
 }
 
-// Draw the straight/level track with bars across
-void levelTrack(int size, int gap)
+// Rasterize the ground and the pillars of the visible chunks nearest eye as occluders. Each
+// pillar stands in as the quad through its axis square to the view, narrowed to lie inside it
+// at every level of detail
+void rasterizeOccluders(const float* viewProjection, const float* eye)
 {
-	// Set track color
-	glColor3f(0.9f, 0.4f, 0.0f);
+	occlusion.begin(viewProjection);
 
-	// Left track
-	glPushMatrix();
-		glTranslatef(-0.5f, -0.3f, - 1 * (size / 10.0f));
-		glScalef(0.5f, 1.0f, -3.0f * size);
-		glutSolidCube(0.2);
-	glPopMatrix();
-
-	// Right track
-	glPushMatrix();
-		glTranslatef(0.5f, -0.3f, - 1 * (size / 10.0f));
-		glScalef(0.5f, 1.0f, -3.0f * size);
-		glutSolidCube(0.2);
-	glPopMatrix();
+	float ground[12];
+	bool hasGround = true;
+	if (endless)
+	{
+		stream.groundOccluder(ground);
+	}
+	else if (terrainReady && eye[1] <= terrain.highestAt(eye[0], eye[2]))
+	{
+		// Beneath the terrain, which only hides what's past its upper side
+		hasGround = false;
+	}
+	else if (terrainReady)
+	{
+		// Nothing shows through the terrain from above below its lowest point
+		float floor = terrain.floorHeight();
+		float half = TERRAIN_CELLS / 2 * TERRAIN_SPACING;
+		const float plane[12] =
+		{
+			-half, floor, half, half, floor, half,
+			half, floor, -half, -half, floor, -half
+		};
+		memcpy(ground, plane, sizeof(plane));
+	}
+	else
+	{
+		// Top of the cube drawGround() scales
+		const float top[12] =
+		{
+			-50.0f, -4.75f, 243.0f, 50.0f, -4.75f, 243.0f,
+			50.0f, -4.75f, -257.0f, -50.0f, -4.75f, -257.0f
+		};
+		memcpy(ground, top, sizeof(top));
+	}
+	if (hasGround)
+	{
+		occlusion.addQuad(ground);
+	}
 
-	// Draw one square section curLength times
-	for (int i = 0; i < gap; i++)
+	occluderPillars.clear();
+	for (int index : visibleChunks)
 	{
-		// Bar across tracks
-		glPushMatrix();
-			glTranslatef(0.0f, -0.3f, - i * 2.1f);
-			glScalef(6.0f, 1.0f, 1.0f);
-			glutSolidCube(0.2);
-		glPopMatrix();
+		const TrackChunk& chunk = trackChunks[index];
+		for (int pillar = chunk.firstPillar; pillar < chunk.firstPillar + chunk.pillarCount; pillar++)
+		{
+			occluderPillars.push_back(pillar);
+		}
+	}
+	auto distance = [&](int pillar)
+	{
+		const float* top = &pillarTops[pillar * 3];
+		return (top[0] - eye[0]) * (top[0] - eye[0]) + (top[2] - eye[2]) * (top[2] - eye[2]);
+	};
+	if (occluderPillars.size() > OCCLUDER_PILLARS)
+	{
+		std::nth_element(occluderPillars.begin(), occluderPillars.begin() + OCCLUDER_PILLARS, occluderPillars.end(),
+			[&](int a, int b) { return distance(a) < distance(b); });
+		occluderPillars.resize(OCCLUDER_PILLARS);
+	}
 
-		// Draw pillars
-		if (i < gap / 2)
+	for (int pillar : occluderPillars)
+	{
+		const float* top = &pillarTops[pillar * 3];
+		float across = sqrtf(distance(pillar));
+		if (across < PILLAR_RADIUS)
 		{
-			drawPillars(1, i); // Left row
-			drawPillars(-1, i); // Right row
+			continue;
 		}
+		float sideX = -(top[2] - eye[2]) / across * OCCLUDER_PILLAR_RADIUS;
+		float sideZ = (top[0] - eye[0]) / across * OCCLUDER_PILLAR_RADIUS;
+		float bottom = top[1] - PILLAR_HEIGHT;
+		const float quad[12] =
+		{
+			top[0] - sideX, top[1], top[2] - sideZ, top[0] + sideX, top[1], top[2] + sideZ,
+			top[0] + sideX, bottom, top[2] + sideZ, top[0] - sideX, bottom, top[2] - sideZ
+		};
+		occlusion.addQuad(quad);
 	}
+
+	occlusion.rasterize(pool);
 }
 
+// Draw the chunks of baked track inside the view, one call per material and run of chunks
 void drawTracks()
 {
-	glPushMatrix();
+	if (endless)
+	{
+		// Sections came or went, so gather the chunks and pillars of those drawn now. Pillars of
+		// sections still drawn keep their levels, so they don't pop as the stream moves on
+		int dropped = stream.pillarsDropped();
+		if (stream.update(cartDistance, trackChunks, chunkSections, pillarTops))
+		{
+			trackBVH.build(trackChunks[0].min, trackChunks[0].max, (int)(sizeof(TrackChunk) / sizeof(float)), (int)trackChunks.size());
+			pillars.shiftPillars(pillarTops, stream.pillarsDropped() - dropped);
+		}
+		trackEnd = stream.end();
+	}
+	else if (bakedGap != pillarGap)
+	{
+		bakeTracks();
+	}
 
-		// Level track
-		glPushMatrix();
-			levelTrack(100, 20); // Draw straigt track of length 100
-		glPopMatrix();
-
-		// Downward curved track
-		glPushMatrix();
-			glPushMatrix();
-				glTranslatef(-0.4f, 0.0f, -40.0f);
-				glRotatef(-90.0f, 0.0f, 0.0f, 1.0f);
-				drawCurveTrack(0.3f, 0.0f, 0.3f, 20, 30, 200); // Draw the left curved track with radius 10 and angle 30
-			glPopMatrix();
-			glPushMatrix();
-				glTranslatef(0.4f, 0.0f, -40.0f);
-				glRotatef(-90.0f, 0.0f, 0.0f, 1.0f);
-				drawCurveTrack(0.3f, 0.0f, 0.3f, 20, 30, 200); // Draw the right curved track with radius 10 and angle 30
-			glPopMatrix();
-		glPopMatrix();
-
-		// Downwards sloping track
-		glPushMatrix();
-			glTranslatef(0.0f, -1.5f, -43.5f);
-			glRotatef(-30.0f, 1.0f, 0.0f, 0.0f);
-			levelTrack(10, 3);
-		glPopMatrix();
-
-		// Upward curved track
-		glPushMatrix();
-			glPushMatrix();
-				glTranslatef(-0.4f, -2.5f, -45.0f);
-				glRotatef(-180.0f, 0.0f, 1.0f, 0.0f);
-				glRotatef(-90.0f, 0.0f, 0.0f, 1.0f);
-				drawCurveTrack(0.3f, 0.0f, 0.3f, 20, 30, 200); // Draw the left curved track with radius 10 and angle 30
-			glPopMatrix();
-			glPushMatrix();
-				glTranslatef(0.4f, -2.5f, -45.0f);
-				glRotatef(-180.0f, 0.0f, 1.0f, 0.0f);
-				glRotatef(-90.0f, 0.0f, 0.0f, 1.0f);
-				drawCurveTrack(0.3f, 0.0f, 0.3f, 20, 30, 200); // Draw the right curved track with radius 10 and angle 30
-			glPopMatrix();
-		glPopMatrix();
-
-		// Upward curved track
-		glPushMatrix();
-			glPushMatrix();
-				glTranslatef(-0.4f, -2.2f, -45.5f);
-				glRotatef(-180.0f, 0.0f, 1.0f, 0.0f);
-				glRotatef(-90.0f, 0.0f, 0.0f, 1.0f);
-				drawCurveTrack(0.3f, 0.0f, 0.3f, 20, 30, 200); // Draw the left curved track with radius 10 and angle 30
-			glPopMatrix();
-			glPushMatrix();
-				glTranslatef(0.4f, -2.2f, -45.5f);
-				glRotatef(-180.0f, 0.0f, 1.0f, 0.0f);
-				glRotatef(-90.0f, 0.0f, 0.0f, 1.0f);
-				drawCurveTrack(0.3f, 0.0f, 0.3f, 20, 30, 200); // Draw the right curved track with radius 10 and angle 30
-			glPopMatrix();
-		glPopMatrix();
-
-		// Upward sloping track
-		glPushMatrix();
-			glTranslatef(0.0f, -1.0f, -46.0f);
-			glRotatef(30.0f, 1.0f, 0.0f, 0.0f);
-			levelTrack(10, 3);
-		glPopMatrix();
-
-		// Downward curved track
-		glPushMatrix();
-			glPushMatrix();
-				glTranslatef(-0.4f, 0.5f, -49.5f);
-				glRotatef(-90.0f, 0.0f, 0.0f, 1.0f);
-				drawCurveTrack(0.3f, 0.0f, 0.3f, 25, 30, 200); // Draw the left curved track with radius 10 and angle 30
-			glPopMatrix();
-			glPushMatrix();
-				glTranslatef(0.4f, 0.5f, -49.5f);
-				glRotatef(-90.0f, 0.0f, 0.0f, 1.0f);
-				drawCurveTrack(0.3f, 0.0f, 0.3f, 25, 30, 200); // Draw the right curved track with radius 10 and angle 30
-			glPopMatrix();
-		glPopMatrix();
-
-		// Level track
-		glPushMatrix();
-			glTranslatef(0.0f, 0.0f, -50.0f);
-			levelTrack(100, 20);// Draw straigt track of length 100
-		glPopMatrix();
+	float projection[16], modelview[16];
+	Frustum frustum;
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	extractFrustum(projection, modelview, frustum);
+	if (cullTrack)
+	{
+		trackBVH.cull(frustum, pool, visibleChunks);
+	}
+	else
+	{
+		visibleChunks.resize(trackChunks.size());
+		for (size_t i = 0; i < trackChunks.size(); i++)
+		{
+			visibleChunks[i] = (int)i;
+		}
+	}
 
-	glPopMatrix();
+	// Pillars are drawn in less detail the fewer pixels they cover
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	float eye[3] = { (float)eyeCenter[0], (float)eyeCenter[1], (float)eyeCenter[2] };
+	pillars.beginFrame(eye, viewport[3] / (2.0f * (float)tan(fov * PI / 360.0)));
+
+	// Drop what the occluders hide before drawing anything, leaving visibleChunks and
+	// visiblePillars holding only what might be seen
+	chunksOccluded = 0;
+	pillarsTested = 0;
+	pillarsOccluded = 0;
+	occlusionMs = 0.0;
+	visiblePillars.clear();
+	if (cullOccluded)
+	{
+		auto start = std::chrono::steady_clock::now();
+		float viewProjection[16];
+		multiplyMatrices(projection, modelview, viewProjection);
+		rasterizeOccluders(viewProjection, eye);
+
+		size_t kept = 0;
+		for (int index : visibleChunks)
+		{
+			const TrackChunk& chunk = trackChunks[index];
+			if (!occlusion.visible(chunk.min, chunk.max))
+			{
+				chunksOccluded++;
+				continue;
+			}
+			visibleChunks[kept++] = index;
+
+			for (int pillar = chunk.firstPillar; pillar < chunk.firstPillar + chunk.pillarCount; pillar++)
+			{
+				const float* top = &pillarTops[pillar * 3];
+				const float low[3] = { top[0] - PILLAR_RADIUS, top[1] - PILLAR_HEIGHT, top[2] - PILLAR_RADIUS };
+				const float high[3] = { top[0] + PILLAR_RADIUS, top[1], top[2] + PILLAR_RADIUS };
+				if (occlusion.visible(low, high))
+				{
+					visiblePillars.push_back(pillar);
+				}
+				else
+				{
+					pillarsOccluded++;
+				}
+				pillarsTested++;
+			}
+		}
+		visibleChunks.resize(kept);
+		occlusionMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Chunks are laid out in track order, so neighbouring visible chunks of a batch draw as one run
+	const BakedBatch* batch = NULL;
+	railFirsts.clear();
+	railCounts.clear();
+	for (int index : visibleChunks)
+	{
+		const BakedBatch* chunkBatch = endless ? &stream.rails(chunkSections[index]) : &trackBatch;
+		if (chunkBatch != batch && batch != NULL)
+		{
+			drawBatchRanges(*batch, railFirsts.data(), railCounts.data(), (int)railFirsts.size());
+			railFirsts.clear();
+			railCounts.clear();
+		}
+		batch = chunkBatch;
+
+		const TrackChunk& chunk = trackChunks[index];
+		addRange(railFirsts, railCounts, chunk.railFirst, chunk.railCount);
+		if (!cullOccluded)
+		{
+			pillars.addPillars(chunk.firstPillar, chunk.pillarCount);
+		}
+	}
+	if (batch != NULL)
+	{
+		drawBatchRanges(*batch, railFirsts.data(), railCounts.data(), (int)railFirsts.size());
+	}
+	for (int pillar : visiblePillars)
+	{
+		pillars.addPillars(pillar, 1);
+	}
+	pillars.draw();
+
+	// Every cart but the one the camera rides in
+	if (!endless)
+	{
+		fleet.draw(cartMatrices.data(), (int)cartMatrices.size() / 16, frustum, 0);
+	}
+
+	if ((int)visibleChunks.size() != shownVisible)
+	{
+		char title[64];
+		shownVisible = (int)visibleChunks.size();
+		sprintf(title, "Rollercoaster - %d/%d track chunks visible", shownVisible, trackBVH.size());
+		glutSetWindowTitle(title);
+	}
 }
 
 void display()
@@ -342,7 +563,21 @@ void display()
 	glLoadIdentity();
 	gluPerspective(fov, aspect, 0.01, 1000.0);
 
-	gluLookAt(eyeCenter[0], eyeCenter[1], eyeCenter[2], rotateX, rotateY, -1000.0, 0.0, 1.0, 0.0);
+	// Look down the camera's -Z, offset by the mouse along its X and Y
+	const float* camera = scene.world(cameraNode);
+	gluLookAt(eyeCenter[0], eyeCenter[1], eyeCenter[2],
+		eyeCenter[0] - 1000.0 * camera[8] + rotateX * camera[0] + rotateY * camera[4],
+		eyeCenter[1] - 1000.0 * camera[9] + rotateX * camera[1] + rotateY * camera[5],
+		eyeCenter[2] - 1000.0 * camera[10] + rotateX * camera[2] + rotateY * camera[6],
+		camera[4], camera[5], camera[6]);
+
+	// setLight() hangs the light over the start of the fixed ride, which the endless one soon
+	// leaves far behind, so carry it along as high over the cart as it starts
+	if (endless)
+	{
+		GLfloat lightPosition[] = { cart.position[0], cart.position[1] + 10.3f, cart.position[2], 1.0f };
+		glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
+	}
 
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
@@ -350,7 +585,24 @@ void display()
 	glEnable(GL_COLOR_MATERIAL);
 
 	// Draw Ground
-	drawGround();
+	if (endless)
+	{
+		stream.drawGround(groundColor);
+	}
+	else if (terrainReady)
+	{
+		float projection[16], modelview[16];
+		Frustum frustum;
+		glGetFloatv(GL_PROJECTION_MATRIX, projection);
+		glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+		extractFrustum(projection, modelview, frustum);
+		const float eye[3] = { (float)eyeCenter[0], (float)eyeCenter[1], (float)eyeCenter[2] };
+		terrain.draw(frustum, eye, groundColor);
+	}
+	else
+	{
+		drawGround();
+	}
 
 	// Draw Track
 	drawTracks();
@@ -360,53 +612,865 @@ void display()
 	glutSwapBuffers();
 }
 
-// Animate the camera while idle
+// Fit the track spline through TRACK_POINTS
+void buildTrack()
+{
+	track.build(&TRACK_POINTS[0][0], (int)(sizeof(TRACK_POINTS) / sizeof(TRACK_POINTS[0])), TRACK_STEP);
+}
+
+// Spread the trains round the fixed track, with its one station where the ride starts
+void buildFleet()
+{
+	fleet.init(&track, 1, FLEET_TRAINS, CARTS_PER_TRAIN, CART_START, BLOCK_LENGTH, track.length(), DWELL_TIME);
+	fleet.setDriveSpeed(0.1f * SPEED / STEP_TIME);
+	cartMatrices.assign(fleet.cartMatrix(0), fleet.cartMatrix(0) + fleet.cartCount() * 16);
+}
+
+// Hang the camera above the cart in the scene graph
+void buildRig()
+{
+	float matrix[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+	cartNode = scene.addNode(-1, matrix);
+	matrix[13] = CAMERA_HEIGHT;
+	cameraNode = scene.addNode(cartNode, matrix);
+}
+
+// Move the cart to its distance along the track, carrying the camera with it
+void updateCart()
+{
+	float matrix[16];
+	if (endless)
+	{
+		// Waits where the track runs out, should the cart ever outrun the worker
+		cartDistance = stream.evaluate(cartDistance, cart);
+	}
+	else
+	{
+		track.evaluate(cartDistance, cart);
+	}
+	frameMatrix(cart, matrix);
+	scene.setLocal(cartNode, matrix);
+	scene.update(pool);
+
+	const float* camera = scene.world(cameraNode);
+	for (int i = 0; i < 3; i++)
+	{
+		eyeCenter[i] = camera[12 + i];
+	}
+}
+
+// Move the ride on by a step, on the simulation thread, and publish where it is now
+void stepRide(double time)
+{
+	RideState& state = rideStates.writeSlot();
+	if (endless)
+	{
+		// Waits where the track runs out, as updateCart() would
+		rideDistance = fminf(rideDistance + 0.1f * SPEED, trackEnd);
+	}
+	else
+	{
+		// The drive holds trains to the speed the menu picks, which gravity adds to down the dip
+		fleet.setDriveSpeed(0.1f * SPEED / STEP_TIME);
+		fleet.step(STEP_TIME, simulationPool);
+		rideDistance = fleet.front(0);
+		state.carts.assign(fleet.cartMatrix(0), fleet.cartMatrix(0) + fleet.cartCount() * 16);
+	}
+	state.time = time;
+	state.distance = rideDistance;
+	rideStates.publish();
+}
+
+// Join the simulation thread before exit() tears down what it steps, as the menu's Exit and
+// closing the window both end the program from inside glutMainLoop()
+void stopRide()
+{
+	simulation.stop();
+}
+
+// Hand the ride to the simulation thread, from where it stands now
+void startRide()
+{
+	shownTo.time = 0.0;
+	shownTo.distance = cartDistance;
+	shownTo.carts = cartMatrices;
+	shownFrom = shownTo;
+	rideDistance = cartDistance;
+	if (endless)
+	{
+		trackEnd = stream.end();
+	}
+	nextFrame = std::chrono::steady_clock::now();
+	simulation.start(STEP_TIME, stepRide);
+	atexit(stopRide);
+}
+
+// Place the cart and carts as they were at time, between the last two states taken from the
+// simulation
+void showRide(double time)
+{
+	if (rideStates.update())
+	{
+		std::swap(shownFrom, shownTo);
+		shownTo = rideStates.readSlot();
+	}
+
+	double span = shownTo.time - shownFrom.time;
+	float t = span > 0.0 ? (float)std::min(std::max((time - shownFrom.time) / span, 0.0), 1.0) : 1.0f;
+
+	// The camera's train going round from the end of the track to the start moves it back
+	cartDistance = shownTo.distance < shownFrom.distance ? shownTo.distance
+		: shownFrom.distance + t * (shownTo.distance - shownFrom.distance);
+	cartMatrices.resize(shownTo.carts.size());
+	for (size_t cart = 0; cart < shownTo.carts.size(); cart += 16)
+	{
+		const float* from = &shownFrom.carts[cart];
+		const float* to = &shownTo.carts[cart];
+		float dx = to[12] - from[12], dy = to[13] - from[13], dz = to[14] - from[14];
+		bool jumped = dx * dx + dy * dy + dz * dz > SNAP_DISTANCE * SNAP_DISTANCE;
+		for (int k = 0; k < 16; k++)
+		{
+			cartMatrices[cart + k] = jumped ? to[k] : from[k] + t * (to[k] - from[k]);
+		}
+	}
+	updateCart();
+}
+
+// Sleep until the next frame is due rather than spinning, then draw the ride a step behind
+// the simulation
 void idle()
 {
-	if (eyeCenter[2] > -38.0f)
+	auto now = std::chrono::steady_clock::now();
+	nextFrame = std::max(nextFrame + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(FRAME_TIME)), now);
+	std::this_thread::sleep_until(nextFrame);
+
+	showRide(simulation.now() - STEP_TIME);
+
+	glutPostRedisplay();
+}
+
+// Time track queries, in order as the cart makes them and scattered as a large scene would
+void benchmarkTrack()
+{
+	const int QUERIES = 10000000;
+	TrackFrame frame;
+	double checksum = 0.0;
+
+	auto start = std::chrono::steady_clock::now();
+	buildTrack();
+	double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Built %.1f units of track in %.3f ms\n", track.length(), buildMs);
+
+	// Distance between nearby queries should match the distance asked for
+	float worstError = 0.0f;
+	for (float distance = 0.0f; distance + 0.01f < track.length(); distance += 0.01f)
 	{
-		eyeCenter[2] -= 0.1 * SPEED;
+		float a[3], b[3];
+		track.position(distance, a);
+		track.position(distance + 0.01f, b);
+		float chord = sqrtf((b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]) + (b[2] - a[2]) * (b[2] - a[2]));
+		worstError = fmaxf(worstError, fabsf(chord / 0.01f - 1.0f));
 	}
+	printf("Worst speed error along the track: %.3f%%\n", worstError * 100.0f);
 
-	// Move camera along Y-Axis
-	if (eyeCenter[2] < -38.0f)
+	for (int pattern = 0; pattern < 2; pattern++)
 	{
-		eyeCenter[2] -= 0.2 * SPEED;
+		unsigned int seed = 1;
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < QUERIES; i++)
+		{
+			float distance;
+			if (pattern == 0)
+			{
+				distance = track.length() * i / QUERIES;
+			}
+			else
+			{
+				seed = seed * 1664525u + 1013904223u;
+				distance = track.length() * (seed >> 8) / 16777216.0f;
+			}
+			track.evaluate(distance, frame);
+			checksum += frame.position[1] + frame.up[2];
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("%s frames: %.1f million/s\n", pattern == 0 ? "Sequential" : "Random", QUERIES / seconds / 1e6);
+	}
+	printf("(checksum %f)\n", checksum);
+}
 
-		// Move along different sections of the track
-		if (eyeCenter[2] > -42.0f)
+// Fit the track spline through a procedural ride for benchmarks, a point every 12 units
+// or so down -Z
+void buildLongTrack(int count)
+{
+	std::vector<float> points(count * 3);
+	for (int i = 0; i < count; i++)
+	{
+		points[i * 3 + 0] = 40.0f * sinf(0.21f * i) + 8.0f * sinf(1.3f * i);
+		points[i * 3 + 1] = 12.0f * sinf(0.33f * i);
+		points[i * 3 + 2] = -12.0f * i;
+	}
+	track.build(&points[0], count, TRACK_STEP);
+}
+
+// Time meshing a long procedural track on one thread and on the whole pool
+void benchmarkMesh()
+{
+	auto start = std::chrono::steady_clock::now();
+	buildLongTrack(400);
+	double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Built %.1f units of track in %.3f ms\n", track.length(), buildMs);
+
+	ThreadPool single;
+	ThreadPool* pools[2] = { &single, &pool };
+	double checksums[2];
+	for (int p = 0; p < 2; p++)
+	{
+		BakedBatch rails;
+		std::vector<float> tops;
+		std::vector<TrackChunk> chunks;
+		TrackMeshStats stats;
+		double best = 1e9;
+		for (int run = 0; run < 5; run++)
 		{
-			// Move along first downward curve
-			eyeCenter[1] -= 0.1 * SPEED;
+			start = std::chrono::steady_clock::now();
+			stats = buildTrackMesh(track, TIE_GAP, 4.0f, *pools[p], rails, tops, chunks);
+			best = fmin(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
 		}
-		else if (eyeCenter[2] > -48.0f)
+
+		checksums[p] = 0.0;
+		for (size_t i = 0; i < rails.vertices.size(); i++)
 		{
-			// Move along upward slope
-			eyeCenter[1] += 0.1 * SPEED;
+			checksums[p] += rails.vertices[i] * (double)(i % 7 + 1);
 		}
-		else if (eyeCenter[2] > 50.0f)
+		for (size_t i = 0; i < rails.indices.size(); i++)
 		{
-			// Move along upward curves
-			eyeCenter[1] -= 0.1 * SPEED;
+			checksums[p] += rails.indices[i] * (double)(i % 5 + 1);
+		}
+		for (size_t i = 0; i < tops.size(); i++)
+		{
+			checksums[p] += tops[i] * (double)(i % 3 + 1);
+		}
+
+		printf("%d thread(s): %.3f ms for %d chunks, %d rings, %d ties, %d pillars, %d vertices, %d triangles\n",
+			pools[p]->size(), best, stats.chunks, stats.rings, stats.ties, stats.pillars, stats.vertices, stats.triangles);
+	}
+	printf("Meshes %s\n", checksums[0] == checksums[1] ? "match" : "DIFFER");
+}
+
+// Ride the long procedural track, timing culling against testing every chunk and
+// drawing with culling against drawing everything
+void benchmarkCull()
+{
+	const int VIEWS = 400;
+
+	buildLongTrack(400);
+	bakeTracks();
+	buildFleet();
+	// No reshape comes before the main loop, so match the window init() made
+	aspect = 1.0f;
+	glViewport(0, 0, (GLsizei)WINDOW_SIZE, (GLsizei)WINDOW_SIZE);
+	GLsizei totalIndices = 0;
+	for (const TrackChunk& chunk : trackChunks)
+	{
+		totalIndices += chunk.railCount;
+	}
+	printf("%d chunks, %d rail triangles, %d pillars\n", (int)trackChunks.size(), totalIndices / 3, (int)pillarTops.size() / 3);
+
+	double cullMs = 0.0, bruteMs = 0.0;
+	long long visibleSum = 0, triangleSum = 0, pillarSum = 0;
+	int mismatches = 0;
+	std::vector<int> brute;
+	for (int view = 0; view < VIEWS; view++)
+	{
+		cartDistance = track.length() * view / VIEWS;
+		updateCart();
+		display();
+
+		float projection[16], modelview[16];
+		Frustum frustum;
+		glGetFloatv(GL_PROJECTION_MATRIX, projection);
+		glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+		extractFrustum(projection, modelview, frustum);
+
+		auto start = std::chrono::steady_clock::now();
+		trackBVH.cull(frustum, pool, visibleChunks);
+		cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Every chunk against every plane, no hierarchy
+		start = std::chrono::steady_clock::now();
+		brute.clear();
+		for (size_t i = 0; i < trackChunks.size(); i++)
+		{
+			const TrackChunk& chunk = trackChunks[i];
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+			{
+				const float* plane = frustum.planes[p];
+				float x = plane[0] > 0.0f ? chunk.max[0] : chunk.min[0];
+				float y = plane[1] > 0.0f ? chunk.max[1] : chunk.min[1];
+				float z = plane[2] > 0.0f ? chunk.max[2] : chunk.min[2];
+				inside = plane[0] * x + plane[1] * y + plane[2] * z + plane[3] >= 0.0f;
+			}
+			if (inside)
+			{
+				brute.push_back((int)i);
+			}
+		}
+		bruteMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		mismatches += brute != visibleChunks ? 1 : 0;
+		visibleSum += visibleChunks.size();
+		for (int index : visibleChunks)
+		{
+			triangleSum += trackChunks[index].railCount / 3;
+			pillarSum += trackChunks[index].pillarCount;
+		}
+	}
+	printf("Visible: %.1f chunks, %lld rail triangles, %lld pillars a view on average\n",
+		(double)visibleSum / VIEWS, triangleSum / VIEWS, pillarSum / VIEWS);
+	printf("Cull: %.4f ms a view over the hierarchy, %.4f ms testing every chunk, %d views differ\n",
+		cullMs / VIEWS, bruteMs / VIEWS, mismatches);
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		cullTrack = pass == 1;
+		auto start = std::chrono::steady_clock::now();
+		for (int view = 0; view < VIEWS; view++)
+		{
+			cartDistance = track.length() * view / VIEWS;
+			updateCart();
+			display();
+			glFinish();
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("Frame with culling %s: %.3f ms\n", cullTrack ? "on" : "off", ms / VIEWS);
+	}
+}
+
+// Ride a track ten times the default one's length, comparing pillars drawn at full detail
+// with pillars drawn through their levels of detail
+void benchmarkLOD()
+{
+	const int VIEWS = 400;
+
+	buildLongTrack(80);
+	bakeTracks();
+	buildFleet();
+	// No reshape comes before the main loop, so match the window init() made
+	aspect = 1.0f;
+	glViewport(0, 0, (GLsizei)WINDOW_SIZE, (GLsizei)WINDOW_SIZE);
+	printf("%.1f units of track, %d pillars\n", track.length(), (int)pillarTops.size() / 3);
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		pillars.enabled = pass == 1;
+		long long triangleSum = 0, railSum = 0;
+		long long levelSums[PILLAR_LEVELS + 1] = { 0 };
+		double totalMs = 0.0, worstMs = 0.0;
+		for (int view = 0; view < VIEWS; view++)
+		{
+			cartDistance = track.length() * view / VIEWS;
+			updateCart();
+			auto start = std::chrono::steady_clock::now();
+			display();
+			glFinish();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			totalMs += ms;
+			worstMs = fmax(worstMs, ms);
+
+			triangleSum += pillars.triangles;
+			for (int index : visibleChunks)
+			{
+				railSum += trackChunks[index].railCount / 3;
+			}
+			for (int level = 0; level <= PILLAR_LEVELS; level++)
+			{
+				levelSums[level] += pillars.levelCounts[level];
+			}
+		}
+
+		printf("Level of detail %s: %.3f ms a frame (worst %.3f), %lld pillar and %lld rail triangles a frame\n",
+			pillars.enabled ? "on" : "off", totalMs / VIEWS, worstMs, triangleSum / VIEWS, railSum / VIEWS);
+		printf("  Pillars a frame by level:");
+		for (int level = 0; level <= PILLAR_LEVELS; level++)
+		{
+			printf(" %.1f", (double)levelSums[level] / VIEWS);
+		}
+		printf("\n");
+	}
+}
+
+// Step a hundred thousand carts in trains of four, on a hundred lines of the long procedural
+// track, timing a fixed step on 1, 2, 4... threads up to maxThreads, or one per core when 0,
+// with how each count scales against one thread and whether it makes CARTS_TARGET_MS
+void benchmarkCarts(int maxThreads)
+{
+	const int CARTS = 100000;
+	const int CARTS_PER = 4;
+	const int TRAINS_PER_LINE = 250;
+	const int STEPS = 600;
+
+	buildLongTrack(400);
+	int lines = CARTS / (CARTS_PER * TRAINS_PER_LINE);
+	printf("%.1f units of track, %d lines of %d trains of %d carts\n", track.length(), lines, TRAINS_PER_LINE, CARTS_PER);
+
+	if (maxThreads <= 0)
+	{
+		maxThreads = pool.size();
+	}
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads < maxThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	std::vector<double> checksums(threadCounts.size());
+	double singleMs = 0.0;
+	for (size_t p = 0; p < threadCounts.size(); p++)
+	{
+		ThreadPool counted;
+		counted.start(threadCounts[p]);
+		CartFleet carts;
+		carts.init(&track, lines, TRAINS_PER_LINE, CARTS_PER, CART_START, 12.0f, 500.0f, 5.0f);
+		carts.setDriveSpeed(6.0f);
+
+		double totalMs = 0.0, worstMs = 0.0;
+		long long standing = 0;
+		double speedSum = 0.0;
+		for (int step = 0; step < STEPS; step++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			carts.step(STEP_TIME, counted);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			totalMs += ms;
+			worstMs = fmax(worstMs, ms);
+
+			for (int train = 0; train < carts.trainCount(); train++)
+			{
+				standing += carts.speed(train) == 0.0f ? 1 : 0;
+				speedSum += carts.speed(train);
+			}
+		}
+
+		checksums[p] = 0.0;
+		for (int cart = 0; cart < carts.cartCount(); cart++)
+		{
+			checksums[p] += carts.cartMatrix(cart)[12] + carts.cartMatrix(cart)[14] * 0.5;
+		}
+		if (p == 0)
+		{
+			singleMs = totalMs / STEPS;
+		}
+		printf("%d thread(s): %.3f ms a step (worst %.3f, %.2fx one thread, %s %.1f ms) for %d carts, mean speed %.2f, %.1f%% of trains standing\n",
+			counted.size(), totalMs / STEPS, worstMs, singleMs * STEPS / totalMs, totalMs / STEPS < CARTS_TARGET_MS ? "under" : "over",
+			CARTS_TARGET_MS, carts.cartCount(), speedSum / ((double)STEPS * carts.trainCount()),
+			100.0 * standing / ((double)STEPS * carts.trainCount()));
+	}
+
+	bool match = true;
+	for (double checksum : checksums)
+	{
+		match = match && checksum == checksums[0];
+	}
+	printf("Carts %s on every thread count\n", match ? "match" : "DIFFER");
+}
+
+// Ride the endless track for minutes of 60 Hz frames at the fastest menu speed, timing each
+// frame along with the streaming it does, and report hitches and the most the stream held
+void benchmarkStream(double minutes)
+{
+	const double HITCH_FACTOR = 2.0; // Frames this many times the median are hitches
+	int frames = (int)(minutes * 60.0 * 60.0);
+
+	// No reshape comes before the main loop, so match the window init() made
+	aspect = 1.0f;
+	glViewport(0, 0, (GLsizei)WINDOW_SIZE, (GLsizei)WINDOW_SIZE);
+	SPEED = 6;
+
+	std::vector<double> times(frames);
+	int stalls = 0;
+	int mostSections = 0;
+	size_t mostBytes = 0, mostUpload = 0;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		float wanted = cartDistance + 0.1f * SPEED;
+		cartDistance = wanted;
+		updateCart();
+		display();
+		glFinish();
+		times[frame] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		stalls += cartDistance < wanted ? 1 : 0;
+		mostSections = std::max(mostSections, stream.sectionCount());
+		mostBytes = std::max(mostBytes, stream.residentBytes());
+		mostUpload = std::max(mostUpload, stream.uploadedLastFrame());
+	}
+
+	std::vector<double> sorted(times);
+	std::sort(sorted.begin(), sorted.end());
+	double total = 0.0;
+	int hitches = 0;
+	for (double ms : times)
+	{
+		total += ms;
+		hitches += ms > HITCH_FACTOR * sorted[frames / 2] ? 1 : 0;
+	}
+
+	printf("%.1f minutes, %d frames, %.1f km of track in %d sections\n", minutes, frames, cartDistance / 1000.0f, stream.generated());
+	printf("Frame time: mean %.3f ms, median %.3f, p99 %.3f, worst %.3f\n",
+		total / frames, sorted[frames / 2], sorted[frames * 99 / 100], sorted[frames - 1]);
+	printf("Hitches over %.0fx the median: %d, frames the cart waited for track: %d\n", HITCH_FACTOR, hitches, stalls);
+	printf("Most at once: %d sections drawn, %.1f KB in buffer objects, %.1f KB uploaded in a frame\n",
+		mostSections, mostBytes / 1024.0, mostUpload / 1024.0);
+}
+
+// Ride the fixed track and the long procedural one, timing frames with occlusion culling off
+// and on, with how much it culls and what it costs. Every view is then drawn both ways with
+// pillars at full detail, as levels depend on what was drawn before, to count pixels that differ
+void benchmarkOcclusion()
+{
+	const int VIEWS = 400;
+	const int PIXELS = (int)WINDOW_SIZE * (int)WINDOW_SIZE;
+
+	// No reshape comes before the main loop, so match the window init() made
+	aspect = 1.0f;
+	glViewport(0, 0, (GLsizei)WINDOW_SIZE, (GLsizei)WINDOW_SIZE);
+
+	std::vector<unsigned char> images[2] = { std::vector<unsigned char>(PIXELS * 3), std::vector<unsigned char>(PIXELS * 3) };
+	for (int scene = 0; scene < 2; scene++)
+	{
+		if (scene == 0)
+		{
+			buildTrack();
 		}
 		else
 		{
-			if (eyeCenter[1] != 1.0f)
+			buildLongTrack(80);
+		}
+		bakeTracks();
+		buildFleet();
+		printf("%s: %.1f units of track, %d chunks, %d pillars\n", scene == 0 ? "Default track" : "Long track",
+			track.length(), (int)trackChunks.size(), (int)pillarTops.size() / 3);
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			cullOccluded = pass == 1;
+			double totalMs = 0.0, cullerMs = 0.0, worstCullerMs = 0.0;
+			long long chunkSum = 0, occludedChunkSum = 0, pillarSum = 0, occludedPillarSum = 0, triangleSum = 0, occluderSum = 0;
+			for (int view = 0; view < VIEWS; view++)
+			{
+				cartDistance = track.length() * view / VIEWS;
+				updateCart();
+				auto start = std::chrono::steady_clock::now();
+				display();
+				glFinish();
+				totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+				cullerMs += occlusionMs;
+				worstCullerMs = fmax(worstCullerMs, occlusionMs);
+				chunkSum += visibleChunks.size() + chunksOccluded;
+				occludedChunkSum += chunksOccluded;
+				pillarSum += pillarsTested;
+				occludedPillarSum += pillarsOccluded;
+				triangleSum += pillars.triangles;
+				occluderSum += occlusion.triangles();
+			}
+
+			if (!cullOccluded)
+			{
+				printf("  Occlusion culling off: %.3f ms a frame, %lld pillar triangles a frame\n", totalMs / VIEWS, triangleSum / VIEWS);
+				continue;
+			}
+			printf("  Occlusion culling on: %.3f ms a frame, %lld pillar triangles a frame\n", totalMs / VIEWS, triangleSum / VIEWS);
+			printf("  Culled %.1f%% of %.1f chunks and %.1f%% of %.1f pillars in the frustum a frame\n",
+				100.0 * occludedChunkSum / std::max(chunkSum, 1LL), (double)chunkSum / VIEWS,
+				100.0 * occludedPillarSum / std::max(pillarSum, 1LL), (double)pillarSum / VIEWS);
+			printf("  Culler: %.3f ms a frame (worst %.3f) for %.1f occluder triangles a frame\n",
+				cullerMs / VIEWS, worstCullerMs, (double)occluderSum / VIEWS);
+		}
+
+		pillars.enabled = false;
+		long long differing = 0;
+		int worstView = 0;
+		for (int view = 0; view < VIEWS; view++)
+		{
+			cartDistance = track.length() * view / VIEWS;
+			updateCart();
+			for (int pass = 0; pass < 2; pass++)
+			{
+				cullOccluded = pass == 1;
+				display();
+				glReadPixels(0, 0, (GLsizei)WINDOW_SIZE, (GLsizei)WINDOW_SIZE, GL_RGB, GL_UNSIGNED_BYTE, images[pass].data());
+			}
+			int count = 0;
+			for (int i = 0; i < PIXELS; i++)
+			{
+				count += memcmp(&images[0][i * 3], &images[1][i * 3], 3) != 0 ? 1 : 0;
+			}
+			differing += count;
+			worstView = std::max(worstView, count);
+		}
+		pillars.enabled = true;
+		printf("  Pixels differing from drawing everything: %lld over %d views, at most %d in a view\n", differing, VIEWS, worstView);
+	}
+}
+
+// CPU seconds the process has used so far, over all its threads
+double processSeconds()
+{
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+	ULARGE_INTEGER kernelTicks, userTicks;
+	kernelTicks.LowPart = kernel.dwLowDateTime;
+	kernelTicks.HighPart = kernel.dwHighDateTime;
+	userTicks.LowPart = user.dwLowDateTime;
+	userTicks.HighPart = user.dwHighDateTime;
+	return (kernelTicks.QuadPart + userTicks.QuadPart) * 1e-7;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+// Ride the endless track for seconds of wall time twice: first moving the cart a fixed step a
+// frame with frames drawn as fast as they come, as the render loop once did, then with the
+// simulation thread stepping it and the render loop sleeping to FRAME_TIME. Reports the CPU
+// each way uses and how evenly the camera moves, as the spread of its speed frame to frame
+void benchmarkPacing(double seconds)
+{
+	// No reshape comes before the main loop, so match the window init() made
+	aspect = 1.0f;
+	glViewport(0, 0, (GLsizei)WINDOW_SIZE, (GLsizei)WINDOW_SIZE);
+	SPEED = 6;
+	double expected = 0.1 * SPEED / STEP_TIME;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		bool paced = pass == 1;
+		if (paced)
+		{
+			startRide();
+		}
+
+		std::vector<double> speeds;
+		auto start = std::chrono::steady_clock::now();
+		auto last = start;
+		double cpuStart = processSeconds();
+		double wall = 0.0;
+		float lastDistance = cartDistance;
+		while (wall < seconds)
+		{
+			if (paced)
+			{
+				idle();
+			}
+			else
 			{
-				// Move along second downward curve
-				eyeCenter[1] -= 0.1 * SPEED;
+				cartDistance += 0.1f * SPEED;
+				updateCart();
 			}
+			display();
+			glFinish();
+
+			auto now = std::chrono::steady_clock::now();
+			speeds.push_back((cartDistance - lastDistance) / std::chrono::duration<double>(now - last).count());
+			last = now;
+			lastDistance = cartDistance;
+			wall = std::chrono::duration<double>(now - start).count();
 		}
+		double cpu = processSeconds() - cpuStart;
+		if (paced)
+		{
+			simulation.stop();
+		}
+
+		double sum = 0.0, squares = 0.0, worst = 0.0;
+		for (double speed : speeds)
+		{
+			sum += speed;
+			squares += (speed - expected) * (speed - expected);
+			worst = fmax(worst, fabs(speed - expected));
+		}
+		int frames = (int)speeds.size();
+		printf("%s: %.1f frames/s, %.1f%% of a core busy, camera speed %.2f for %.2f expected\n",
+			paced ? "Simulation thread, paced frames" : "Step a frame, frames as fast as they come",
+			frames / wall, 100.0 * cpu / wall, sum / frames, expected);
+		printf("  Speed off expected frame to frame: %.2f%% RMS, worst %.2f%%\n",
+			100.0 * sqrt(squares / frames) / expected, 100.0 * worst / expected);
+	}
+	if (simulation.dropped() > 0)
+	{
+		printf("Simulation fell behind and dropped %d steps\n", simulation.dropped());
 	}
+}
 
-	if (eyeCenter[2] < -60)
+// Local matrix of benchmark node i: a turn about Y that drifts with time, then a step out
+void sceneLocal(int i, int time, float* matrix)
+{
+	float angle = 0.3f * (i % 7) + 0.01f * time;
+	float c = cosf(angle), s = sinf(angle);
+	const float local[16] = { c, 0.0f, -s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, s, 0.0f, c, 0.0f, 1.0f, 0.1f, 0.0f, 1.0f };
+	memcpy(matrix, local, sizeof(local));
+}
+
+// Move a few nodes of a million-node tree each frame, timing the cached update on one
+// thread and on the pool against recomputing every world matrix as the matrix stack does
+void benchmarkScene()
+{
+	const int NODES = 1000000;
+	const int BRANCHING = 8;
+	const int MOVED = NODES / 100;
+	const int FRAMES = 50;
+
+	std::vector<float> locals(NODES * 16), worlds(NODES * 16);
+	SceneGraph graph;
+	for (int i = 0; i < NODES; i++)
 	{
-		// Reset camera's position
-		eyeCenter[2] = 5.0f;
-		eyeCenter[1] = 1.0f;
+		sceneLocal(i, 0, &locals[i * 16]);
+		graph.addNode(i == 0 ? -1 : (i - 1) / BRANCHING, &locals[i * 16]);
 	}
+	graph.update(pool);
 
-	glutPostRedisplay();
+	ThreadPool single;
+	ThreadPool* pools[2] = { &single, &pool };
+	for (int p = 0; p < 3; p++)
+	{
+		unsigned int seed = 1;
+		long long updatedSum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int frame = 1; frame <= FRAMES; frame++)
+		{
+			for (int k = 0; k < MOVED; k++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				int node = (int)((seed >> 8) % NODES);
+				sceneLocal(node, frame, &locals[node * 16]);
+				if (p < 2)
+				{
+					graph.setLocal(node, &locals[node * 16]);
+				}
+			}
+
+			if (p < 2)
+			{
+				graph.update(*pools[p]);
+				updatedSum += graph.updated();
+			}
+			else
+			{
+				// Nodes are numbered in depth order, so a parent's world is always ready before its children
+				memcpy(&worlds[0], &locals[0], 16 * sizeof(float));
+				for (int i = 1; i < NODES; i++)
+				{
+					multiplyMatrices(&worlds[(i - 1) / BRANCHING * 16], &locals[i * 16], &worlds[i * 16]);
+				}
+				updatedSum += NODES;
+			}
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (p < 2)
+		{
+			printf("Cached, %d thread(s): %.3f ms a frame, %lld nodes updated a frame\n", pools[p]->size(), ms / FRAMES, updatedSum / FRAMES);
+		}
+		else
+		{
+			printf("Every node, 1 thread: %.3f ms a frame, %lld nodes updated a frame\n", ms / FRAMES, updatedSum / FRAMES);
+		}
+	}
+
+	// Every pass moved the same nodes the same way, so the cached worlds should match
+	float worst = 0.0f;
+	for (int i = 0; i < NODES; i++)
+	{
+		const float* world = graph.world(i);
+		for (int k = 0; k < 16; k++)
+		{
+			worst = fmaxf(worst, fabsf(world[k] - worlds[i * 16 + k]));
+		}
+	}
+	printf("Largest difference from recomputing everything: %g\n", worst);
+}
+
+// Fly low over the terrain from one corner of the map towards the other at the speed of a
+// fast plane, timing its frames and how long its tiles keep it waiting
+void benchmarkTerrain(double seconds)
+{
+	const float FLIGHT_SPEED = 200.0f; // Units a second
+	const float FLIGHT_HEIGHT = 20.0f; // Above the ground under the eye
+	const float FLIGHT_START = -6000.0f; // x and z the flight starts from
+	const int WARM_UP = 60; // Frames standing at the start, untimed
+
+	if (!terrainReady)
+	{
+		printf("No terrain to fly over\n");
+		return;
+	}
+
+	aspect = 1.0f;
+	glViewport(0, 0, (GLsizei)WINDOW_SIZE, (GLsizei)WINDOW_SIZE);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glEnable(GL_COLOR_MATERIAL);
+
+	// setLight() hangs the light over the ride, soon far behind, so light the flight from the sky
+	GLfloat sun[] = { 0.4f, 1.0f, 0.3f, 0.0f };
+	glLightfv(GL_LIGHT0, GL_POSITION, sun);
+
+	int frames = (int)(seconds / FRAME_TIME);
+	double totalMs = 0.0, worstMs = 0.0;
+	long long nodeSum = 0, triangleSum = 0, coarserSum = 0, uploadSum = 0;
+	int waitingFrames = 0;
+	for (int frame = -WARM_UP; frame < frames; frame++)
+	{
+		// Straight along the diagonal, looking ahead and a little down
+		float travelled = FLIGHT_SPEED * (float)(std::max(frame, 0) * FRAME_TIME) / sqrtf(2.0f);
+		float x = FLIGHT_START + travelled, z = FLIGHT_START + travelled;
+		const float eye[3] = { x, terrain.height(x, z) + FLIGHT_HEIGHT, z };
+
+		auto start = std::chrono::steady_clock::now();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glMatrixMode(GL_PROJECTION);
+		glLoadIdentity();
+		gluPerspective(fov, aspect, 0.01, 1000.0);
+		gluLookAt(eye[0], eye[1], eye[2], eye[0] + 100.0, eye[1] - 20.0, eye[2] + 100.0, 0.0, 1.0, 0.0);
+
+		float projection[16], modelview[16];
+		Frustum frustum;
+		glGetFloatv(GL_PROJECTION_MATRIX, projection);
+		glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+		extractFrustum(projection, modelview, frustum);
+		terrain.draw(frustum, eye, groundColor);
+		glFinish();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (frame < 0)
+		{
+			continue;
+		}
+		totalMs += ms;
+		worstMs = fmax(worstMs, ms);
+		nodeSum += terrain.nodesDrawn;
+		triangleSum += terrain.triangles;
+		coarserSum += terrain.coarser;
+		uploadSum += terrain.tilesUploaded;
+		waitingFrames += terrain.coarser > 0 ? 1 : 0;
+	}
+	glDisable(GL_COLOR_MATERIAL);
+
+	printf("Flew %.0f units over a %d by %d heightmap in %d frames\n", FLIGHT_SPEED * frames * FRAME_TIME,
+		TERRAIN_CELLS, TERRAIN_CELLS, frames);
+	printf("  %.3f ms a frame (worst %.3f), %.1f nodes and %lld triangles a frame\n",
+		totalMs / frames, worstMs, (double)nodeSum / frames, triangleSum / frames);
+	printf("  %d frames drew some nodes coarser waiting for tiles, %.2f nodes a frame over the flight\n",
+		waitingFrames, (double)coarserSum / frames);
+	printf("  %d tiles generated, %lld uploaded in flight, %d resident in %.1f MB\n",
+		terrain.tilesGenerated(), uploadSum, terrain.tilesResident(), terrain.residentBytes() / (1024.0 * 1024.0));
 }
 
 // Change point that the camera looks at
@@ -529,10 +1593,84 @@ void init()
 
 int main(int argc, char *argv[])
 {
+	if (argc > 1 && strcmp(argv[1], "--bench-track") == 0)
+	{
+		benchmarkTrack();
+		return 0;
+	}
+
+	pool.start();
+	if (argc > 1 && strcmp(argv[1], "--bench-mesh") == 0)
+	{
+		benchmarkMesh();
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-scene") == 0)
+	{
+		benchmarkScene();
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-carts") == 0)
+	{
+		benchmarkCarts(argc > 2 ? atoi(argv[2]) : 0);
+		return 0;
+	}
+
+	buildRig();
+	buildTrack();
+	buildFleet();
+	updateCart();
+
 	glutInit(&argc, argv);  // initialize the library
 	init();
 	setLight();
 
+	// Buffer objects need the context init() created
+	initBufferObjects();
+	initBatch(trackBatch, GL_TRIANGLES, RAIL_COLOR[0], RAIL_COLOR[1], RAIL_COLOR[2]);
+	pillars.init(1.0f, 0.6f, 0.6f);
+	fleet.initDrawing(0.2f, 0.4f, 0.9f);
+	terrainReady = terrain.init();
+
+	endless = argc > 1 && (strcmp(argv[1], "--endless") == 0 || strcmp(argv[1], "--bench-stream") == 0 ||
+		strcmp(argv[1], "--bench-pacing") == 0);
+	if (endless)
+	{
+		stream.start(TIE_GAP, (float)pillarGap, RAIL_COLOR);
+		updateCart();
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--bench-cull") == 0)
+	{
+		benchmarkCull();
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-lod") == 0)
+	{
+		benchmarkLOD();
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-occlusion") == 0)
+	{
+		benchmarkOcclusion();
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-stream") == 0)
+	{
+		benchmarkStream(argc > 2 ? atof(argv[2]) : 30.0);
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-pacing") == 0)
+	{
+		benchmarkPacing(argc > 2 ? atof(argv[2]) : 10.0);
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-terrain") == 0)
+	{
+		benchmarkTerrain(argc > 2 ? atof(argv[2]) : 60.0);
+		return 0;
+	}
+
 	glutSetCursor(GLUT_CURSOR_CROSSHAIR);
 
 	// All callback functions
@@ -546,6 +1684,8 @@ int main(int argc, char *argv[])
 
 	createMenu();
 
+	// From here the simulation thread moves the ride, and idle() only draws it
+	startRide();
 	glutMainLoop();  // enter event processing loop
 
 	return 0;
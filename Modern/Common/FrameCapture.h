@@ -0,0 +1,622 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+// Asynchronous framebuffer readback with an encoder thread behind it.
+//
+// Include an OpenGL loader (glad, gl3w, ...) before this header. In exactly one source file,
+// define FRAME_CAPTURE_IMPLEMENTATION before including it, as with Profiler.h.
+//
+// Capture() has the GPU copy the read framebuffer into the next of RING pixel pack buffers and
+// fences the copy, returning at once. Later calls map each buffer once its fence has signalled,
+// normally a couple of frames on, and the encoder thread writes the frame straight from the
+// mapping. The GL thread only waits when every buffer is still busy, which Stalls() counts.
+// With DropWhenBehind set it skips that frame instead, which Dropped() counts, so a slow encoder
+// costs frames of the capture rather than frame time. Dropped frames leave gaps in the numbered
+// files and are missing from Y4M streams.
+//
+// The output path picks the format: name.png, name.qoi and name.ppm write name00000.png,
+// name00001.png, ...; name.y4m writes one YUV 4:2:0 stream. PNG is stored uncompressed to keep
+// the encoder fast, QOI is the compact choice.
+
+#include<atomic>
+#include<condition_variable>
+#include<cstdint>
+#include<cstdio>
+#include<deque>
+#include<functional>
+#include<mutex>
+#include<string>
+#include<thread>
+
+enum class CaptureFormat
+{
+	None, // Read back for OnFrame only
+	PPM,
+	PNG,
+	QOI,
+	Y4M
+};
+
+// One read back frame, RGBA rows bottom-up as GL returns them
+struct CapturedFrame
+{
+	int index;
+	int width;
+	int height;
+	const unsigned char* pixels;
+};
+
+class FrameCapture
+{
+	public:
+		static const int RING = 4; // Pixel pack buffers, frames read back but not yet encoded
+
+		// Called on the encoder thread for every frame, in capture order, before it is written
+		std::function<void(const CapturedFrame&)> OnFrame;
+		// Skip frames instead of waiting when every buffer is busy. Leave unset when every frame counts
+		bool DropWhenBehind = false;
+
+		FrameCapture();
+
+		// Starts a capture of width x height frames. path may be nullptr to only call OnFrame,
+		// fps is the frame rate recorded in Y4M streams
+		bool Start(const char* path, int width, int height, double fps = 60.0);
+		// Reads back the bound read framebuffer. GL thread only
+		void Capture();
+		// Encodes every frame still in flight and stops the encoder thread
+		void Finish();
+
+		// Times Capture() had to wait for a buffer, for the GPU copy or for the encoder
+		uint64_t Stalls() const { return stalls; }
+		// Frames DropWhenBehind skipped
+		uint64_t Dropped() const { return dropped; }
+
+	private:
+		enum SlotState { Free, Reading, Encoding, Encoded };
+		struct Slot
+		{
+			GLuint buffer = 0;
+			GLsync fence = 0;
+			int index = 0;
+			const unsigned char* mapped = nullptr;
+			std::atomic<int> state{ Free };
+		};
+
+		CaptureFormat format;
+		std::string prefix; // Path without the extension
+		int width;
+		int height;
+		double fps;
+		FILE* stream; // Y4M output
+
+		Slot slots[RING];
+		int next; // Slot the next Capture() uses
+		int oldest; // Oldest slot that is not Free
+		int reading; // Oldest slot whose copy may still be running
+		int frameIndex;
+		uint64_t stalls;
+		uint64_t dropped;
+
+		std::thread encoder;
+		std::mutex mutex;
+		std::condition_variable wake; // Signals the encoder that a frame is queued or it should stop
+		std::condition_variable done; // Signals the GL thread that a frame was encoded
+		std::deque<Slot*> queue;
+		bool stopping;
+
+		// Maps and queues slots whose copies are complete, waiting for them if block is set
+		void Collect(bool block);
+		void EncoderLoop();
+		void Write(const CapturedFrame& frame);
+};
+
+#endif
+
+#ifdef FRAME_CAPTURE_IMPLEMENTATION
+#ifndef FRAME_CAPTURE_IMPLEMENTED
+#define FRAME_CAPTURE_IMPLEMENTED
+
+#include<algorithm>
+#include<cstring>
+#include<vector>
+
+namespace
+{
+	uint32_t captureCrc32(uint32_t crc, const unsigned char* data, size_t size)
+	{
+		static uint32_t table[256];
+		static bool ready = false;
+		if (!ready)
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++)
+				{
+					c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+				table[i] = c;
+			}
+			ready = true;
+		}
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	void capturePutBE32(std::vector<unsigned char>& out, uint32_t value)
+	{
+		out.push_back((unsigned char)(value >> 24));
+		out.push_back((unsigned char)(value >> 16));
+		out.push_back((unsigned char)(value >> 8));
+		out.push_back((unsigned char)value);
+	}
+
+	// Appends a PNG chunk with its length and CRC
+	void capturePngChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size)
+	{
+		capturePutBE32(out, (uint32_t)size);
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data, data + size);
+		capturePutBE32(out, captureCrc32(0, &out[start], size + 4));
+	}
+
+	// RGB PNG in stored (uncompressed) deflate blocks
+	void captureWritePng(FILE* file, const CapturedFrame& frame)
+	{
+		const size_t rowBytes = (size_t)frame.width * 3 + 1; // Filter byte, then the row
+		std::vector<unsigned char> raw(rowBytes * frame.height);
+		for (int y = 0; y < frame.height; y++)
+		{
+			const unsigned char* src = frame.pixels + (size_t)(frame.height - 1 - y) * frame.width * 4;
+			unsigned char* dst = &raw[rowBytes * y];
+			*dst++ = 0;
+			for (int x = 0; x < frame.width; x++, src += 4)
+			{
+				*dst++ = src[0];
+				*dst++ = src[1];
+				*dst++ = src[2];
+			}
+		}
+
+		// zlib stream: header, 64 KiB stored blocks, Adler-32
+		std::vector<unsigned char> zlib = { 0x78, 0x01 };
+		zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+		uint32_t a = 1;
+		uint32_t b = 0;
+		int pending = 0; // Bytes summed since the last modulo, 5552 at most keeps b within 32 bits
+		for (size_t offset = 0; offset < raw.size(); )
+		{
+			size_t size = std::min(raw.size() - offset, (size_t)65535);
+			zlib.push_back(offset + size == raw.size() ? 1 : 0);
+			zlib.push_back((unsigned char)size);
+			zlib.push_back((unsigned char)(size >> 8));
+			zlib.push_back((unsigned char)~size);
+			zlib.push_back((unsigned char)(~size >> 8));
+			zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+			for (size_t i = offset; i < offset + size; i++)
+			{
+				a += raw[i];
+				b += a;
+				if (++pending == 5552)
+				{
+					a %= 65521;
+					b %= 65521;
+					pending = 0;
+				}
+			}
+			offset += size;
+		}
+		capturePutBE32(zlib, (b % 65521) << 16 | (a % 65521));
+
+		static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		std::vector<unsigned char> out(signature, signature + sizeof(signature));
+		std::vector<unsigned char> header;
+		capturePutBE32(header, frame.width);
+		capturePutBE32(header, frame.height);
+		header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bits, RGB, deflate, no filter, no interlace
+		capturePngChunk(out, "IHDR", header.data(), header.size());
+		capturePngChunk(out, "IDAT", zlib.data(), zlib.size());
+		capturePngChunk(out, "IEND", nullptr, 0);
+		fwrite(out.data(), 1, out.size(), file);
+	}
+
+	// QOI, the Quite OK Image format, RGB
+	void captureWriteQoi(FILE* file, const CapturedFrame& frame)
+	{
+		std::vector<unsigned char> out = { 'q', 'o', 'i', 'f' };
+		capturePutBE32(out, frame.width);
+		capturePutBE32(out, frame.height);
+		out.push_back(3); // RGB
+		out.push_back(0); // sRGB with linear alpha
+		out.reserve(out.size() + (size_t)frame.width * frame.height * 4 + 8);
+
+		unsigned char index[64][3] = {};
+		unsigned char previous[3] = { 0, 0, 0 };
+		bool indexed[64] = {};
+		int run = 0;
+		for (int y = frame.height - 1; y >= 0; y--)
+		{
+			const unsigned char* px = frame.pixels + (size_t)y * frame.width * 4;
+			for (int x = 0; x < frame.width; x++, px += 4)
+			{
+				if (px[0] == previous[0] && px[1] == previous[1] && px[2] == previous[2])
+				{
+					if (++run == 62)
+					{
+						out.push_back(0xC0 | (run - 1)); // QOI_OP_RUN
+						run = 0;
+					}
+					continue;
+				}
+				if (run > 0)
+				{
+					out.push_back(0xC0 | (run - 1));
+					run = 0;
+				}
+
+				// Alpha is always 255 here, which the hash has to include
+				int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+				if (indexed[hash] && memcmp(index[hash], px, 3) == 0)
+				{
+					out.push_back((unsigned char)hash); // QOI_OP_INDEX
+				}
+				else
+				{
+					int dr = (signed char)(px[0] - previous[0]);
+					int dg = (signed char)(px[1] - previous[1]);
+					int db = (signed char)(px[2] - previous[2]);
+					int drg = dr - dg;
+					int dbg = db - dg;
+					if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					{
+						out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)); // QOI_OP_DIFF
+					}
+					else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+					{
+						out.push_back(0x80 | (dg + 32)); // QOI_OP_LUMA
+						out.push_back((drg + 8) << 4 | (dbg + 8));
+					}
+					else
+					{
+						out.push_back(0xFE); // QOI_OP_RGB
+						out.insert(out.end(), px, px + 3);
+					}
+					memcpy(index[hash], px, 3);
+					indexed[hash] = true;
+				}
+				memcpy(previous, px, 3);
+			}
+		}
+		if (run > 0)
+		{
+			out.push_back(0xC0 | (run - 1));
+		}
+		out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+		fwrite(out.data(), 1, out.size(), file);
+	}
+
+	void captureWritePpm(FILE* file, const CapturedFrame& frame)
+	{
+		fprintf(file, "P6\n%d %d\n255\n", frame.width, frame.height);
+		std::vector<unsigned char> row((size_t)frame.width * 3);
+		for (int y = frame.height - 1; y >= 0; y--)
+		{
+			const unsigned char* src = frame.pixels + (size_t)y * frame.width * 4;
+			for (int x = 0; x < frame.width; x++)
+			{
+				row[x * 3 + 0] = src[x * 4 + 0];
+				row[x * 3 + 1] = src[x * 4 + 1];
+				row[x * 3 + 2] = src[x * 4 + 2];
+			}
+			fwrite(row.data(), 1, row.size(), file);
+		}
+	}
+
+	// One Y4M FRAME: BT.601 limited range luma, chroma averaged over 2x2 blocks
+	void captureWriteY4mFrame(FILE* file, const CapturedFrame& frame)
+	{
+		const int w = frame.width;
+		const int h = frame.height;
+		const int cw = (w + 1) / 2;
+		const int ch = (h + 1) / 2;
+		std::vector<unsigned char> planes((size_t)w * h + (size_t)cw * ch * 2);
+		unsigned char* lumaPlane = planes.data();
+		unsigned char* uPlane = lumaPlane + (size_t)w * h;
+		unsigned char* vPlane = uPlane + (size_t)cw * ch;
+
+		auto pixel = [&](int x, int y) { return frame.pixels + ((size_t)(h - 1 - y) * w + x) * 4; };
+		for (int y = 0; y < h; y++)
+		{
+			for (int x = 0; x < w; x++)
+			{
+				const unsigned char* p = pixel(x, y);
+				lumaPlane[(size_t)y * w + x] = (unsigned char)((66 * p[0] + 129 * p[1] + 25 * p[2] + 128 + 4096) >> 8);
+			}
+		}
+		for (int y = 0; y < ch; y++)
+		{
+			for (int x = 0; x < cw; x++)
+			{
+				int r = 0;
+				int g = 0;
+				int b = 0;
+				for (int k = 0; k < 4; k++)
+				{
+					const unsigned char* p = pixel(std::min(x * 2 + (k & 1), w - 1), std::min(y * 2 + (k >> 1), h - 1));
+					r += p[0];
+					g += p[1];
+					b += p[2];
+				}
+				uPlane[(size_t)y * cw + x] = (unsigned char)((-38 * r - 74 * g + 112 * b + 512 + 131072) >> 10);
+				vPlane[(size_t)y * cw + x] = (unsigned char)((112 * r - 94 * g - 18 * b + 512 + 131072) >> 10);
+			}
+		}
+		fputs("FRAME\n", file);
+		fwrite(planes.data(), 1, planes.size(), file);
+	}
+}
+
+FrameCapture::FrameCapture()
+{
+	format = CaptureFormat::None;
+	width = 0;
+	height = 0;
+	fps = 60.0;
+	stream = nullptr;
+	next = 0;
+	oldest = 0;
+	reading = 0;
+	frameIndex = 0;
+	stalls = 0;
+	dropped = 0;
+	stopping = false;
+}
+
+bool FrameCapture::Start(const char* path, int frameWidth, int frameHeight, double framesPerSecond)
+{
+	Finish();
+
+	format = CaptureFormat::None;
+	if (path != nullptr)
+	{
+		prefix = path;
+		size_t dot = prefix.rfind('.');
+		std::string extension = dot == std::string::npos ? "" : prefix.substr(dot);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+		format = extension == ".png" ? CaptureFormat::PNG : extension == ".qoi" ? CaptureFormat::QOI
+			: extension == ".ppm" ? CaptureFormat::PPM : extension == ".y4m" ? CaptureFormat::Y4M : CaptureFormat::None;
+		if (format == CaptureFormat::None)
+		{
+			printf("FRAME_CAPTURE_ERROR: %s is not .png, .qoi, .ppm or .y4m\n", path);
+			return false;
+		}
+		prefix.resize(dot);
+	}
+
+	width = frameWidth;
+	height = frameHeight;
+	fps = framesPerSecond;
+	if (format == CaptureFormat::Y4M)
+	{
+		stream = fopen(path, "wb");
+		if (stream == nullptr)
+		{
+			printf("FRAME_CAPTURE_ERROR: cannot write %s\n", path);
+			return false;
+		}
+		fprintf(stream, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg\n", width, height, (int)(fps * 1000.0 + 0.5));
+	}
+
+	GLsizeiptr size = (GLsizeiptr)width * height * 4;
+	for (Slot& slot : slots)
+	{
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		slot.state = Free;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	next = 0;
+	oldest = 0;
+	reading = 0;
+	frameIndex = 0;
+	stalls = 0;
+	dropped = 0;
+	stopping = false;
+	encoder = std::thread(&FrameCapture::EncoderLoop, this);
+	return true;
+}
+
+void FrameCapture::Capture()
+{
+	if (!encoder.joinable())
+	{
+		return;
+	}
+
+	Collect(false);
+	if (slots[next].state != Free)
+	{
+		// Every buffer is busy: the GPU or the encoder is more than RING frames behind
+		if (DropWhenBehind)
+		{
+			dropped++;
+			frameIndex++;
+			return;
+		}
+		stalls++;
+		while (slots[next].state != Free)
+		{
+			Collect(true);
+		}
+	}
+
+	Slot& slot = slots[next];
+	slot.index = frameIndex++;
+	// The program may rely on its own pack alignment, so put it back after the read
+	GLint alignment = 4;
+	glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.state = Reading;
+	next = (next + 1) % RING;
+}
+
+void FrameCapture::Collect(bool block)
+{
+	// Slots move through their states in ring order, so only the oldest of each state needs looking at
+	while (slots[oldest].state == Encoded)
+	{
+		Slot& slot = slots[oldest];
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.mapped = nullptr;
+		slot.state = Free;
+		oldest = (oldest + 1) % RING;
+	}
+
+	while (slots[reading].state == Reading)
+	{
+		Slot& slot = slots[reading];
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, block ? GL_TIMEOUT_IGNORED : 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			return;
+		}
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		slot.mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)width * height * 4, GL_MAP_READ_BIT);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.state = Encoding;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(&slot);
+		}
+		wake.notify_one();
+		reading = (reading + 1) % RING;
+	}
+
+	// Everything the GPU finished is queued, so all that is left to wait for is the encoder
+	if (block && slots[oldest].state == Encoding)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return slots[oldest].state != Encoding; });
+	}
+}
+
+void FrameCapture::EncoderLoop()
+{
+	while (true)
+	{
+		Slot* slot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || !queue.empty(); });
+			if (queue.empty())
+			{
+				return;
+			}
+			slot = queue.front();
+			queue.pop_front();
+		}
+
+		if (slot->mapped != nullptr)
+		{
+			CapturedFrame frame = { slot->index, width, height, slot->mapped };
+			if (OnFrame)
+			{
+				OnFrame(frame);
+			}
+			Write(frame);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			slot->state = Encoded;
+		}
+		done.notify_one();
+	}
+}
+
+void FrameCapture::Write(const CapturedFrame& frame)
+{
+	if (format == CaptureFormat::None)
+	{
+		return;
+	}
+	if (format == CaptureFormat::Y4M)
+	{
+		captureWriteY4mFrame(stream, frame);
+		return;
+	}
+
+	static const char* extensions[] = { "", ".ppm", ".png", ".qoi" };
+	char path[1024];
+	snprintf(path, sizeof(path), "%s%05d%s", prefix.c_str(), frame.index, extensions[(int)format]);
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr)
+	{
+		printf("FRAME_CAPTURE_ERROR: cannot write %s\n", path);
+		return;
+	}
+	if (format == CaptureFormat::PNG)
+	{
+		captureWritePng(file, frame);
+	}
+	else if (format == CaptureFormat::QOI)
+	{
+		captureWriteQoi(file, frame);
+	}
+	else
+	{
+		captureWritePpm(file, frame);
+	}
+	fclose(file);
+}
+
+void FrameCapture::Finish()
+{
+	if (!encoder.joinable())
+	{
+		return;
+	}
+
+	// Drain the ring in order, then let the encoder run dry
+	while (slots[oldest].state != Free)
+	{
+		Collect(true);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	encoder.join();
+
+	for (Slot& slot : slots)
+	{
+		glDeleteBuffers(1, &slot.buffer);
+		slot.buffer = 0;
+	}
+	if (stream != nullptr)
+	{
+		fclose(stream);
+		stream = nullptr;
+	}
+}
+
+#endif
+#endif
@@ -0,0 +1,492 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame profiler with nested CPU scopes on any thread and GPU scopes on the GL thread.
+//
+// Include an OpenGL loader (glad, gl3w, ...) before this header. In exactly one source file,
+// define PROFILER_IMPLEMENTATION before including it, as stb.cpp does for stb_image.
+//
+// Each thread records finished scopes into its own single-producer ring, which the GL thread
+// drains at EndFrame without locking. GPU scopes are GL_TIMESTAMP query pairs that are read
+// GPU_LATENCY frames later, once the GPU is done with them, so profiling never stalls the pipeline.
+
+#include<atomic>
+#include<cstdint>
+
+// One finished scope. Times are nanoseconds on the CPU clock, GPU scopes included
+struct ProfileEvent
+{
+	const char* name; // Must outlive the profiler, string literals are expected
+	int64_t start;
+	int64_t duration;
+	uint32_t thread; // 0 is the GPU
+	uint32_t depth;
+};
+
+// Lock-free ring written by one thread and drained by the GL thread
+class ProfileRing
+{
+	public:
+		static const uint32_t CAPACITY = 1 << 14;
+
+		uint32_t thread;
+		std::atomic<uint64_t> dropped; // Events lost because the ring was full
+
+		ProfileRing(uint32_t threadID);
+		bool Push(const ProfileEvent& event);
+		bool Pop(ProfileEvent& event);
+
+	private:
+		ProfileEvent events[CAPACITY];
+		std::atomic<uint32_t> head; // Next slot the producer writes
+		std::atomic<uint32_t> tail; // Next slot the consumer reads
+};
+
+class Profiler
+{
+	public:
+		static const int GPU_LATENCY = 3; // Frames between issuing GPU queries and reading them
+		static const int MAX_GPU_SCOPES = 128; // Per frame
+		static const int MAX_DEPTH = 64; // Nesting limit for scopes on one thread
+		static const int WINDOW = 512; // Samples per scope name in the rolling summary
+		static const int CALIBRATE_FRAMES = 600; // Frames between re-reading the GPU clock against the CPU's, as the two drift
+
+		// Brackets one frame on the GL thread. Nested calls are ignored, so both a
+		// main loop and the code it calls may mark frames
+		static void BeginFrame();
+		static void EndFrame();
+
+		static void BeginCpu(const char* name);
+		static void EndCpu();
+		// GL thread only
+		static void BeginGpu(const char* name);
+		static void EndGpu();
+
+		// Nanoseconds on the profiler's CPU clock
+		static int64_t Now();
+
+		// Writes every event still in the history as Chrome Trace Event JSON (chrome://tracing, Perfetto)
+		static bool WriteChromeTrace(const char* path);
+		// Prints p50/p95/p99 of each scope over the last WINDOW samples
+		static void PrintSummary();
+		// Deletes the GL queries, call while the context is still current
+		static void Shutdown();
+};
+
+// Times the enclosing block on the CPU
+class CpuScope
+{
+	public:
+		CpuScope(const char* name) { Profiler::BeginCpu(name); }
+		~CpuScope() { Profiler::EndCpu(); }
+};
+
+// Times the enclosing block on the GPU
+class GpuScope
+{
+	public:
+		GpuScope(const char* name) { Profiler::BeginGpu(name); }
+		~GpuScope() { Profiler::EndGpu(); }
+};
+
+// Marks the enclosing block as one frame
+class FrameScope
+{
+	public:
+		FrameScope() { Profiler::BeginFrame(); }
+		~FrameScope() { Profiler::EndFrame(); }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_CPU(name) CpuScope PROFILE_CONCAT(profileCpu, __LINE__)(name)
+#define PROFILE_GPU(name) GpuScope PROFILE_CONCAT(profileGpu, __LINE__)(name)
+// Times a block on both the CPU and the GPU under the same name
+#define PROFILE(name) PROFILE_CPU(name); PROFILE_GPU(name)
+#define PROFILE_FRAME() FrameScope PROFILE_CONCAT(profileFrame, __LINE__)
+
+#endif
+
+#ifdef PROFILER_IMPLEMENTATION
+#ifndef PROFILER_IMPLEMENTED
+#define PROFILER_IMPLEMENTED
+
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<map>
+#include<mutex>
+#include<string>
+#include<vector>
+
+ProfileRing::ProfileRing(uint32_t threadID) : thread(threadID), dropped(0), head(0), tail(0)
+{
+}
+
+bool ProfileRing::Push(const ProfileEvent& event)
+{
+	uint32_t h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) == CAPACITY)
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	events[h % CAPACITY] = event;
+	head.store(h + 1, std::memory_order_release); // Publishes the event to the consumer
+	return true;
+}
+
+bool ProfileRing::Pop(ProfileEvent& event)
+{
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	if (t == head.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+	event = events[t % CAPACITY];
+	tail.store(t + 1, std::memory_order_release); // Hands the slot back to the producer
+	return true;
+}
+
+namespace
+{
+	// Rolling window of durations in milliseconds for one scope name
+	struct ProfileStat
+	{
+		std::vector<double> samples;
+		size_t next = 0;
+
+		void Add(double ms)
+		{
+			if (samples.size() < (size_t)Profiler::WINDOW)
+			{
+				samples.push_back(ms);
+			}
+			else
+			{
+				samples[next] = ms;
+				next = (next + 1) % Profiler::WINDOW;
+			}
+		}
+	};
+
+	// GPU scopes issued during one frame, waiting GPU_LATENCY frames to be read
+	struct ProfileGpuFrame
+	{
+		GLuint queries[Profiler::MAX_GPU_SCOPES * 2];
+		const char* names[Profiler::MAX_GPU_SCOPES];
+		uint32_t depths[Profiler::MAX_GPU_SCOPES];
+		int used = 0;
+		GLuint last = 0; // Query issued last, which is the outer Frame scope's end rather than the last scope's
+	};
+
+	struct ProfilerState
+	{
+		std::mutex registryMutex; // Only taken when a thread records its first event
+		std::vector<ProfileRing*> rings;
+
+		static const size_t HISTORY = 1 << 20;
+		std::vector<ProfileEvent> history;
+		size_t historyNext = 0;
+		std::map<std::string, ProfileStat> cpuStats;
+		std::map<std::string, ProfileStat> gpuStats;
+
+		ProfileGpuFrame gpuFrames[Profiler::GPU_LATENCY + 1];
+		bool gpuReady = false;
+		int64_t gpuToCpu = 0; // Added to GPU timestamps to put them on the CPU clock
+		int gpuStack[Profiler::MAX_DEPTH];
+		int gpuDepth = 0;
+		uint64_t gpuDropped = 0; // Frames whose queries were still pending when their slot came around
+
+		uint64_t frame = 0;
+		int frameDepth = 0;
+	};
+
+	ProfilerState& profilerState()
+	{
+		static ProfilerState state;
+		return state;
+	}
+
+	struct ProfileThread
+	{
+		ProfileRing* ring = nullptr;
+		int64_t starts[Profiler::MAX_DEPTH];
+		const char* names[Profiler::MAX_DEPTH];
+		int depth = 0;
+	};
+	thread_local ProfileThread profileThread;
+
+	ProfileRing* profileRing()
+	{
+		if (profileThread.ring == nullptr)
+		{
+			ProfilerState& state = profilerState();
+			std::lock_guard<std::mutex> lock(state.registryMutex);
+			profileThread.ring = new ProfileRing((uint32_t)state.rings.size() + 1);
+			state.rings.push_back(profileThread.ring);
+		}
+		return profileThread.ring;
+	}
+
+	void profileRecord(ProfilerState& state, const ProfileEvent& event, bool gpu)
+	{
+		if (state.history.size() < ProfilerState::HISTORY)
+		{
+			state.history.push_back(event);
+		}
+		else
+		{
+			state.history[state.historyNext] = event;
+			state.historyNext = (state.historyNext + 1) % ProfilerState::HISTORY;
+		}
+		(gpu ? state.gpuStats : state.cpuStats)[event.name].Add(event.duration / 1e6);
+	}
+
+	// Reads back a frame slot that is GPU_LATENCY frames old
+	void profileResolveGpu(ProfilerState& state, ProfileGpuFrame& slot)
+	{
+		if (slot.used == 0)
+		{
+			return;
+		}
+
+		// Queries complete in the order they were issued, so the last one being ready means all of them are
+		GLint available = 0;
+		glGetQueryObjectiv(slot.last, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			state.gpuDropped++;
+			slot.used = 0;
+			return;
+		}
+
+		for (int i = 0; i < slot.used; i++)
+		{
+			GLuint64 begin = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(slot.queries[i * 2], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(slot.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+			if (end != 0)
+			{
+				ProfileEvent event = { slot.names[i], (int64_t)begin + state.gpuToCpu, (int64_t)(end - begin), 0, slot.depths[i] };
+				profileRecord(state, event, true);
+			}
+		}
+		slot.used = 0;
+	}
+
+	double profilePercentile(std::vector<double> samples, double p)
+	{
+		size_t index = (size_t)(p * (samples.size() - 1) + 0.5);
+		std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+		return samples[index];
+	}
+}
+
+int64_t Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::BeginFrame()
+{
+	ProfilerState& state = profilerState();
+	if (state.frameDepth++ > 0)
+	{
+		return;
+	}
+
+	if (!state.gpuReady)
+	{
+		for (ProfileGpuFrame& slot : state.gpuFrames)
+		{
+			glGenQueries(MAX_GPU_SCOPES * 2, slot.queries);
+		}
+		state.gpuReady = true;
+	}
+	if (state.frame % CALIBRATE_FRAMES == 0)
+	{
+		// Reading GL_TIMESTAMP returns once the GPU has the commands so far, without waiting for them to run
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		state.gpuToCpu = Now() - gpuNow;
+	}
+
+	// This slot was last written GPU_LATENCY frames ago
+	profileResolveGpu(state, state.gpuFrames[state.frame % (GPU_LATENCY + 1)]);
+
+	BeginCpu("Frame");
+	BeginGpu("Frame");
+}
+
+void Profiler::EndFrame()
+{
+	ProfilerState& state = profilerState();
+	if (state.frameDepth == 0 || --state.frameDepth > 0)
+	{
+		return;
+	}
+
+	EndGpu();
+	EndCpu();
+
+	// Drain every thread's ring into the history
+	std::vector<ProfileRing*> rings;
+	{
+		std::lock_guard<std::mutex> lock(state.registryMutex);
+		rings = state.rings;
+	}
+	ProfileEvent event;
+	for (ProfileRing* ring : rings)
+	{
+		while (ring->Pop(event))
+		{
+			profileRecord(state, event, false);
+		}
+	}
+
+	state.frame++;
+}
+
+void Profiler::BeginCpu(const char* name)
+{
+	ProfileThread& thread = profileThread;
+	if (thread.depth < MAX_DEPTH)
+	{
+		thread.names[thread.depth] = name;
+		thread.starts[thread.depth] = Now();
+	}
+	thread.depth++;
+}
+
+void Profiler::EndCpu()
+{
+	ProfileThread& thread = profileThread;
+	if (thread.depth == 0 || --thread.depth >= MAX_DEPTH)
+	{
+		return;
+	}
+	int64_t start = thread.starts[thread.depth];
+	ProfileEvent event = { thread.names[thread.depth], start, Now() - start, profileRing()->thread, (uint32_t)thread.depth };
+	profileRing()->Push(event);
+}
+
+void Profiler::BeginGpu(const char* name)
+{
+	ProfilerState& state = profilerState();
+	if (!state.gpuReady || state.gpuDepth >= MAX_DEPTH)
+	{
+		state.gpuDepth++;
+		return;
+	}
+
+	ProfileGpuFrame& slot = state.gpuFrames[state.frame % (GPU_LATENCY + 1)];
+	int index = slot.used < MAX_GPU_SCOPES ? slot.used++ : -1;
+	if (index >= 0)
+	{
+		slot.names[index] = name;
+		slot.depths[index] = (uint32_t)state.gpuDepth;
+		glQueryCounter(slot.queries[index * 2], GL_TIMESTAMP);
+		slot.last = slot.queries[index * 2];
+	}
+	state.gpuStack[state.gpuDepth++] = index;
+}
+
+void Profiler::EndGpu()
+{
+	ProfilerState& state = profilerState();
+	if (state.gpuDepth == 0 || --state.gpuDepth >= MAX_DEPTH || !state.gpuReady)
+	{
+		return;
+	}
+
+	ProfileGpuFrame& slot = state.gpuFrames[state.frame % (GPU_LATENCY + 1)];
+	int index = state.gpuStack[state.gpuDepth];
+	if (index >= 0)
+	{
+		glQueryCounter(slot.queries[index * 2 + 1], GL_TIMESTAMP);
+		slot.last = slot.queries[index * 2 + 1];
+	}
+}
+
+bool Profiler::WriteChromeTrace(const char* path)
+{
+	ProfilerState& state = profilerState();
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+
+	// Oldest first
+	size_t count = state.history.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		const ProfileEvent& event = state.history[(state.historyNext + i) % count];
+		fprintf(file, ",\n{\"name\":\"");
+		for (const char* c = event.name; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				fputc('\\', file);
+			}
+			fputc(*c, file);
+		}
+		fprintf(file, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+			event.thread == 0 ? "gpu" : "cpu", event.start / 1000.0, event.duration / 1000.0, event.thread);
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
+
+void Profiler::PrintSummary()
+{
+	ProfilerState& state = profilerState();
+	printf("%-24s %6s %10s %10s %10s\n", "scope (ms)", "n", "p50", "p95", "p99");
+	for (int gpu = 0; gpu < 2; gpu++)
+	{
+		for (auto& entry : gpu ? state.gpuStats : state.cpuStats)
+		{
+			const std::vector<double>& samples = entry.second.samples;
+			std::string name = (gpu ? "gpu " : "cpu ") + entry.first;
+			printf("%-24s %6zu %10.3f %10.3f %10.3f\n", name.c_str(), samples.size(),
+				profilePercentile(samples, 0.50), profilePercentile(samples, 0.95), profilePercentile(samples, 0.99));
+		}
+	}
+
+	uint64_t dropped = 0;
+	{
+		std::lock_guard<std::mutex> lock(state.registryMutex);
+		for (ProfileRing* ring : state.rings)
+		{
+			dropped += ring->dropped.load();
+		}
+	}
+	if (dropped > 0 || state.gpuDropped > 0)
+	{
+		printf("dropped %llu cpu events, %llu gpu frames\n", (unsigned long long)dropped, (unsigned long long)state.gpuDropped);
+	}
+}
+
+void Profiler::Shutdown()
+{
+	ProfilerState& state = profilerState();
+	if (state.gpuReady)
+	{
+		for (ProfileGpuFrame& slot : state.gpuFrames)
+		{
+			glDeleteQueries(MAX_GPU_SCOPES * 2, slot.queries);
+			slot.used = 0;
+		}
+		state.gpuReady = false;
+	}
+}
+
+#endif
+#endif
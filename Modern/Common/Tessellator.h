@@ -0,0 +1,776 @@
+#ifndef TESSELLATOR_H
+#define TESSELLATOR_H
+
+// CPU version of the fixed-function tessellation primitive generator (GL 4.5 section 11.2.2).
+//
+// In exactly one source file, define TESSELLATOR_IMPLEMENTATION before including this header.
+//
+// Generate turns a set of levels into a pattern: domain coordinates as gl_TessCoord would see
+// them, plus triangle or line indices. Where the spec leaves vertex placement to the
+// implementation (the short segments of fractional spacing) the layout of the D3D11 reference
+// tessellator is used, which is what llvmpipe and most hardware produce. The triangulation
+// between rings is implementation-dependent in the spec and is our own, but any conforming
+// one has the same vertices and the same number of primitives.
+//
+// TessPatternCache keeps the patterns for levels already seen, so a patch only costs an
+// evaluation, and tessEvaluate maps a pattern onto a patch four vertices at a time.
+
+#include<cstddef>
+#include<cstdint>
+#include<unordered_map>
+#include<vector>
+
+enum class TessDomain { Triangles, Quads, Isolines };
+enum class TessSpacing { Equal, FractionalEven, FractionalOdd };
+
+// Levels as a control shader writes them. Triangles use inner[0] and outer[0..2],
+// isolines outer[0] (line count) and outer[1] (segments per line)
+struct TessLevels
+{
+	float inner[2];
+	float outer[4];
+};
+
+// Output for one set of levels. Coordinates are kept as separate arrays padded with zeros to a
+// multiple of four, so evaluation can load them four at a time; w is 1-u-v for triangles
+struct TessPattern
+{
+	TessDomain domain;
+	uint32_t vertexCount;
+	std::vector<float> u, v, w;
+	// Triangles in the requested winding, or line segments for isolines. Empty if the patch is discarded
+	std::vector<uint32_t> indices;
+
+	uint32_t PrimitiveCount() const { return (uint32_t)indices.size() / (domain == TessDomain::Isolines ? 2 : 3); }
+};
+
+class Tessellator
+{
+	public:
+		static const int MAX_LEVEL = 64; // The minimum GL_MAX_TESS_GEN_LEVEL
+
+		// Clamps and rounds the levels the way the generator sees them, zeroing the ones the
+		// domain ignores. Returns false if the patch is discarded
+		static bool Normalize(TessDomain domain, TessSpacing spacing, const TessLevels& levels, TessLevels& out);
+		// cw matches layout(cw): triangles clockwise in (u, v) space
+		static void Generate(TessDomain domain, TessSpacing spacing, bool cw, const TessLevels& levels, TessPattern& out);
+};
+
+// Patterns by domain, spacing, winding and normalized levels. Equal spacing rounds levels to
+// integers, so a handful of patterns covers it; fractional levels are kept as they are and the
+// cache starts over once it holds capacity patterns
+class TessPatternCache
+{
+	public:
+		explicit TessPatternCache(size_t capacity = 4096);
+
+		// The pattern stays valid until the cache is cleared or starts over
+		const TessPattern& Get(TessDomain domain, TessSpacing spacing, bool cw, const TessLevels& levels);
+		void Clear();
+
+		size_t Size() const { return patterns.size(); }
+		// Bumped every time the cache drops its patterns, after which a new pattern may reuse
+		// an old one's address, so a pointer alone doesn't say which pattern it was
+		uint64_t Generation() const { return generation; }
+		uint64_t hits;
+		uint64_t misses;
+
+	private:
+		struct Key
+		{
+			TessDomain domain;
+			TessSpacing spacing;
+			bool cw;
+			TessLevels levels;
+
+			bool operator==(const Key& other) const;
+		};
+		struct KeyHash
+		{
+			size_t operator()(const Key& key) const;
+		};
+
+		size_t capacity;
+		uint64_t generation;
+		std::unordered_map<Key, TessPattern, KeyHash> patterns;
+		TessPattern discarded;
+};
+
+// Positions of every pattern vertex on one patch, written as vertexCount xyzw values.
+// Triangles blend corners[0..2] by (u, v, w) like the samples' evaluation shaders. Quads and
+// isolines blend four corners bilinearly, corners[0] at (0, 0), [1] at (1, 0), [2] at (1, 1), [3] at (0, 1)
+void tessEvaluate(const TessPattern& pattern, const float (*corners)[4], float (*out)[4]);
+// Same result one vertex at a time, for checking the SIMD path
+void tessEvaluateScalar(const TessPattern& pattern, const float (*corners)[4], float (*out)[4]);
+
+#endif
+
+#ifdef TESSELLATOR_IMPLEMENTATION
+#ifndef TESSELLATOR_IMPLEMENTED
+#define TESSELLATOR_IMPLEMENTED
+
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TESSELLATOR_SSE
+#include<emmintrin.h>
+#endif
+
+namespace
+{
+	// Points along one subdivided edge, placed like the D3D11 reference tessellator: each point
+	// is a blend between its position at the next lower and the next higher level of the same
+	// parity, so points slide smoothly as a fractional level changes
+	struct TessSubdivision
+	{
+		int segments;
+		bool odd;
+		int halfPoints; // Points in the first half of the edge, the middle excluded
+		int splitPoint; // The point past which the lower level has one point fewer
+		double fraction;
+		double floorStep;
+		double ceilStep;
+
+		double Place(int point) const
+		{
+			bool flip = false;
+			if (point >= halfPoints)
+			{
+				point = 2 * halfPoints - point - (odd ? 1 : 0);
+				flip = true;
+			}
+			if (point == halfPoints)
+			{
+				return 0.5;
+			}
+			int floorPoint = point > splitPoint ? point - 1 : point;
+			double location = floorPoint * floorStep * (1.0 - fraction) + point * ceilStep * fraction;
+			return flip ? 1.0 - location : location;
+		}
+	};
+
+	int tessRemoveMsb(int value)
+	{
+		int msb = 1;
+		while (value > 0 && (msb << 1) <= value)
+		{
+			msb <<= 1;
+		}
+		return value > 0 ? value & ~msb : 0;
+	}
+
+	// level is already clamped, and for equal spacing rounded
+	TessSubdivision tessSubdivide(float level, TessSpacing spacing)
+	{
+		TessSubdivision s;
+		s.odd = spacing == TessSpacing::FractionalOdd
+			|| (spacing == TessSpacing::Equal && ((int)level & 1) == 1);
+
+		double half = level * 0.5 + (s.odd ? 0.5 : 0.0);
+		int floorHalf = (int)std::floor(half);
+		int ceilHalf = (int)std::ceil(half);
+		s.fraction = half - floorHalf;
+		s.halfPoints = ceilHalf;
+		if (floorHalf == ceilHalf)
+		{
+			s.splitPoint = s.halfPoints + 1; // Nothing to split
+		}
+		else if (s.odd)
+		{
+			s.splitPoint = floorHalf == 1 ? 0 : (tessRemoveMsb(floorHalf - 1) << 1) + 1;
+		}
+		else
+		{
+			s.splitPoint = (tessRemoveMsb(floorHalf) << 1) + 1;
+		}
+
+		int floorSegments = 2 * floorHalf - (s.odd ? 1 : 0);
+		int ceilSegments = 2 * ceilHalf - (s.odd ? 1 : 0);
+		s.segments = ceilSegments;
+		s.floorStep = floorSegments > 0 ? 1.0 / floorSegments : 0.0;
+		s.ceilStep = 1.0 / ceilSegments;
+		return s;
+	}
+
+	float tessClampLevel(float level, TessSpacing spacing)
+	{
+		switch (spacing)
+		{
+			case TessSpacing::Equal:
+				return std::ceil(std::min(std::max(level, 1.0f), (float)Tessellator::MAX_LEVEL));
+			case TessSpacing::FractionalEven:
+				return std::min(std::max(level, 2.0f), (float)Tessellator::MAX_LEVEL);
+			case TessSpacing::FractionalOdd:
+				return std::min(std::max(level, 1.0f), (float)Tessellator::MAX_LEVEL - 1.0f);
+		}
+		return level;
+	}
+
+	// Builds a pattern in domain coordinates, tracking (u, v) for orientation
+	struct TessBuilder
+	{
+		TessPattern& out;
+		bool cw;
+
+		uint32_t Add(double u, double v, double w)
+		{
+			out.u.push_back((float)u);
+			out.v.push_back((float)v);
+			out.w.push_back((float)w);
+			return (uint32_t)out.u.size() - 1;
+		}
+
+		// a, b, c are counter-clockwise in (u, v)
+		void Triangle(uint32_t a, uint32_t b, uint32_t c)
+		{
+			out.indices.push_back(a);
+			out.indices.push_back(cw ? c : b);
+			out.indices.push_back(cw ? b : c);
+		}
+
+		// Fills the strip between an outer and an inner polyline running the same way, with the
+		// region on the left of both. t are the points' positions along the side, from 0 to 1
+		void Stitch(const std::vector<uint32_t>& outer, const std::vector<double>& outerT,
+			const std::vector<uint32_t>& inner, const std::vector<double>& innerT)
+		{
+			size_t i = 0;
+			size_t j = 0;
+			size_t m = outer.size() - 1;
+			size_t k = inner.size() - 1;
+			while (i < m || j < k)
+			{
+				// Advance whichever side's next segment is centred earlier along the strip
+				bool advanceOuter = j == k
+					|| (i < m && outerT[i] + outerT[i + 1] <= innerT[j] + innerT[j + 1]);
+				if (advanceOuter)
+				{
+					Triangle(outer[i], outer[i + 1], inner[j]);
+					i++;
+				}
+				else
+				{
+					Triangle(inner[j + 1], inner[j], outer[i]);
+					j++;
+				}
+			}
+		}
+	};
+
+	// One side of a ring: its vertices from corner to corner and their positions along it
+	struct TessSide
+	{
+		std::vector<uint32_t> vertices;
+		std::vector<double> t;
+	};
+
+	void tessTriangles(TessBuilder& b, TessSpacing spacing, const TessLevels& levels)
+	{
+		// Corners counter-clockwise in (u, v): w = 1, u = 1, v = 1. Side i runs from corner i to
+		// corner i + 1 and lies on v = 0, w = 0 and u = 0, whose levels are outer[1], outer[2], outer[0]
+		static const double corners[3][3] = { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } };
+		static const int sideLevel[3] = { 1, 2, 0 };
+
+		float inner = levels.inner[0];
+		bool outerAboveOne = levels.outer[0] > 1.0f || levels.outer[1] > 1.0f || levels.outer[2] > 1.0f;
+		if (inner <= 1.0f && !outerAboveOne)
+		{
+			uint32_t c0 = b.Add(0, 0, 1);
+			uint32_t c1 = b.Add(1, 0, 0);
+			uint32_t c2 = b.Add(0, 1, 0);
+			b.Triangle(c0, c1, c2);
+			return;
+		}
+		if (inner <= 1.0f)
+		{
+			inner = tessClampLevel(std::nextafter(1.0f, 2.0f), spacing); // Treated as 1 + epsilon
+		}
+
+		auto lerp = [](const double* a, const double* c, double t, int axis) { return a[axis] + (c[axis] - a[axis]) * t; };
+
+		// Outer ring, each side with its own level. Corners are shared between sides
+		uint32_t outerCorners[3];
+		for (int c = 0; c < 3; c++)
+		{
+			outerCorners[c] = b.Add(corners[c][0], corners[c][1], corners[c][2]);
+		}
+		TessSide outerSides[3];
+		for (int side = 0; side < 3; side++)
+		{
+			const double* from = corners[side];
+			const double* to = corners[(side + 1) % 3];
+			TessSubdivision s = tessSubdivide(levels.outer[sideLevel[side]], spacing);
+			TessSide& out = outerSides[side];
+			for (int q = 0; q <= s.segments; q++)
+			{
+				double t = s.Place(q);
+				out.t.push_back(t);
+				if (q == 0)
+				{
+					out.vertices.push_back(outerCorners[side]);
+				}
+				else if (q == s.segments)
+				{
+					out.vertices.push_back(outerCorners[(side + 1) % 3]);
+				}
+				else
+				{
+					out.vertices.push_back(b.Add(lerp(from, to, t, 0), lerp(from, to, t, 1), lerp(from, to, t, 2)));
+				}
+			}
+		}
+
+		// Inner rings r = 1, 2, ... sit at 2/3 of the r-th inner point towards the centre and
+		// reuse the inner subdivision between their own corners
+		TessSubdivision s = tessSubdivide(inner, spacing);
+		int rings = (s.segments + 1) / 2;
+		TessSide* previous = outerSides;
+		TessSide ringSides[2][3];
+		for (int r = 1; r < rings; r++)
+		{
+			double a = s.Place(r) * 2.0 / 3.0;
+			double ringCorners[3][3] = { { a, a, 1 - 2 * a }, { 1 - 2 * a, a, a }, { a, 1 - 2 * a, a } };
+			uint32_t ringCornerIndices[3];
+			for (int c = 0; c < 3; c++)
+			{
+				ringCornerIndices[c] = b.Add(ringCorners[c][0], ringCorners[c][1], ringCorners[c][2]);
+			}
+
+			TessSide* current = ringSides[r & 1];
+			double start = s.Place(r);
+			double length = s.Place(s.segments - r) - start;
+			for (int side = 0; side < 3; side++)
+			{
+				const double* from = ringCorners[side];
+				const double* to = ringCorners[(side + 1) % 3];
+				TessSide& out = current[side];
+				out.vertices.clear();
+				out.t.clear();
+				for (int q = r; q <= s.segments - r; q++)
+				{
+					double t = (s.Place(q) - start) / length;
+					out.t.push_back(t);
+					if (q == r)
+					{
+						out.vertices.push_back(ringCornerIndices[side]);
+					}
+					else if (q == s.segments - r)
+					{
+						out.vertices.push_back(ringCornerIndices[(side + 1) % 3]);
+					}
+					else
+					{
+						out.vertices.push_back(b.Add(lerp(from, to, t, 0), lerp(from, to, t, 1), lerp(from, to, t, 2)));
+					}
+				}
+				b.Stitch(previous[side].vertices, previous[side].t, out.vertices, out.t);
+			}
+			previous = current;
+		}
+
+		if (s.segments - 2 * (rings - 1) == 1)
+		{
+			// Odd levels end in a single triangle
+			b.Triangle(previous[0].vertices[0], previous[1].vertices[0], previous[2].vertices[0]);
+			return;
+		}
+
+		// Even levels end in the centre point
+		TessSide centre;
+		centre.vertices.push_back(b.Add(1.0 / 3.0, 1.0 / 3.0, 1.0 / 3.0));
+		centre.t.push_back(0.5);
+		for (int side = 0; side < 3; side++)
+		{
+			b.Stitch(previous[side].vertices, previous[side].t, centre.vertices, centre.t);
+		}
+	}
+
+	void tessQuads(TessBuilder& b, TessSpacing spacing, const TessLevels& levels)
+	{
+		// Corners counter-clockwise: (0, 0), (1, 0), (1, 1), (0, 1). Side i runs from corner i to
+		// corner i + 1 and lies on v = 0, u = 1, v = 1 and u = 0, whose levels are outer[1], outer[2], outer[3], outer[0]
+		static const double corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+		static const int sideLevel[4] = { 1, 2, 3, 0 };
+
+		float innerU = levels.inner[0];
+		float innerV = levels.inner[1];
+		bool outerAboveOne = levels.outer[0] > 1.0f || levels.outer[1] > 1.0f
+			|| levels.outer[2] > 1.0f || levels.outer[3] > 1.0f;
+		if (innerU <= 1.0f && innerV <= 1.0f && !outerAboveOne)
+		{
+			uint32_t c[4];
+			for (int i = 0; i < 4; i++)
+			{
+				c[i] = b.Add(corners[i][0], corners[i][1], 0);
+			}
+			b.Triangle(c[0], c[1], c[2]);
+			b.Triangle(c[0], c[2], c[3]);
+			return;
+		}
+		const float onePlus = tessClampLevel(std::nextafter(1.0f, 2.0f), spacing); // 1 + epsilon
+		innerU = innerU <= 1.0f ? onePlus : innerU;
+		innerV = innerV <= 1.0f ? onePlus : innerV;
+
+		uint32_t outerCorners[4];
+		for (int c = 0; c < 4; c++)
+		{
+			outerCorners[c] = b.Add(corners[c][0], corners[c][1], 0);
+		}
+		TessSide outerSides[4];
+		for (int side = 0; side < 4; side++)
+		{
+			const double* from = corners[side];
+			const double* to = corners[(side + 1) % 4];
+			TessSubdivision s = tessSubdivide(levels.outer[sideLevel[side]], spacing);
+			TessSide& out = outerSides[side];
+			for (int q = 0; q <= s.segments; q++)
+			{
+				double t = s.Place(q);
+				out.t.push_back(t);
+				if (q == 0)
+				{
+					out.vertices.push_back(outerCorners[side]);
+				}
+				else if (q == s.segments)
+				{
+					out.vertices.push_back(outerCorners[(side + 1) % 4]);
+				}
+				else
+				{
+					out.vertices.push_back(b.Add(from[0] + (to[0] - from[0]) * t, from[1] + (to[1] - from[1]) * t, 0));
+				}
+			}
+		}
+
+		// Every interior vertex is on the grid of inner points. It may be a single line or point
+		TessSubdivision su = tessSubdivide(innerU, spacing);
+		TessSubdivision sv = tessSubdivide(innerV, spacing);
+		int columns = su.segments - 1;
+		int rows = sv.segments - 1;
+		std::vector<uint32_t> grid(columns * rows);
+		std::vector<double> gridU(columns), gridV(rows);
+		for (int i = 0; i < columns; i++)
+		{
+			gridU[i] = su.Place(i + 1);
+		}
+		for (int j = 0; j < rows; j++)
+		{
+			gridV[j] = sv.Place(j + 1);
+		}
+		for (int j = 0; j < rows; j++)
+		{
+			for (int i = 0; i < columns; i++)
+			{
+				grid[j * columns + i] = b.Add(gridU[i], gridV[j], 0);
+			}
+		}
+
+		// The grid's border, walked counter-clockwise like the outer ring
+		auto along = [](const std::vector<double>& positions, int index) {
+			return positions.size() > 1 ? (positions[index] - positions.front()) / (positions.back() - positions.front()) : 0.5;
+		};
+		TessSide innerSides[4];
+		for (int i = 0; i < columns; i++)
+		{
+			innerSides[0].vertices.push_back(grid[i]);
+			innerSides[0].t.push_back(along(gridU, i));
+			innerSides[2].vertices.push_back(grid[(rows - 1) * columns + (columns - 1 - i)]);
+			innerSides[2].t.push_back(along(gridU, i));
+		}
+		for (int j = 0; j < rows; j++)
+		{
+			innerSides[1].vertices.push_back(grid[j * columns + columns - 1]);
+			innerSides[1].t.push_back(along(gridV, j));
+			innerSides[3].vertices.push_back(grid[(rows - 1 - j) * columns]);
+			innerSides[3].t.push_back(along(gridV, j));
+		}
+		for (int side = 0; side < 4; side++)
+		{
+			b.Stitch(outerSides[side].vertices, outerSides[side].t, innerSides[side].vertices, innerSides[side].t);
+		}
+
+		for (int j = 0; j + 1 < rows; j++)
+		{
+			for (int i = 0; i + 1 < columns; i++)
+			{
+				uint32_t c00 = grid[j * columns + i];
+				uint32_t c10 = grid[j * columns + i + 1];
+				uint32_t c01 = grid[(j + 1) * columns + i];
+				uint32_t c11 = grid[(j + 1) * columns + i + 1];
+				b.Triangle(c00, c10, c11);
+				b.Triangle(c00, c11, c01);
+			}
+		}
+	}
+
+	void tessIsolines(TessBuilder& b, TessSpacing spacing, const TessLevels& levels)
+	{
+		// The line count always uses equal spacing, and no line is drawn at v = 1
+		int lines = (int)levels.outer[0];
+		TessSubdivision s = tessSubdivide(levels.outer[1], spacing);
+		for (int line = 0; line < lines; line++)
+		{
+			double v = (double)line / lines;
+			uint32_t first = (uint32_t)b.out.u.size();
+			for (int q = 0; q <= s.segments; q++)
+			{
+				b.Add(s.Place(q), v, 0);
+			}
+			for (int q = 0; q < s.segments; q++)
+			{
+				b.out.indices.push_back(first + q);
+				b.out.indices.push_back(first + q + 1);
+			}
+		}
+	}
+}
+
+bool Tessellator::Normalize(TessDomain domain, TessSpacing spacing, const TessLevels& levels, TessLevels& out)
+{
+	memset(&out, 0, sizeof(out));
+	int outerCount = domain == TessDomain::Triangles ? 3 : domain == TessDomain::Quads ? 4 : 2;
+	int innerCount = domain == TessDomain::Triangles ? 1 : domain == TessDomain::Quads ? 2 : 0;
+
+	// Zero, negative or NaN outer levels discard the patch
+	for (int i = 0; i < outerCount; i++)
+	{
+		if (!(levels.outer[i] > 0.0f))
+		{
+			return false;
+		}
+	}
+
+	if (domain == TessDomain::Isolines)
+	{
+		out.outer[0] = tessClampLevel(levels.outer[0], TessSpacing::Equal);
+		out.outer[1] = tessClampLevel(levels.outer[1], spacing);
+		return true;
+	}
+	for (int i = 0; i < outerCount; i++)
+	{
+		out.outer[i] = tessClampLevel(levels.outer[i], spacing);
+	}
+	for (int i = 0; i < innerCount; i++)
+	{
+		// NaN inner levels act as 1 before the 1 + epsilon rule
+		out.inner[i] = tessClampLevel(levels.inner[i] == levels.inner[i] ? levels.inner[i] : 1.0f, spacing);
+	}
+	return true;
+}
+
+void Tessellator::Generate(TessDomain domain, TessSpacing spacing, bool cw, const TessLevels& levels, TessPattern& out)
+{
+	out.domain = domain;
+	out.vertexCount = 0;
+	out.u.clear();
+	out.v.clear();
+	out.w.clear();
+	out.indices.clear();
+
+	TessLevels normalized;
+	if (!Normalize(domain, spacing, levels, normalized))
+	{
+		return;
+	}
+
+	TessBuilder b = { out, cw };
+	switch (domain)
+	{
+		case TessDomain::Triangles:
+			tessTriangles(b, spacing, normalized);
+			break;
+		case TessDomain::Quads:
+			tessQuads(b, spacing, normalized);
+			break;
+		case TessDomain::Isolines:
+			tessIsolines(b, spacing, normalized);
+			break;
+	}
+
+	out.vertexCount = (uint32_t)out.u.size();
+	size_t padded = (out.u.size() + 3) & ~(size_t)3;
+	out.u.resize(padded, 0.0f);
+	out.v.resize(padded, 0.0f);
+	out.w.resize(padded, 0.0f);
+}
+
+bool TessPatternCache::Key::operator==(const Key& other) const
+{
+	return domain == other.domain && spacing == other.spacing && cw == other.cw
+		&& memcmp(&levels, &other.levels, sizeof(levels)) == 0;
+}
+
+size_t TessPatternCache::KeyHash::operator()(const Key& key) const
+{
+	// FNV-1a over the fields, levels compared bitwise like operator==
+	uint64_t hash = 14695981039346656037ULL;
+	auto mix = [&hash](const void* data, size_t size) {
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ ((const unsigned char*)data)[i]) * 1099511628211ULL;
+		}
+	};
+	int header[3] = { (int)key.domain, (int)key.spacing, key.cw ? 1 : 0 };
+	mix(header, sizeof(header));
+	mix(&key.levels, sizeof(key.levels));
+	return (size_t)hash;
+}
+
+TessPatternCache::TessPatternCache(size_t capacity) : hits(0), misses(0), capacity(capacity), generation(0)
+{
+	discarded.domain = TessDomain::Triangles;
+	discarded.vertexCount = 0;
+}
+
+const TessPattern& TessPatternCache::Get(TessDomain domain, TessSpacing spacing, bool cw, const TessLevels& levels)
+{
+	Key key;
+	key.domain = domain;
+	key.spacing = spacing;
+	key.cw = cw && domain != TessDomain::Isolines;
+	if (!Tessellator::Normalize(domain, spacing, levels, key.levels))
+	{
+		hits++;
+		discarded.domain = domain;
+		return discarded;
+	}
+
+	auto found = patterns.find(key);
+	if (found != patterns.end())
+	{
+		hits++;
+		return found->second;
+	}
+
+	misses++;
+	if (patterns.size() >= capacity)
+	{
+		patterns.clear();
+		generation++;
+	}
+	TessPattern& pattern = patterns[key];
+	Tessellator::Generate(domain, spacing, key.cw, key.levels, pattern);
+	return pattern;
+}
+
+void TessPatternCache::Clear()
+{
+	patterns.clear();
+	generation++;
+	hits = 0;
+	misses = 0;
+}
+
+void tessEvaluateScalar(const TessPattern& pattern, const float (*corners)[4], float (*out)[4])
+{
+	bool triangles = pattern.domain == TessDomain::Triangles;
+	for (uint32_t i = 0; i < pattern.vertexCount; i++)
+	{
+		float u = pattern.u[i];
+		float v = pattern.v[i];
+		float weights[4];
+		if (triangles)
+		{
+			weights[0] = u;
+			weights[1] = v;
+			weights[2] = pattern.w[i];
+			weights[3] = 0.0f;
+		}
+		else
+		{
+			weights[0] = (1.0f - u) * (1.0f - v);
+			weights[1] = u * (1.0f - v);
+			weights[2] = u * v;
+			weights[3] = (1.0f - u) * v;
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			out[i][c] = weights[0] * corners[0][c] + weights[1] * corners[1][c] + weights[2] * corners[2][c]
+				+ (triangles ? 0.0f : weights[3] * corners[3][c]);
+		}
+	}
+}
+
+#ifdef TESSELLATOR_SSE
+
+void tessEvaluate(const TessPattern& pattern, const float (*corners)[4], float (*out)[4])
+{
+	bool triangles = pattern.domain == TessDomain::Triangles;
+	int cornerCount = triangles ? 3 : 4;
+
+	// Each corner component broadcast across the four lanes
+	__m128 c[4][4];
+	for (int k = 0; k < cornerCount; k++)
+	{
+		for (int component = 0; component < 4; component++)
+		{
+			c[k][component] = _mm_set1_ps(corners[k][component]);
+		}
+	}
+
+	const __m128 one = _mm_set1_ps(1.0f);
+	uint32_t full = pattern.vertexCount & ~3u;
+	for (uint32_t i = 0; i < pattern.u.size(); i += 4)
+	{
+		__m128 u = _mm_loadu_ps(&pattern.u[i]);
+		__m128 v = _mm_loadu_ps(&pattern.v[i]);
+		__m128 weights[4];
+		if (triangles)
+		{
+			weights[0] = u;
+			weights[1] = v;
+			weights[2] = _mm_loadu_ps(&pattern.w[i]);
+		}
+		else
+		{
+			__m128 iu = _mm_sub_ps(one, u);
+			__m128 iv = _mm_sub_ps(one, v);
+			weights[0] = _mm_mul_ps(iu, iv);
+			weights[1] = _mm_mul_ps(u, iv);
+			weights[2] = _mm_mul_ps(u, v);
+			weights[3] = _mm_mul_ps(iu, v);
+		}
+
+		// Four vertices as x, y, z, w registers, then transposed to one register per vertex
+		__m128 position[4];
+		for (int component = 0; component < 4; component++)
+		{
+			__m128 sum = _mm_mul_ps(weights[0], c[0][component]);
+			for (int k = 1; k < cornerCount; k++)
+			{
+				sum = _mm_add_ps(sum, _mm_mul_ps(weights[k], c[k][component]));
+			}
+			position[component] = sum;
+		}
+		_MM_TRANSPOSE4_PS(position[0], position[1], position[2], position[3]);
+
+		if (i < full)
+		{
+			for (int lane = 0; lane < 4; lane++)
+			{
+				_mm_storeu_ps(out[i + lane], position[lane]);
+			}
+		}
+		else
+		{
+			// The padding lanes of the last group have nowhere to go
+			for (uint32_t lane = 0; i + lane < pattern.vertexCount; lane++)
+			{
+				_mm_storeu_ps(out[i + lane], position[lane]);
+			}
+		}
+	}
+}
+
+#else
+
+void tessEvaluate(const TessPattern& pattern, const float (*corners)[4], float (*out)[4])
+{
+	tessEvaluateScalar(pattern, corners, out);
+}
+
+#endif
+
+#endif
+#endif
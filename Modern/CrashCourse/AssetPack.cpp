@@ -0,0 +1,370 @@
+#include "AssetPack.h"
+
+#include<algorithm>
+#include<cstring>
+#include<fstream>
+#include<iostream>
+#include<string>
+#include<vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+
+AssetPack::AssetPack()
+{
+	data = nullptr;
+	size = 0;
+	entries = nullptr;
+	entryCount = 0;
+	mapping = nullptr;
+}
+
+bool AssetPack::Open(const char* path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	HANDLE fileMapping = fileSize.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	CloseHandle(file); // The mapping keeps the file open
+	if (fileMapping == NULL)
+	{
+		return false;
+	}
+	data = (const unsigned char*)MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr)
+	{
+		CloseHandle(fileMapping);
+		return false;
+	}
+	mapping = fileMapping;
+	size = (size_t)fileSize.QuadPart;
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+	struct stat info;
+	void* view = fstat(file, &info) == 0 && info.st_size > 0
+		? mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+	close(file); // The mapping keeps the file open
+	if (view == MAP_FAILED)
+	{
+		return false;
+	}
+	data = (const unsigned char*)view;
+	size = (size_t)info.st_size;
+#endif
+
+	// Validate the header and index once so lookups can trust them
+	const AssetPackHeader* header = (const AssetPackHeader*)data;
+	bool valid = size >= sizeof(AssetPackHeader) && header->magic == PACK_MAGIC && header->version == PACK_VERSION
+		&& size >= sizeof(AssetPackHeader) + (uint64_t)header->entryCount * sizeof(AssetPackEntry);
+	if (valid)
+	{
+		entries = (const AssetPackEntry*)(data + sizeof(AssetPackHeader));
+		entryCount = header->entryCount;
+		for (uint32_t i = 0; i < entryCount && valid; i++)
+		{
+			// Readers allocate rawSize up front, so it must be plausible for the stored bytes
+			const AssetPackEntry& entry = entries[i];
+			valid = entry.name[sizeof(entry.name) - 1] == '\0'
+				&& entry.offset <= size && entry.storedSize <= size - entry.offset
+				&& entry.rawSize <= PACK_MAX_RAW_SIZE
+				&& ((entry.flags & PACK_LZ4) ? entry.rawSize <= lz4MaxExpansion(entry.storedSize) : entry.rawSize == entry.storedSize)
+				&& (i == 0 || strcmp(entries[i - 1].name, entry.name) < 0);
+		}
+	}
+	if (!valid)
+	{
+		std::cout << "ASSET_PACK_ERROR: " << path << " is not a valid pack" << std::endl;
+		Close();
+		return false;
+	}
+	return true;
+}
+
+const AssetPackEntry* AssetPack::Find(const char* name) const
+{
+	const AssetPackEntry* end = entries + entryCount;
+	const AssetPackEntry* entry = std::lower_bound(entries, end, name,
+		[](const AssetPackEntry& e, const char* n) { return strcmp(e.name, n) < 0; });
+	return entry != end && strcmp(entry->name, name) == 0 ? entry : nullptr;
+}
+
+const unsigned char* AssetPack::Payload(const AssetPackEntry& entry) const
+{
+	return data + entry.offset;
+}
+
+void AssetPack::Close()
+{
+	if (data != nullptr)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle((HANDLE)mapping);
+#else
+		munmap((void*)data, size);
+#endif
+	}
+	data = nullptr;
+	size = 0;
+	entries = nullptr;
+	entryCount = 0;
+	mapping = nullptr;
+}
+
+bool AssetPack::Write(const char* path, const char* const* files, int count)
+{
+	struct Pending
+	{
+		AssetPackEntry entry;
+		std::vector<unsigned char> payload;
+	};
+	std::vector<Pending> pending(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		std::ifstream in(files[i], std::ios::binary);
+		if (!in || strlen(files[i]) >= sizeof(pending[i].entry.name))
+		{
+			std::cout << "ASSET_PACK_ERROR: cannot pack " << files[i] << std::endl;
+			return false;
+		}
+		std::vector<unsigned char> raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		if (raw.size() > PACK_MAX_RAW_SIZE)
+		{
+			std::cout << "ASSET_PACK_ERROR: " << files[i] << " is larger than a pack entry may be" << std::endl;
+			return false;
+		}
+
+		AssetPackEntry& entry = pending[i].entry;
+		memset(&entry, 0, sizeof(entry));
+		strcpy(entry.name, files[i]);
+		entry.rawSize = (uint32_t)raw.size();
+
+		// Keep the compressed form only when it saves at least an eighth
+		std::vector<unsigned char> packed(lz4Bound(raw.size()));
+		size_t packedSize = lz4Compress(raw.data(), raw.size(), packed.data(), packed.size());
+		if (packedSize > 0 && packedSize < raw.size() - raw.size() / 8)
+		{
+			packed.resize(packedSize);
+			pending[i].payload.swap(packed);
+			entry.flags = PACK_LZ4;
+		}
+		else
+		{
+			pending[i].payload.swap(raw);
+		}
+		entry.storedSize = (uint32_t)pending[i].payload.size();
+	}
+
+	std::sort(pending.begin(), pending.end(),
+		[](const Pending& a, const Pending& b) { return strcmp(a.entry.name, b.entry.name) < 0; });
+
+	uint64_t offset = sizeof(AssetPackHeader) + pending.size() * sizeof(AssetPackEntry);
+	for (Pending& p : pending)
+	{
+		offset = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+		p.entry.offset = offset;
+		offset += p.entry.storedSize;
+	}
+
+	std::ofstream out(path, std::ios::binary);
+	AssetPackHeader header = { PACK_MAGIC, PACK_VERSION, (uint32_t)pending.size(), 0 };
+	out.write((const char*)&header, sizeof(header));
+	for (Pending& p : pending)
+	{
+		out.write((const char*)&p.entry, sizeof(p.entry));
+	}
+	for (Pending& p : pending)
+	{
+		std::vector<char> padding((size_t)(p.entry.offset - (uint64_t)out.tellp()), 0);
+		out.write(padding.data(), padding.size());
+		out.write((const char*)p.payload.data(), p.payload.size());
+	}
+	return (bool)out;
+}
+
+// Appends an LZ4 length continuation: runs of 255 followed by the remainder
+static bool lz4WriteLength(size_t length, unsigned char* dst, size_t& op, size_t dstCapacity)
+{
+	for (; length >= 255; length -= 255)
+	{
+		if (op >= dstCapacity)
+		{
+			return false;
+		}
+		dst[op++] = 255;
+	}
+	if (op >= dstCapacity)
+	{
+		return false;
+	}
+	dst[op++] = (unsigned char)length;
+	return true;
+}
+
+// Greedy single-pass compressor. Returns the compressed size, or 0 if dst is too small
+size_t lz4Compress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstCapacity)
+{
+	const size_t MIN_MATCH = 4;
+	const size_t LAST_LITERALS = 5; // The block must end with at least this many literals
+	const size_t MATCH_LIMIT = 12; // No match may start within this many bytes of the end
+	const int HASH_BITS = 12;
+
+	std::vector<int64_t> table((size_t)1 << HASH_BITS, -1);
+	size_t anchor = 0;
+	size_t pos = 0;
+	size_t op = 0;
+
+	while (srcSize > MATCH_LIMIT && pos < srcSize - MATCH_LIMIT)
+	{
+		uint32_t sequence;
+		memcpy(&sequence, src + pos, sizeof(sequence));
+		uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+		int64_t candidate = table[hash];
+		table[hash] = (int64_t)pos;
+
+		if (candidate < 0 || pos - candidate > 65535 || memcmp(src + candidate, src + pos, MIN_MATCH) != 0)
+		{
+			pos++;
+			continue;
+		}
+
+		size_t matchEnd = pos + MIN_MATCH;
+		while (matchEnd < srcSize - LAST_LITERALS && src[matchEnd] == src[candidate + (matchEnd - pos)])
+		{
+			matchEnd++;
+		}
+
+		size_t literals = pos - anchor;
+		size_t matchLength = matchEnd - pos - MIN_MATCH;
+		if (op + 1 + literals + 2 > dstCapacity)
+		{
+			return 0;
+		}
+		size_t token = op++;
+		dst[token] = (unsigned char)(((literals < 15 ? literals : 15) << 4) | (matchLength < 15 ? matchLength : 15));
+		if (literals >= 15 && !lz4WriteLength(literals - 15, dst, op, dstCapacity))
+		{
+			return 0;
+		}
+		if (op + literals + 2 > dstCapacity)
+		{
+			return 0;
+		}
+		memcpy(dst + op, src + anchor, literals);
+		op += literals;
+		dst[op++] = (unsigned char)((pos - candidate) & 0xFF);
+		dst[op++] = (unsigned char)((pos - candidate) >> 8);
+		if (matchLength >= 15 && !lz4WriteLength(matchLength - 15, dst, op, dstCapacity))
+		{
+			return 0;
+		}
+
+		pos = matchEnd;
+		anchor = pos;
+	}
+
+	// Final sequence carries the remaining literals and no match
+	size_t literals = srcSize - anchor;
+	if (op + 1 > dstCapacity)
+	{
+		return 0;
+	}
+	dst[op++] = (unsigned char)((literals < 15 ? literals : 15) << 4);
+	if (literals >= 15 && !lz4WriteLength(literals - 15, dst, op, dstCapacity))
+	{
+		return 0;
+	}
+	if (op + literals > dstCapacity)
+	{
+		return 0;
+	}
+	memcpy(dst + op, src + anchor, literals);
+	return op + literals;
+}
+
+// Decompresses exactly dstSize bytes, rejecting any block that reads or writes out of bounds
+bool lz4Decompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize)
+{
+	size_t ip = 0;
+	size_t op = 0;
+	while (ip < srcSize)
+	{
+		unsigned char token = src[ip++];
+
+		size_t literals = token >> 4;
+		if (literals == 15)
+		{
+			unsigned char extra = 255;
+			while (extra == 255 && ip < srcSize)
+			{
+				extra = src[ip++];
+				literals += extra;
+			}
+		}
+		if (literals > srcSize - ip || literals > dstSize - op)
+		{
+			return false;
+		}
+		memcpy(dst + op, src + ip, literals);
+		ip += literals;
+		op += literals;
+
+		if (ip == srcSize)
+		{
+			break; // The last sequence has no match
+		}
+		if (srcSize - ip < 2)
+		{
+			return false;
+		}
+		size_t offset = src[ip] | (src[ip + 1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op)
+		{
+			return false;
+		}
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15)
+		{
+			unsigned char extra = 255;
+			while (extra == 255 && ip < srcSize)
+			{
+				extra = src[ip++];
+				matchLength += extra;
+			}
+		}
+		matchLength += 4;
+		if (matchLength > dstSize - op)
+		{
+			return false;
+		}
+
+		// Byte by byte since a match may overlap the bytes it produces
+		for (size_t i = 0; i < matchLength; i++, op++)
+		{
+			dst[op] = dst[op - offset];
+		}
+	}
+	return op == dstSize;
+}
@@ -0,0 +1,70 @@
+#ifndef ASSET_PACK_CLASS_H
+#define ASSET_PACK_CLASS_H
+
+#include<cstdint>
+#include<cstddef>
+
+// On-disk layout of a pack:
+//   AssetPackHeader
+//   AssetPackEntry[entryCount], sorted by name
+//   payloads, each starting on a PACK_ALIGNMENT boundary
+const uint32_t PACK_MAGIC = 0x4B415041; // "APAK"
+const uint32_t PACK_VERSION = 1;
+const uint64_t PACK_ALIGNMENT = 4096;
+const uint32_t PACK_LZ4 = 1; // Entry flag: payload is an LZ4 block
+const uint32_t PACK_MAX_RAW_SIZE = 256u << 20; // Largest entry once decompressed
+
+struct AssetPackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+};
+
+struct AssetPackEntry
+{
+	char name[52]; // Null terminated
+	uint32_t flags;
+	uint64_t offset; // From the start of the pack
+	uint32_t storedSize; // Bytes in the pack
+	uint32_t rawSize; // Bytes once decompressed
+};
+
+static_assert(sizeof(AssetPackHeader) == 16, "AssetPackHeader must match the file format");
+static_assert(sizeof(AssetPackEntry) == 72, "AssetPackEntry must match the file format");
+
+// A pack file mapped into memory once. Entries and payloads are read in place
+class AssetPack
+{
+	public:
+		AssetPack();
+
+		// Maps a pack file, returns false if it is missing or malformed
+		bool Open(const char* path);
+		// Binary searches the index, returns nullptr if the pack has no such entry
+		const AssetPackEntry* Find(const char* name) const;
+		// Stored bytes of an entry, still compressed if the entry is
+		const unsigned char* Payload(const AssetPackEntry& entry) const;
+		// Unmaps the file
+		void Close();
+
+		// Builds a pack from loose files, compressing each one that LZ4 shrinks
+		static bool Write(const char* path, const char* const* files, int count);
+
+	private:
+		const unsigned char* data;
+		size_t size;
+		const AssetPackEntry* entries;
+		uint32_t entryCount;
+		void* mapping; // Platform handle kept alive while the view is mapped
+};
+
+// LZ4 block format (no frame header), as stored in PACK_LZ4 entries
+size_t lz4Compress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstCapacity);
+bool lz4Decompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize);
+inline size_t lz4Bound(size_t size) { return size + size / 255 + 16; }
+// A length continuation byte adds at most 255 bytes of output, so no block expands further
+inline uint64_t lz4MaxExpansion(size_t storedSize) { return (uint64_t)storedSize * 255; }
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef BLOCK_LAYOUT_H
+#define BLOCK_LAYOUT_H
+
+#include<glad/glad.h>
+#include<cstddef>
+
+// Memory layouts that GLSL interface blocks can be declared with
+enum class BlockLayout
+{
+	Std140, // Uniform blocks
+	Std430  // Shader storage blocks
+};
+
+// One member of a GLSL block as it is declared in the shader
+struct BlockMember
+{
+	GLenum type; // GL_FLOAT, GL_FLOAT_VEC4, GL_FLOAT_MAT4, ...
+	size_t arrayCount; // 0 if the member is not an array
+};
+
+// Number of components in a scalar or vector type, 0 if the type is not supported
+constexpr size_t blockComponents(GLenum type)
+{
+	return type == GL_FLOAT || type == GL_INT || type == GL_UNSIGNED_INT ? 1
+		: type == GL_FLOAT_VEC2 || type == GL_INT_VEC2 || type == GL_UNSIGNED_INT_VEC2 ? 2
+		: type == GL_FLOAT_VEC3 || type == GL_INT_VEC3 || type == GL_UNSIGNED_INT_VEC3 ? 3
+		: type == GL_FLOAT_VEC4 || type == GL_INT_VEC4 || type == GL_UNSIGNED_INT_VEC4 ? 4
+		: 0;
+}
+
+// Number of columns of a matrix type, 0 if the type is not a matrix
+constexpr size_t blockColumns(GLenum type)
+{
+	return type == GL_FLOAT_MAT2 ? 2
+		: type == GL_FLOAT_MAT3 ? 3
+		: type == GL_FLOAT_MAT4 ? 4
+		: 0;
+}
+
+constexpr size_t blockRoundUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Base alignment of a member (OpenGL 4.6 spec, section 7.6.2.2)
+constexpr size_t blockAlignment(BlockLayout layout, BlockMember member)
+{
+	// Matrices are laid out as arrays of column vectors
+	size_t components = blockColumns(member.type) ? blockColumns(member.type) : blockComponents(member.type);
+	size_t alignment = (components == 1 ? 1 : components == 2 ? 2 : 4) * 4;
+
+	// std140 rounds arrays and matrix columns up to the alignment of a vec4
+	bool isArray = member.arrayCount > 0 || blockColumns(member.type) > 0;
+	if (layout == BlockLayout::Std140 && isArray)
+	{
+		alignment = blockRoundUp(alignment, 16);
+	}
+	return alignment;
+}
+
+// Number of bytes a member occupies, including the padding between array elements
+constexpr size_t blockSize(BlockLayout layout, BlockMember member)
+{
+	size_t columns = blockColumns(member.type);
+	size_t components = columns ? columns : blockComponents(member.type);
+	size_t elements = member.arrayCount > 0 ? member.arrayCount : 1;
+
+	if (member.arrayCount == 0 && columns == 0)
+	{
+		return components * 4;
+	}
+	return elements * (columns ? columns : 1) * blockAlignment(layout, member);
+}
+
+// Byte offset of the member at index in a block declared with the given members
+template<size_t N>
+constexpr size_t blockOffset(BlockLayout layout, const BlockMember (&members)[N], size_t index)
+{
+	size_t offset = 0;
+	for (size_t i = 0; i < N; i++)
+	{
+		offset = blockRoundUp(offset, blockAlignment(layout, members[i]));
+		if (i == index)
+		{
+			return offset;
+		}
+		offset += blockSize(layout, members[i]);
+	}
+	return offset;
+}
+
+// Total size of a block, rounded up to the alignment of its largest member
+template<size_t N>
+constexpr size_t blockTotalSize(BlockLayout layout, const BlockMember (&members)[N])
+{
+	size_t largest = layout == BlockLayout::Std140 ? 16 : 4;
+	for (size_t i = 0; i < N; i++)
+	{
+		largest = blockAlignment(layout, members[i]) > largest ? blockAlignment(layout, members[i]) : largest;
+	}
+	return blockRoundUp(blockOffset(layout, members, N), largest);
+}
+
+// Fails to compile if a C++ struct member does not sit where GLSL expects it
+#define CHECK_BLOCK_MEMBER(Struct, member, layout, members, index) \
+	static_assert(offsetof(Struct, member) == blockOffset(layout, members, index), \
+		#Struct "::" #member " does not match the GLSL block layout")
+
+// Fails to compile if a C++ struct is not the size GLSL expects
+#define CHECK_BLOCK_SIZE(Struct, layout, members) \
+	static_assert(sizeof(Struct) == blockTotalSize(layout, members), \
+		#Struct " does not match the GLSL block size")
+
+#endif
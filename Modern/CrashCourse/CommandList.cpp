@@ -0,0 +1,263 @@
+#include "CommandList.h"
+
+#include<algorithm>
+#include<cstdlib>
+#include<cstring>
+#include<iostream>
+
+LinearArena::LinearArena()
+{
+	block = 0;
+	offset = 0;
+}
+
+void* LinearArena::Allocate(size_t size, size_t alignment)
+{
+	if (size > BLOCK_SIZE)
+	{
+		std::cout << "LINEAR_ARENA_ERROR: " << size << " bytes is more than a block" << std::endl;
+		return nullptr;
+	}
+
+	offset = (offset + alignment - 1) & ~(alignment - 1);
+	if (block == blocks.size() || offset + size > BLOCK_SIZE)
+	{
+		// Move on to the next block, allocating it only the first time the arena gets this far
+		if (block < blocks.size())
+		{
+			block++;
+		}
+		if (block == blocks.size())
+		{
+			blocks.push_back((unsigned char*)malloc(BLOCK_SIZE));
+		}
+		offset = 0;
+	}
+
+	void* memory = blocks[block] + offset;
+	offset += size;
+	return memory;
+}
+
+void LinearArena::Reset()
+{
+	block = 0;
+	offset = 0;
+}
+
+void LinearArena::Delete()
+{
+	for (unsigned char* memory : blocks)
+	{
+		free(memory);
+	}
+	blocks.clear();
+	Reset();
+}
+
+CommandList::CommandList()
+{
+	last = nullptr;
+}
+
+template<typename T> T* CommandList::Push(CommandType type)
+{
+	if (packets.empty())
+	{
+		std::cout << "COMMAND_LIST_ERROR: command recorded before Begin" << std::endl;
+		Begin(0);
+	}
+
+	T* command = (T*)arena.Allocate(sizeof(T), alignof(T));
+	command->header.next = nullptr;
+	command->header.type = type;
+	if (last == nullptr)
+	{
+		packets.back().first = &command->header;
+	}
+	else
+	{
+		last->next = &command->header;
+	}
+	last = &command->header;
+	return command;
+}
+
+void CommandList::Begin(uint64_t key)
+{
+	packets.push_back({ key, nullptr });
+	last = nullptr;
+}
+
+void CommandList::BindProgram(GLuint program)
+{
+	Push<BindProgramCommand>(CommandType::BindProgram)->program = program;
+}
+
+void CommandList::BindVertexArray(GLuint vao)
+{
+	Push<BindVertexArrayCommand>(CommandType::BindVertexArray)->vao = vao;
+}
+
+void CommandList::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	BindTextureCommand* command = Push<BindTextureCommand>(CommandType::BindTexture);
+	command->unit = unit;
+	command->target = target;
+	command->texture = texture;
+}
+
+void CommandList::Uniform4f(GLint location, const GLfloat* value)
+{
+	Uniform4fCommand* command = Push<Uniform4fCommand>(CommandType::Uniform4f);
+	command->location = location;
+	memcpy(command->value, value, sizeof(command->value));
+}
+
+void CommandList::BindUniformRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	BindUniformRangeCommand* command = Push<BindUniformRangeCommand>(CommandType::BindUniformRange);
+	command->binding = binding;
+	command->buffer = buffer;
+	command->offset = offset;
+	command->size = size;
+}
+
+void CommandList::DrawElements(GLenum mode, GLsizei count, GLenum type, GLintptr offset)
+{
+	DrawElementsCommand* command = Push<DrawElementsCommand>(CommandType::DrawElements);
+	command->mode = mode;
+	command->count = count;
+	command->type = type;
+	command->offset = offset;
+}
+
+void CommandList::Close()
+{
+	std::stable_sort(packets.begin(), packets.end(), [](const Packet& a, const Packet& b) { return a.key < b.key; });
+	last = nullptr;
+}
+
+void CommandList::Reset()
+{
+	packets.clear();
+	arena.Reset();
+	last = nullptr;
+}
+
+void CommandList::Delete()
+{
+	Reset();
+	arena.Delete();
+}
+
+namespace
+{
+	// GL state as left by the commands replayed so far
+	struct ReplayState
+	{
+		static const GLuint UNITS = 32;
+
+		GLuint program = 0;
+		GLuint vao = 0;
+		GLuint activeUnit = 0;
+		GLuint textures[UNITS] = {};
+	};
+
+	void replayPacket(ReplayState& state, const CommandHeader* command)
+	{
+		for (; command != nullptr; command = command->next)
+		{
+			switch (command->type)
+			{
+				case CommandType::BindProgram:
+				{
+					GLuint program = ((const BindProgramCommand*)command)->program;
+					if (program != state.program)
+					{
+						glUseProgram(program);
+						state.program = program;
+					}
+					break;
+				}
+				case CommandType::BindVertexArray:
+				{
+					GLuint vao = ((const BindVertexArrayCommand*)command)->vao;
+					if (vao != state.vao)
+					{
+						glBindVertexArray(vao);
+						state.vao = vao;
+					}
+					break;
+				}
+				case CommandType::BindTexture:
+				{
+					const BindTextureCommand* bind = (const BindTextureCommand*)command;
+					if (bind->unit >= ReplayState::UNITS || bind->texture != state.textures[bind->unit])
+					{
+						if (bind->unit != state.activeUnit)
+						{
+							glActiveTexture(GL_TEXTURE0 + bind->unit);
+							state.activeUnit = bind->unit;
+						}
+						glBindTexture(bind->target, bind->texture);
+						if (bind->unit < ReplayState::UNITS)
+						{
+							state.textures[bind->unit] = bind->texture;
+						}
+					}
+					break;
+				}
+				case CommandType::Uniform4f:
+				{
+					const Uniform4fCommand* uniform = (const Uniform4fCommand*)command;
+					glUniform4fv(uniform->location, 1, uniform->value);
+					break;
+				}
+				case CommandType::BindUniformRange:
+				{
+					const BindUniformRangeCommand* bind = (const BindUniformRangeCommand*)command;
+					glBindBufferRange(GL_UNIFORM_BUFFER, bind->binding, bind->buffer, bind->offset, bind->size);
+					break;
+				}
+				case CommandType::DrawElements:
+				{
+					const DrawElementsCommand* draw = (const DrawElementsCommand*)command;
+					glDrawElements(draw->mode, draw->count, draw->type, (const void*)draw->offset);
+					break;
+				}
+			}
+		}
+	}
+}
+
+void CommandList::Execute(CommandList* const* lists, int count)
+{
+	// Whatever the caller bound before is unknown, so the first bind of each kind always goes through
+	ReplayState state;
+	state.program = ~0u;
+	state.vao = ~0u;
+	state.activeUnit = ~0u;
+	std::fill(state.textures, state.textures + ReplayState::UNITS, ~0u);
+
+	// k-way merge of the sorted lists. There is one list per worker thread, so a linear scan for
+	// the smallest head is cheaper than a heap
+	std::vector<size_t> heads(count, 0);
+	while (true)
+	{
+		int next = -1;
+		for (int i = 0; i < count; i++)
+		{
+			if (heads[i] < lists[i]->packets.size()
+				&& (next < 0 || lists[i]->packets[heads[i]].key < lists[next]->packets[heads[next]].key))
+			{
+				next = i;
+			}
+		}
+		if (next < 0)
+		{
+			break;
+		}
+		replayPacket(state, lists[next]->packets[heads[next]++].first);
+	}
+}
@@ -0,0 +1,100 @@
+#ifndef COMMAND_LIST_CLASS_H
+#define COMMAND_LIST_CLASS_H
+
+#include<glad/glad.h>
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+
+// Bump allocator over fixed-size blocks, used by one thread at a time.
+// Reset keeps the blocks, so after the first few frames recording never touches the heap
+class LinearArena
+{
+	public:
+		static const size_t BLOCK_SIZE = 64 * 1024;
+
+		LinearArena();
+
+		// Returns size bytes aligned to alignment, which must be a power of two
+		void* Allocate(size_t size, size_t alignment);
+		// Makes every block available again
+		void Reset();
+		// Frees the blocks
+		void Delete();
+
+	private:
+		std::vector<unsigned char*> blocks;
+		size_t block; // Index of the block being filled
+		size_t offset; // Next free byte in it
+};
+
+enum class CommandType : uint32_t
+{
+	BindProgram,
+	BindVertexArray,
+	BindTexture,
+	Uniform4f,
+	BindUniformRange,
+	DrawElements
+};
+
+// Every command starts with this, chained to the next command of the same packet
+struct CommandHeader
+{
+	const CommandHeader* next;
+	CommandType type;
+};
+
+struct BindProgramCommand { CommandHeader header; GLuint program; };
+struct BindVertexArrayCommand { CommandHeader header; GLuint vao; };
+struct BindTextureCommand { CommandHeader header; GLuint unit; GLenum target; GLuint texture; };
+struct Uniform4fCommand { CommandHeader header; GLint location; GLfloat value[4]; };
+struct BindUniformRangeCommand { CommandHeader header; GLuint binding; GLuint buffer; GLintptr offset; GLsizeiptr size; };
+struct DrawElementsCommand { CommandHeader header; GLenum mode; GLsizei count; GLenum type; GLintptr offset; };
+
+// Draws recorded on any thread into plain structs, replayed later on the GL thread.
+// Commands are grouped into packets, each with a sort key; Execute replays the packets of
+// several lists in key order, so a key of (layer, program, texture, depth) from high bits to low
+// groups draws by state no matter which thread recorded them
+class CommandList
+{
+	public:
+		CommandList();
+
+		// Starts a packet. The commands that follow replay together, in the order recorded
+		void Begin(uint64_t key);
+		void BindProgram(GLuint program);
+		void BindVertexArray(GLuint vao);
+		void BindTexture(GLuint unit, GLenum target, GLuint texture);
+		// Sets a uniform of the program bound at that point of the replay
+		void Uniform4f(GLint location, const GLfloat* value);
+		void BindUniformRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size);
+		void DrawElements(GLenum mode, GLsizei count, GLenum type, GLintptr offset);
+
+		// Sorts the packets by key, call on the recording thread once it is done
+		void Close();
+		// Forgets every packet, call once the lists have been executed
+		void Reset();
+		void Delete();
+
+		// Merges closed lists by key and replays them on the GL thread, skipping binds of state
+		// that is already bound. Packets with equal keys keep the order of lists, then of recording
+		static void Execute(CommandList* const* lists, int count);
+
+		size_t PacketCount() const { return packets.size(); }
+
+	private:
+		struct Packet
+		{
+			uint64_t key;
+			const CommandHeader* first;
+		};
+
+		LinearArena arena;
+		std::vector<Packet> packets;
+		CommandHeader* last; // Most recent command of the open packet
+
+		template<typename T> T* Push(CommandType type);
+};
+
+#endif
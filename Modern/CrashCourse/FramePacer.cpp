@@ -0,0 +1,247 @@
+#include "FramePacer.h"
+
+#include<algorithm>
+#include<chrono>
+#include<iomanip>
+#include<iostream>
+#include<string>
+#include<thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include<windows.h>
+#include<mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+FramePacer::FramePacer(double targetFps, GLuint maxFramesInFlight)
+{
+	period = 0;
+	deadline = 0;
+	lastFrame = 0;
+	frameIndex = 0;
+	intervalNext = 0;
+	std::fill(histogram, histogram + BUCKETS, 0);
+	SetTargetFps(targetFps);
+	SetMaxFramesInFlight(maxFramesInFlight);
+
+	// Line the GPU clock up with the CPU one, both read back to back
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	gpuToCpu = Now() - gpuNow;
+
+#ifdef _WIN32
+	// Sleeps otherwise round up to the 15.6 ms scheduler tick, far past SPIN_MARGIN
+	timeBeginPeriod(1);
+#endif
+}
+
+int64_t FramePacer::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FramePacer::SetTargetFps(double fps)
+{
+	targetFps = fps > 0.0 ? fps : 0.0;
+	period = targetFps > 0.0 ? (int64_t)(1e9 / targetFps) : 0;
+	deadline = 0; // Restart the schedule from the next frame
+}
+
+void FramePacer::SetMaxFramesInFlight(GLuint frames)
+{
+	for (GLsync fence : fences)
+	{
+		if (fence)
+		{
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(fence);
+		}
+	}
+	framesInFlight = frames > 0 ? frames : 1;
+	fences.assign(framesInFlight, (GLsync)0);
+}
+
+void FramePacer::MarkInput()
+{
+	markedInputs.push_back(Now());
+}
+
+void FramePacer::BeginFrame()
+{
+	frameInputs.swap(markedInputs);
+	markedInputs.clear();
+}
+
+void FramePacer::EndFrame()
+{
+	if (!frameInputs.empty())
+	{
+		PendingFrame frame;
+		if (freeQueries.empty())
+		{
+			glGenQueries(1, &frame.query);
+		}
+		else
+		{
+			frame.query = freeQueries.back();
+			freeQueries.pop_back();
+		}
+		glQueryCounter(frame.query, GL_TIMESTAMP);
+		frame.inputs.swap(frameInputs);
+		pending.push_back(frame);
+	}
+	frameInputs.clear();
+
+	// Fence this frame, then wait for the one framesInFlight - 1 frames older. With a single
+	// frame in flight that is this frame's own fence and the CPU never runs ahead of the GPU
+	GLuint slot = (GLuint)(frameIndex % framesInFlight);
+	fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	GLuint oldest = (GLuint)((frameIndex + 1) % framesInFlight);
+	if (fences[oldest])
+	{
+		glClientWaitSync(fences[oldest], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fences[oldest]);
+		fences[oldest] = 0;
+	}
+	frameIndex++;
+
+	Resolve();
+
+	int64_t now = Now();
+	if (lastFrame != 0)
+	{
+		double ms = (now - lastFrame) / 1e6;
+		if (intervals.size() < (size_t)WINDOW)
+		{
+			intervals.push_back(ms);
+		}
+		else
+		{
+			intervals[intervalNext] = ms;
+			intervalNext = (intervalNext + 1) % WINDOW;
+		}
+	}
+	lastFrame = now;
+}
+
+void FramePacer::WaitForDeadline()
+{
+	if (period == 0)
+	{
+		return;
+	}
+
+	// Start a fresh schedule rather than rushing frames to catch up after a stall
+	int64_t now = Now();
+	deadline += period;
+	if (deadline < now - period)
+	{
+		deadline = now;
+	}
+
+	if (deadline - now > SPIN_MARGIN)
+	{
+		std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - SPIN_MARGIN));
+	}
+	while (Now() < deadline)
+	{
+	}
+}
+
+void FramePacer::Resolve()
+{
+	// Timestamps complete in order, so stop at the first one the GPU hasn't reached
+	size_t done = 0;
+	for (; done < pending.size(); done++)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(pending[done].query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			break;
+		}
+
+		GLuint64 gpuTime = 0;
+		glGetQueryObjectui64v(pending[done].query, GL_QUERY_RESULT, &gpuTime);
+		int64_t displayed = (int64_t)gpuTime + gpuToCpu;
+		for (int64_t input : pending[done].inputs)
+		{
+			double ms = (displayed - input) / 1e6;
+			latencies.push_back(ms);
+			histogram[std::min(std::max((int)(ms / BUCKET_MS), 0), BUCKETS - 1)]++;
+		}
+		freeQueries.push_back(pending[done].query);
+	}
+	pending.erase(pending.begin(), pending.begin() + done);
+}
+
+// Value at fraction p of an already sorted list
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	return sorted.empty() ? 0.0 : sorted[std::min((size_t)(p * sorted.size()), sorted.size() - 1)];
+}
+
+void FramePacer::PrintReport()
+{
+	std::vector<double> sorted(intervals);
+	std::sort(sorted.begin(), sorted.end());
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "Frame interval (ms) over " << sorted.size() << " frames at ";
+	if (period)
+	{
+		std::cout << targetFps << " fps";
+	}
+	else
+	{
+		std::cout << "unlimited fps";
+	}
+	std::cout << ": p50 " << percentile(sorted, 0.5) << "  p95 " << percentile(sorted, 0.95)
+		<< "  p99 " << percentile(sorted, 0.99) << "  max " << (sorted.empty() ? 0.0 : sorted.back()) << std::endl;
+
+	sorted = latencies;
+	std::sort(sorted.begin(), sorted.end());
+	std::cout << "Input to photon latency (ms) over " << sorted.size() << " inputs: p50 " << percentile(sorted, 0.5)
+		<< "  p95 " << percentile(sorted, 0.95) << "  p99 " << percentile(sorted, 0.99) << std::endl;
+
+	// Rows up to the slowest bucket that has any samples
+	uint64_t tallest = *std::max_element(histogram, histogram + BUCKETS);
+	int rows = BUCKETS;
+	while (rows > 0 && histogram[rows - 1] == 0)
+	{
+		rows--;
+	}
+	for (int i = 0; i < rows; i++)
+	{
+		std::cout << std::setw(4) << i * BUCKET_MS;
+		if (i == BUCKETS - 1)
+		{
+			std::cout << "+    ";
+		}
+		else
+		{
+			std::cout << " -" << std::setw(3) << (i + 1) * BUCKET_MS;
+		}
+		std::cout << std::setw(8) << histogram[i] << " " << std::string((size_t)(40 * histogram[i] / tallest), '#') << std::endl;
+	}
+	std::cout << std::defaultfloat;
+}
+
+void FramePacer::Delete()
+{
+	SetMaxFramesInFlight(1);
+	for (PendingFrame& frame : pending)
+	{
+		freeQueries.push_back(frame.query);
+	}
+	pending.clear();
+	if (!freeQueries.empty())
+	{
+		glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+	}
+	freeQueries.clear();
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
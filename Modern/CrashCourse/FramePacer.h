@@ -0,0 +1,76 @@
+#ifndef FRAME_PACER_CLASS_H
+#define FRAME_PACER_CLASS_H
+
+#include<glad/glad.h>
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+
+// Paces the main loop and measures input-to-photon latency.
+// A frame limiter holds the loop to a target rate, sleeping until about SPIN_MARGIN before each
+// deadline and spinning the rest, and fences cap how many frames the GPU may queue behind the CPU.
+// Input events are timestamped as they arrive and charged to the next frame; that frame's
+// latency ends when the GPU reaches a timestamp query issued right after its swap.
+class FramePacer
+{
+	public:
+		static const int64_t SPIN_MARGIN = 1000000; // Nanoseconds before a deadline to stop sleeping
+		static const int BUCKET_MS = 4; // Width of one latency histogram bucket
+		static const int BUCKETS = 25; // The last bucket also holds everything above it
+		static const int WINDOW = 4096; // Frame intervals kept for the pacing summary
+
+		FramePacer(double targetFps = 0.0, GLuint maxFramesInFlight = 2);
+
+		// Frames per second to hold the loop to, 0 leaves it unlimited
+		void SetTargetFps(double fps);
+		double TargetFps() const { return targetFps; }
+		void SetMaxFramesInFlight(GLuint frames);
+
+		// Timestamps an input event, its effect is first drawn by the next frame to begin
+		void MarkInput();
+		// Claims the inputs marked since the last frame, call before the frame reads input state
+		void BeginFrame();
+		// Call right after swapping: queries the frame's display time and waits until no more than
+		// maxFramesInFlight frames are queued
+		void EndFrame();
+		// Blocks until the next frame is due, call just before polling input
+		void WaitForDeadline();
+
+		// Prints the latency histogram and how closely frame intervals held the target
+		void PrintReport();
+		// Deletes the fences and queries, call while the context is still current
+		void Delete();
+
+	private:
+		struct PendingFrame
+		{
+			GLuint query;
+			std::vector<int64_t> inputs;
+		};
+
+		double targetFps;
+		int64_t period; // Nanoseconds per frame, 0 when unlimited
+		int64_t deadline;
+		int64_t lastFrame;
+
+		GLuint framesInFlight;
+		uint64_t frameIndex;
+		std::vector<GLsync> fences;
+
+		int64_t gpuToCpu; // Added to GL_TIMESTAMP results to put them on the CPU clock
+		std::vector<int64_t> markedInputs;
+		std::vector<int64_t> frameInputs;
+		std::vector<PendingFrame> pending;
+		std::vector<GLuint> freeQueries;
+
+		uint64_t histogram[BUCKETS];
+		std::vector<double> latencies;
+		std::vector<double> intervals;
+		size_t intervalNext;
+
+		static int64_t Now();
+		// Reads back every pending query the GPU has reached
+		void Resolve();
+};
+
+#endif
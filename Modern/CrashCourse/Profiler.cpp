@@ -0,0 +1,4 @@
+#include<glad/glad.h>
+
+#define PROFILER_IMPLEMENTATION
+#include "../Common/Profiler.h"
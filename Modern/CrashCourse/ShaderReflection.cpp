@@ -0,0 +1,145 @@
+#include "ShaderReflection.h"
+
+#include<iostream>
+
+// Checks if a uniform type is one of the sampler types
+static bool isSamplerType(GLenum type)
+{
+	switch (type)
+	{
+		case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+		case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+		case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY:
+		case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW:
+		case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+		case GL_SAMPLER_BUFFER: case GL_SAMPLER_2D_RECT: case GL_SAMPLER_2D_RECT_SHADOW:
+		case GL_INT_SAMPLER_1D: case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_INT_SAMPLER_CUBE:
+		case GL_INT_SAMPLER_1D_ARRAY: case GL_INT_SAMPLER_2D_ARRAY: case GL_INT_SAMPLER_BUFFER:
+		case GL_UNSIGNED_INT_SAMPLER_1D: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D:
+		case GL_UNSIGNED_INT_SAMPLER_CUBE: case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+		case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+			return true;
+	}
+	return false;
+}
+
+void ShaderReflection::Reflect(GLuint program)
+{
+	attribs.clear();
+	blocks.clear();
+	samplers.clear();
+	formats.clear();
+
+	char name[256];
+	GLsizei length;
+	GLint size;
+	GLenum type;
+
+	// Vertex inputs, skipping built-ins like gl_VertexID which have no location
+	GLint count = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		glGetActiveAttrib(program, i, sizeof(name), &length, &size, &type, name);
+		GLint location = glGetAttribLocation(program, name);
+		if (location >= 0)
+		{
+			attribs.push_back({ name, location, type });
+		}
+	}
+
+	// Uniform blocks get consecutive binding points
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint dataSize = 0;
+		glGetActiveUniformBlockName(program, i, sizeof(name), &length, name);
+		glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+		glUniformBlockBinding(program, i, (GLuint)blocks.size());
+		blocks.push_back({ name, (GLuint)i, dataSize, (GLuint)blocks.size() });
+	}
+
+	// Samplers get consecutive texture units, one per array element
+	GLint previous = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+	glUseProgram(program);
+
+	GLuint nextUnit = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		glGetActiveUniform(program, i, sizeof(name), &length, &size, &type, name);
+		if (!isSamplerType(type))
+		{
+			continue;
+		}
+
+		GLint location = glGetUniformLocation(program, name);
+		std::vector<GLint> units(size);
+		for (GLint element = 0; element < size; element++)
+		{
+			units[element] = nextUnit + element;
+		}
+		glUniform1iv(location, size, units.data());
+
+		samplers.push_back({ name, location, type, nextUnit });
+		nextUnit += size;
+	}
+
+	glUseProgram(previous);
+}
+
+const ShaderAttrib* ShaderReflection::FindAttrib(const char* name) const
+{
+	for (const ShaderAttrib& attrib : attribs)
+	{
+		if (attrib.name == name)
+		{
+			return &attrib;
+		}
+	}
+	std::cout << "SHADER_REFLECTION_ERROR: no active attribute " << name << std::endl;
+	return nullptr;
+}
+
+const ShaderBlock* ShaderReflection::FindBlock(const char* name) const
+{
+	for (const ShaderBlock& block : blocks)
+	{
+		if (block.name == name)
+		{
+			return &block;
+		}
+	}
+	std::cout << "SHADER_REFLECTION_ERROR: no active uniform block " << name << std::endl;
+	return nullptr;
+}
+
+const ShaderSampler* ShaderReflection::FindSampler(const char* name) const
+{
+	for (const ShaderSampler& sampler : samplers)
+	{
+		if (sampler.name == name)
+		{
+			return &sampler;
+		}
+	}
+	std::cout << "SHADER_REFLECTION_ERROR: no active sampler " << name << std::endl;
+	return nullptr;
+}
+
+bool ShaderReflection::CheckBlock(const char* name, size_t size) const
+{
+	const ShaderBlock* block = FindBlock(name);
+	if (block == nullptr)
+	{
+		return false;
+	}
+	if ((size_t)block->dataSize != size)
+	{
+		std::cout << "SHADER_REFLECTION_ERROR: uniform block " << name << " is " << block->dataSize
+			<< " bytes in GLSL but " << size << " bytes in C++" << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,74 @@
+#ifndef SHADER_REFLECTION_CLASS_H
+#define SHADER_REFLECTION_CLASS_H
+
+#include<glad/glad.h>
+#include<map>
+#include<string>
+#include<vector>
+
+// An active vertex shader input
+struct ShaderAttrib
+{
+	std::string name;
+	GLint location;
+	GLenum type; // GL_FLOAT_VEC3, ...
+};
+
+// An active uniform block and the binding point it was assigned
+struct ShaderBlock
+{
+	std::string name;
+	GLuint index;
+	GLint dataSize;
+	GLuint binding;
+};
+
+// An active sampler uniform and the texture unit it was assigned
+struct ShaderSampler
+{
+	std::string name;
+	GLint location;
+	GLenum type; // GL_SAMPLER_2D, ...
+	GLuint unit;
+};
+
+// One attribute pointer of a vertex format, resolved against the program's inputs
+struct FormatLink
+{
+	GLuint location;
+	GLint numComponents;
+	GLenum type;
+	GLsizeiptr offset;
+};
+
+// A vertex format matched against the program, kept so later links skip the matching
+struct LinkedFormat
+{
+	bool matches;
+	GLsizeiptr stride;
+	std::vector<FormatLink> links;
+};
+
+// Everything a linked program exposes, queried once right after linking
+class ShaderReflection
+{
+	public:
+		std::vector<ShaderAttrib> attribs;
+		std::vector<ShaderBlock> blocks;
+		std::vector<ShaderSampler> samplers;
+		// Vertex formats VAO::LinkFormat has matched against this program, keyed by their elements
+		mutable std::map<std::string, LinkedFormat> formats;
+
+		// Enumerates the program's interface and assigns texture units and block bindings in declaration order
+		void Reflect(GLuint program);
+
+		// Lookups by name, meant for load time only. Return nullptr and report if the name is not active
+		const ShaderAttrib* FindAttrib(const char* name) const;
+		const ShaderBlock* FindBlock(const char* name) const;
+		const ShaderSampler* FindSampler(const char* name) const;
+
+		// Reports a uniform block whose size differs from the C++ struct that feeds it
+		bool CheckBlock(const char* name, size_t size) const;
+};
+
+#endif
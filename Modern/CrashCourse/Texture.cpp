@@ -11,6 +11,26 @@ Texture::Texture(const char* image, GLenum texType, GLenum slot, GLenum format,
 	stbi_set_flip_vertically_on_load(true); // Flips the image so it appears right side up
 	unsigned char* bytes = stbi_load(image, &widthImg, &heightImg, &numColCh, 0); // Reads the image from a file and stores it in bytes
 
+	Create(bytes, widthImg, heightImg, texType, slot, format, pixelType);
+}
+
+Texture::Texture(VFS& vfs, const char* image, GLenum texType, GLenum slot, GLenum format, GLenum pixelType)
+{
+	type = texType; // Assigns the type of the texture ot the texture object
+
+	// Stores the width, height, and the number of color channels of the image
+	int widthImg;
+	int heightImg;
+	int numColCh;
+	std::string_view file = vfs.Read(image);
+	stbi_set_flip_vertically_on_load(true); // Flips the image so it appears right side up
+	unsigned char* bytes = stbi_load_from_memory((const stbi_uc*)file.data(), (int)file.size(), &widthImg, &heightImg, &numColCh, 0); // Decodes the image in place
+
+	Create(bytes, widthImg, heightImg, texType, slot, format, pixelType);
+}
+
+void Texture::Create(unsigned char* bytes, int widthImg, int heightImg, GLenum texType, GLenum slot, GLenum format, GLenum pixelType)
+{
 	glGenTextures(1, &ID); // Generates an OpenGL texture object
 	// Assigns the texture to a Texture Unit
 	glActiveTexture(slot);
@@ -48,6 +68,12 @@ void Texture::Bind()
 	glBindTexture(type, ID);
 }
 
+void Texture::BindUnit(GLuint unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(type, ID);
+}
+
 void Texture::Unbind()
 {
 	glBindTexture(type, 0);
@@ -4,6 +4,7 @@
 #include<glad/glad.h>
 
 #include"shaderClass.h"
+#include"VFS.h"
 #include "Libraries/include/stb/stb_image.h"
 
 class Texture
@@ -12,14 +13,22 @@ public:
 	GLuint ID;
 	GLenum type;
 	Texture(const char* image, GLenum texType, GLenum slot, GLenum format, GLenum pixelType);
+	// Decodes the image straight from the view the VFS returns
+	Texture(VFS& vfs, const char* image, GLenum texType, GLenum slot, GLenum format, GLenum pixelType);
 
 	// Assigns a texture unit to a texture
 	void texUnit(Shader& shader, const char* uniform, GLuint unit);
 	// Binds a texture
 	void Bind();
+	// Binds a texture to a texture unit, e.g. one assigned by the shader's reflection
+	void BindUnit(GLuint unit);
 	// Unbinds a texture
 	void Unbind();
 	// Deletes a texture
 	void Delete();
+
+private:
+	// Uploads decoded pixels and frees them
+	void Create(unsigned char* bytes, int widthImg, int heightImg, GLenum texType, GLenum slot, GLenum format, GLenum pixelType);
 };
 #endif
\ No newline at end of file
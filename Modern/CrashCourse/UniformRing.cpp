@@ -0,0 +1,96 @@
+#include "UniformRing.h"
+
+#include<cassert>
+#include<cstring>
+#include<iostream>
+
+// Constructor that allocates framesInFlight regions of blocksPerFrame blocks each
+UniformRing::UniformRing(GLsizeiptr blockSize, GLuint blocksPerFrame, GLuint framesInFlight)
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	stride = (blockSize + alignment - 1) / alignment * alignment;
+
+	frameSize = stride * blocksPerFrame;
+	frames = framesInFlight;
+	frameIndex = frames - 1;
+	fences.assign(frames, (GLsync)0);
+	mapped = nullptr;
+	frameStart = 0;
+	cursor = 0;
+
+	glGenBuffers(1, &ID);
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	glBufferData(GL_UNIFORM_BUFFER, frameSize * frames, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformRing::BeginFrame()
+{
+	frameIndex = (frameIndex + 1) % frames;
+	frameStart = frameSize * frameIndex;
+	cursor = frameStart;
+
+	// Block only if the GPU is still reading the frame that last used this region
+	if (fences[frameIndex])
+	{
+		glClientWaitSync(fences[frameIndex], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fences[frameIndex]);
+		fences[frameIndex] = 0;
+	}
+
+	// The fence already guarantees the region is free, so skip the driver's own synchronization
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, frameStart, frameSize,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+GLintptr UniformRing::Push(const void* data, GLsizeiptr size)
+{
+	// Overflowing would hand back a block another draw already uses, so sizing the ring too small is a bug
+	bool fits = mapped != nullptr && size <= stride && cursor + stride <= frameStart + frameSize;
+	assert(fits && "UniformRing pushed past blocksPerFrame");
+	if (!fits)
+	{
+		std::cout << "UNIFORM_RING_ERROR: block does not fit in the current frame" << std::endl;
+		return frameStart;
+	}
+
+	GLintptr offset = cursor;
+	memcpy(mapped + (offset - frameStart), data, size);
+	cursor += stride;
+	return offset;
+}
+
+void UniformRing::Commit()
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	mapped = nullptr;
+}
+
+void UniformRing::EndFrame()
+{
+	fences[frameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void UniformRing::BindRange(GLuint binding, GLintptr offset)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, ID, offset, stride);
+}
+
+// Deletes the buffer and any fences still pending
+void UniformRing::Delete()
+{
+	for (GLsync& fence : fences)
+	{
+		if (fence)
+		{
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+	glDeleteBuffers(1, &ID);
+}
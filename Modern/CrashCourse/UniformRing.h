@@ -0,0 +1,42 @@
+#ifndef UNIFORM_RING_CLASS_H
+#define UNIFORM_RING_CLASS_H
+
+#include<glad/glad.h>
+#include<vector>
+
+// A uniform buffer split into one region per frame in flight.
+// Each frame writes all of its blocks into its own region with a single mapping
+// and fences it, so the CPU never overwrites data the GPU is still reading.
+class UniformRing
+{
+	public:
+		GLuint ID;
+		UniformRing(GLsizeiptr blockSize, GLuint blocksPerFrame, GLuint framesInFlight = 3);
+
+		// Waits until the GPU is done with the next region and maps it for writing
+		void BeginFrame();
+		// Copies a block into the current region and returns its offset in the buffer.
+		// Asserts if the region already holds blocksPerFrame blocks
+		GLintptr Push(const void* data, GLsizeiptr size);
+		template<typename T> GLintptr Push(const T& block) { return Push(&block, sizeof(T)); }
+		// Unmaps the current region so the pushed blocks can be drawn with
+		void Commit();
+		// Fences the current region behind this frame's draws
+		void EndFrame();
+
+		// Binds the block at offset to a uniform block binding point
+		void BindRange(GLuint binding, GLintptr offset);
+		void Delete();
+
+	private:
+		GLsizeiptr stride; // Block size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+		GLsizeiptr frameSize;
+		GLuint frames;
+		GLuint frameIndex;
+		std::vector<GLsync> fences;
+		unsigned char* mapped;
+		GLintptr frameStart;
+		GLintptr cursor;
+};
+
+#endif
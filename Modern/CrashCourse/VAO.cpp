@@ -1,4 +1,8 @@
 #include"VAO.h"
+#include"BlockLayout.h"
+
+#include<algorithm>
+#include<string>
 
 // Constructor that generates a VAO ID
 VAO::VAO()
@@ -15,6 +19,107 @@ void VAO::LinkAttrib(VBO& vbo, GLuint layout, GLuint numComponents, GLenum type,
 	vbo.Unbind();
 }
 
+// Size in bytes of one component of a vertex attribute type, 0 if the type is not supported
+static GLuint componentSize(GLenum type)
+{
+	switch (type)
+	{
+		case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+		case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: return 2;
+		case GL_INT: case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+		case GL_DOUBLE: return 8;
+		default: return 0;
+	}
+}
+
+// Matches every element of an interleaved vertex against the shader's reflected inputs.
+// A matrix input takes one location per column, each fed by as many components as it has rows
+static LinkedFormat matchFormat(const ShaderReflection& reflection, const VertexElement* elements, GLuint count)
+{
+	LinkedFormat format = { true, 0, {} };
+	for (GLuint i = 0; i < count; i++)
+	{
+		if (componentSize(elements[i].type) == 0)
+		{
+			std::cout << "VERTEX_FORMAT_ERROR for:" << elements[i].name << "\nunsupported component type 0x"
+				<< std::hex << elements[i].type << std::dec << std::endl;
+			format.matches = false;
+		}
+		format.stride += elements[i].numComponents * componentSize(elements[i].type);
+	}
+
+	GLsizeiptr offset = 0;
+	for (GLuint i = 0; i < count; i++)
+	{
+		auto attrib = std::find_if(reflection.attribs.begin(), reflection.attribs.end(),
+			[&](const ShaderAttrib& candidate) { return candidate.name == elements[i].name; });
+
+		if (attrib == reflection.attribs.end())
+		{
+			// The linker drops inputs whose results are never used, so there is nothing to link
+			offset += elements[i].numComponents * componentSize(elements[i].type);
+			continue;
+		}
+
+		GLuint columns = blockColumns(attrib->type) ? (GLuint)blockColumns(attrib->type) : 1;
+		GLuint rows = blockColumns(attrib->type) ? columns : (GLuint)blockComponents(attrib->type);
+		if (rows == 0 || rows * columns != elements[i].numComponents)
+		{
+			std::cout << "VERTEX_FORMAT_ERROR for:" << elements[i].name << "\n" << elements[i].numComponents
+				<< " components given but the shader expects " << rows * columns << std::endl;
+			format.matches = false;
+		}
+		else
+		{
+			for (GLuint column = 0; column < columns; column++)
+			{
+				GLsizeiptr columnOffset = offset + column * rows * componentSize(elements[i].type);
+				format.links.push_back({ attrib->location + column, (GLint)rows, elements[i].type, columnOffset });
+			}
+		}
+		offset += elements[i].numComponents * componentSize(elements[i].type);
+	}
+
+	// Every input the shader reads must be fed by the format
+	for (const ShaderAttrib& attrib : reflection.attribs)
+	{
+		if (std::none_of(elements, elements + count, [&](const VertexElement& element) { return attrib.name == element.name; }))
+		{
+			std::cout << "VERTEX_FORMAT_ERROR for:" << attrib.name << "\nshader input is not in the vertex format" << std::endl;
+			format.matches = false;
+		}
+	}
+	return format;
+}
+
+// Links every element of an interleaved vertex at the locations the shader reports. Each format
+// is matched against a program once, after which linking it again only sets the pointers
+bool VAO::LinkFormat(VBO& vbo, const Shader& shader, const VertexElement* elements, GLuint count)
+{
+	std::string key;
+	for (GLuint i = 0; i < count; i++)
+	{
+		key += std::string(elements[i].name) + ":" + std::to_string(elements[i].numComponents) + ":" + std::to_string(elements[i].type) + ";";
+	}
+
+	auto cached = shader.reflection.formats.find(key);
+	if (cached == shader.reflection.formats.end())
+	{
+		cached = shader.reflection.formats.emplace(key, matchFormat(shader.reflection, elements, count)).first;
+	}
+
+	const LinkedFormat& format = cached->second;
+	if (!format.matches)
+	{
+		return false;
+	}
+	for (const FormatLink& link : format.links)
+	{
+		LinkAttrib(vbo, link.location, link.numComponents, link.type, format.stride, (void*)link.offset);
+	}
+	return true;
+}
+
 // Binds the VAO
 void VAO::Bind()
 {
@@ -3,6 +3,15 @@
 
 #include<glad/glad.h>
 #include "VBO.h"
+#include "shaderClass.h"
+
+// One attribute of an interleaved vertex, matched by name to an input of the shader
+struct VertexElement
+{
+	const char* name;
+	GLuint numComponents; // All of a matrix's, which is linked a column at a time
+	GLenum type;
+};
 
 class VAO
 {
@@ -11,6 +20,13 @@ class VAO
 		VAO();
 
 		void LinkAttrib(VBO& vbo, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset);
+		// Links tightly packed elements to the locations the shader reports, failing without linking
+		// anything if they disagree. The match is cached in the shader's reflection
+		bool LinkFormat(VBO& vbo, const Shader& shader, const VertexElement* elements, GLuint count);
+		template<GLuint N> bool LinkFormat(VBO& vbo, const Shader& shader, const VertexElement (&elements)[N])
+		{
+			return LinkFormat(vbo, shader, elements, N);
+		}
 		void Bind();
 		void Unbind();
 		void Delete();
@@ -0,0 +1,55 @@
+#include "VFS.h"
+
+#include<cerrno>
+#include<fstream>
+#include<iostream>
+
+bool VFS::Mount(const char* packPath)
+{
+	return pack.Open(packPath);
+}
+
+std::string_view VFS::Read(const char* name)
+{
+	auto cached = cache.find(name);
+	if (cached != cache.end())
+	{
+		return std::string_view(cached->second.data(), cached->second.size());
+	}
+
+	const AssetPackEntry* entry = pack.Find(name);
+	if (entry != nullptr && !(entry->flags & PACK_LZ4))
+	{
+		return std::string_view((const char*)pack.Payload(*entry), entry->storedSize);
+	}
+
+	std::vector<char>& bytes = cache[name];
+	if (entry != nullptr)
+	{
+		bytes.resize(entry->rawSize);
+		if (!lz4Decompress(pack.Payload(*entry), entry->storedSize, (unsigned char*)bytes.data(), bytes.size()))
+		{
+			std::cout << "ASSET_PACK_ERROR: " << name << " is corrupt" << std::endl;
+			cache.erase(name);
+			throw(EILSEQ);
+		}
+	}
+	else
+	{
+		// Loose file fallback for assets that are not packed yet
+		std::ifstream in(name, std::ios::binary);
+		if (!in)
+		{
+			cache.erase(name);
+			throw(errno);
+		}
+		bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	return std::string_view(bytes.data(), bytes.size());
+}
+
+void VFS::Delete()
+{
+	pack.Close();
+	cache.clear();
+}
@@ -0,0 +1,30 @@
+#ifndef VFS_CLASS_H
+#define VFS_CLASS_H
+
+#include<map>
+#include<string>
+#include<string_view>
+#include<vector>
+
+#include"AssetPack.h"
+
+// Resolves asset names to bytes, from a mounted pack when there is one and from loose files otherwise
+class VFS
+{
+	public:
+		// Maps a pack built with AssetPack::Write. Without one every read falls back to loose files
+		bool Mount(const char* packPath);
+
+		// Returns a view of the asset's bytes that stays valid until Delete.
+		// Uncompressed pack entries point straight into the mapping; others are read or decompressed once and cached
+		std::string_view Read(const char* name);
+
+		// Unmaps the pack and frees every cached asset
+		void Delete();
+
+	private:
+		AssetPack pack;
+		std::map<std::string, std::vector<char>> cache;
+};
+
+#endif
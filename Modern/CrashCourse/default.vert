@@ -6,11 +6,15 @@ layout (location = 2) in vec2 aTex;
 out vec3 color;
 out vec2 texCoord;
 
-uniform float scale;
+// Per-object constants, filled from a UniformRing
+layout (std140) uniform Object
+{
+	vec4 offsetScale; // xy = offset, z = scale
+};
 
 void main()
 {
-	gl_Position = vec4(aPos + aPos * scale, 1.0);
+	gl_Position = vec4(aPos + aPos * offsetScale.z + vec3(offsetScale.xy, 0.0), 1.0);
    color = aColor;
    texCoord = aTex;
 }
\ No newline at end of file
@@ -1,4 +1,12 @@
 #include <iostream>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -7,6 +15,20 @@
 #include "VBO.h"
 #include "VAO.h"
 #include "EBO.h"
+#include "BlockLayout.h"
+#include "UniformRing.h"
+#include "VFS.h"
+#include "FramePacer.h"
+#include "CommandList.h"
+#include "../Common/Profiler.h"
+
+// Layout of one vertex in vertices, linked to the shader inputs of the same names
+const VertexElement vertexFormat[] =
+{
+	{ "aPos", 3, GL_FLOAT },
+	{ "aColor", 3, GL_FLOAT },
+	{ "aTex", 2, GL_FLOAT }
+};
 
 // Vertices coordinates
 GLfloat vertices[] =
@@ -43,8 +65,426 @@ GLuint indices[] =
 
 };
 
-int main()
+// Every file the program loads, packed into ASSET_PACK by --pack
+const char* const assetFiles[] = { "default.frag", "default.vert", "uniforms.vert", "pop_cat.png" };
+const char* const ASSET_PACK = "assets.pak";
+
+// C++ mirror of the Object uniform block in default.vert
+struct ObjectBlock
+{
+	GLfloat offsetScale[4]; // xy = offset, z = scale
+};
+
+constexpr BlockMember objectBlockMembers[] = { { GL_FLOAT_VEC4, 0 } };
+CHECK_BLOCK_MEMBER(ObjectBlock, offsetScale, BlockLayout::Std140, objectBlockMembers, 0);
+CHECK_BLOCK_SIZE(ObjectBlock, BlockLayout::Std140, objectBlockMembers);
+
+const int BENCH_OBJECTS = 10000; // Number of quads drawn by the uniform benchmark
+const int BENCH_FRAMES = 100; // Number of frames timed for each path
+
+// Places object i of count on a grid covering the window
+void objectOffsetScale(int i, int count, GLfloat* out)
+{
+	int side = 1;
+	while (side * side < count)
+	{
+		side++;
+	}
+	out[0] = -1.0f + (2.0f * (i % side) + 1.0f) / side;
+	out[1] = -1.0f + (2.0f * (i / side) + 1.0f) / side;
+	out[2] = 1.0f / side - 1.0f; // Shrinks the unit quad to one grid cell
+	out[3] = 0.0f;
+}
+
+// Times drawing BENCH_OBJECTS quads with one glUniform call each against one UniformRing write per frame
+void benchmarkUniforms(GLFWwindow* window, VFS& vfs, VAO& vao, Shader& blockProgram, GLuint objectBinding)
+{
+	Shader uniformProgram(vfs, "default.frag", "uniforms.vert");
+	UniformRing ring(sizeof(ObjectBlock), BENCH_OBJECTS);
+	GLint offsetScaleID = glGetUniformLocation(uniformProgram.ID, "offsetScale");
+
+	GLfloat (*constants)[4] = new GLfloat[BENCH_OBJECTS][4];
+	GLintptr* offsets = new GLintptr[BENCH_OBJECTS];
+	for (int i = 0; i < BENCH_OBJECTS; i++)
+	{
+		objectOffsetScale(i, BENCH_OBJECTS, constants[i]);
+	}
+
+	vao.Bind();
+	for (int path = 0; path < 2; path++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < BENCH_FRAMES; frame++)
+		{
+			glClear(GL_COLOR_BUFFER_BIT);
+
+			if (path == 0)
+			{
+				uniformProgram.Activate();
+				for (int i = 0; i < BENCH_OBJECTS; i++)
+				{
+					glUniform4fv(offsetScaleID, 1, constants[i]);
+					glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+				}
+			}
+			else
+			{
+				// Write the whole frame's constants in one pass, then only bind ranges while drawing
+				ring.BeginFrame();
+				for (int i = 0; i < BENCH_OBJECTS; i++)
+				{
+					offsets[i] = ring.Push(constants[i], sizeof(ObjectBlock));
+				}
+				ring.Commit();
+
+				blockProgram.Activate();
+				for (int i = 0; i < BENCH_OBJECTS; i++)
+				{
+					ring.BindRange(objectBinding, offsets[i]);
+					glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+				}
+				ring.EndFrame();
+			}
+
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+		glFinish();
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << (path == 0 ? "glUniform:   " : "UniformRing: ") << ms / BENCH_FRAMES << " ms/frame for "
+			<< BENCH_OBJECTS << " objects" << std::endl;
+	}
+
+	delete[] constants;
+	delete[] offsets;
+	ring.Delete();
+	uniformProgram.Delete();
+}
+
+const int COMMAND_OBJECTS = 50000; // Objects in the command list benchmark's scene
+
+// One object of the command list benchmark's scene
+struct SceneObject
+{
+	GLfloat x, y; // Rest position
+	GLfloat phase; // Offset into the sway animation
+	GLuint texture;
+};
+
+// Animates objects [begin, end) to time t and culls them against the window,
+// calling draw with the index and constants of each one left
+template<typename Draw> void traverseScene(const SceneObject* objects, int begin, int end, float t, float scale, Draw draw)
+{
+	for (int i = begin; i < end; i++)
+	{
+		// Sways by at most half the gap to the neighbouring quads, so no two ever overlap
+		GLfloat offsetScale[4] = { objects[i].x + 0.25f * scale * sinf(t + objects[i].phase),
+			objects[i].y + 0.25f * scale * cosf(t + objects[i].phase), scale - 1.0f, 0.0f };
+		float extent = 0.5f * scale; // The unit quad spans -0.5 to 0.5
+		if (fabsf(offsetScale[0]) - extent > 1.0f || fabsf(offsetScale[1]) - extent > 1.0f)
+		{
+			continue;
+		}
+		draw(i, offsetScale);
+	}
+}
+
+// Times a scene of COMMAND_OBJECTS quads, a bit under half of them on screen, drawn straight from
+// the traversal against recorded into sorted command lists the GL thread replays, first on one
+// thread and then on every core
+void benchmarkCommandLists(GLFWwindow* window, VFS& vfs, VAO& vao, Texture& popCat)
+{
+	Shader program(vfs, "default.frag", "uniforms.vert");
+	GLint offsetScaleID = glGetUniformLocation(program.ID, "offsetScale");
+	const ShaderSampler* tex0 = program.reflection.FindSampler("tex0");
+	if (tex0 == nullptr)
+	{
+		program.Delete();
+		return;
+	}
+	GLuint unit = tex0->unit;
+
+	// A second texture so the objects alternate between two
+	GLuint checker;
+	const GLubyte checkerPixels[] = { 255, 255, 255, 255, 40, 40, 40, 255, 40, 40, 40, 255, 255, 255, 255, 255 };
+	glGenTextures(1, &checker);
+	glBindTexture(GL_TEXTURE_2D, checker);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checkerPixels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	int side = 1;
+	while (side * side < COMMAND_OBJECTS)
+	{
+		side++;
+	}
+	std::vector<SceneObject> objects(COMMAND_OBJECTS);
+	for (int i = 0; i < COMMAND_OBJECTS; i++)
+	{
+		objects[i].x = -1.5f + (3.0f * (i % side) + 1.5f) / side;
+		objects[i].y = -1.5f + (3.0f * (i / side) + 1.5f) / side;
+		objects[i].phase = (float)i;
+		objects[i].texture = i % 2 ? checker : popCat.ID;
+	}
+	float scale = 1.5f / side; // Half of each grid cell
+
+	int workers = std::max((int)std::thread::hardware_concurrency(), 1);
+	std::vector<CommandList> lists(workers);
+	std::vector<CommandList*> listPointers;
+	for (CommandList& list : lists)
+	{
+		listPointers.push_back(&list);
+	}
+
+	// Records objects [begin, end) of the scene at time t, sorted by texture then index
+	float t = 0.0f;
+	auto record = [&](CommandList& list, int begin, int end)
+	{
+		traverseScene(objects.data(), begin, end, t, scale, [&](int i, const GLfloat* offsetScale)
+		{
+			list.Begin((uint64_t)objects[i].texture << 32 | (uint32_t)i);
+			list.BindProgram(program.ID);
+			list.BindVertexArray(vao.ID);
+			list.BindTexture(unit, GL_TEXTURE_2D, objects[i].texture);
+			list.Uniform4f(offsetScaleID, offsetScale);
+			list.DrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+		});
+		list.Close();
+	};
+	auto recordSlice = [&](int worker)
+	{
+		record(lists[worker], COMMAND_OBJECTS * worker / workers, COMMAND_OBJECTS * (worker + 1) / workers);
+	};
+
+	// The workers live for the whole benchmark and record one slice each whenever the
+	// generation moves on, so starting threads isn't timed as recording
+	std::mutex mutex;
+	std::condition_variable wake; // Signals the workers that a frame is ready or they should stop
+	std::condition_variable done; // Signals the GL thread that every slice is recorded
+	int generation = 0;
+	int pending = 0;
+	bool quit = false;
+	std::vector<std::thread> threads;
+	for (int worker = 1; worker < workers; worker++)
+	{
+		threads.emplace_back([&, worker]()
+		{
+			int seen = 0;
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true)
+			{
+				wake.wait(lock, [&]() { return quit || generation != seen; });
+				if (quit)
+				{
+					return;
+				}
+				seen = generation;
+				lock.unlock();
+				recordSlice(worker);
+				lock.lock();
+				if (--pending == 0)
+				{
+					done.notify_one();
+				}
+			}
+		});
+	}
+
+	// Unsorted from the traversal, then sorted on one thread, then sorted on every core, so the
+	// gap between the last two is what the threading alone buys
+	const char* const pathNames[] = { "Direct:           ", "Sorted, 1 thread: ", "Command lists:    " };
+	for (int path = 0; path < 3; path++)
+	{
+		double recordMs = 0.0;
+		double replayMs = 0.0;
+		int visible = 0;
+		int listCount = path == 1 ? 1 : workers;
+		auto start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < BENCH_FRAMES; frame++)
+		{
+			glClear(GL_COLOR_BUFFER_BIT);
+			t = frame / 60.0f;
+
+			if (path == 0)
+			{
+				program.Activate();
+				vao.Bind();
+				glActiveTexture(GL_TEXTURE0 + unit);
+				GLuint bound = 0;
+				visible = 0;
+				traverseScene(objects.data(), 0, COMMAND_OBJECTS, t, scale, [&](int i, const GLfloat* offsetScale)
+				{
+					if (objects[i].texture != bound)
+					{
+						glBindTexture(GL_TEXTURE_2D, objects[i].texture);
+						bound = objects[i].texture;
+					}
+					glUniform4fv(offsetScaleID, 1, offsetScale);
+					glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+					visible++;
+				});
+			}
+			else
+			{
+				auto recordStart = std::chrono::steady_clock::now();
+				if (path == 1)
+				{
+					record(lists[0], 0, COMMAND_OBJECTS);
+				}
+				else
+				{
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						generation++;
+						pending = workers - 1;
+					}
+					wake.notify_all();
+					recordSlice(0);
+					std::unique_lock<std::mutex> lock(mutex);
+					done.wait(lock, [&]() { return pending == 0; });
+				}
+
+				auto replayStart = std::chrono::steady_clock::now();
+				CommandList::Execute(listPointers.data(), listCount);
+				visible = 0;
+				for (int list = 0; list < listCount; list++)
+				{
+					visible += (int)lists[list].PacketCount();
+					lists[list].Reset();
+				}
+				auto replayEnd = std::chrono::steady_clock::now();
+				recordMs += std::chrono::duration<double, std::milli>(replayStart - recordStart).count();
+				replayMs += std::chrono::duration<double, std::milli>(replayEnd - replayStart).count();
+			}
+
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+		glFinish();
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << pathNames[path] << ms / BENCH_FRAMES << " ms/frame for "
+			<< COMMAND_OBJECTS << " objects, " << visible << " visible";
+		if (path != 0)
+		{
+			std::cout << " (record " << recordMs / BENCH_FRAMES << " ms on " << listCount << (listCount == 1 ? " thread" : " threads")
+				<< ", replay " << replayMs / BENCH_FRAMES << " ms)";
+		}
+		std::cout << std::endl;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	for (CommandList& list : lists)
+	{
+		list.Delete();
+	}
+	glDeleteTextures(1, &checker);
+	program.Delete();
+}
+
+// Sets vsync: 0 off, 1 every refresh, -1 adaptive (tears instead of waiting a whole refresh when
+// a frame is late). Adaptive needs swap_control_tear and falls back to 1 without it
+int setSwapInterval(int interval)
 {
+	if (interval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+	{
+		std::cout << "Adaptive vsync is not supported, using a swap interval of 1" << std::endl;
+		interval = 1;
+	}
+	glfwSwapInterval(interval);
+	std::cout << "Swap interval " << interval << std::endl;
+	return interval;
+}
+
+int swapInterval = 1;
+const double fpsLimits[] = { 0.0, 30.0, 60.0, 120.0 }; // Cycled by F6, 0 is unlimited
+
+// Every key press is a latency sample. F5 cycles the swap interval, F6 the frame rate limit,
+// F9 writes the profiler's Chrome trace, F10 prints its percentile summary and the pacing report
+void debugKeys(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
+{
+	if (action != GLFW_PRESS)
+	{
+		return;
+	}
+	FramePacer* pacer = (FramePacer*)glfwGetWindowUserPointer(window);
+	pacer->MarkInput();
+
+	if (key == GLFW_KEY_F5)
+	{
+		swapInterval = setSwapInterval(swapInterval == 1 ? 0 : swapInterval == 0 ? -1 : 1);
+	}
+	if (key == GLFW_KEY_F6)
+	{
+		int next = 0;
+		while (next < 4 && fpsLimits[next] != pacer->TargetFps())
+		{
+			next++;
+		}
+		pacer->SetTargetFps(fpsLimits[(next + 1) % 4]);
+		std::cout << "Frame rate limit " << pacer->TargetFps() << std::endl;
+	}
+	if (key == GLFW_KEY_F9 && Profiler::WriteChromeTrace("trace.json"))
+	{
+		std::cout << "Wrote trace.json" << std::endl;
+	}
+	if (key == GLFW_KEY_F10)
+	{
+		Profiler::PrintSummary();
+		pacer->PrintReport();
+	}
+}
+
+// Mouse clicks are latency samples too
+void debugMouse(GLFWwindow* window, int /*button*/, int action, int /*mods*/)
+{
+	if (action == GLFW_PRESS)
+	{
+		((FramePacer*)glfwGetWindowUserPointer(window))->MarkInput();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--pack") == 0)
+	{
+		return AssetPack::Write(ASSET_PACK, assetFiles, sizeof(assetFiles) / sizeof(assetFiles[0])) ? 0 : -1;
+	}
+
+	// --fps N limits the frame rate, --swap-interval N sets vsync (-1 adaptive),
+	// --frames-in-flight N caps how far the CPU may run ahead of the GPU
+	double targetFps = 0.0;
+	int framesInFlight = 2;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--fps") == 0)
+		{
+			targetFps = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--swap-interval") == 0)
+		{
+			swapInterval = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--frames-in-flight") == 0)
+		{
+			framesInFlight = atoi(argv[++i]);
+		}
+	}
+
+	// Read assets from the pack if it has been built, loose files otherwise
+	VFS vfs;
+	vfs.Mount(ASSET_PACK);
+
 	// Initialize GLFW
 	glfwInit();
 
@@ -65,9 +505,14 @@ int main()
 	glfwMakeContextCurrent(window); // Introduce the window to current context
 	gladLoadGL(); //Load GLAD to configure OpenGL
 	glViewport(0, 0, 1000, 1000);
+	swapInterval = setSwapInterval(swapInterval);
+	FramePacer pacer(targetFps, framesInFlight > 0 ? framesInFlight : 1);
+	glfwSetWindowUserPointer(window, &pacer);
+	glfwSetKeyCallback(window, debugKeys);
+	glfwSetMouseButtonCallback(window, debugMouse);
 
 	// Generates Shader object using shaders defualt.vert and default.frag
-	Shader shaderProgram("default.frag", "default.vert");
+	Shader shaderProgram(vfs, "default.frag", "default.vert");
 
 	// Generates Vertex Array Object and binds it
 	VAO vao1;
@@ -76,37 +521,95 @@ int main()
 	VBO vbo1(vertices, sizeof(vertices)); // Generates Vertex Buffer Object and links it to vertices
 	EBO ebo1(indices, sizeof(indices));	// Generates Element Buffer Object and links it to indices
 
-	vao1.LinkAttrib(vbo1, 0, 3, GL_FLOAT, 8 * sizeof(float), (void *)0); // Links VBO to VAO (layout == 0)
-	vao1.LinkAttrib(vbo1, 1, 3, GL_FLOAT, 8 * sizeof(float), (void*)(3 * sizeof(float))); // Links VBO to VAO (layout == 1)
-	vao1.LinkAttrib(vbo1, 2, 2, GL_FLOAT, 8 * sizeof(float), (void*)(6 * sizeof(float))); // Links VBO to VAO (layout == 2)
+	bool formatMatches = vao1.LinkFormat(vbo1, shaderProgram, vertexFormat); // Links VBO to VAO at the locations the shader declares
 
 	// Unbind all to prevent accidentally modifying them
 	vao1.Unbind();
 	vbo1.Unbind();
 	ebo1.Unbind();
 
-	GLuint unifID = glGetUniformLocation(shaderProgram.ID, "scale"); // Get scale uniform from vertex shader
+	// Per-object constants live in a ring of uniform buffer regions, one per frame in flight,
+	// each sized for the single object the main loop draws
+	const ShaderBlock* objectBlock = shaderProgram.reflection.FindBlock("Object");
+	bool blockMatches = shaderProgram.reflection.CheckBlock("Object", sizeof(ObjectBlock));
+	UniformRing objectRing(sizeof(ObjectBlock), 1);
 
 	// Texture
-	Texture popCat("pop_cat.png", GL_TEXTURE_2D, GL_TEXTURE0, GL_RGBA, GL_UNSIGNED_BYTE);
-	popCat.texUnit(shaderProgram, "tex0", 0);
+	Texture popCat(vfs, "pop_cat.png", GL_TEXTURE_2D, GL_TEXTURE0, GL_RGBA, GL_UNSIGNED_BYTE);
+	const ShaderSampler* tex0 = shaderProgram.reflection.FindSampler("tex0");
+
+	// Nothing can be drawn right if the shaders disagree with what feeds them, so stop at load
+	if (!formatMatches || objectBlock == nullptr || !blockMatches || tex0 == nullptr)
+	{
+		std::cout << "Failed to load default.vert and default.frag" << std::endl;
+		vao1.Delete();
+		vbo1.Delete();
+		ebo1.Delete();
+		popCat.Delete();
+		objectRing.Delete();
+		pacer.Delete();
+		shaderProgram.Delete();
+		vfs.Delete();
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return -1;
+	}
+	GLuint objectBinding = objectBlock->binding;
+	GLuint popCatUnit = tex0->unit; // Unit the shader's tex0 was assigned
+
+	// The benchmarks present every frame, so with vsync on they would time the refresh rate
+	if (argc > 1 && strcmp(argv[1], "--bench-uniforms") == 0)
+	{
+		popCat.BindUnit(popCatUnit);
+		glfwSwapInterval(0);
+		benchmarkUniforms(window, vfs, vao1, shaderProgram, objectBinding);
+		glfwSwapInterval(swapInterval);
+	}
+	if (argc > 1 && strcmp(argv[1], "--bench-commands") == 0)
+	{
+		glfwSwapInterval(0);
+		benchmarkCommandLists(window, vfs, vao1, popCat);
+		glfwSwapInterval(swapInterval);
+	}
 
 	// Main while loop
 	while (!glfwWindowShouldClose(window))
 	{
-		glClearColor(0.07f, 0.13f, 0.17f, 1.0f); // Specify the color of the background
-		glClear(GL_COLOR_BUFFER_BIT); // Clean the back buffer and assign the new color to it
+		Profiler::BeginFrame();
+		pacer.BeginFrame();
+		{
+			PROFILE("Clear");
+			glClearColor(0.07f, 0.13f, 0.17f, 1.0f); // Specify the color of the background
+			glClear(GL_COLOR_BUFFER_BIT); // Clean the back buffer and assign the new color to it
+		}
 
-		shaderProgram.Activate(); // Tell OpenGL which Shader Program we want to use
+		{
+			PROFILE("Draw");
+			shaderProgram.Activate(); // Tell OpenGL which Shader Program we want to use
 
-		glUniform1f(unifID, 0.5f); // Set scale uniform
-		popCat.Bind();
+			// Set scale uniform
+			ObjectBlock object = { { 0.0f, 0.0f, 0.5f, 0.0f } };
+			objectRing.BeginFrame();
+			objectRing.BindRange(objectBinding, objectRing.Push(object));
+			objectRing.Commit();
+			popCat.BindUnit(popCatUnit);
 
-		vao1.Bind(); // Bind the VAO so OpenGL knows to use it
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			vao1.Bind(); // Bind the VAO so OpenGL knows to use it
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			objectRing.EndFrame();
+		}
 
-		glfwSwapBuffers(window); // Swap the back buffer with the front buffer
+		{
+			PROFILE_CPU("Swap");
+			glfwSwapBuffers(window); // Swap the back buffer with the front buffer
+		}
+		{
+			PROFILE_CPU("Pacing");
+			pacer.EndFrame(); // Throttle to the frames in flight limit
+			pacer.WaitForDeadline(); // Sleep off the rest of the frame before sampling input
+		}
 		glfwPollEvents(); // Take care of all GLFW events
+		Profiler::EndFrame();
 	}
 
 	// Delete all the objects we've created
@@ -114,7 +617,12 @@ int main()
 	vbo1.Delete();
 	ebo1.Delete();
 	popCat.Delete();
+	objectRing.Delete();
+	pacer.PrintReport();
+	pacer.Delete();
+	Profiler::Shutdown();
 	shaderProgram.Delete();
+	vfs.Delete();
 
 	glfwDestroyWindow(window);
 	glfwTerminate();
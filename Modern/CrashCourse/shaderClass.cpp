@@ -23,19 +23,31 @@ Shader::Shader(const char* fragmentFile, const char* vertexFile)
 	std::string vertexCode = get_file_contents(vertexFile);
 	std::string fragmentCode = get_file_contents(fragmentFile);
 
-	// Convert the shader source strings into character arrays
-	const char* vertexSource = vertexCode.c_str();
-	const char* fragmentSource = fragmentCode.c_str();
+	Build(vertexCode, fragmentCode);
+}
+
+Shader::Shader(VFS& vfs, const char* fragmentFile, const char* vertexFile)
+{
+	Build(vfs.Read(vertexFile), vfs.Read(fragmentFile));
+}
+
+void Shader::Build(std::string_view vertexCode, std::string_view fragmentCode)
+{
+	// The views are not null terminated, so pass their lengths along
+	const char* vertexSource = vertexCode.data();
+	const char* fragmentSource = fragmentCode.data();
+	GLint vertexLength = (GLint)vertexCode.size();
+	GLint fragmentLength = (GLint)fragmentCode.size();
 
 	// Create and compile vertex shader
 	GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexShader, 1, &vertexSource, NULL);
+	glShaderSource(vertexShader, 1, &vertexSource, &vertexLength);
 	glCompileShader(vertexShader); // Compile shader into machine code
 	compileErrors(vertexShader, "VERTEX");
 
 	//Create and compile fragment shader
 	GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+	glShaderSource(fragmentShader, 1, &fragmentSource, &fragmentLength);
 	glCompileShader(fragmentShader); // Compile shader into machine code
 	compileErrors(fragmentShader, "FRAGMENT");
 
@@ -45,6 +57,7 @@ Shader::Shader(const char* fragmentFile, const char* vertexFile)
 	glAttachShader(ID, fragmentShader); // Attach fragment shader to program
 	glLinkProgram(ID); // Link all shaders together into the program
 	compileErrors(ID, "PROGRAM");
+	reflection.Reflect(ID); // Assign texture units and block bindings once, at load
 
 	// Delete shaders
 	glDeleteShader(vertexShader);
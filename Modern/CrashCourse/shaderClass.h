@@ -3,22 +3,30 @@
 
 #include<glad/glad.h>
 #include<string>
+#include<string_view>
 #include<fstream>
 #include<sstream>
 #include<iostream>
 #include<cerrno>
 
-std::string get__file_contents(const char* filename);
+#include"ShaderReflection.h"
+#include"VFS.h"
+
+std::string get_file_contents(const char* filename);
 
 class Shader
 {
 	public:
 		GLuint ID;
+		ShaderReflection reflection; // Attributes, blocks and samplers found when the program was linked
 		Shader(const char* fragmentFile, const char* vertexFile);
+		// Compiles straight from the views the VFS returns, without copying the sources
+		Shader(VFS& vfs, const char* fragmentFile, const char* vertexFile);
 
 		void Activate();
 		void Delete();
 	private:
+		void Build(std::string_view vertexCode, std::string_view fragmentCode);
 		void compileErrors(unsigned int shader, const char* type); // Checks if the different Shaders have compiled properly
 };
 
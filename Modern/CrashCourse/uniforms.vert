@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in vec2 aTex;
+
+out vec3 color;
+out vec2 texCoord;
+
+// Same constants as default.vert, set with individual glUniform calls
+uniform vec4 offsetScale; // xy = offset, z = scale
+
+void main()
+{
+	gl_Position = vec4(aPos + aPos * offsetScale.z + vec3(offsetScale.xy, 0.0), 1.0);
+   color = aColor;
+   texCoord = aTex;
+}
\ No newline at end of file
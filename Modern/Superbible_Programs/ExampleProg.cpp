@@ -1,4 +1,5 @@
 #include <sb7.h>
+#include "sb7headless.h"
 
 
 
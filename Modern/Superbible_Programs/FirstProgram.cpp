@@ -2,6 +2,7 @@
 	First program from OpenGL Superbible
 **/
 #include "../../include/sb7.h"
+#include "sb7headless.h"
 
 class my_application : public sb7::application
 {
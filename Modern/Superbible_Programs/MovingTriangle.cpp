@@ -1,7 +1,31 @@
 #include "../../include/sb7.h"
+#include "sb7headless.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MOVING_TRIANGLE_SSE
+#include <emmintrin.h>
+#endif
 
 /*
 This program transfers data from vertex shader to fragment shader using 'in' and 'out' variables
+
+Besides the single triangle it can animate up to MAX_TRIANGLES of them with one instanced draw.
+Each triangle's state is kept as one array per field (base position, speed, angle) and its
+offset is written to two more arrays the vertex shader reads by gl_InstanceID. Either a
+compute shader updates the arrays in place, or the CPU updates its own copy with SSE on every
+core and uploads the offsets.
+
+The MOVING_TRIANGLES environment variable sets the count (and starts on the gpu path), and
+MOVING_TRIANGLES_PATH picks single, gpu or cpu. M cycles the path and keypad +/- double or
+halve the count. The profiler summary printed at shutdown has the timings of each path.
 */
 
 GLuint compile_shaders(void)
@@ -105,8 +129,199 @@ GLuint compile_shaders(void)
 	return program;
 };
 
+// Compiles the compute update and the instanced vertex shader, which reuses the fragment shader above
+GLuint compile_instanced_shaders(GLuint& update_program)
+{
+	// Source code for the Compute Shader that animates every triangle
+	static const GLchar * compute_shader_source[] =
+	{
+		"#version 450 core																\n"
+		"																				\n"
+		"layout (local_size_x = 256) in;												\n"
+		"																				\n"
+		"// One array per field, the same layout the CPU path updates					\n"
+		"layout (std430, binding = 0) readonly buffer BaseX { float base_x[]; };		\n"
+		"layout (std430, binding = 1) readonly buffer BaseY { float base_y[]; };		\n"
+		"layout (std430, binding = 2) readonly buffer Speed { float speed[]; };			\n"
+		"layout (std430, binding = 3) buffer Angle { float angle[]; };					\n"
+		"layout (std430, binding = 4) writeonly buffer OffsetX { float offset_x[]; };	\n"
+		"layout (std430, binding = 5) writeonly buffer OffsetY { float offset_y[]; };	\n"
+		"																				\n"
+		"uniform uint count;															\n"
+		"uniform float dt;																\n"
+		"uniform vec2 amplitude;														\n"
+		"																				\n"
+		"void main(void)																\n"
+		"{																				\n"
+		"	uint i = gl_GlobalInvocationID.x;											\n"
+		"	if (i >= count)																\n"
+		"	{																			\n"
+		"		return;																	\n"
+		"	}																			\n"
+		"																				\n"
+		"	// Advance the angle and keep it in [-pi, pi] so it never loses precision	\n"
+		"	float a = angle[i] + speed[i] * dt;											\n"
+		"	a -= 6.28318531 * round(a * 0.159154943);									\n"
+		"	angle[i] = a;																\n"
+		"																				\n"
+		"	offset_x[i] = base_x[i] + sin(a) * amplitude.x;								\n"
+		"	offset_y[i] = base_y[i] + cos(a) * amplitude.y;								\n"
+		"}																				\n"
+	};
+
+	// Source code for the instanced Vertex Shader
+	static const GLchar * vertex_shader_source[] =
+	{
+		"#version 450 core																\n"
+		"																				\n"
+		"layout (std430, binding = 4) readonly buffer OffsetX { float offset_x[]; };	\n"
+		"layout (std430, binding = 5) readonly buffer OffsetY { float offset_y[]; };	\n"
+		"																				\n"
+		"// Triangle size, smaller as the count grows									\n"
+		"uniform float scale;															\n"
+		"																				\n"
+		"out vec4 vs_color;																\n"
+		"																				\n"
+		"void main(void)																\n"
+		"{																				\n"
+		"	const vec4 vertices[3] = vec4[3](vec4(0.25, -0.25, 0.5, 1.0),				\n"
+		"									 vec4(-0.25, -0.25, 0.5, 1.0),				\n"
+		"									 vec4(0.25, 0.25, 0.5, 1.0));				\n"
+		"																				\n"
+		"	vec4 offset = vec4(offset_x[gl_InstanceID], offset_y[gl_InstanceID], 0.0, 0.0);	\n"
+		"	gl_Position = vec4(vertices[gl_VertexID].xy * scale, 0.5, 1.0) + offset;	\n"
+		"																				\n"
+		"	// A colour per triangle, hashed from its index								\n"
+		"	uint h = uint(gl_InstanceID) * 2654435761u;									\n"
+		"	vs_color = vec4(float(h & 255u), float((h >> 8) & 255u), float((h >> 16) & 255u), 255.0) / 255.0;	\n"
+		"}																				\n"
+	};
+
+	static const GLchar * fragment_shader_source[] =
+	{
+		"#version 450 core																\n"
+		"																				\n"
+		"in vec4 vs_color;																\n"
+		"out vec4 color;																\n"
+		"																				\n"
+		"void main(void)																\n"
+		"{																				\n"
+		"	color = vs_color;															\n"
+		"}																				\n"
+	};
+
+	GLuint compute_shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute_shader, 1, compute_shader_source, NULL);
+	glCompileShader(compute_shader);
+	update_program = glCreateProgram();
+	glAttachShader(update_program, compute_shader);
+	glLinkProgram(update_program);
+	glDeleteShader(compute_shader);
+
+	GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertex_shader, 1, vertex_shader_source, NULL);
+	glCompileShader(vertex_shader);
+	GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragment_shader, 1, fragment_shader_source, NULL);
+	glCompileShader(fragment_shader);
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+	glLinkProgram(program);
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	return program;
+}
+
+// Per-triangle state as one array per field, shared layout between the CPU and the GPU
+struct TriangleState
+{
+	std::vector<float> base_x, base_y, speed, angle;
+	std::vector<float> offset_x, offset_y;
+};
+
+static const float TWO_PI = 6.28318531f;
+
+#ifdef MOVING_TRIANGLE_SSE
+
+// sin and cos of four angles in [-pi, pi]. Folds to [-pi/2, pi/2] and uses the Taylor
+// series to x^11, whose error there is under 1e-7
+static void sincos_ps(__m128 x, __m128& s, __m128& c)
+{
+	const __m128 pi = _mm_set1_ps(3.14159265f);
+	const __m128 half_pi = _mm_set1_ps(1.57079633f);
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+
+	auto sin_folded = [&](__m128 a) {
+		// sin(a) = sin(pi - a) above pi/2 and sin(-pi - a) below -pi/2
+		__m128 sign = _mm_and_ps(a, sign_mask);
+		__m128 magnitude = _mm_andnot_ps(sign_mask, a);
+		__m128 over = _mm_cmpgt_ps(magnitude, half_pi);
+		magnitude = _mm_or_ps(_mm_and_ps(over, _mm_sub_ps(pi, magnitude)), _mm_andnot_ps(over, magnitude));
+		a = _mm_or_ps(magnitude, sign);
+
+		__m128 a2 = _mm_mul_ps(a, a);
+		__m128 p = _mm_set1_ps(-2.50521084e-8f);
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(2.75573192e-6f));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(-1.98412698e-4f));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(8.33333333e-3f));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(-1.66666667e-1f));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(1.0f));
+		return _mm_mul_ps(p, a);
+	};
+
+	s = sin_folded(x);
+
+	// cos(x) = sin(x + pi/2), wrapped back into [-pi, pi]
+	__m128 shifted = _mm_add_ps(x, half_pi);
+	__m128 wrap = _mm_cmpgt_ps(shifted, pi);
+	shifted = _mm_sub_ps(shifted, _mm_and_ps(wrap, _mm_set1_ps(TWO_PI)));
+	c = sin_folded(shifted);
+}
+
+#endif
+
+// The compute shader's update for triangles [begin, end), four at a time where SSE is available
+static void update_triangles(TriangleState& state, size_t begin, size_t end, float dt, float amplitude_x, float amplitude_y)
+{
+	size_t i = begin;
+#ifdef MOVING_TRIANGLE_SSE
+	const __m128 dt4 = _mm_set1_ps(dt);
+	const __m128 two_pi = _mm_set1_ps(TWO_PI);
+	const __m128 inv_two_pi = _mm_set1_ps(1.0f / TWO_PI);
+	const __m128 ax = _mm_set1_ps(amplitude_x);
+	const __m128 ay = _mm_set1_ps(amplitude_y);
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 a = _mm_add_ps(_mm_loadu_ps(&state.angle[i]), _mm_mul_ps(_mm_loadu_ps(&state.speed[i]), dt4));
+		__m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(a, inv_two_pi)));
+		a = _mm_sub_ps(a, _mm_mul_ps(turns, two_pi));
+		_mm_storeu_ps(&state.angle[i], a);
+
+		__m128 s, c;
+		sincos_ps(a, s, c);
+		_mm_storeu_ps(&state.offset_x[i], _mm_add_ps(_mm_loadu_ps(&state.base_x[i]), _mm_mul_ps(s, ax)));
+		_mm_storeu_ps(&state.offset_y[i], _mm_add_ps(_mm_loadu_ps(&state.base_y[i]), _mm_mul_ps(c, ay)));
+	}
+#endif
+	for (; i < end; i++)
+	{
+		float a = state.angle[i] + state.speed[i] * dt;
+		a -= TWO_PI * roundf(a / TWO_PI);
+		state.angle[i] = a;
+		state.offset_x[i] = state.base_x[i] + sinf(a) * amplitude_x;
+		state.offset_y[i] = state.base_y[i] + cosf(a) * amplitude_y;
+	}
+}
+
 class DrawMovingTriangle : public sb7::application
 {
+	enum UpdatePath { PATH_SINGLE, PATH_GPU, PATH_CPU, PATH_COUNT };
+	// Buffer per field, in binding order
+	enum Field { BASE_X, BASE_Y, SPEED, ANGLE, OFFSET_X, OFFSET_Y, FIELD_COUNT };
+	static const int MAX_TRIANGLES = 1 << 20;
+
 public:
 
 	void startup()
@@ -114,11 +329,84 @@ public:
 		rendering_program = compile_shaders();
 		glCreateVertexArrays(1, &vertex_array_object);
 		glBindVertexArray(vertex_array_object);
+
+		instanced_program = compile_instanced_shaders(update_program);
+		count_location = glGetUniformLocation(update_program, "count");
+		dt_location = glGetUniformLocation(update_program, "dt");
+		amplitude_location = glGetUniformLocation(update_program, "amplitude");
+		scale_location = glGetUniformLocation(instanced_program, "scale");
+
+		if (const char* count = getenv("MOVING_TRIANGLES"))
+		{
+			triangle_count = std::min(std::max(atoi(count), 1), MAX_TRIANGLES);
+			path = PATH_GPU;
+		}
+		if (const char* name = getenv("MOVING_TRIANGLES_PATH"))
+		{
+			static const char* names[PATH_COUNT] = { "single", "gpu", "cpu" };
+			for (int i = 0; i < PATH_COUNT; i++)
+			{
+				if (strcmp(name, names[i]) == 0)
+				{
+					path = (UpdatePath)i;
+				}
+			}
+		}
+
+		// Scatter the triangles over the window, each with its own speed and phase
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> speed(0.5f, 2.0f);
+		std::uniform_real_distribution<float> phase(-3.14159265f, 3.14159265f);
+		state.base_x.resize(MAX_TRIANGLES);
+		state.base_y.resize(MAX_TRIANGLES);
+		state.speed.resize(MAX_TRIANGLES);
+		state.angle.resize(MAX_TRIANGLES);
+		state.offset_x.resize(MAX_TRIANGLES);
+		state.offset_y.resize(MAX_TRIANGLES);
+		for (int i = 0; i < MAX_TRIANGLES; i++)
+		{
+			state.base_x[i] = position(rng);
+			state.base_y[i] = position(rng);
+			state.speed[i] = speed(rng);
+			state.angle[i] = phase(rng);
+		}
+
+		const float* fields[FIELD_COUNT] = { state.base_x.data(), state.base_y.data(), state.speed.data(),
+											 state.angle.data(), state.offset_x.data(), state.offset_y.data() };
+		glCreateBuffers(FIELD_COUNT, buffers);
+		for (int i = 0; i < FIELD_COUNT; i++)
+		{
+			glNamedBufferStorage(buffers[i], MAX_TRIANGLES * sizeof(float), fields[i], GL_DYNAMIC_STORAGE_BIT);
+		}
+		glBindBuffersBase(GL_SHADER_STORAGE_BUFFER, 0, FIELD_COUNT, buffers);
+
+		// One worker per core besides this thread, kept for the whole run
+		unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+		for (unsigned int i = 1; i < cores; i++)
+		{
+			workers.emplace_back(&DrawMovingTriangle::worker_loop, this, (size_t)i);
+		}
 	}
 
 	void shutdown()
 	{
-		glDeleteVertexArrays(1, &vertex_array_object);
+		Profiler::PrintSummary();
+
+		{
+			std::lock_guard<std::mutex> lock(worker_mutex);
+			stopping = true;
+		}
+		worker_wake.notify_all();
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+		workers.clear();
+
+		glDeleteBuffers(FIELD_COUNT, buffers);
+		glDeleteProgram(update_program);
+		glDeleteProgram(instanced_program);
 		glDeleteProgram(rendering_program);
 		glDeleteVertexArrays(1, &vertex_array_object);
 	}
@@ -126,6 +414,9 @@ public:
 	// Our rendering function
 	void render(double currentTime)
 	{
+		float dt = last_time < 0.0 ? 0.0f : (float)(currentTime - last_time);
+		last_time = currentTime;
+
 		// Sets colour
 		static const GLfloat color[] = { (float)sin(currentTime) * 0.5f + 0.5f,
 										 (float)cos(currentTime) * 0.5f + 0.5f,
@@ -133,24 +424,173 @@ public:
 
 		glClearBufferfv(GL_COLOR, 0, color);
 
-		// Use program object we created for rendering
-		glUseProgram(rendering_program);
+		if (path == PATH_SINGLE)
+		{
+			// Use program object we created for rendering
+			glUseProgram(rendering_program);
+
+			GLfloat attrib[] = { (float)sin(currentTime) * 0.5f,
+								 (float)cos(currentTime) * 0.6f,
+								 0.0f, 0.0f };
+
+			// Update value of input attribute 0
+			glVertexAttrib4fv(0, attrib);
+
+			// Draw one triangle
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			return;
+		}
+
+		// Shrink the triangles and their orbits as the count grows so they stay apart
+		float scale = 1.0f / sqrtf((float)triangle_count);
+		float amplitude_x = 0.5f * scale;
+		float amplitude_y = 0.6f * scale;
+
+		if (path == PATH_GPU)
+		{
+			PROFILE("update gpu");
+			glUseProgram(update_program);
+			glUniform1ui(count_location, triangle_count);
+			glUniform1f(dt_location, dt);
+			glUniform2f(amplitude_location, amplitude_x, amplitude_y);
+			glDispatchCompute((triangle_count + 255) / 256, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+		else
+		{
+			{
+				PROFILE_CPU("update cpu");
+				update_parallel(dt, amplitude_x, amplitude_y);
+			}
+			PROFILE("upload");
+			glNamedBufferSubData(buffers[OFFSET_X], 0, triangle_count * sizeof(float), state.offset_x.data());
+			glNamedBufferSubData(buffers[OFFSET_Y], 0, triangle_count * sizeof(float), state.offset_y.data());
+		}
 
-		GLfloat attrib[] = { (float)sin(currentTime) * 0.5f,
-							 (float)cos(currentTime) * 0.6f,
-							 0.0f, 0.0f };
+		PROFILE("draw");
+		glUseProgram(instanced_program);
+		glUniform1f(scale_location, scale);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 3, triangle_count);
+	}
 
-		// Update value of input attribute 0
-		glVertexAttrib4fv(0, attrib);
+	virtual void onKey(int key, int action)
+	{
+		if (action != GLFW_PRESS)
+		{
+			return;
+		}
 
-		// Draw one triangle	
-		glDrawArrays(GL_TRIANGLES, 0, 3);
+		switch (key)
+		{
+			// Cycle single triangle, compute update and CPU update
+			case 'M':
+				set_path((UpdatePath)((path + 1) % PATH_COUNT));
+				break;
+			// More or fewer triangles
+			case GLFW_KEY_KP_ADD:
+				triangle_count = std::min(triangle_count * 2, MAX_TRIANGLES);
+				break;
+			case GLFW_KEY_KP_SUBTRACT:
+				triangle_count = std::max(triangle_count / 2, 1);
+				break;
+		}
 	}
 
 private:
 
+	// The angles are the only state both paths advance, so hand them over when switching
+	void set_path(UpdatePath next)
+	{
+		if (path == PATH_GPU && next != PATH_GPU)
+		{
+			glGetNamedBufferSubData(buffers[ANGLE], 0, MAX_TRIANGLES * sizeof(float), state.angle.data());
+		}
+		else if (path == PATH_CPU && next != PATH_CPU)
+		{
+			glNamedBufferSubData(buffers[ANGLE], 0, MAX_TRIANGLES * sizeof(float), state.angle.data());
+		}
+		path = next;
+	}
+
+	// Splits the triangles into one run per core, each a multiple of four so SSE never straddles two.
+	// This thread takes the first run and wakes the workers for the rest
+	void update_parallel(float dt, float amplitude_x, float amplitude_y)
+	{
+		size_t count = triangle_count;
+		size_t threads = workers.size() + 1;
+		size_t chunk = ((count + threads - 1) / threads + 3) & ~(size_t)3;
+
+		{
+			std::lock_guard<std::mutex> lock(worker_mutex);
+			job = { dt, amplitude_x, amplitude_y, chunk, count };
+			busy = (int)workers.size();
+			generation++;
+		}
+		worker_wake.notify_all();
+		update_triangles(state, 0, std::min(chunk, count), dt, amplitude_x, amplitude_y);
+
+		std::unique_lock<std::mutex> lock(worker_mutex);
+		worker_done.wait(lock, [&]() { return busy == 0; });
+	}
+
+	// Updates run index of every frame's job, until shutdown
+	void worker_loop(size_t index)
+	{
+		unsigned int seen = 0;
+		std::unique_lock<std::mutex> lock(worker_mutex);
+		while (true)
+		{
+			worker_wake.wait(lock, [&]() { return stopping || generation != seen; });
+			if (stopping)
+			{
+				return;
+			}
+			seen = generation;
+			UpdateJob run = job;
+			lock.unlock();
+
+			size_t begin = std::min(index * run.chunk, run.count);
+			update_triangles(state, begin, std::min(begin + run.chunk, run.count), run.dt, run.amplitude_x, run.amplitude_y);
+
+			lock.lock();
+			if (--busy == 0)
+			{
+				worker_done.notify_one();
+			}
+		}
+	}
+
 	GLuint rendering_program;
 	GLuint vertex_array_object;
+
+	GLuint update_program;
+	GLuint instanced_program;
+	GLint count_location;
+	GLint dt_location;
+	GLint amplitude_location;
+	GLint scale_location;
+	GLuint buffers[FIELD_COUNT];
+
+	TriangleState state;
+
+	// Arguments of the frame's cpu update, shared with the workers
+	struct UpdateJob
+	{
+		float dt, amplitude_x, amplitude_y;
+		size_t chunk, count;
+	};
+	std::vector<std::thread> workers;
+	std::mutex worker_mutex;
+	std::condition_variable worker_wake; // Signals the workers that an update started or they should stop
+	std::condition_variable worker_done; // Signals the render thread that the last worker finished its run
+	UpdateJob job;
+	unsigned int generation = 0; // Bumped per update, so each worker runs it once
+	int busy = 0; // Workers still on the current update
+	bool stopping = false;
+
+	UpdatePath path = PATH_SINGLE;
+	int triangle_count = 1024;
+	double last_time = -1.0;
 };
 
 // Only instance of DECLARE_MAIN to state entry point
@@ -1,7 +1,22 @@
 #include "../../include/sb7.h"
+#include "sb7headless.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <vector>
 
 /*
 This program transfers data from vertex shader to fragment shader using 'in' and 'out' variables
+
+The triangle also sheds up to MAX_PARTICLES particles, which live entirely on the GPU. Each frame:
+	emit		pops free particles off an atomic free list, spawns them on the triangle and
+				appends them to the alive list
+	simulate	moves every alive particle, pushing the ones that die back on the free list
+	compact		prefix sums the survivors' flags and scatters them into the other alive list,
+				whose length becomes the count of the indirect draw
+Nothing is read back; the dispatch sizes and the draw count are written by the GPU. Keypad +/-
+double or halve the emission rate, and the GPU time of each pass prints at shutdown.
 */
 
 GLuint compile_shaders(void)
@@ -85,8 +100,348 @@ GLuint compile_shaders(void)
 	return program;
 };
 
+// Declarations every particle pass starts with
+static const GLchar * particle_common_source[] =
+{
+	"#version 450 core																\n"
+	"																				\n"
+	"struct Particle																\n"
+	"{																				\n"
+	"	vec2 position;																\n"
+	"	vec2 velocity;																\n"
+	"	float life;			// Seconds left, 0 once dead							\n"
+	"	float lifetime;		// Seconds it was emitted with							\n"
+	"};																				\n"
+	"																				\n"
+	"layout (std430, binding = 0) buffer Particles { Particle particles[]; };		\n"
+	"layout (std430, binding = 1) buffer FreeList { uint free_list[]; };			\n"
+	"layout (std430, binding = 2) buffer AliveIn { uint alive_in[]; };				\n"
+	"layout (std430, binding = 3) buffer AliveOut { uint alive_out[]; };			\n"
+	"layout (std430, binding = 4) buffer Scan { uint scan[]; };						\n"
+	"layout (std430, binding = 5) buffer BlockSums { uint block_sums[]; };			\n"
+	"layout (std430, binding = 6) buffer Counters									\n"
+	"{																				\n"
+	"	int free_count;																\n"
+	"	uint alive_count;		// Entries in alive_in								\n"
+	"	uint scan_count;		// alive_count when this frame's compaction started	\n"
+	"	uint block_count;		// Groups of 256 in scan_count						\n"
+	"	uint dispatch_x;		// glDispatchComputeIndirect arguments				\n"
+	"	uint dispatch_y;															\n"
+	"	uint dispatch_z;															\n"
+	"	uint padding;																\n"
+	"	uint draw_count;		// glDrawArraysIndirect arguments					\n"
+	"	uint draw_instance_count;													\n"
+	"	uint draw_first;															\n"
+	"	uint draw_base_instance;													\n"
+	"};																				\n"
+	"																				\n"
+	"// PCG hash, a float in [0, 1) per call										\n"
+	"float random(inout uint state)													\n"
+	"{																				\n"
+	"	state = state * 747796405u + 2891336453u;									\n"
+	"	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;		\n"
+	"	return float((word >> 22u) ^ word) / 4294967296.0;							\n"
+	"}																				\n"
+};
+
+static const GLchar * particle_emit_source[] =
+{
+	"layout (local_size_x = 256) in;												\n"
+	"																				\n"
+	"uniform uint emit_count;														\n"
+	"uniform uint seed;																\n"
+	"uniform vec2 emitter;															\n"
+	"																				\n"
+	"void main(void)																\n"
+	"{																				\n"
+	"	if (gl_GlobalInvocationID.x >= emit_count)									\n"
+	"	{																			\n"
+	"		return;																	\n"
+	"	}																			\n"
+	"																				\n"
+	"	// Pop a free particle, handing the slot back if the list has run dry		\n"
+	"	int slot = atomicAdd(free_count, -1) - 1;									\n"
+	"	if (slot < 0)																\n"
+	"	{																			\n"
+	"		atomicAdd(free_count, 1);												\n"
+	"		return;																	\n"
+	"	}																			\n"
+	"	uint index = free_list[slot];												\n"
+	"																				\n"
+	"	// Somewhere on the triangle, heading off in any direction					\n"
+	"	uint state = gl_GlobalInvocationID.x + seed * 2654435769u;					\n"
+	"	float a = random(state);													\n"
+	"	float b = random(state);													\n"
+	"	if (a + b > 1.0)															\n"
+	"	{																			\n"
+	"		a = 1.0 - a;															\n"
+	"		b = 1.0 - b;															\n"
+	"	}																			\n"
+	"	float angle = random(state) * 6.28318531;									\n"
+	"	float speed = 0.1 + random(state) * 0.4;									\n"
+	"																				\n"
+	"	particles[index].position = emitter + vec2(0.25, -0.25) + a * vec2(-0.5, 0.0) + b * vec2(0.0, 0.5);	\n"
+	"	particles[index].velocity = vec2(cos(angle), sin(angle)) * speed;			\n"
+	"	particles[index].lifetime = 1.0 + random(state) * 2.0;						\n"
+	"	particles[index].life = particles[index].lifetime;							\n"
+	"																				\n"
+	"	alive_in[atomicAdd(alive_count, 1u)] = index;								\n"
+	"}																				\n"
+};
+
+static const GLchar * particle_prepare_source[] =
+{
+	"layout (local_size_x = 1) in;													\n"
+	"																				\n"
+	"// Sizes the indirect dispatches of simulate and compact to the particles alive after emit	\n"
+	"void main(void)																\n"
+	"{																				\n"
+	"	scan_count = alive_count;													\n"
+	"	block_count = (alive_count + 255u) / 256u;									\n"
+	"	dispatch_x = block_count;													\n"
+	"	dispatch_y = 1u;															\n"
+	"	dispatch_z = 1u;															\n"
+	"}																				\n"
+};
+
+static const GLchar * particle_simulate_source[] =
+{
+	"layout (local_size_x = 256) in;												\n"
+	"																				\n"
+	"uniform float dt;																\n"
+	"																				\n"
+	"void main(void)																\n"
+	"{																				\n"
+	"	uint i = gl_GlobalInvocationID.x;											\n"
+	"	if (i >= scan_count)														\n"
+	"	{																			\n"
+	"		return;																	\n"
+	"	}																			\n"
+	"																				\n"
+	"	uint index = alive_in[i];													\n"
+	"	Particle p = particles[index];												\n"
+	"	p.velocity.y -= 0.5 * dt;													\n"
+	"	p.position += p.velocity * dt;												\n"
+	"	p.life -= dt;																\n"
+	"																				\n"
+	"	// Dead particles go straight back on the free list and are flagged for compaction	\n"
+	"	bool alive = p.life > 0.0;													\n"
+	"	if (!alive)																	\n"
+	"	{																			\n"
+	"		p.life = 0.0;															\n"
+	"		free_list[atomicAdd(free_count, 1)] = index;							\n"
+	"	}																			\n"
+	"	particles[index] = p;														\n"
+	"	scan[i] = alive ? 1u : 0u;													\n"
+	"}																				\n"
+};
+
+static const GLchar * particle_scan_blocks_source[] =
+{
+	"layout (local_size_x = 256) in;												\n"
+	"																				\n"
+	"shared uint partial[256];														\n"
+	"																				\n"
+	"// Turns each group's alive flags into an exclusive prefix sum and records the group's total	\n"
+	"void main(void)																\n"
+	"{																				\n"
+	"	uint i = gl_GlobalInvocationID.x;											\n"
+	"	uint local = gl_LocalInvocationID.x;										\n"
+	"	uint flag = i < scan_count ? scan[i] : 0u;									\n"
+	"																				\n"
+	"	partial[local] = flag;														\n"
+	"	barrier();																	\n"
+	"	for (uint offset = 1u; offset < 256u; offset <<= 1)							\n"
+	"	{																			\n"
+	"		uint add = local >= offset ? partial[local - offset] : 0u;				\n"
+	"		barrier();																\n"
+	"		partial[local] += add;													\n"
+	"		barrier();																\n"
+	"	}																			\n"
+	"																				\n"
+	"	if (i < scan_count)															\n"
+	"	{																			\n"
+	"		scan[i] = partial[local] - flag;										\n"
+	"	}																			\n"
+	"	if (local == 255u)															\n"
+	"	{																			\n"
+	"		block_sums[gl_WorkGroupID.x] = partial[255];							\n"
+	"	}																			\n"
+	"}																				\n"
+};
+
+static const GLchar * particle_scan_sums_source[] =
+{
+	"layout (local_size_x = 1024) in;												\n"
+	"																				\n"
+	"shared uint partial[1024];														\n"
+	"																				\n"
+	"// One group turns every block total into that block's start, 16 blocks per invocation,	\n"
+	"// and the grand total becomes the alive count and the draw's vertex count		\n"
+	"void main(void)																\n"
+	"{																				\n"
+	"	uint local = gl_LocalInvocationID.x;										\n"
+	"	uint first = local * 16u;													\n"
+	"	uint last = min(first + 16u, block_count);									\n"
+	"																				\n"
+	"	uint sum = 0u;																\n"
+	"	for (uint b = first; b < last; b++)											\n"
+	"	{																			\n"
+	"		sum += block_sums[b];													\n"
+	"	}																			\n"
+	"	partial[local] = sum;														\n"
+	"	barrier();																	\n"
+	"	for (uint offset = 1u; offset < 1024u; offset <<= 1)						\n"
+	"	{																			\n"
+	"		uint add = local >= offset ? partial[local - offset] : 0u;				\n"
+	"		barrier();																\n"
+	"		partial[local] += add;													\n"
+	"		barrier();																\n"
+	"	}																			\n"
+	"																				\n"
+	"	uint start = partial[local] - sum;											\n"
+	"	for (uint b = first; b < last; b++)											\n"
+	"	{																			\n"
+	"		uint total = block_sums[b];												\n"
+	"		block_sums[b] = start;													\n"
+	"		start += total;															\n"
+	"	}																			\n"
+	"																				\n"
+	"	if (local == 1023u)															\n"
+	"	{																			\n"
+	"		alive_count = partial[1023];											\n"
+	"		draw_count = partial[1023];												\n"
+	"		draw_instance_count = 1u;												\n"
+	"		draw_first = 0u;														\n"
+	"		draw_base_instance = 0u;												\n"
+	"	}																			\n"
+	"}																				\n"
+};
+
+static const GLchar * particle_scatter_source[] =
+{
+	"layout (local_size_x = 256) in;												\n"
+	"																				\n"
+	"// Writes the survivors, in their original order, to the other alive list		\n"
+	"void main(void)																\n"
+	"{																				\n"
+	"	uint i = gl_GlobalInvocationID.x;											\n"
+	"	if (i >= scan_count)														\n"
+	"	{																			\n"
+	"		return;																	\n"
+	"	}																			\n"
+	"																				\n"
+	"	uint index = alive_in[i];													\n"
+	"	if (particles[index].life > 0.0)											\n"
+	"	{																			\n"
+	"		alive_out[block_sums[gl_WorkGroupID.x] + scan[i]] = index;				\n"
+	"	}																			\n"
+	"}																				\n"
+};
+
+// Compiles one particle pass after the shared declarations
+GLuint compile_particle_pass(const GLchar * const * pass_source)
+{
+	const GLchar * sources[] = { particle_common_source[0], pass_source[0] };
+	GLuint compute_shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute_shader, 2, sources, NULL);
+	glCompileShader(compute_shader);
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, compute_shader);
+	glLinkProgram(program);
+	glDeleteShader(compute_shader);
+
+	return program;
+}
+
+// Draws each alive particle as a point, passing its colour on through the same interface block
+GLuint compile_particle_shaders(void)
+{
+	static const GLchar * vertex_shader_source[] =
+	{
+		"#version 450 core																\n"
+		"																				\n"
+		"struct Particle																\n"
+		"{																				\n"
+		"	vec2 position;																\n"
+		"	vec2 velocity;																\n"
+		"	float life;																	\n"
+		"	float lifetime;																\n"
+		"};																				\n"
+		"																				\n"
+		"layout (std430, binding = 0) readonly buffer Particles { Particle particles[]; };	\n"
+		"layout (std430, binding = 2) readonly buffer Alive { uint alive[]; };			\n"
+		"																				\n"
+		"//Declare VS_OUT as an output interface block									\n"
+		"out VS_OUT																		\n"
+		"{																				\n"
+		"	vec4 color; //Send color to next stage										\n"
+		"}vs_out;																		\n"
+		"																				\n"
+		"void main(void)																\n"
+		"{																				\n"
+		"	// One point per entry of the compacted alive list							\n"
+		"	Particle p = particles[alive[gl_VertexID]];									\n"
+		"	gl_Position = vec4(p.position, 0.5, 1.0);									\n"
+		"																				\n"
+		"	// Yellow when emitted, darkening through red as it dies					\n"
+		"	float t = p.life / p.lifetime;												\n"
+		"	vs_out.color = vec4(0.5 + 0.5 * t, t, 0.0, 1.0);							\n"
+		"}																				\n"
+	};
+
+	static const GLchar * fragment_shader_source[] =
+	{
+		"#version 450 core																\n"
+		"																				\n"
+		"in VS_OUT																		\n"
+		"{																				\n"
+		"	vec4 color;																	\n"
+		"}fs_in;																		\n"
+		"																				\n"
+		"out vec4 color;																\n"
+		"																				\n"
+		"void main(void)																\n"
+		"{																				\n"
+		"	color = fs_in.color;														\n"
+		"}																				\n"
+	};
+
+	GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertex_shader, 1, vertex_shader_source, NULL);
+	glCompileShader(vertex_shader);
+	GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragment_shader, 1, fragment_shader_source, NULL);
+	glCompileShader(fragment_shader);
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+	glLinkProgram(program);
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	return program;
+}
+
 class DrawMovingTriangleWInterfaceBlocks : public sb7::application
 {
+	static const int MAX_PARTICLES = 1 << 22;
+	// Buffer per binding of particle_common_source
+	enum ParticleBuffer { PARTICLES, FREE_LIST, ALIVE_IN, ALIVE_OUT, SCAN, BLOCK_SUMS, COUNTERS, BUFFER_COUNT };
+
+	// Mirrors the Counters block, the indirect arguments at the offsets GL expects
+	struct Counters
+	{
+		GLint free_count;
+		GLuint alive_count;
+		GLuint scan_count;
+		GLuint block_count;
+		GLuint dispatch[4];
+		GLuint draw[4];
+	};
+
 public:
 
 	void startup()
@@ -94,13 +449,51 @@ public:
 		rendering_program = compile_shaders();
 		glCreateVertexArrays(1, &vertex_array_object);
 		glBindVertexArray(vertex_array_object);
+
+		particle_program = compile_particle_shaders();
+		emit_program = compile_particle_pass(particle_emit_source);
+		prepare_program = compile_particle_pass(particle_prepare_source);
+		simulate_program = compile_particle_pass(particle_simulate_source);
+		scan_blocks_program = compile_particle_pass(particle_scan_blocks_source);
+		scan_sums_program = compile_particle_pass(particle_scan_sums_source);
+		scatter_program = compile_particle_pass(particle_scatter_source);
+		emit_count_location = glGetUniformLocation(emit_program, "emit_count");
+		seed_location = glGetUniformLocation(emit_program, "seed");
+		emitter_location = glGetUniformLocation(emit_program, "emitter");
+		dt_location = glGetUniformLocation(simulate_program, "dt");
+
+		// Every particle starts free, popped from the end of the list
+		std::vector<GLuint> free_list(MAX_PARTICLES);
+		std::iota(free_list.rbegin(), free_list.rend(), 0u);
+		Counters counters = { MAX_PARTICLES, 0, 0, 0, { 0, 1, 1, 0 }, { 0, 1, 0, 0 } };
+
+		glCreateBuffers(BUFFER_COUNT, buffers);
+		glNamedBufferStorage(buffers[PARTICLES], MAX_PARTICLES * 6 * sizeof(float), NULL, 0);
+		glNamedBufferStorage(buffers[FREE_LIST], MAX_PARTICLES * sizeof(GLuint), free_list.data(), 0);
+		glNamedBufferStorage(buffers[ALIVE_IN], MAX_PARTICLES * sizeof(GLuint), NULL, 0);
+		glNamedBufferStorage(buffers[ALIVE_OUT], MAX_PARTICLES * sizeof(GLuint), NULL, 0);
+		glNamedBufferStorage(buffers[SCAN], MAX_PARTICLES * sizeof(GLuint), NULL, 0);
+		glNamedBufferStorage(buffers[BLOCK_SUMS], MAX_PARTICLES / 256 * sizeof(GLuint), NULL, 0);
+		glNamedBufferStorage(buffers[COUNTERS], sizeof(counters), &counters, 0);
+		glBindBuffersBase(GL_SHADER_STORAGE_BUFFER, 0, BUFFER_COUNT, buffers);
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffers[COUNTERS]);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers[COUNTERS]);
 	}
 
 	void shutdown()
 	{
+		Profiler::PrintSummary();
+
+		glDeleteBuffers(BUFFER_COUNT, buffers);
+		glDeleteProgram(scatter_program);
+		glDeleteProgram(scan_sums_program);
+		glDeleteProgram(scan_blocks_program);
+		glDeleteProgram(simulate_program);
+		glDeleteProgram(prepare_program);
+		glDeleteProgram(emit_program);
+		glDeleteProgram(particle_program);
 		glDeleteVertexArrays(1, &vertex_array_object);
 		glDeleteProgram(rendering_program);
-		glDeleteVertexArrays(1, &vertex_array_object);
 	}
 
 	// Our rendering function
@@ -113,24 +506,122 @@ public:
 
 		glClearBufferfv(GL_COLOR, 0, color);
 
-		// Use program object we created for rendering
-		glUseProgram(rendering_program);
-
 		GLfloat attrib[] = { (float)sin(currentTime) * 0.5f,
 			(float)cos(currentTime) * 0.6f,
 			0.0f, 0.0f };
 
+		update_particles(currentTime, attrib);
+
+		// Use program object we created for rendering
+		glUseProgram(rendering_program);
+
 		// Update value of input attribute 0
 		glVertexAttrib4fv(0, attrib);
 
-		// Draw one triangle	
+		// Draw one triangle
 		glDrawArrays(GL_TRIANGLES, 0, 3);
 	}
 
+	virtual void onKey(int key, int action)
+	{
+		if (action != GLFW_PRESS)
+		{
+			return;
+		}
+
+		switch (key)
+		{
+			// Faster or slower emission, the free list caps the total at MAX_PARTICLES
+			case GLFW_KEY_KP_ADD:
+				emit_rate = std::min(emit_rate * 2.0, (double)MAX_PARTICLES * 8.0);
+				break;
+			case GLFW_KEY_KP_SUBTRACT:
+				emit_rate = std::max(emit_rate * 0.5, 1.0);
+				break;
+		}
+	}
+
 private:
 
+	// Runs the emit, simulate and compact passes, then draws the alive particles
+	void update_particles(double currentTime, const GLfloat* emitter)
+	{
+		float dt = last_time < 0.0 ? 0.0f : (float)std::min(currentTime - last_time, 0.1);
+		last_time = currentTime;
+
+		// Whole particles only, the fraction carries over to the next frame
+		emit_budget = std::min(emit_budget + emit_rate * dt, (double)MAX_PARTICLES);
+		GLuint emit_count = (GLuint)emit_budget;
+		emit_budget -= emit_count;
+
+		{
+			PROFILE("emit");
+			glUseProgram(emit_program);
+			glUniform1ui(emit_count_location, emit_count);
+			glUniform1ui(seed_location, frame++);
+			glUniform2f(emitter_location, emitter[0], emitter[1]);
+			glDispatchCompute((emit_count + 255) / 256, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			glUseProgram(prepare_program);
+			glDispatchCompute(1, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+		}
+
+		{
+			PROFILE("simulate");
+			glUseProgram(simulate_program);
+			glUniform1f(dt_location, dt);
+			glDispatchComputeIndirect(offsetof(Counters, dispatch));
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+
+		{
+			PROFILE("compact");
+			glUseProgram(scan_blocks_program);
+			glDispatchComputeIndirect(offsetof(Counters, dispatch));
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			glUseProgram(scan_sums_program);
+			glDispatchCompute(1, 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			glUseProgram(scatter_program);
+			glDispatchComputeIndirect(offsetof(Counters, dispatch));
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+			// The survivors are next frame's input
+			std::swap(buffers[ALIVE_IN], buffers[ALIVE_OUT]);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ALIVE_IN, buffers[ALIVE_IN]);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ALIVE_OUT, buffers[ALIVE_OUT]);
+		}
+
+		PROFILE("draw particles");
+		glUseProgram(particle_program);
+		glDrawArraysIndirect(GL_POINTS, (const void*)offsetof(Counters, draw));
+	}
+
 	GLuint rendering_program;
 	GLuint vertex_array_object;
+
+	GLuint particle_program;
+	GLuint emit_program;
+	GLuint prepare_program;
+	GLuint simulate_program;
+	GLuint scan_blocks_program;
+	GLuint scan_sums_program;
+	GLuint scatter_program;
+	GLint emit_count_location;
+	GLint seed_location;
+	GLint emitter_location;
+	GLint dt_location;
+	GLuint buffers[BUFFER_COUNT];
+
+	// Particles per second, enough to keep about two million alive
+	double emit_rate = MAX_PARTICLES / 4.0;
+	double emit_budget = 0.0;
+	double last_time = -1.0;
+	GLuint frame = 0;
 };
 
 // Only instance of DECLARE_MAIN to state entry point
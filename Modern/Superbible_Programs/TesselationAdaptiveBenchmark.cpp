@@ -0,0 +1,342 @@
+/**
+	Benchmark of fixed against screen-space adaptive tessellation levels.
+
+	A ground grid of about 100k triangular patches is drawn twice a frame, first with the
+	same level on every edge and then with levels from the projected edge lengths and
+	frustum culling. Each pass is timed with the profiler and counted with a primitives
+	query; the counts print every few seconds and the timings at shutdown.
+	A toggles which pass stays on screen, keypad +/- change the target pixels per edge.
+**/
+
+#include <sb7.h>
+#include <vmath.h>
+#include "sb7headless.h"
+#include "sb7tessellation.h"
+
+#include <vector>
+
+class TesselationAdaptiveBenchmark : public sb7::application
+{
+	// Quads per grid side, two patches each
+	static const int GRID_SIZE = 224;
+	static const int PATCH_COUNT = GRID_SIZE * GRID_SIZE * 2;
+	// Frames between printing the primitive counts
+	static const int REPORT_INTERVAL = 300;
+
+	void init()
+	{
+		static const char title[] = "Adaptive Tessellation Benchmark";
+
+		sb7::application::init();
+
+		memcpy(info.title, title, sizeof(title));
+	}
+
+	virtual void startup()
+	{
+		static const char * vertex_shader_source[] =
+		{
+			"#version 450 core                                                                                              \n"
+			"                                                                                                               \n"
+			"layout (location = 0) in vec4 position;                                                                        \n"
+			"                                                                                                               \n"
+			"uniform mat4 mvp;                                                                                              \n"
+			"                                                                                                               \n"
+			"void main(void)                                                                                                \n"
+			"{                                                                                                              \n"
+			"    gl_Position = mvp * position;                                                                              \n"
+			"}                                                                                                              \n"
+		};
+
+		static const char * tesselation_control_shader_source[] =
+		{
+			"#version 450 core                                                                                              \n"
+			"                                                                                                               \n"
+			"layout (vertices = 3) out;                                                                                     \n"
+			"                                                                                                               \n"
+			"uniform bool adaptive = true;                       // false uses fixed_level everywhere                       \n"
+			"uniform float fixed_level = 8.0;                    // Level for every edge when not adaptive                  \n"
+			"                                                                                                               \n"
+			SB7_ADAPTIVE_LEVELS
+			"void main(void)                                                                                                \n"
+			"{                                                                                                              \n"
+			"    if (gl_InvocationID == 0)                                                                                  \n"
+			"    {                                                                                                          \n"
+			"        vec4 p0 = gl_in[0].gl_Position;                                                                        \n"
+			"        vec4 p1 = gl_in[1].gl_Position;                                                                        \n"
+			"        vec4 p2 = gl_in[2].gl_Position;                                                                        \n"
+			"                                                                                                               \n"
+			"        if (!adaptive)                                                                                         \n"
+			"        {                                                                                                      \n"
+			"            gl_TessLevelInner[0] = fixed_level;                                                                \n"
+			"            gl_TessLevelOuter[0] = fixed_level;                                                                \n"
+			"            gl_TessLevelOuter[1] = fixed_level;                                                                \n"
+			"            gl_TessLevelOuter[2] = fixed_level;                                                                \n"
+			"        }                                                                                                      \n"
+			"        else if (outside_frustum(p0, p1, p2))                                                                  \n"
+			"        {                                                                                                      \n"
+			"            // A zero outer level discards the patch before evaluation                                         \n"
+			"            gl_TessLevelInner[0] = 0.0;                                                                        \n"
+			"            gl_TessLevelOuter[0] = 0.0;                                                                        \n"
+			"            gl_TessLevelOuter[1] = 0.0;                                                                        \n"
+			"            gl_TessLevelOuter[2] = 0.0;                                                                        \n"
+			"        }                                                                                                      \n"
+			"        else                                                                                                   \n"
+			"        {                                                                                                      \n"
+			"            // Each outer level covers the edge opposite the vertex with the same index                        \n"
+			"            gl_TessLevelOuter[0] = edge_level(p1, p2);                                                         \n"
+			"            gl_TessLevelOuter[1] = edge_level(p2, p0);                                                         \n"
+			"            gl_TessLevelOuter[2] = edge_level(p0, p1);                                                         \n"
+			"            gl_TessLevelInner[0] = max(gl_TessLevelOuter[0], max(gl_TessLevelOuter[1], gl_TessLevelOuter[2])); \n"
+			"        }                                                                                                      \n"
+			"    }                                                                                                          \n"
+			"    gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;                                  \n"
+			"}                                                                                                              \n"
+		};
+
+		static const char * tesselation_evaluation_shader_source[] =
+		{
+			"#version 450 core                                                                                              \n"
+			"                                                                                                               \n"
+			"layout (triangles, equal_spacing, cw) in;                                                                      \n"
+			"                                                                                                               \n"
+			"void main(void)                                                                                                \n"
+			"{                                                                                                              \n"
+			"    gl_Position = (gl_TessCoord.x * gl_in[0].gl_Position) +                                                    \n"
+			"                  (gl_TessCoord.y * gl_in[1].gl_Position) +                                                    \n"
+			"                  (gl_TessCoord.z * gl_in[2].gl_Position);                                                     \n"
+			"}                                                                                                              \n"
+		};
+
+		static const char * fragment_shader_source[] =
+		{
+			"#version 450 core                                                                                              \n"
+			"                                                                                                               \n"
+			"out vec4 color;                                                                                                \n"
+			"                                                                                                               \n"
+			"void main(void)                                                                                                \n"
+			"{                                                                                                              \n"
+			"    color = vec4(0.0, 0.8, 1.0, 1.0);                                                                          \n"
+			"}                                                                                                              \n"
+		};
+
+		rendering_program = glCreateProgram();
+
+		// Compile shaders
+		GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vs, 1, vertex_shader_source, NULL);
+		glCompileShader(vs);
+
+		GLuint tcs = glCreateShader(GL_TESS_CONTROL_SHADER);
+		glShaderSource(tcs, 1, tesselation_control_shader_source, NULL);
+		glCompileShader(tcs);
+
+		GLuint tes = glCreateShader(GL_TESS_EVALUATION_SHADER);
+		glShaderSource(tes, 1, tesselation_evaluation_shader_source, NULL);
+		glCompileShader(tes);
+
+		GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(fs, 1, fragment_shader_source, NULL);
+		glCompileShader(fs);
+
+		// Attach shaders to the program
+		glAttachShader(rendering_program, vs);
+		glAttachShader(rendering_program, tcs);
+		glAttachShader(rendering_program, tes);
+		glAttachShader(rendering_program, fs);
+
+		// Link the program
+		glLinkProgram(rendering_program);
+
+		// Delete the shaders
+		glDeleteShader(vs);
+		glDeleteShader(tcs);
+		glDeleteShader(tes);
+		glDeleteShader(fs);
+
+		mvp_location = glGetUniformLocation(rendering_program, "mvp");
+		viewport_size_location = glGetUniformLocation(rendering_program, "viewport_size");
+		pixels_per_edge_location = glGetUniformLocation(rendering_program, "pixels_per_edge");
+		adaptive_location = glGetUniformLocation(rendering_program, "adaptive");
+		fixed_level_location = glGetUniformLocation(rendering_program, "fixed_level");
+
+		// Rolling ground, 200 units across, so the camera sees near and far patches at once
+		std::vector<GLfloat> vertices;
+		vertices.reserve((GRID_SIZE + 1) * (GRID_SIZE + 1) * 4);
+		for (int z = 0; z <= GRID_SIZE; z++)
+		{
+			for (int x = 0; x <= GRID_SIZE; x++)
+			{
+				float px = (x / (float)GRID_SIZE - 0.5f) * 200.0f;
+				float pz = (z / (float)GRID_SIZE - 0.5f) * 200.0f;
+				vertices.push_back(px);
+				vertices.push_back(sinf(px * 0.1f) * cosf(pz * 0.1f) * 4.0f);
+				vertices.push_back(pz);
+				vertices.push_back(1.0f);
+			}
+		}
+
+		// Neighbouring patches index the same vertices, so shared edges get the same level
+		std::vector<GLuint> indices;
+		indices.reserve(PATCH_COUNT * 3);
+		for (int z = 0; z < GRID_SIZE; z++)
+		{
+			for (int x = 0; x < GRID_SIZE; x++)
+			{
+				GLuint i0 = z * (GRID_SIZE + 1) + x;
+				GLuint i1 = i0 + 1;
+				GLuint i2 = i0 + GRID_SIZE + 1;
+				GLuint i3 = i2 + 1;
+				indices.push_back(i0); indices.push_back(i2); indices.push_back(i1);
+				indices.push_back(i1); indices.push_back(i2); indices.push_back(i3);
+			}
+		}
+
+		// Generate vertex arrays
+		glGenVertexArrays(1, &vertex_array_object);
+		glBindVertexArray(vertex_array_object);
+
+		glGenBuffers(2, buffers);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(0);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+		glGenQueries(2, primitive_queries);
+		query_issued[0] = query_issued[1] = false;
+		primitives[0] = primitives[1] = 0;
+		frame_index = 0;
+
+		glPatchParameteri(GL_PATCH_VERTICES, 3);
+		glEnable(GL_DEPTH_TEST);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	}
+
+	virtual void render(double currentTime)
+	{
+		static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
+		static const GLfloat one = 1.0f;
+
+		PROFILE_FRAME();
+
+		// Orbit low over the ground so the view spans close-up and distant patches
+		float t = (float)currentTime * 0.1f;
+		vmath::mat4 proj_matrix = vmath::perspective(60.0f, (float)info.windowWidth / (float)info.windowHeight, 0.1f, 500.0f);
+		vmath::mat4 view_matrix = vmath::lookat(vmath::vec3(sinf(t) * 40.0f, 12.0f, cosf(t) * 40.0f),
+												vmath::vec3(0.0f, 0.0f, 0.0f),
+												vmath::vec3(0.0f, 1.0f, 0.0f));
+
+		glUseProgram(rendering_program);
+		glUniformMatrix4fv(mvp_location, 1, GL_FALSE, proj_matrix * view_matrix);
+		glUniform2f(viewport_size_location, (float)info.windowWidth, (float)info.windowHeight);
+		glUniform1f(pixels_per_edge_location, pixels_per_edge);
+		glUniform1f(fixed_level_location, fixed_level);
+
+		// Pick up last report's counts once the GPU has them, without stalling. A name from
+		// glGenQueries only becomes a query object once begun, so skip it until then
+		for (int pass = 0; pass < 2; pass++)
+		{
+			if (!query_issued[pass])
+			{
+				continue;
+			}
+			GLuint available = 0;
+			glGetQueryObjectuiv(primitive_queries[pass], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				glGetQueryObjectui64v(primitive_queries[pass], GL_QUERY_RESULT, &primitives[pass]);
+			}
+		}
+
+		// The pass drawn second is the one left on screen
+		const int order[2] = { show_adaptive ? 0 : 1, show_adaptive ? 1 : 0 };
+		for (int i = 0; i < 2; i++)
+		{
+			int pass = order[i];
+			bool count = frame_index % REPORT_INTERVAL == 0;
+
+			glClearBufferfv(GL_COLOR, 0, green);
+			glClearBufferfv(GL_DEPTH, 0, &one);
+
+			PROFILE(pass ? "adaptive levels" : "fixed levels");
+			glUniform1i(adaptive_location, pass);
+			if (count)
+			{
+				glBeginQuery(GL_PRIMITIVES_GENERATED, primitive_queries[pass]);
+				query_issued[pass] = true;
+			}
+			glDrawElements(GL_PATCHES, PATCH_COUNT * 3, GL_UNSIGNED_INT, NULL);
+			if (count)
+			{
+				glEndQuery(GL_PRIMITIVES_GENERATED);
+			}
+		}
+
+		if (frame_index % REPORT_INTERVAL == 0 && frame_index > 0)
+		{
+			printf("%d patches: fixed level %.0f -> %llu triangles, adaptive at %.0f px/edge -> %llu triangles\n",
+				   PATCH_COUNT, fixed_level, (unsigned long long)primitives[0],
+				   pixels_per_edge, (unsigned long long)primitives[1]);
+		}
+		frame_index++;
+	}
+
+	virtual void onKey(int key, int action)
+	{
+		if (action != GLFW_PRESS)
+		{
+			return;
+		}
+
+		switch (key)
+		{
+			// Show the adaptive or the fixed pass
+			case 'A':
+				show_adaptive = !show_adaptive;
+				break;
+			// Finer or coarser adaptive tessellation
+			case GLFW_KEY_KP_ADD:
+				pixels_per_edge = fmaxf(pixels_per_edge * 0.5f, 1.0f);
+				break;
+			case GLFW_KEY_KP_SUBTRACT:
+				pixels_per_edge = fminf(pixels_per_edge * 2.0f, 256.0f);
+				break;
+		}
+	}
+
+	virtual void shutdown()
+	{
+		Profiler::PrintSummary();
+
+		glDeleteQueries(2, primitive_queries);
+		glDeleteBuffers(2, buffers);
+		glDeleteVertexArrays(1, &vertex_array_object);
+		glDeleteProgram(rendering_program);
+	}
+
+private:
+
+	GLuint rendering_program;
+	GLuint vertex_array_object;
+	GLuint buffers[2];
+	GLuint primitive_queries[2];
+	bool query_issued[2]; // Begun at least once, so the name is a query object
+	GLuint64 primitives[2];
+	int frame_index;
+
+	GLint mvp_location;
+	GLint viewport_size_location;
+	GLint pixels_per_edge_location;
+	GLint adaptive_location;
+	GLint fixed_level_location;
+
+	float pixels_per_edge = 16.0f;
+	float fixed_level = 8.0f;
+	bool show_adaptive = true;
+};
+
+// Declare entry point
+DECLARE_MAIN(TesselationAdaptiveBenchmark)
@@ -1,8 +1,15 @@
 /**
 	Program to draw the vertices of a tesselated triangle
+
+	Two paths give the same points. The geometry shader path re-emits every tessellated
+	triangle's vertices as points. The compute path generates the distinct vertices of the
+	same pattern into a buffer, counts them into an indirect draw command, and draws that as
+	plain points, with no tessellation or geometry stage. C switches between them.
 **/
 
 #include <sb7.h>
+#include "sb7headless.h"
+#include "sb7tessellation.h"
 
 class TesselatedTriangleVertices : public sb7::application
 {
@@ -33,21 +40,47 @@ class TesselatedTriangleVertices : public sb7::application
 
 		static const char * tesselation_control_shader_source[] =
 		{
-			"#version 450 core                                                                 \n"
-			"                                                                                  \n"
-			"layout (vertices = 3) out;                                                        \n"
-			"                                                                                  \n"
-			"void main(void)                                                                   \n"
-			"{                                                                                 \n"
-			"    if (gl_InvocationID == 0)                                                     \n"
-			"    {                                                                             \n"
-			"        gl_TessLevelInner[0] = 5.0;                                               \n"
-			"        gl_TessLevelOuter[0] = 5.0;                                               \n"
-			"        gl_TessLevelOuter[1] = 5.0;                                               \n"
-			"        gl_TessLevelOuter[2] = 5.0;                                               \n"
-			"    }                                                                             \n"
-			"    gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;     \n"
-			"}                                                                                 \n"
+			"#version 450 core                                                                                              \n"
+			"                                                                                                               \n"
+			"layout (vertices = 3) out;                                                                                     \n"
+			"                                                                                                               \n"
+			"uniform bool adaptive = true;                       // false keeps every level at 5                            \n"
+			"                                                                                                               \n"
+			SB7_ADAPTIVE_LEVELS
+			"void main(void)                                                                                                \n"
+			"{                                                                                                              \n"
+			"    if (gl_InvocationID == 0)                                                                                  \n"
+			"    {                                                                                                          \n"
+			"        vec4 p0 = gl_in[0].gl_Position;                                                                        \n"
+			"        vec4 p1 = gl_in[1].gl_Position;                                                                        \n"
+			"        vec4 p2 = gl_in[2].gl_Position;                                                                        \n"
+			"                                                                                                               \n"
+			"        if (!adaptive)                                                                                         \n"
+			"        {                                                                                                      \n"
+			"            gl_TessLevelInner[0] = 5.0;                                                                        \n"
+			"            gl_TessLevelOuter[0] = 5.0;                                                                        \n"
+			"            gl_TessLevelOuter[1] = 5.0;                                                                        \n"
+			"            gl_TessLevelOuter[2] = 5.0;                                                                        \n"
+			"        }                                                                                                      \n"
+			"        else if (outside_frustum(p0, p1, p2))                                                                  \n"
+			"        {                                                                                                      \n"
+			"            // A zero outer level discards the patch before evaluation                                         \n"
+			"            gl_TessLevelInner[0] = 0.0;                                                                        \n"
+			"            gl_TessLevelOuter[0] = 0.0;                                                                        \n"
+			"            gl_TessLevelOuter[1] = 0.0;                                                                        \n"
+			"            gl_TessLevelOuter[2] = 0.0;                                                                        \n"
+			"        }                                                                                                      \n"
+			"        else                                                                                                   \n"
+			"        {                                                                                                      \n"
+			"            // Each outer level covers the edge opposite the vertex with the same index                        \n"
+			"            gl_TessLevelOuter[0] = edge_level(p1, p2);                                                         \n"
+			"            gl_TessLevelOuter[1] = edge_level(p2, p0);                                                         \n"
+			"            gl_TessLevelOuter[2] = edge_level(p0, p1);                                                         \n"
+			"            gl_TessLevelInner[0] = max(gl_TessLevelOuter[0], max(gl_TessLevelOuter[1], gl_TessLevelOuter[2])); \n"
+			"        }                                                                                                      \n"
+			"    }                                                                                                          \n"
+			"    gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;                                  \n"
+			"}                                                                                                              \n"
 		};
 
 		static const char * tesselation_evaluation_shader_source[] =
@@ -95,6 +128,8 @@ class TesselatedTriangleVertices : public sb7::application
 			"}                                                                 \n"
 		};
 
+		// Builds the tessellated vertices for the compute path
+		// Draws the compute path's points straight from its buffer
 		rendering_program = glCreateProgram();
 
 		// Compile shaders
@@ -128,6 +163,11 @@ class TesselatedTriangleVertices : public sb7::application
 		// Link the program
 		glLinkProgram(rendering_program);
 
+		// Look up the tessellation controls
+		viewport_size_location = glGetUniformLocation(rendering_program, "viewport_size");
+		pixels_per_edge_location = glGetUniformLocation(rendering_program, "pixels_per_edge");
+		adaptive_location = glGetUniformLocation(rendering_program, "adaptive");
+
 		// Delete the shaders
 		glDeleteShader(vs);
 		glDeleteShader(tcs);
@@ -135,6 +175,19 @@ class TesselatedTriangleVertices : public sb7::application
 		glDeleteShader(gs);
 		glDeleteShader(fs);
 
+		// The patch the vertex shader hardcodes, for the compute path to read
+		static const GLfloat patch_corners[] =
+		{
+			 0.25f, -0.25f, 0.5f, 1.0f,
+			-0.25f, -0.25f, 0.5f, 1.0f,
+			 0.25f,  0.25f, 0.5f, 1.0f
+		};
+
+		points.create(patch_corners, 1, fragment_shader_source);
+		compute_viewport_size_location = glGetUniformLocation(points.compute_program, "viewport_size");
+		compute_pixels_per_edge_location = glGetUniformLocation(points.compute_program, "pixels_per_edge");
+		compute_adaptive_location = glGetUniformLocation(points.compute_program, "adaptive");
+
 		// Generate vertex arrays
 		glGenVertexArrays(1, &vertex_array_object);
 		glBindVertexArray(vertex_array_object);
@@ -145,15 +198,57 @@ class TesselatedTriangleVertices : public sb7::application
 		static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
 		glClearBufferfv(GL_COLOR, 0, green);
 
+		glPointSize(5.0f);
+
+		if (use_compute)
+		{
+			glProgramUniform2f(points.compute_program, compute_viewport_size_location, (float)info.windowWidth, (float)info.windowHeight);
+			glProgramUniform1f(points.compute_program, compute_pixels_per_edge_location, pixels_per_edge);
+			glProgramUniform1i(points.compute_program, compute_adaptive_location, adaptive ? 1 : 0);
+			points.draw();
+			return;
+		}
+
 		glUseProgram(rendering_program);
 
-		glPointSize(5.0f);
+		// Levels follow the projected edge lengths unless adaptive mode is off
+		glUniform2f(viewport_size_location, (float)info.windowWidth, (float)info.windowHeight);
+		glUniform1f(pixels_per_edge_location, pixels_per_edge);
+		glUniform1i(adaptive_location, adaptive ? 1 : 0);
 
 		glDrawArrays(GL_PATCHES, 0, 3);
 	}
 
+	virtual void onKey(int key, int action)
+	{
+		if (action != GLFW_PRESS)
+		{
+			return;
+		}
+
+		switch (key)
+		{
+			// Toggle between the geometry shader and the compute path
+			case 'C':
+				use_compute = !use_compute;
+				break;
+			// Toggle between adaptive and fixed levels
+			case 'A':
+				adaptive = !adaptive;
+				break;
+			// Finer or coarser tessellation
+			case GLFW_KEY_KP_ADD:
+				pixels_per_edge = fmaxf(pixels_per_edge * 0.5f, 1.0f);
+				break;
+			case GLFW_KEY_KP_SUBTRACT:
+				pixels_per_edge = fminf(pixels_per_edge * 2.0f, 256.0f);
+				break;
+		}
+	}
+
 	virtual void shutdown()
 	{
+		points.destroy();
 		glDeleteVertexArrays(1, &vertex_array_object);
 		glDeleteProgram(rendering_program);
 	}
@@ -161,7 +256,19 @@ class TesselatedTriangleVertices : public sb7::application
 private:
 
 	GLuint rendering_program;
+	sb7::tess_points points;
 	GLuint vertex_array_object;
+
+	GLint viewport_size_location;
+	GLint pixels_per_edge_location;
+	GLint adaptive_location;
+	GLint compute_viewport_size_location;
+	GLint compute_pixels_per_edge_location;
+	GLint compute_adaptive_location;
+
+	float pixels_per_edge = 16.0f;
+	bool adaptive = true;
+	bool use_compute = false;
 };
 
 // Declare entry point
@@ -1,7 +1,15 @@
 /**
 		Program to draw a triangle with tesselation.
+
+		The patch does not move, so by default it is tessellated once and the output captured
+		with transform feedback; later frames draw the captured triangles with
+		glDrawTransformFeedback and only tessellate again when the levels change. Every
+		REFERENCE_INTERVAL frames the patch is tessellated anyway to keep a live timing to compare
+		with. R toggles between capturing and tessellating every frame.
 **/
 #include <sb7.h>
+#include "sb7headless.h"
+#include "sb7tessellation.h"
 
 class TesselatedTriangle : public sb7::application
 {
@@ -32,21 +40,47 @@ class TesselatedTriangle : public sb7::application
 
 		static const char * tesselation_control_shader_source[] =
 		{
-			"#version 450 core                                                                 \n"
-			"                                                                                  \n"
-			"layout (vertices = 3) out;                                                        \n"
-			"                                                                                  \n"
-			"void main(void)                                                                   \n"
-			"{                                                                                 \n"
-			"    if (gl_InvocationID == 0)                                                     \n"
-			"    {                                                                             \n"
-			"        gl_TessLevelInner[0] = 5.0;                                               \n"
-			"        gl_TessLevelOuter[0] = 5.0;                                               \n"
-			"        gl_TessLevelOuter[1] = 5.0;                                               \n"
-			"        gl_TessLevelOuter[2] = 5.0;                                               \n"
-			"    }                                                                             \n"
-			"    gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;     \n"
-			"}                                                                                 \n"
+			"#version 450 core                                                                                              \n"
+			"                                                                                                               \n"
+			"layout (vertices = 3) out;                                                                                     \n"
+			"                                                                                                               \n"
+			"uniform bool adaptive = true;                       // false keeps every level at 5                            \n"
+			"                                                                                                               \n"
+			SB7_ADAPTIVE_LEVELS
+			"void main(void)                                                                                                \n"
+			"{                                                                                                              \n"
+			"    if (gl_InvocationID == 0)                                                                                  \n"
+			"    {                                                                                                          \n"
+			"        vec4 p0 = gl_in[0].gl_Position;                                                                        \n"
+			"        vec4 p1 = gl_in[1].gl_Position;                                                                        \n"
+			"        vec4 p2 = gl_in[2].gl_Position;                                                                        \n"
+			"                                                                                                               \n"
+			"        if (!adaptive)                                                                                         \n"
+			"        {                                                                                                      \n"
+			"            gl_TessLevelInner[0] = 5.0;                                                                        \n"
+			"            gl_TessLevelOuter[0] = 5.0;                                                                        \n"
+			"            gl_TessLevelOuter[1] = 5.0;                                                                        \n"
+			"            gl_TessLevelOuter[2] = 5.0;                                                                        \n"
+			"        }                                                                                                      \n"
+			"        else if (outside_frustum(p0, p1, p2))                                                                  \n"
+			"        {                                                                                                      \n"
+			"            // A zero outer level discards the patch before evaluation                                         \n"
+			"            gl_TessLevelInner[0] = 0.0;                                                                        \n"
+			"            gl_TessLevelOuter[0] = 0.0;                                                                        \n"
+			"            gl_TessLevelOuter[1] = 0.0;                                                                        \n"
+			"            gl_TessLevelOuter[2] = 0.0;                                                                        \n"
+			"        }                                                                                                      \n"
+			"        else                                                                                                   \n"
+			"        {                                                                                                      \n"
+			"            // Each outer level covers the edge opposite the vertex with the same index                        \n"
+			"            gl_TessLevelOuter[0] = edge_level(p1, p2);                                                         \n"
+			"            gl_TessLevelOuter[1] = edge_level(p2, p0);                                                         \n"
+			"            gl_TessLevelOuter[2] = edge_level(p0, p1);                                                         \n"
+			"            gl_TessLevelInner[0] = max(gl_TessLevelOuter[0], max(gl_TessLevelOuter[1], gl_TessLevelOuter[2])); \n"
+			"        }                                                                                                      \n"
+			"    }                                                                                                          \n"
+			"    gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;                                  \n"
+			"}                                                                                                              \n"
 		};
 
 		static const char * tesselation_evaluation_shader_source[] =
@@ -63,6 +97,19 @@ class TesselatedTriangle : public sb7::application
 			"}                                                                                 \n"
 		};
 
+		// Draws the captured triangles, already in clip space
+		static const char * replay_vertex_shader_source[] =
+		{
+			"#version 450 core                                                 \n"
+			"                                                                  \n"
+			"layout (location = 0) in vec4 position;                           \n"
+			"                                                                  \n"
+			"void main(void)                                                   \n"
+			"{                                                                 \n"
+			"    gl_Position = position;                                       \n"
+			"}                                                                 \n"
+		};
+
 		static const char * fragment_shader_source[] =
 		{
 			"#version 450 core                                                 \n"
@@ -100,13 +147,55 @@ class TesselatedTriangle : public sb7::application
 		glAttachShader(rendering_program, tes);
 		glAttachShader(rendering_program, fs);
 
+		// Capture what the evaluation shader outputs whenever transform feedback is active
+		static const char * captured_varyings[] = { "gl_Position" };
+		glTransformFeedbackVaryings(rendering_program, 1, captured_varyings, GL_INTERLEAVED_ATTRIBS);
+
 		// Link the program
 		glLinkProgram(rendering_program);
 
+		// Look up the tessellation controls
+		viewport_size_location = glGetUniformLocation(rendering_program, "viewport_size");
+		pixels_per_edge_location = glGetUniformLocation(rendering_program, "pixels_per_edge");
+		adaptive_location = glGetUniformLocation(rendering_program, "adaptive");
+
+		replay_program = glCreateProgram();
+		GLuint replay_vs = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(replay_vs, 1, replay_vertex_shader_source, NULL);
+		glCompileShader(replay_vs);
+		glAttachShader(replay_program, replay_vs);
+		glAttachShader(replay_program, fs);
+		glLinkProgram(replay_program);
+
+		glDeleteShader(vs);
+		glDeleteShader(tcs);
+		glDeleteShader(tes);
+		glDeleteShader(fs);
+		glDeleteShader(replay_vs);
+
 		// Generate vertex arrays
 		glGenVertexArrays(1, &vertex_array_object);
 		glBindVertexArray(vertex_array_object);
 
+		// The transform feedback object remembers how many vertices were captured, so the
+		// replay never needs to read the count back
+		glGenBuffers(1, &capture_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, capture_buffer);
+		glBufferData(GL_ARRAY_BUFFER, MAX_CAPTURED_TRIANGLES * 3 * 4 * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+
+		glGenTransformFeedbacks(1, &capture_feedback);
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, capture_feedback);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, capture_buffer);
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+
+		glGenVertexArrays(1, &replay_vao);
+		glBindVertexArray(replay_vao);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(0);
+
+		captured = false;
+		frame_index = 0;
+
 		// Declare the drawing mode for the polygons
 		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	}
@@ -115,26 +204,131 @@ class TesselatedTriangle : public sb7::application
 	{
 		static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
 
+		PROFILE_FRAME();
+
 		glClearBufferfv(GL_COLOR, 0, green);
 
+		// Everything the levels depend on; the control points are constants in the vertex shader
+		const CaptureState state = { info.windowWidth, info.windowHeight, pixels_per_edge, adaptive };
+		bool reference = frame_index++ % REFERENCE_INTERVAL == 0;
+
+		if (retained && captured && !reference && state == captured_state)
+		{
+			PROFILE("replay");
+			glUseProgram(replay_program);
+			glBindVertexArray(replay_vao);
+			glDrawTransformFeedback(GL_TRIANGLES, capture_feedback);
+			return;
+		}
+
 		glUseProgram(rendering_program);
+		glBindVertexArray(vertex_array_object);
+
+		// Levels follow the projected edge lengths unless adaptive mode is off
+		glUniform2f(viewport_size_location, (float)info.windowWidth, (float)info.windowHeight);
+		glUniform1f(pixels_per_edge_location, pixels_per_edge);
+		glUniform1i(adaptive_location, adaptive ? 1 : 0);
 
+		if (!retained || (captured && state == captured_state))
+		{
+			PROFILE("tessellate");
+			glDrawArrays(GL_PATCHES, 0, 3);
+			return;
+		}
+
+		// Draw and capture in the same pass
+		PROFILE("capture");
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, capture_feedback);
+		glBeginTransformFeedback(GL_TRIANGLES);
 		glDrawArrays(GL_PATCHES, 0, 3);
+		glEndTransformFeedback();
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+		captured_state = state;
+		captured = true;
+	}
+
+	virtual void onKey(int key, int action)
+	{
+		if (action != GLFW_PRESS)
+		{
+			return;
+		}
+
+		switch (key)
+		{
+			// Toggle between capturing once and tessellating every frame
+			case 'R':
+				retained = !retained;
+				break;
+			// Toggle between adaptive and fixed levels
+			case 'A':
+				adaptive = !adaptive;
+				break;
+			// Finer or coarser tessellation
+			case GLFW_KEY_KP_ADD:
+				pixels_per_edge = fmaxf(pixels_per_edge * 0.5f, 1.0f);
+				break;
+			case GLFW_KEY_KP_SUBTRACT:
+				pixels_per_edge = fminf(pixels_per_edge * 2.0f, 256.0f);
+				break;
+		}
 	}
 
 	virtual void shutdown()
 	{
+		// Compare "replay" with "tessellate" for the time saved per frame
+		Profiler::PrintSummary();
+
+		glDeleteTransformFeedbacks(1, &capture_feedback);
+		glDeleteBuffers(1, &capture_buffer);
+		glDeleteVertexArrays(1, &replay_vao);
 		glDeleteVertexArrays(1, &vertex_array_object);
 
+		glDeleteProgram(replay_program);
 		glDeleteProgram(rendering_program);
 	}
 
 
 private:
 
+	// Triangles of one patch with every level at 64
+	static const int MAX_CAPTURED_TRIANGLES = 6144;
+	// Frames between live tessellations kept for timing while replaying
+	static const int REFERENCE_INTERVAL = 60;
+
+	struct CaptureState
+	{
+		int             width;
+		int             height;
+		float           pixels_per_edge;
+		bool            adaptive;
+
+		bool operator==(const CaptureState & other) const
+		{
+			return width == other.width && height == other.height &&
+				   pixels_per_edge == other.pixels_per_edge && adaptive == other.adaptive;
+		}
+	};
+
 	GLuint          rendering_program;
 	GLuint          vertex_array_object;
 
+	GLuint          replay_program;
+	GLuint          replay_vao;
+	GLuint          capture_buffer;
+	GLuint          capture_feedback;
+	CaptureState    captured_state;
+	bool            captured;
+	bool            retained = true;
+	int             frame_index;
+
+	GLint           viewport_size_location;
+	GLint           pixels_per_edge_location;
+	GLint           adaptive_location;
+
+	float           pixels_per_edge = 16.0f;
+	bool            adaptive = true;
+
 };
 
 // One and only instance of DECLARE_MAIN
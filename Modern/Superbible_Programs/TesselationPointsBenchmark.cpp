@@ -0,0 +1,228 @@
+/**
+	Benchmark of the two ways to draw a tessellated patch's vertices as points.
+
+	A grid of patches is drawn twice a frame at the same level: once through tessellation and a
+	geometry shader that re-emits every triangle's vertices as points, and once by a compute
+	shader that writes the distinct vertices and an indirect draw command. The level doubles
+	from 1 to 64, FRAMES_PER_LEVEL frames each; every level and path has its own profiler
+	scope, and the timings print at shutdown.
+**/
+
+#include <sb7.h>
+#include "sb7headless.h"
+#include "sb7tessellation.h"
+
+#include <vector>
+
+class TesselationPointsBenchmark : public sb7::application
+{
+	// Quads per grid side, two patches each
+	static const int GRID_SIZE = 16;
+	static const int PATCH_COUNT = GRID_SIZE * GRID_SIZE * 2;
+	static const int LEVEL_COUNT = 7;
+	static const int FRAMES_PER_LEVEL = 60;
+
+	void init()
+	{
+		static const char title[] = "Geometry Shader vs Compute Points";
+
+		sb7::application::init();
+
+		memcpy(info.title, title, sizeof(title));
+	}
+
+	virtual void startup()
+	{
+		static const char * vertex_shader_source[] =
+		{
+			"#version 450 core                                                                 \n"
+			"                                                                                  \n"
+			"layout (location = 0) in vec4 position;                                           \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    gl_Position = position;                                                       \n"
+			"}                                                                                 \n"
+		};
+
+		static const char * tesselation_control_shader_source[] =
+		{
+			"#version 450 core                                                                 \n"
+			"                                                                                  \n"
+			"layout (vertices = 3) out;                                                        \n"
+			"                                                                                  \n"
+			"uniform float level;                                                              \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    if (gl_InvocationID == 0)                                                     \n"
+			"    {                                                                             \n"
+			"        gl_TessLevelInner[0] = level;                                             \n"
+			"        gl_TessLevelOuter[0] = level;                                             \n"
+			"        gl_TessLevelOuter[1] = level;                                             \n"
+			"        gl_TessLevelOuter[2] = level;                                             \n"
+			"    }                                                                             \n"
+			"    gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;     \n"
+			"}                                                                                 \n"
+		};
+
+		static const char * tesselation_evaluation_shader_source[] =
+		{
+			"#version 450 core                                                                 \n"
+			"                                                                                  \n"
+			"layout (triangles, equal_spacing, cw) in;                                         \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    gl_Position = (gl_TessCoord.x * gl_in[0].gl_Position) +                       \n"
+			"                  (gl_TessCoord.y * gl_in[1].gl_Position) +                       \n"
+			"                  (gl_TessCoord.z * gl_in[2].gl_Position);                        \n"
+			"}                                                                                 \n"
+		};
+
+		static const char * geometry_shader_source[] =
+		{
+			"#version 450 core                                                                  \n"
+			"                                                                                   \n"
+			"layout (triangles) in;                                                             \n"
+			"layout (points, max_vertices = 3) out;                                             \n"
+			"                                                                                   \n"
+			"void main(void)                                                                    \n"
+			"{                                                                                  \n"
+			"    int i;                                                                         \n"
+			"                                                                                   \n"
+			"    for (i = 0; i < gl_in.length(); i++)                                           \n"
+			"    {                                                                              \n"
+			"        gl_Position = gl_in[i].gl_Position;                                        \n"
+			"        EmitVertex();                                                              \n"
+			"    }                                                                              \n"
+			"}                                                                                  \n"
+		};
+
+		static const char * fragment_shader_source[] =
+		{
+			"#version 450 core                                                 \n"
+			"                                                                  \n"
+			"out vec4 color;                                                   \n"
+			"                                                                  \n"
+			"void main(void)                                                   \n"
+			"{                                                                 \n"
+			"    color = vec4(0.0, 0.8, 1.0, 1.0);                             \n"
+			"}                                                                 \n"
+		};
+
+		// Geometry shader path
+		geometry_program = glCreateProgram();
+		attach_shader(geometry_program, GL_VERTEX_SHADER, vertex_shader_source);
+		attach_shader(geometry_program, GL_TESS_CONTROL_SHADER, tesselation_control_shader_source);
+		attach_shader(geometry_program, GL_TESS_EVALUATION_SHADER, tesselation_evaluation_shader_source);
+		attach_shader(geometry_program, GL_GEOMETRY_SHADER, geometry_shader_source);
+		attach_shader(geometry_program, GL_FRAGMENT_SHADER, fragment_shader_source);
+		glLinkProgram(geometry_program);
+		level_location = glGetUniformLocation(geometry_program, "level");
+
+		// Small triangles across the screen, so the points do not pile up on a few pixels
+		std::vector<GLfloat> corners;
+		corners.reserve(PATCH_COUNT * 3 * 4);
+		const float cell = 1.8f / GRID_SIZE;
+		for (int y = 0; y < GRID_SIZE; y++)
+		{
+			for (int x = 0; x < GRID_SIZE; x++)
+			{
+				float x0 = -0.9f + x * cell, y0 = -0.9f + y * cell;
+				float x1 = x0 + cell, y1 = y0 + cell;
+				const float quad[6][2] = { { x0, y0 }, { x0, y1 }, { x1, y0 }, { x1, y0 }, { x0, y1 }, { x1, y1 } };
+				for (int i = 0; i < 6; i++)
+				{
+					corners.push_back(quad[i][0]);
+					corners.push_back(quad[i][1]);
+					corners.push_back(0.5f);
+					corners.push_back(1.0f);
+				}
+			}
+		}
+
+		// Compute path, with the levels fixed like the control shader's
+		points.create(corners.data(), PATCH_COUNT, fragment_shader_source);
+		compute_level_location = glGetUniformLocation(points.compute_program, "fixed_level");
+		glProgramUniform1i(points.compute_program, glGetUniformLocation(points.compute_program, "adaptive"), 0);
+
+		// The corners are both the patch vertices and the compute shader's input
+		glGenVertexArrays(1, &vertex_array_object);
+		glBindVertexArray(vertex_array_object);
+		glBindBuffer(GL_ARRAY_BUFFER, points.buffers[0]);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(0);
+
+		glPatchParameteri(GL_PATCH_VERTICES, 3);
+		glPointSize(2.0f);
+		frame_index = 0;
+	}
+
+	virtual void render(double currentTime)
+	{
+		static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
+		// Scope names must outlive the profiler, so they are literals, one per level and path
+		static const char * const geometry_names[LEVEL_COUNT] =
+		{
+			"level 01 geometry", "level 02 geometry", "level 04 geometry", "level 08 geometry",
+			"level 16 geometry", "level 32 geometry", "level 64 geometry"
+		};
+		static const char * const compute_names[LEVEL_COUNT] =
+		{
+			"level 01 compute", "level 02 compute", "level 04 compute", "level 08 compute",
+			"level 16 compute", "level 32 compute", "level 64 compute"
+		};
+
+		PROFILE_FRAME();
+
+		int step = (frame_index++ / FRAMES_PER_LEVEL) % LEVEL_COUNT;
+		float level = (float)(1 << step);
+
+		glClearBufferfv(GL_COLOR, 0, green);
+		{
+			PROFILE(geometry_names[step]);
+			glUseProgram(geometry_program);
+			glUniform1f(level_location, level);
+			glDrawArrays(GL_PATCHES, 0, PATCH_COUNT * 3);
+		}
+
+		glClearBufferfv(GL_COLOR, 0, green);
+		{
+			PROFILE(compute_names[step]);
+			glProgramUniform1f(points.compute_program, compute_level_location, level);
+			points.draw();
+		}
+	}
+
+	virtual void shutdown()
+	{
+		Profiler::PrintSummary();
+
+		points.destroy();
+		glDeleteVertexArrays(1, &vertex_array_object);
+		glDeleteProgram(geometry_program);
+	}
+
+private:
+
+	static void attach_shader(GLuint program, GLenum type, const char * const * source)
+	{
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, source, NULL);
+		glCompileShader(shader);
+		glAttachShader(program, shader);
+		glDeleteShader(shader);
+	}
+
+	GLuint geometry_program;
+	sb7::tess_points points;
+	GLuint vertex_array_object;
+
+	GLint level_location;
+	GLint compute_level_location;
+	int frame_index;
+};
+
+// Declare entry point
+DECLARE_MAIN(TesselationPointsBenchmark)
@@ -0,0 +1,531 @@
+/**
+	Checks the CPU tessellator against the GPU and draws its patterns without tessellation shaders.
+
+	At startup every domain and spacing is run through the GPU's primitive generator with
+	transform feedback capturing gl_TessCoord, and compared with ../Common/Tessellator.h:
+	same primitive count, same vertices, same winding. The SIMD and scalar evaluation paths
+	are checked and timed as well.
+	The left half then draws four patches with tessellation shaders and the right half the same
+	patches as instances of one cached pattern, the fallback for hardware without tessellation.
+	S cycles the spacing.
+**/
+
+#include <sb7.h>
+#include "sb7headless.h"
+
+#define TESSELLATOR_IMPLEMENTATION
+#include "../Common/Tessellator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+class TesselationReference : public sb7::application
+{
+	static const int PATCH_COUNT = 4;
+	// Room for the largest captured pattern, quads at level 64
+	static const GLsizeiptr CAPTURE_BYTES = 1 << 20;
+
+	void init()
+	{
+		static const char title[] = "Tessellation Reference";
+
+		sb7::application::init();
+
+		memcpy(info.title, title, sizeof(title));
+	}
+
+	virtual void startup()
+	{
+		static const char * fallback_vertex_shader_source[] =
+		{
+			"#version 450 core                                                                 \n"
+			"                                                                                  \n"
+			"layout (location = 0) in vec3 tess_coord;      // One vertex of the cached pattern\n"
+			"layout (location = 1) in vec4 corner0;         // Patch corners, one set per instance\n"
+			"layout (location = 2) in vec4 corner1;                                            \n"
+			"layout (location = 3) in vec4 corner2;                                            \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    gl_Position = (tess_coord.x * corner0) +                                      \n"
+			"                  (tess_coord.y * corner1) +                                      \n"
+			"                  (tess_coord.z * corner2);                                       \n"
+			"}                                                                                 \n"
+		};
+
+		static const char * vertex_shader_source[] =
+		{
+			"#version 450 core                                                                 \n"
+			"                                                                                  \n"
+			"layout (location = 1) in vec4 position;                                           \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    gl_Position = position;                                                       \n"
+			"}                                                                                 \n"
+		};
+
+		static const char * tesselation_control_shader_source[] =
+		{
+			"#version 450 core                                                                 \n"
+			"                                                                                  \n"
+			"layout (vertices = 3) out;                                                        \n"
+			"                                                                                  \n"
+			"uniform float level;                                                              \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    if (gl_InvocationID == 0)                                                     \n"
+			"    {                                                                             \n"
+			"        gl_TessLevelInner[0] = level;                                             \n"
+			"        gl_TessLevelOuter[0] = level;                                             \n"
+			"        gl_TessLevelOuter[1] = level;                                             \n"
+			"        gl_TessLevelOuter[2] = level;                                             \n"
+			"    }                                                                             \n"
+			"    gl_out[gl_InvocationID].gl_Position = gl_in[gl_InvocationID].gl_Position;     \n"
+			"}                                                                                 \n"
+		};
+
+		// Follows one of the layout lines below
+		static const char * tesselation_evaluation_shader_body[] =
+		{
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    gl_Position = (gl_TessCoord.x * gl_in[0].gl_Position) +                       \n"
+			"                  (gl_TessCoord.y * gl_in[1].gl_Position) +                       \n"
+			"                  (gl_TessCoord.z * gl_in[2].gl_Position);                        \n"
+			"}                                                                                 \n"
+		};
+
+		static const char * fragment_shader_source[] =
+		{
+			"#version 450 core                                                                 \n"
+			"                                                                                  \n"
+			"out vec4 color;                                                                   \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    color = vec4(0.0, 0.8, 1.0, 1.0);                                             \n"
+			"}                                                                                 \n"
+		};
+
+		fallback_program = link_program(fallback_vertex_shader_source[0], NULL, NULL, fragment_shader_source[0]);
+		for (int spacing = 0; spacing < 3; spacing++)
+		{
+			std::string tes = tes_layout("triangles", spacing) + tesselation_evaluation_shader_body[0];
+			rendering_programs[spacing] = link_program(vertex_shader_source[0], tesselation_control_shader_source[0],
+													   tes.c_str(), fragment_shader_source[0]);
+			level_locations[spacing] = glGetUniformLocation(rendering_programs[spacing], "level");
+		}
+
+		// Four triangles in a square, shared by both paths: patch vertices for the
+		// tessellation shaders, per-instance corners for the fallback
+		static const GLfloat corners[PATCH_COUNT][3][4] =
+		{
+			{ { -0.9f, -0.9f, 0.5f, 1.0f }, { -0.9f,  0.9f, 0.5f, 1.0f }, {  0.9f, -0.9f, 0.5f, 1.0f } },
+			{ {  0.9f, -0.9f, 0.5f, 1.0f }, { -0.9f,  0.9f, 0.5f, 1.0f }, {  0.9f,  0.9f, 0.5f, 1.0f } },
+			{ { -0.5f, -0.5f, 0.5f, 1.0f }, { -0.5f,  0.1f, 0.5f, 1.0f }, {  0.1f, -0.5f, 0.5f, 1.0f } },
+			{ {  0.5f,  0.5f, 0.5f, 1.0f }, {  0.5f, -0.1f, 0.5f, 1.0f }, { -0.1f,  0.5f, 0.5f, 1.0f } },
+		};
+
+		glGenBuffers(1, &corner_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, corner_buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+		glGenVertexArrays(1, &patch_vao);
+		glBindVertexArray(patch_vao);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(1);
+
+		glGenVertexArrays(1, &fallback_vao);
+		glBindVertexArray(fallback_vao);
+		for (GLuint corner = 0; corner < 3; corner++)
+		{
+			glVertexAttribPointer(1 + corner, 4, GL_FLOAT, GL_FALSE, sizeof(corners[0]), (void *)(corner * sizeof(corners[0][0])));
+			glVertexAttribDivisor(1 + corner, 1);
+			glEnableVertexAttribArray(1 + corner);
+		}
+		glGenBuffers(2, pattern_buffers);
+		glBindBuffer(GL_ARRAY_BUFFER, pattern_buffers[0]);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pattern_buffers[1]);
+		uploaded_pattern = NULL;
+
+		check_against_gpu();
+		check_evaluation();
+
+		glPatchParameteri(GL_PATCH_VERTICES, 3);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	}
+
+	virtual void render(double currentTime)
+	{
+		static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
+		glClearBufferfv(GL_COLOR, 0, green);
+
+		// Sweep the level up and down so the fractional modes show their sliding points
+		float level = 1.0f + 15.0f * (0.5f - 0.5f * cosf((float)currentTime * 0.5f));
+		int half_width = info.windowWidth / 2;
+
+		// Left: the GPU's primitive generator
+		glViewport(0, 0, half_width, info.windowHeight);
+		glUseProgram(rendering_programs[spacing]);
+		glUniform1f(level_locations[spacing], level);
+		glBindVertexArray(patch_vao);
+		glDrawArrays(GL_PATCHES, 0, PATCH_COUNT * 3);
+
+		// Right: the cached CPU pattern, one instance per patch
+		const TessLevels levels = { { level, level }, { level, level, level, level } };
+		const TessPattern& pattern = pattern_cache.Get(TessDomain::Triangles, (TessSpacing)spacing, true, levels);
+		glViewport(half_width, 0, info.windowWidth - half_width, info.windowHeight);
+		glUseProgram(fallback_program);
+		glBindVertexArray(fallback_vao);
+		upload_pattern(pattern);
+		glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)pattern.indices.size(), GL_UNSIGNED_INT, NULL, PATCH_COUNT);
+
+		glViewport(0, 0, info.windowWidth, info.windowHeight);
+	}
+
+	virtual void onKey(int key, int action)
+	{
+		if (action == GLFW_PRESS && key == 'S')
+		{
+			spacing = (spacing + 1) % 3;
+		}
+	}
+
+	virtual void shutdown()
+	{
+		printf("pattern cache: %zu patterns, %llu hits, %llu misses\n", pattern_cache.Size(),
+			   (unsigned long long)pattern_cache.hits, (unsigned long long)pattern_cache.misses);
+
+		glDeleteBuffers(2, pattern_buffers);
+		glDeleteBuffers(1, &corner_buffer);
+		glDeleteVertexArrays(1, &fallback_vao);
+		glDeleteVertexArrays(1, &patch_vao);
+		glDeleteProgram(fallback_program);
+		for (int i = 0; i < 3; i++)
+		{
+			glDeleteProgram(rendering_programs[i]);
+		}
+
+		// DECLARE_MAIN always returns 0, so a failed check has to end the process itself
+		if (conformance_failures > 0)
+		{
+			fprintf(stderr, "%d level sets disagreed with the GPU\n", conformance_failures);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+private:
+
+	static std::string tes_layout(const char * domain, int spacing)
+	{
+		static const char * spacings[] = { "equal_spacing", "fractional_even_spacing", "fractional_odd_spacing" };
+		return std::string("#version 450 core\n\nlayout (") + domain + ", " + spacings[spacing] + ", cw) in;\n\n";
+	}
+
+	// tcs and tes may be NULL. Varyings, if given, are captured before linking
+	static GLuint link_program(const char * vs_source, const char * tcs_source, const char * tes_source,
+							   const char * fs_source, const char * varying = NULL)
+	{
+		GLuint program = glCreateProgram();
+		const GLenum types[] = { GL_VERTEX_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER, GL_FRAGMENT_SHADER };
+		const char * sources[] = { vs_source, tcs_source, tes_source, fs_source };
+		for (int i = 0; i < 4; i++)
+		{
+			if (sources[i] == NULL)
+			{
+				continue;
+			}
+			GLuint shader = glCreateShader(types[i]);
+			glShaderSource(shader, 1, &sources[i], NULL);
+			glCompileShader(shader);
+			glAttachShader(program, shader);
+			glDeleteShader(shader);
+		}
+		if (varying != NULL)
+		{
+			glTransformFeedbackVaryings(program, 1, &varying, GL_INTERLEAVED_ATTRIBS);
+		}
+		glLinkProgram(program);
+
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked)
+		{
+			char log[1024];
+			glGetProgramInfoLog(program, sizeof(log), NULL, log);
+			fprintf(stderr, "link failed: %s\n", log);
+		}
+		return program;
+	}
+
+	void upload_pattern(const TessPattern& pattern)
+	{
+		if (&pattern == uploaded_pattern && pattern_cache.Generation() == uploaded_generation)
+		{
+			return;
+		}
+
+		// The pattern keeps u, v and w apart for the SIMD path, the vertex shader wants them together
+		std::vector<GLfloat> coords(pattern.vertexCount * 3);
+		for (uint32_t i = 0; i < pattern.vertexCount; i++)
+		{
+			coords[i * 3 + 0] = pattern.u[i];
+			coords[i * 3 + 1] = pattern.v[i];
+			coords[i * 3 + 2] = pattern.w[i];
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, pattern_buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, coords.size() * sizeof(GLfloat), coords.data(), GL_DYNAMIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, pattern.indices.size() * sizeof(uint32_t), pattern.indices.data(), GL_DYNAMIC_DRAW);
+		uploaded_pattern = &pattern;
+		uploaded_generation = pattern_cache.Generation();
+	}
+
+	// Runs one patch through the GPU and the CPU tessellator, returns true if they agree
+	bool compare_patch(GLuint program, TessDomain domain, TessSpacing spacing, const TessLevels& levels,
+					   GLuint capture_buffer, GLuint query)
+	{
+		glUseProgram(program);
+		glUniform2fv(glGetUniformLocation(program, "inner"), 1, levels.inner);
+		glUniform4fv(glGetUniformLocation(program, "outer"), 1, levels.outer);
+
+		bool lines = domain == TessDomain::Isolines;
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
+		glBeginTransformFeedback(lines ? GL_LINES : GL_TRIANGLES);
+		glDrawArrays(GL_PATCHES, 0, 1);
+		glEndTransformFeedback();
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+
+		GLuint gpu_primitives = 0;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT, &gpu_primitives);
+		int per_primitive = lines ? 2 : 3;
+		std::vector<GLfloat> gpu(gpu_primitives * per_primitive * 3);
+		glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, gpu.size() * sizeof(GLfloat), gpu.data());
+
+		TessPattern pattern;
+		Tessellator::Generate(domain, spacing, true, levels, pattern);
+		if (pattern.PrimitiveCount() != gpu_primitives)
+		{
+			return false;
+		}
+
+		// GPU positions are fixed point, so vertices match within a tolerance rather than exactly
+		struct Coord { float u, v, w; };
+		const float tolerance = 3e-4f;
+		std::vector<Coord> cpu(pattern.vertexCount);
+		for (uint32_t i = 0; i < pattern.vertexCount; i++)
+		{
+			cpu[i] = { pattern.u[i], pattern.v[i], domain == TessDomain::Triangles ? pattern.w[i] : 0.0f };
+		}
+		std::sort(cpu.begin(), cpu.end(), [](const Coord& a, const Coord& b) { return a.u < b.u; });
+		std::vector<bool> used(cpu.size(), false);
+		for (size_t i = 0; i < gpu.size(); i += 3)
+		{
+			auto first = std::lower_bound(cpu.begin(), cpu.end(), gpu[i] - tolerance,
+										  [](const Coord& c, float u) { return c.u < u; });
+			bool found = false;
+			for (auto c = first; c != cpu.end() && c->u <= gpu[i] + tolerance; ++c)
+			{
+				if (fabsf(c->v - gpu[i + 1]) <= tolerance && fabsf(c->w - gpu[i + 2]) <= tolerance)
+				{
+					used[c - cpu.begin()] = true;
+					found = true;
+				}
+			}
+			if (!found)
+			{
+				return false;
+			}
+		}
+		if (std::find(used.begin(), used.end(), false) != used.end())
+		{
+			return false;
+		}
+
+		// Same coverage and the same winding: the signed areas in (u, v) add up to the same total.
+		// Single triangles are not compared, since slivers can flip between float and fixed point
+		if (!lines)
+		{
+			auto signed_area = [](const float * a, const float * b, const float * c) {
+				return 0.5 * ((b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]));
+			};
+			double gpu_area = 0.0;
+			double cpu_area = 0.0;
+			for (size_t i = 0; i < gpu.size(); i += 9)
+			{
+				gpu_area += signed_area(&gpu[i], &gpu[i + 3], &gpu[i + 6]);
+			}
+			for (size_t i = 0; i < pattern.indices.size(); i += 3)
+			{
+				const uint32_t * t = &pattern.indices[i];
+				float a[2] = { pattern.u[t[0]], pattern.v[t[0]] };
+				float b[2] = { pattern.u[t[1]], pattern.v[t[1]] };
+				float c[2] = { pattern.u[t[2]], pattern.v[t[2]] };
+				cpu_area += signed_area(a, b, c);
+			}
+			if (fabs(gpu_area - cpu_area) > tolerance)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void check_against_gpu()
+	{
+		static const char * vertex_shader_source[] =
+		{
+			"#version 450 core                                                                 \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    gl_Position = vec4(0.0);                                                      \n"
+			"}                                                                                 \n"
+		};
+
+		static const char * tesselation_control_shader_source[] =
+		{
+			"#version 450 core                                                                 \n"
+			"                                                                                  \n"
+			"layout (vertices = 1) out;                                                        \n"
+			"                                                                                  \n"
+			"uniform vec2 inner;                                                               \n"
+			"uniform vec4 outer;                                                               \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    gl_TessLevelInner[0] = inner.x;                                               \n"
+			"    gl_TessLevelInner[1] = inner.y;                                               \n"
+			"    gl_TessLevelOuter[0] = outer.x;                                               \n"
+			"    gl_TessLevelOuter[1] = outer.y;                                               \n"
+			"    gl_TessLevelOuter[2] = outer.z;                                               \n"
+			"    gl_TessLevelOuter[3] = outer.w;                                               \n"
+			"    gl_out[gl_InvocationID].gl_Position = vec4(0.0);                              \n"
+			"}                                                                                 \n"
+		};
+
+		// Follows one of the layout lines
+		static const char * tesselation_evaluation_shader_body[] =
+		{
+			"out vec3 tess_coord;                                                              \n"
+			"                                                                                  \n"
+			"void main(void)                                                                   \n"
+			"{                                                                                 \n"
+			"    tess_coord = gl_TessCoord;                                                    \n"
+			"    gl_Position = vec4(0.0);                                                      \n"
+			"}                                                                                 \n"
+		};
+
+		// Including patches that round up, the 1 + epsilon inner rule and a discarded patch
+		static const TessLevels level_sets[] =
+		{
+			{ { 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+			{ { 1.0f, 1.0f }, { 2.0f, 3.0f, 4.0f, 5.0f } },
+			{ { 2.5f, 3.7f }, { 1.0f, 4.2f, 7.9f, 2.0f } },
+			{ { 4.0f, 4.0f }, { 4.0f, 4.0f, 4.0f, 4.0f } },
+			{ { 7.3f, 2.0f }, { 5.5f, 3.3f, 9.1f, 12.7f } },
+			{ { 16.0f, 9.0f }, { 16.0f, 33.3f, 1.5f, 64.0f } },
+			{ { 64.0f, 64.0f }, { 64.0f, 64.0f, 64.0f, 64.0f } },
+			{ { 0.5f, 5.0f }, { 3.0f, 0.0f, 3.0f, 3.0f } },
+		};
+		static const char * domains[] = { "triangles", "quads", "isolines" };
+		static const char * spacings[] = { "equal", "fractional even", "fractional odd" };
+		const int set_count = sizeof(level_sets) / sizeof(level_sets[0]);
+
+		GLuint vao, capture_buffer, query;
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glGenBuffers(1, &capture_buffer);
+		glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, capture_buffer);
+		glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, CAPTURE_BYTES, NULL, GL_STATIC_READ);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, capture_buffer);
+		glGenQueries(1, &query);
+		glEnable(GL_RASTERIZER_DISCARD);
+		glPatchParameteri(GL_PATCH_VERTICES, 1);
+
+		for (int domain = 0; domain < 3; domain++)
+		{
+			for (int spacing = 0; spacing < 3; spacing++)
+			{
+				std::string tes = tes_layout(domains[domain], spacing) + tesselation_evaluation_shader_body[0];
+				GLuint program = link_program(vertex_shader_source[0], tesselation_control_shader_source[0],
+											  tes.c_str(), NULL, "tess_coord");
+				int matches = 0;
+				for (int set = 0; set < set_count; set++)
+				{
+					matches += compare_patch(program, (TessDomain)domain, (TessSpacing)spacing, level_sets[set],
+											 capture_buffer, query);
+				}
+				printf("%-9s %-15s %d/%d level sets match the GPU\n", domains[domain], spacings[spacing], matches, set_count);
+				conformance_failures += set_count - matches;
+				glDeleteProgram(program);
+			}
+		}
+
+		glDisable(GL_RASTERIZER_DISCARD);
+		glDeleteQueries(1, &query);
+		glDeleteBuffers(1, &capture_buffer);
+		glDeleteVertexArrays(1, &vao);
+	}
+
+	void check_evaluation()
+	{
+		static const float corners[4][4] =
+		{
+			{ -1.0f, -1.0f, 0.0f, 1.0f }, { 1.0f, -1.0f, 0.5f, 1.0f }, { 1.0f, 1.0f, 0.25f, 1.0f }, { -1.0f, 1.0f, 1.0f, 1.0f }
+		};
+		const TessLevels levels = { { 64.0f, 64.0f }, { 64.0f, 64.0f, 64.0f, 64.0f } };
+		const int repeats = 2000;
+
+		for (int domain = 0; domain < 2; domain++)
+		{
+			const TessPattern& pattern = pattern_cache.Get((TessDomain)domain, TessSpacing::FractionalOdd, true, levels);
+			std::vector<float> simd(pattern.vertexCount * 4), scalar(pattern.vertexCount * 4);
+
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < repeats; i++)
+			{
+				tessEvaluate(pattern, corners, (float (*)[4])simd.data());
+			}
+			auto middle = std::chrono::steady_clock::now();
+			for (int i = 0; i < repeats; i++)
+			{
+				tessEvaluateScalar(pattern, corners, (float (*)[4])scalar.data());
+			}
+			auto end = std::chrono::steady_clock::now();
+
+			float error = 0.0f;
+			for (size_t i = 0; i < simd.size(); i++)
+			{
+				error = std::max(error, fabsf(simd[i] - scalar[i]));
+			}
+			double simd_ms = std::chrono::duration<double, std::milli>(middle - start).count();
+			double scalar_ms = std::chrono::duration<double, std::milli>(end - middle).count();
+			printf("%-9s evaluation of %u vertices: simd %.3f us, scalar %.3f us, max difference %g\n",
+				   domain == 0 ? "triangles" : "quads", pattern.vertexCount,
+				   simd_ms * 1000.0 / repeats, scalar_ms * 1000.0 / repeats, error);
+		}
+	}
+
+	GLuint          rendering_programs[3];
+	GLint           level_locations[3];
+	GLuint          fallback_program;
+	GLuint          corner_buffer;
+	GLuint          pattern_buffers[2];
+	GLuint          patch_vao;
+	GLuint          fallback_vao;
+
+	TessPatternCache    pattern_cache;
+	const TessPattern * uploaded_pattern;
+	uint64_t            uploaded_generation = 0;
+	int                 conformance_failures = 0; // Level sets that disagreed with the GPU
+	int                 spacing = 2;
+};
+
+// Declare entry point
+DECLARE_MAIN(TesselationReference)
@@ -1,4 +1,5 @@
 #include "../../include/sb7.h"
+#include "sb7headless.h"
 
 GLuint compile_shaders(void)
 {
@@ -0,0 +1,336 @@
+/**
+	Headless runner for sb7::application programs.
+
+	Define SB7_HEADLESS and link against libEGL to swap a program's window for an offscreen
+	framebuffer on an EGL context with no window system, e.g. Mesa llvmpipe on a CI machine.
+	render(currentTime) is then driven from a synthetic clock as fast as the context allows,
+	which makes frame cost measurable and frame output comparable between runs.
+	Without SB7_HEADLESS this header changes nothing.
+
+	Command line options:
+		--frames N      number of frames to render (default 300)
+		--fps F         rate of the synthetic clock, currentTime = frame / F (default 60)
+		--size WxH      framebuffer size (default: the size init() asks for)
+		--checksum      print an FNV-1a hash of every frame's pixels
+		--dump PREFIX   write every frame to PREFIX00000.ppm, PREFIX00001.ppm, ...
+		--capture FILE  write every frame as FILE00000.png (or .qoi, .ppm), or one FILE.y4m stream
+		--drop-late     let --capture skip frames the encoder has no room for instead of waiting
+		--trace FILE    write the profiler's Chrome trace of the run to FILE
+		--summary       print the profiler's p50/p95/p99 of every scope at the end
+
+	Frames are read back through ../Common/FrameCapture.h, so checksums and captures cost the
+	render loop a pixel pack copy on the GPU instead of a pipeline drain. The encoder thread
+	still needs a core of its own: sharing one with rendering, it slows every frame down and
+	without --drop-late the render loop waits for it. --checksum always reads every frame.
+
+	Programs that bind framebuffer 0 to get back to the window draw to nothing here.
+**/
+#ifndef __SB7HEADLESS_H__
+#define __SB7HEADLESS_H__
+
+#include "sb7profile.h"
+
+#ifdef SB7_HEADLESS
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#define FRAME_CAPTURE_IMPLEMENTATION
+#include "../Common/FrameCapture.h"
+
+namespace sb7
+{
+
+struct headless_options
+{
+	int frames = 300;
+	double fps = 60.0;
+	int width = 0; // 0 keeps the size from init()
+	int height = 0;
+	bool checksum = false;
+	std::string capture_path; // Empty for no capture
+	bool drop_late = false;
+	const char* trace_path = nullptr;
+	bool summary = false;
+};
+
+template <class App>
+class headless : public App
+{
+public:
+	headless_options options;
+
+	void parse(int argc, const char ** argv)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			bool has_value = i + 1 < argc;
+			if (!strcmp(argv[i], "--frames") && has_value)
+				options.frames = atoi(argv[++i]);
+			else if (!strcmp(argv[i], "--fps") && has_value)
+				options.fps = atof(argv[++i]);
+			else if (!strcmp(argv[i], "--size") && has_value)
+				sscanf(argv[++i], "%dx%d", &options.width, &options.height);
+			else if (!strcmp(argv[i], "--checksum"))
+				options.checksum = true;
+			else if (!strcmp(argv[i], "--dump") && has_value)
+				options.capture_path = std::string(argv[++i]) + ".ppm";
+			else if (!strcmp(argv[i], "--capture") && has_value)
+				options.capture_path = argv[++i];
+			else if (!strcmp(argv[i], "--drop-late"))
+				options.drop_late = true;
+			else if (!strcmp(argv[i], "--trace") && has_value)
+				options.trace_path = argv[++i];
+			else if (!strcmp(argv[i], "--summary"))
+				options.summary = true;
+			else
+				fprintf(stderr, "sb7headless: ignoring option %s\n", argv[i]);
+		}
+	}
+
+	virtual void run(sb7::application* the_app)
+	{
+		// init() and friends may be private in the program, so call them through the base class
+		the_app->init();
+		if (options.width > 0 && options.height > 0)
+		{
+			this->info.windowWidth = options.width;
+			this->info.windowHeight = options.height;
+		}
+
+		if (!create_context())
+		{
+			return;
+		}
+		gl3wInit();
+		create_framebuffer();
+
+		fprintf(stderr, "sb7headless: %s on %s, %dx%d\n", this->info.title,
+				(const char *)glGetString(GL_RENDERER), this->info.windowWidth, this->info.windowHeight);
+
+		the_app->startup();
+
+		// The encoder thread hashes frames in order, before writing them
+		FrameCapture capture;
+		unsigned long long sequence_hash = fnv_offset;
+		if (options.checksum)
+		{
+			capture.OnFrame = [&](const CapturedFrame& frame)
+			{
+				unsigned long long hash = fnv1a(fnv_offset, frame.pixels, (size_t)frame.width * frame.height * 4);
+				sequence_hash = fnv1a(sequence_hash, (const unsigned char *)&hash, sizeof(hash));
+				printf("frame %d checksum %016llx\n", frame.index, hash);
+			};
+		}
+		// A checksum of a frame that was never read back would be meaningless
+		capture.DropWhenBehind = options.drop_late && !options.checksum;
+		bool capturing = (options.checksum || !options.capture_path.empty())
+			&& capture.Start(options.capture_path.empty() ? nullptr : options.capture_path.c_str(),
+							 this->info.windowWidth, this->info.windowHeight, options.fps);
+		double total_ms = 0.0, min_ms = 1e30, max_ms = 0.0;
+
+		for (int frame = 0; frame < options.frames; frame++)
+		{
+			auto start = std::chrono::steady_clock::now();
+
+			Profiler::BeginFrame();
+			{
+				PROFILE("render");
+				the_app->render(frame / options.fps);
+			}
+			if (capturing)
+			{
+				PROFILE("capture");
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+				capture.Capture();
+				glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+			}
+			Profiler::EndFrame();
+			glFinish(); // Count the GPU's share of the frame too
+
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			total_ms += ms;
+			min_ms = ms < min_ms ? ms : min_ms;
+			max_ms = ms > max_ms ? ms : max_ms;
+		}
+		capture.Finish();
+
+		if (options.frames > 0)
+		{
+			printf("%d frames, %.3f ms/frame (min %.3f, max %.3f), %.1f frames/s\n", options.frames,
+				   total_ms / options.frames, min_ms, max_ms, 1000.0 * options.frames / total_ms);
+		}
+		if (options.checksum)
+		{
+			printf("sequence checksum %016llx\n", sequence_hash);
+		}
+		if (capture.Stalls() > 0)
+		{
+			fprintf(stderr, "sb7headless: capture stalled %llu times waiting for readback or encoding\n",
+					(unsigned long long)capture.Stalls());
+		}
+		if (capture.Dropped() > 0)
+		{
+			fprintf(stderr, "sb7headless: capture dropped %llu of %d frames the encoder had no room for\n",
+					(unsigned long long)capture.Dropped(), options.frames);
+		}
+		if (options.summary)
+		{
+			Profiler::PrintSummary();
+		}
+		if (options.trace_path && !Profiler::WriteChromeTrace(options.trace_path))
+		{
+			fprintf(stderr, "sb7headless: cannot write %s\n", options.trace_path);
+		}
+
+		the_app->shutdown();
+		Profiler::Shutdown();
+		destroy_framebuffer();
+		destroy_context();
+	}
+
+private:
+	static const unsigned long long fnv_offset = 14695981039346656037ULL;
+
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+	EGLSurface surface = EGL_NO_SURFACE;
+	GLuint fbo = 0;
+	GLuint color_buffer = 0;
+	GLuint depth_buffer = 0;
+
+	static unsigned long long fnv1a(unsigned long long hash, const unsigned char* data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ data[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	bool create_context()
+	{
+		// Prefer Mesa's surfaceless platform, which needs no display server at all
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display)
+			display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+		{
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+			if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+			{
+				fprintf(stderr, "sb7headless: no EGL display\n");
+				return false;
+			}
+		}
+		eglBindAPI(EGL_OPENGL_API);
+
+		static const EGLint config_attribs[] =
+		{
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE
+		};
+		EGLConfig config = 0;
+		EGLint num_configs = 0;
+		eglChooseConfig(display, config_attribs, &config, 1, &num_configs);
+
+		const EGLint context_attribs[] =
+		{
+			EGL_CONTEXT_MAJOR_VERSION, this->info.majorVersion,
+			EGL_CONTEXT_MINOR_VERSION, this->info.minorVersion,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_CONTEXT_OPENGL_DEBUG, this->info.flags.debug ? EGL_TRUE : EGL_FALSE,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, num_configs ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attribs);
+		if (context == EGL_NO_CONTEXT)
+		{
+			fprintf(stderr, "sb7headless: cannot create a GL %d.%d core context\n",
+					this->info.majorVersion, this->info.minorVersion);
+			return false;
+		}
+
+		// Rendering goes to our framebuffer, so a surface is only needed where surfaceless contexts are not supported
+		if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) && num_configs)
+		{
+			static const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+			eglMakeCurrent(display, surface, surface, context);
+		}
+		if (eglGetCurrentContext() != context)
+		{
+			fprintf(stderr, "sb7headless: cannot make the context current\n");
+			return false;
+		}
+		return true;
+	}
+
+	void destroy_context()
+	{
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (surface != EGL_NO_SURFACE)
+			eglDestroySurface(display, surface);
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+	}
+
+	// Stands in for the window's default framebuffer for the whole run
+	void create_framebuffer()
+	{
+		const int width = this->info.windowWidth;
+		const int height = this->info.windowHeight;
+		const int samples = this->info.samples;
+
+		glGenRenderbuffers(1, &color_buffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+
+		glGenRenderbuffers(1, &depth_buffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+		glViewport(0, 0, width, height);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			fprintf(stderr, "sb7headless: offscreen framebuffer is incomplete\n");
+		if (samples > 0 && (options.checksum || !options.capture_path.empty()))
+			fprintf(stderr, "sb7headless: cannot read back a multisampled framebuffer, disable samples\n");
+	}
+
+	void destroy_framebuffer()
+	{
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(1, &color_buffer);
+		glDeleteRenderbuffers(1, &depth_buffer);
+	}
+};
+
+}
+
+// Every program ends with DECLARE_MAIN, so redirecting it is all a program needs
+#undef DECLARE_MAIN
+#define DECLARE_MAIN(a)                             \
+int main(int argc, const char ** argv)              \
+{                                                   \
+	sb7::headless<a> *app = new sb7::headless<a>;   \
+	app->parse(argc, argv);                         \
+	app->run(app);                                  \
+	delete app;                                     \
+	return 0;                                       \
+}
+
+#endif /* SB7_HEADLESS */
+
+#endif /* __SB7HEADLESS_H__ */
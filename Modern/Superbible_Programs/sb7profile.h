@@ -0,0 +1,15 @@
+/**
+	Frame profiler for the sb7 programs, see ../Common/Profiler.h.
+
+	Each program is a single source file, so the implementation is compiled right here.
+	The headless runner marks frames and times render() on its own; in a window, open a
+	PROFILE_FRAME() at the top of render() to get the same, and add PROFILE("name") scopes
+	around the passes worth measuring.
+**/
+#ifndef __SB7PROFILE_H__
+#define __SB7PROFILE_H__
+
+#define PROFILER_IMPLEMENTATION
+#include "../Common/Profiler.h"
+
+#endif /* __SB7PROFILE_H__ */
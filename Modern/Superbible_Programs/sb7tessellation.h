@@ -0,0 +1,253 @@
+/**
+	GLSL shared by the tessellation samples, as string literals that go between the lines of a
+	shader source so every sample compiles the same code.
+
+	SB7_ADAPTIVE_LEVELS declares viewport_size and pixels_per_edge, and functions that pick an
+	edge's tessellation level from its length on screen and test a patch against the frustum.
+	sb7::tess_points expands patches into points with a compute shader that uses them.
+**/
+#ifndef __SB7TESSELLATION_H__
+#define __SB7TESSELLATION_H__
+
+#define SB7_ADAPTIVE_LEVELS \
+	"uniform vec2 viewport_size = vec2(800.0, 600.0);    // Framebuffer size in pixels                              \n" \
+	"uniform float pixels_per_edge = 16.0;               // Target on-screen length of a tessellated edge           \n" \
+	"                                                                                                               \n" \
+	"// Projects a clip-space position to pixels                                                                    \n" \
+	"vec2 to_screen(vec4 position)                                                                                  \n" \
+	"{                                                                                                              \n" \
+	"    return position.xy / max(position.w, 0.0001) * 0.5 * viewport_size;                                        \n" \
+	"}                                                                                                              \n" \
+	"                                                                                                               \n" \
+	"// Depends only on the edge's end points, so patches sharing an edge agree on its level                        \n" \
+	"float edge_level(vec4 a, vec4 b)                                                                               \n" \
+	"{                                                                                                              \n" \
+	"    return clamp(distance(to_screen(a), to_screen(b)) / pixels_per_edge, 1.0, 64.0);                           \n" \
+	"}                                                                                                              \n" \
+	"                                                                                                               \n" \
+	"// True when all three corners are outside the same clip plane                                                 \n" \
+	"bool outside_frustum(vec4 a, vec4 b, vec4 c)                                                                   \n" \
+	"{                                                                                                              \n" \
+	"    vec3 w = vec3(a.w, b.w, c.w);                                                                              \n" \
+	"    return all(lessThan(vec3(a.x, b.x, c.x), -w)) || all(greaterThan(vec3(a.x, b.x, c.x), w)) ||               \n" \
+	"           all(lessThan(vec3(a.y, b.y, c.y), -w)) || all(greaterThan(vec3(a.y, b.y, c.y), w)) ||               \n" \
+	"           all(lessThan(vec3(a.z, b.z, c.z), -w)) || all(greaterThan(vec3(a.z, b.z, c.z), w));                 \n" \
+	"}                                                                                                              \n" \
+	"                                                                                                               \n"
+
+namespace sb7
+{
+
+// Draws the distinct vertices of tessellated triangle patches as points, with no tessellation
+// or geometry stage. A compute shader writes every patch's points into a buffer and counts them
+// into an indirect draw command, with the levels SB7_ADAPTIVE_LEVELS picks, or fixed_level
+// everywhere when adaptive is false. Set those uniforms on compute_program with glProgramUniform
+class tess_points
+{
+public:
+	// Distinct vertices of a triangle patch with every level at 64
+	static const int MAX_POINTS_PER_PATCH = 3169;
+
+	GLuint compute_program;
+	GLuint point_program;
+	GLuint buffers[3]; // Patch corners, points, draw command
+	int patch_count;
+
+	// Three xyzw corners a patch in corners. fragment_shader_source colours the points
+	void create(const GLfloat * corners, int patch_count, const char * const * fragment_shader_source)
+	{
+			static const char * compute_shader_source[] =
+			{
+				"#version 450 core                                                                                              \n"
+				"                                                                                                               \n"
+				"layout (local_size_x = 64) in;                                                                                 \n"
+				"                                                                                                               \n"
+				"layout (std430, binding = 0) readonly buffer Patches                                                           \n"
+				"{                                                                                                              \n"
+				"    vec4 patch_corners[];                           // Three per patch                                         \n"
+				"};                                                                                                             \n"
+				"                                                                                                               \n"
+				"layout (std430, binding = 1) writeonly buffer Points                                                           \n"
+				"{                                                                                                              \n"
+				"    vec4 points[];                                                                                             \n"
+				"};                                                                                                             \n"
+				"                                                                                                               \n"
+				"layout (std430, binding = 2) buffer Command          // Arguments of glDrawArraysIndirect                      \n"
+				"{                                                                                                              \n"
+				"    uint count;                                                                                                \n"
+				"    uint instance_count;                                                                                       \n"
+				"    uint first;                                                                                                \n"
+				"    uint base_instance;                                                                                        \n"
+				"} command;                                                                                                     \n"
+				"                                                                                                               \n"
+				"uniform bool adaptive = true;                       // false uses fixed_level everywhere                       \n"
+				"uniform float fixed_level = 5.0;                    // Level for every edge when not adaptive                  \n"
+				"                                                                                                               \n"
+				"shared uint first_point;                                                                                       \n"
+				"                                                                                                               \n"
+				SB7_ADAPTIVE_LEVELS
+				"// Segments of an edge under equal_spacing                                                                     \n"
+				"int segments(float level)                                                                                      \n"
+				"{                                                                                                              \n"
+				"    return int(ceil(clamp(level, 1.0, 64.0)));                                                                 \n"
+				"}                                                                                                              \n"
+				"                                                                                                               \n"
+				"// The k-th distinct vertex of the triangle domain. Corners run w, u, v; side s goes from corner s             \n"
+				"// to corner s + 1 with side_segments[s] segments, then come the inner rings, then the centre                  \n"
+				"vec3 tess_coord(int k, int side_segments[3], int inner)                                                        \n"
+				"{                                                                                                              \n"
+				"    const vec3 corners[3] = vec3[](vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0));             \n"
+				"                                                                                                               \n"
+				"    for (int s = 0; s < 3; s++)                                                                                \n"
+				"    {                                                                                                          \n"
+				"        if (k < side_segments[s])                                                                              \n"
+				"        {                                                                                                      \n"
+				"            return mix(corners[s], corners[(s + 1) % 3], float(k) / float(side_segments[s]));                  \n"
+				"        }                                                                                                      \n"
+				"        k -= side_segments[s];                                                                                 \n"
+				"    }                                                                                                          \n"
+				"                                                                                                               \n"
+				"    // Ring r sits at 2/3 of the r-th inner point towards the centre, with inner - 2r segments a side          \n"
+				"    for (int r = 1; inner - 2 * r > 0; r++)                                                                    \n"
+				"    {                                                                                                          \n"
+				"        int m = inner - 2 * r;                                                                                 \n"
+				"        if (k < 3 * m)                                                                                         \n"
+				"        {                                                                                                      \n"
+				"            float a = 2.0 * float(r) / (3.0 * float(inner));                                                   \n"
+				"            vec3 ring[3] = vec3[](vec3(a, a, 1.0 - 2.0 * a), vec3(1.0 - 2.0 * a, a, a), vec3(a, 1.0 - 2.0 * a, a));\n"
+				"            int s = k / m;                                                                                     \n"
+				"            return mix(ring[s], ring[(s + 1) % 3], float(k % m) / float(m));                                   \n"
+				"        }                                                                                                      \n"
+				"        k -= 3 * m;                                                                                            \n"
+				"    }                                                                                                          \n"
+				"    return vec3(1.0 / 3.0);                                                                                    \n"
+				"}                                                                                                              \n"
+				"                                                                                                               \n"
+				"void main(void)                                                                                                \n"
+				"{                                                                                                              \n"
+				"    uint patch_index = gl_WorkGroupID.x;                                                                       \n"
+				"    vec4 p0 = patch_corners[patch_index * 3 + 0];                                                              \n"
+				"    vec4 p1 = patch_corners[patch_index * 3 + 1];                                                              \n"
+				"    vec4 p2 = patch_corners[patch_index * 3 + 2];                                                              \n"
+				"                                                                                                               \n"
+				"    // The same levels the tessellation control shader picks                                                   \n"
+				"    vec4 levels = vec4(fixed_level);                                                                           \n"
+				"    if (adaptive)                                                                                              \n"
+				"    {                                                                                                          \n"
+				"        if (outside_frustum(p0, p1, p2))                                                                       \n"
+				"        {                                                                                                      \n"
+				"            return;                                                                                            \n"
+				"        }                                                                                                      \n"
+				"        levels.x = edge_level(p1, p2);                                                                         \n"
+				"        levels.y = edge_level(p2, p0);                                                                         \n"
+				"        levels.z = edge_level(p0, p1);                                                                         \n"
+				"        levels.w = max(levels.x, max(levels.y, levels.z));                                                     \n"
+				"    }                                                                                                          \n"
+				"                                                                                                               \n"
+				"    // Outer levels 0, 1, 2 belong to the edges u = 0, v = 0, w = 0, which are sides 2, 0, 1                   \n"
+				"    int side_segments[3] = int[](segments(levels.y), segments(levels.z), segments(levels.x));                  \n"
+				"    int inner = segments(levels.w);                                                                            \n"
+				"    bool single = inner == 1 && side_segments[0] == 1 && side_segments[1] == 1 && side_segments[2] == 1;       \n"
+				"    if (inner == 1 && !single)                                                                                 \n"
+				"    {                                                                                                          \n"
+				"        inner = 2; // An inner level of 1 is treated as 1 + epsilon                                            \n"
+				"    }                                                                                                          \n"
+				"                                                                                                               \n"
+				"    int rings = single ? 0 : (inner - 1) / 2;                                                                  \n"
+				"    int total = side_segments[0] + side_segments[1] + side_segments[2] + 3 * (rings * inner - rings * (rings + 1));\n"
+				"    if (!single && inner % 2 == 0)                                                                             \n"
+				"    {                                                                                                          \n"
+				"        total += 1; // Even levels end in the centre point                                                     \n"
+				"    }                                                                                                          \n"
+				"                                                                                                               \n"
+				"    if (gl_LocalInvocationIndex == 0)                                                                          \n"
+				"    {                                                                                                          \n"
+				"        first_point = atomicAdd(command.count, uint(total));                                                   \n"
+				"    }                                                                                                          \n"
+				"    barrier();                                                                                                 \n"
+				"                                                                                                               \n"
+				"    for (int k = int(gl_LocalInvocationIndex); k < total; k += int(gl_WorkGroupSize.x))                        \n"
+				"    {                                                                                                          \n"
+				"        vec3 tc = tess_coord(k, side_segments, single ? 1 : inner);                                            \n"
+				"        points[first_point + k] = (tc.x * p0) + (tc.y * p1) + (tc.z * p2);                                     \n"
+				"    }                                                                                                          \n"
+				"}                                                                                                              \n"
+			};
+
+			static const char * point_vertex_shader_source[] =
+			{
+				"#version 450 core                                                                 \n"
+				"                                                                                  \n"
+				"layout (std430, binding = 1) readonly buffer Points                               \n"
+				"{                                                                                 \n"
+				"    vec4 points[];                                                                \n"
+				"};                                                                                \n"
+				"                                                                                  \n"
+				"void main(void)                                                                   \n"
+				"{                                                                                 \n"
+				"    gl_Position = points[gl_VertexID];                                            \n"
+				"}                                                                                 \n"
+			};
+
+		compute_program = glCreateProgram();
+		attach_shader(compute_program, GL_COMPUTE_SHADER, compute_shader_source);
+		glLinkProgram(compute_program);
+
+		point_program = glCreateProgram();
+		attach_shader(point_program, GL_VERTEX_SHADER, point_vertex_shader_source);
+		attach_shader(point_program, GL_FRAGMENT_SHADER, fragment_shader_source);
+		glLinkProgram(point_program);
+
+		this->patch_count = patch_count;
+		glGenBuffers(3, buffers);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)patch_count * 3 * 4 * sizeof(GLfloat), corners, GL_STATIC_DRAW);
+
+		// Room for every patch at the highest level, so the compute shader never runs past the end
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[1]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)patch_count * MAX_POINTS_PER_PATCH * 4 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers[2]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers[2]);
+	}
+
+	// Generates and draws the points of every patch with the vertex array bound now
+	void draw()
+	{
+		// Start from an empty draw: no points, one instance
+		static const GLuint empty_command[] = { 0, 1, 0, 0 };
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[2]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(empty_command), empty_command);
+
+		glUseProgram(compute_program);
+		glDispatchCompute(patch_count, 1, 1);
+
+		// The draw reads the points from the buffer and its count from the command
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+		glUseProgram(point_program);
+		glDrawArraysIndirect(GL_POINTS, NULL);
+	}
+
+	void destroy()
+	{
+		glDeleteBuffers(3, buffers);
+		glDeleteProgram(point_program);
+		glDeleteProgram(compute_program);
+	}
+
+private:
+	static void attach_shader(GLuint program, GLenum type, const char * const * source)
+	{
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, source, NULL);
+		glCompileShader(shader);
+		glAttachShader(program, shader);
+		glDeleteShader(shader);
+	}
+};
+
+}
+
+#endif /* __SB7TESSELLATION_H__ */